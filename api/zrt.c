@@ -19,12 +19,18 @@
  *       can be used for "selective syscallback" - this is allow to intercept particular
  *       syscalls while leaving other syscalls to zerovm care (see zrt_mmap()).
  *
+ * note: zrt is single threaded. its state (channel buffers, positions, break) is not
+ *       guarded and the syscallback is switched off around direct syscalls, so the
+ *       thread syscalls are refused. threaded nexes must not use zrt (use nacl sdk
+ *       libpthread without syscallback, see samples/psort)
+ *
  *  Created on: Feb 18, 2012
  *      Author: d'b
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
@@ -251,6 +257,191 @@ char *itoa(int n, char *s, int b) {
 #define NaCl_invalid() ((int32_t (*)()) \
     (999 * 0x20 + 0x10000))()
 
+/*
+ * BUFFERED CHANNELS
+ * libc reads and writes stdin/stdout/stderr by small blocks and each read or
+ * write of LOADED channel is a trap. zrt keeps a large aligned buffer for
+ * the channel: reads are served from the buffer filled by one trap (readahead),
+ * writes are coalesced and written when the buffer is full, on seek and on
+ * exit. requests not smaller than the buffer bypass it. the buffer is
+ * allocated by the first buffered call, so unused channels cost nothing.
+ * MAPPED channels are not buffered: they are memory already. the program
+ * can take the data in place with zvm_view() and read() the taken part to
+ * move the position: read() to the mapping itself does not copy. reads and
+ * writes of the channel share the buffer: read writes the pending data
+ * first, write and seek drop the read ahead
+ *
+ * note: write errors (e.g. channel limits) are reported by the call which
+ * flushes the buffer, not by the call which put the data to it
+ */
+#ifndef ZRT_BUFFER_SIZE
+#define ZRT_BUFFER_SIZE 0x100000 /* default buffer size. can be set by -D */
+#endif
+#define ZRT_BUFFER_ALIGN 0x10000
+
+struct ChannelBuffer
+{
+  char *data; /* NULL - not allocated yet */
+  char *own; /* buffer allocated by zrt */
+  int32_t size; /* buffer capacity, 0 - the channel is not buffered */
+  int64_t offset; /* channel position of data[0] */
+  int32_t valid; /* read buffer: amount of data */
+  int32_t dirty; /* write buffer: amount of data not written yet */
+};
+
+/* stdin and stdout are buffered by default, user log is not (see zrt_setbuf()) */
+static struct ChannelBuffer buffers[3] = {
+    {NULL, NULL, ZRT_BUFFER_SIZE, 0, 0, 0},
+    {NULL, NULL, ZRT_BUFFER_SIZE, 0, 0, 0},
+    {NULL, NULL, 0, 0, 0, 0}
+};
+
+/*
+ * allocate the buffer of the channel if not yet. return the buffer or
+ * NULL, if there is no memory the channel becomes unbuffered
+ */
+static char *BufferGet(int file)
+{
+  struct ChannelBuffer *b = &buffers[file];
+
+  if(b->data != NULL) return b->data;
+  b->own = b->data = memalign(ZRT_BUFFER_ALIGN, b->size);
+  if(b->data == NULL) b->size = 0;
+  return b->data;
+}
+
+/* write buffered data of the channel. return 0 or negative error */
+static int32_t BufferFlush(int file)
+{
+  struct ChannelBuffer *b = &buffers[file];
+  int32_t done = 0;
+  int32_t retcode = 0;
+
+  while(done < b->dirty)
+  {
+    int32_t n = zvm_pwrite(file, b->data + done, b->dirty - done, b->offset + done);
+    if(n <= 0)
+    {
+      /* the rest is lost, the channel refused it */
+      retcode = n < 0 ? n : -EIO;
+      break;
+    }
+    done += n;
+  }
+
+  b->offset += b->dirty;
+  b->dirty = 0;
+  return retcode;
+}
+
+/* flush all write buffers */
+static void BuffersFlush()
+{
+  int i;
+  for(i = OutputChannel; i <= LogChannel; ++i)
+    if(buffers[i].dirty > 0) BufferFlush(i);
+}
+
+/* read from the channel at the current position through the buffer */
+static int32_t BufferRead(int file, char *buf, int32_t length)
+{
+  struct ChannelBuffer *b = &buffers[file];
+  int64_t pos = pos_ptr[file];
+  int32_t copied = 0;
+  int32_t retcode;
+
+  /* the buffer is shared with writes: they must be in the channel first */
+  if(b->dirty > 0)
+    if((retcode = BufferFlush(file)) != 0) return retcode;
+
+  while(copied < length)
+  {
+    int32_t n;
+
+    /* take buffered data */
+    if(pos >= b->offset && pos < b->offset + b->valid)
+    {
+      n = b->offset + b->valid - pos;
+      if(n > length - copied) n = length - copied;
+      memcpy(buf + copied, b->data + (pos - b->offset), n);
+      copied += n;
+      pos += n;
+      continue;
+    }
+
+    /* large request goes directly to the user buffer */
+    if(length - copied >= b->size)
+    {
+      n = zvm_pread(file, buf + copied, length - copied, pos);
+      if(n < 0 && copied == 0) return n;
+      if(n > 0) copied += n, pos += n;
+      break;
+    }
+
+    /* read ahead whole buffer */
+    b->valid = 0;
+    n = zvm_pread(file, b->data, b->size, pos);
+    if(n < 0 && copied == 0) return n;
+    if(n <= 0) break;
+    b->offset = pos;
+    b->valid = n;
+  }
+
+  pos_ptr[file] = pos;
+  return copied;
+}
+
+/* write to the channel at the current position through the buffer */
+static int32_t BufferWrite(int file, char *buf, int32_t length)
+{
+  struct ChannelBuffer *b = &buffers[file];
+  int64_t pos = pos_ptr[file];
+  int32_t retcode;
+
+  /* read ahead data is overwritten (or made stale) by the write */
+  b->valid = 0;
+
+  /* buffered data must be contiguous */
+  if(b->dirty > 0 && (pos != b->offset + b->dirty || b->dirty + length > b->size))
+    if((retcode = BufferFlush(file)) != 0) return retcode;
+  if(b->dirty == 0) b->offset = pos;
+
+  /* large request goes directly from the user buffer */
+  if(length >= b->size)
+  {
+    retcode = zvm_pwrite(file, buf, length, pos);
+    if(retcode > 0) pos_ptr[file] += retcode;
+    b->offset = pos_ptr[file];
+    return retcode;
+  }
+
+  memcpy(b->data + b->dirty, buf, length);
+  b->dirty += length;
+  pos_ptr[file] += length;
+  return length;
+}
+
+/*
+ * set the buffer of the channel (0..2). NULL "buffer" with non zero "size"
+ * makes zrt allocate the buffer of that size on the first use, zero "size"
+ * disables buffering. pending data is written first. return 0 or -1
+ */
+int zrt_setbuf(int file, char *buffer, int32_t size)
+{
+  if(file < InputChannel || file > LogChannel) return -1;
+  if((buffer != NULL && size == 0) || size < 0) return -1;
+
+  if(buffers[file].dirty > 0) BufferFlush(file);
+  free(buffers[file].own);
+  buffers[file].own = NULL;
+  buffers[file].data = buffer;
+  buffers[file].size = size;
+  buffers[file].offset = pos_ptr[file];
+  buffers[file].valid = 0;
+  buffers[file].dirty = 0;
+  return 0;
+}
+
 /*
  * ZRT IMPLEMENTATION OF NACL SYSCALLS
  * each nacl syscall must be implemented or, at least, mocked. no exclusions!
@@ -363,11 +554,18 @@ int32_t zrt_read(uint32_t *args)
         break;
       }
 
-      memcpy(buf, (void*)setup.channels[file].buffer + pos_ptr[file], length);
+      /* the data taken in place (see zvm_view()) only moves the position */
+      if(buf != (void*)setup.channels[file].buffer + pos_ptr[file])
+        memcpy(buf, (void*)setup.channels[file].buffer + pos_ptr[file], length);
       pos_ptr[file] += length;
       break;
 
     case LOADED:
+      if(buffers[file].size > 0 && BufferGet(file) != NULL)
+      {
+        length = BufferRead(file, buf, length);
+        break;
+      }
       length = zvm_pread(file, buf, length, pos_ptr[file]);
       if(length > 0) pos_ptr[file] += length;
       break;
@@ -424,11 +622,17 @@ int32_t zrt_write(uint32_t *args)
         break;
       }
 
-      memcpy((void*)setup.channels[file].buffer + pos_ptr[file], buf, length);
+      if(buf != (void*)setup.channels[file].buffer + pos_ptr[file])
+        memcpy((void*)setup.channels[file].buffer + pos_ptr[file], buf, length);
       pos_ptr[file] += length;
       break;
 
     case LOADED:
+      if(buffers[file].size > 0 && BufferGet(file) != NULL)
+      {
+        length = BufferWrite(file, buf, length);
+        break;
+      }
       length = zvm_pwrite(file, buf, length, pos_ptr[file]);
       if(length > 0) pos_ptr[file] += length;
       break;
@@ -465,6 +669,10 @@ int32_t zrt_lseek(uint32_t *args)
   /* check if given handle is valid and seekable */
   if(handle < InputChannel || handle > LogChannel) return -EBADF;
 
+  /* SEEK_END must see the buffered data. read ahead is dropped */
+  if(buffers[handle].dirty > 0) BufferFlush(handle);
+  buffers[handle].valid = 0;
+
   switch(whence)
   {
     case SEEK_SET:
@@ -682,7 +890,9 @@ int32_t zrt_getdents(uint32_t *args)
 int32_t zrt_exit(uint32_t *args)
 {
   /* no need to check args for NULL. it is always set by syscall_manager */
-  SHOWID; zvm_exit(args[0]);
+  SHOWID;
+  BuffersFlush(); /* write-behind data must reach the channels */
+  zvm_exit(args[0]);
 
   /* not reached */
   return 0;
@@ -838,10 +1048,10 @@ int32_t zrt_cond_timed_wait_abs(uint32_t *args)
   SHOWID; return 0;
 }
 
-/* mock. should be implemented */
+/* zrt is single threaded (see the note on top). sync stubs are fine without threads */
 int32_t zrt_thread_create(uint32_t *args)
 {
-  SHOWID; return 0;
+  SHOWID; return -ENOSYS; /* Function not implemented */
 }
 
 /* mock. should be implemented */
@@ -86,6 +86,79 @@ int32_t zvm_pwrite(int desc, char *buffer, int32_t size, int64_t offset)
   return _trap(request);
 }
 
+/*
+ * wrapper for zerovm "TrapCopy"
+ */
+int32_t zvm_copy(int src, int64_t src_offset,
+    int dst, int64_t dst_offset, int32_t size)
+{
+  uint64_t request[] = {TrapCopy, 0, src, src_offset, dst, dst_offset, size};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapView"
+ */
+int32_t zvm_view(int desc, char **data)
+{
+  uint64_t request[] = {TrapView, 0, desc, (uint32_t)data};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapRelease"
+ */
+int32_t zvm_release(int desc, int64_t offset)
+{
+  uint64_t request[] = {TrapRelease, 0, desc, offset};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapWindow"
+ */
+int32_t zvm_window(int desc, int64_t offset)
+{
+  uint64_t request[] = {TrapWindow, 0, desc, offset};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapPoll"
+ */
+int32_t zvm_poll(struct PollItem *items, int32_t count, int32_t timeout)
+{
+  uint64_t request[] = {TrapPoll, 0, (uint32_t)items, count, timeout};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapScatter"
+ */
+int32_t zvm_scatter(char *buffer, int32_t size, struct ShufflePart *parts, int32_t count)
+{
+  uint64_t request[] = {TrapScatter, 0, (uint32_t)buffer, size, (uint32_t)parts, count};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapGather"
+ */
+int32_t zvm_gather(char *buffer, int32_t size, struct ShufflePart *parts, int32_t count)
+{
+  uint64_t request[] = {TrapGather, 0, (uint32_t)buffer, size, (uint32_t)parts, count};
+  return _trap(request);
+}
+
+/*
+ * wrapper for zerovm "TrapCrc"
+ */
+int32_t zvm_crc(int desc, uint32_t *crc)
+{
+  uint64_t request[] = {TrapCrc, 0, desc, (uint32_t)crc};
+  return _trap(request);
+}
+
 /*
  * wrapper for zerovm "TrapExit"
  */
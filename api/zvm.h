@@ -63,7 +63,15 @@ enum TrapCalls {
   TrapUserSetup = 17770430,
   TrapRead,
   TrapWrite,
-  TrapExit
+  TrapExit,
+  TrapCopy,
+  TrapView,
+  TrapRelease,
+  TrapWindow,
+  TrapPoll,
+  TrapScatter,
+  TrapGather,
+  TrapCrc
 };
 
 /* nanosleep ret codes, only 2 because of nanosleep limitations */
@@ -89,8 +97,49 @@ enum TRAP_CODES {
   OUT_OF_LIMITS
 };
 
-/* channel mount mode */
-enum MountMode {MAPPED=0, LOADED, NETWORK, INVALID=-1};
+/*
+ * channel mount mode. DIRECT - loaded, but bypassing the page cache. LAZY -
+ * input channel in memory, the pages are read from the source when touched
+ */
+enum MountMode {MAPPED=0, LOADED, NETWORK, DIRECT, LAZY, INVALID=-1};
+
+/* channel access pattern hints (bitmask). names answer to CHANNEL_HINTS */
+enum ChannelHints {
+  HintSequential = 1, /* data will be read/written sequentially */
+  HintRandom = 2, /* data will be accessed in random order */
+  HintWillNeed = 4, /* whole channel will be needed, start reading now */
+  HintDontNeed = 8 /* data will not be accessed again after read/write */
+};
+
+#define CHANNEL_HINTS {"sequential", "random", "willneed", "dontneed"}
+
+/* events of zvm_poll (bitmask) */
+enum PollEvents {
+  PollRead = 1, /* channel has data to read (or the end of data) */
+  PollWrite = 2 /* channel can take data */
+};
+
+/* the most channels can be polled at once */
+#define POLL_ITEMS_MAX 1024
+
+/* channel polled by zvm_poll: requested events and the ready ones */
+struct PollItem
+{
+  int32_t desc;
+  int16_t events;
+  int16_t revents;
+};
+
+/* the most parts can be shuffled at once (each has own i/o thread) */
+#define SHUFFLE_PARTS_MAX 64
+
+/* part of the buffer shuffled by zvm_scatter/zvm_gather */
+struct ShufflePart
+{
+  int32_t desc; /* network channel */
+  int32_t offset; /* offset of the part in the buffer */
+  int32_t size; /* size of the part */
+};
 
 /*
  * hold information about preopened for user file
@@ -128,6 +177,23 @@ struct PreOpenedFileDesc
   int32_t cnt_puts; /* write calls counter */
   int64_t cnt_get_size; /* read bytes counter */
   int64_t cnt_put_size; /* written bytes counter */
+
+  /* i/o hints set from manifest. n/a for user */
+  int32_t hints; /* access pattern hints (see enum ChannelHints) */
+  int32_t prefetch; /* size of data (in mb) to read ahead of user, 0 - disabled */
+
+  /* mapped channel window. readonly for user */
+  int32_t window; /* size of the mapped window (in mb), 0 - whole channel is mapped */
+  int64_t window_offset; /* channel offset of the mapped window */
+  int64_t released; /* consumed part of the view or the window (see zvm_release) */
+
+  /* mapped output channel is trimmed to it after the nexe exit (see setup) */
+  int64_t high_water; /* end of the written data set by user, -1 - not set */
+
+  /* integrity mode set from manifest. readonly for user (see TrapCrc) */
+  int32_t integrity; /* 1 - crc32c of the channel i/o is computed, 0 - disabled */
+  uint32_t crc_get; /* crc32c of the bytes read from the channel */
+  uint32_t crc_put; /* crc32c of the bytes written to the channel */
 };
 
 /* all magic numbers about user custom attributes are here */
@@ -150,13 +216,15 @@ struct SetupList
   int32_t max_cpu; /* max cpu time available for user program, 0 - no limit */
   int32_t max_syscalls; /* max allowed *real* system calls, 0 - no limit */
   int32_t max_setup_calls; /* allowed calls of _trap_setup */
+  int32_t max_threads; /* max user threads (main thread included), 0 - threads disabled */
 
   /* memory, cpu and other system resources counters */
   int32_t cnt_mem; /* amount of memory available for user */
-  int32_t cnt_cpu; /* n/a for user */
-  int32_t cnt_cpu_last; /* n/a for user. initially should be set when nexe start */
+  int32_t cnt_cpu; /* cpu time used (in milliseconds). n/a for user */
+  int32_t cnt_cpu_last; /* reserved. the clock is kept by zerovm */
   int32_t cnt_syscalls; /* syscalls limit */
   int32_t cnt_setup_calls;
+  int32_t cnt_threads; /* running user threads */
 
   /* custom attributes. fixed length arrays, to reserve memory in the user space */
   char content_type[CONTENT_TYPE_LEN];
@@ -195,6 +263,65 @@ int32_t zvm_pread(int desc, char *buffer, int32_t size, int64_t offset);
  */
 int32_t zvm_pwrite(int desc, char *buffer, int32_t size, int64_t offset);
 
+/*
+ * wrapper for zerovm "TrapCopy". copies data from one channel to another
+ * without passing it through the user memory
+ */
+int32_t zvm_copy(int src, int64_t src_offset,
+    int dst, int64_t dst_offset, int32_t size);
+
+/*
+ * wrapper for zerovm "TrapView". gives direct access to the MAPPED (or LAZY) channel:
+ * "*data" is set to the channel data, the size of it is returned (or
+ * negative error). input channel view is read only
+ */
+int32_t zvm_view(int desc, char **data);
+
+/*
+ * wrapper for zerovm "TrapRelease". tells zerovm the MAPPED input channel
+ * view is consumed up to "offset", so the pages bellow can be dropped.
+ * the data can be accessed again, but will be read from the disk
+ */
+int32_t zvm_release(int desc, int64_t offset);
+
+/*
+ * wrapper for zerovm "TrapWindow". moves the window of the MAPPED channel
+ * (see "window" of the channel) to the given channel offset (must be
+ * multiple of 64kb). the window stays at the same address. return the
+ * size of the channel data in the window or negative error
+ */
+int32_t zvm_window(int desc, int64_t offset);
+
+/*
+ * wrapper for zerovm "TrapPoll". waits until at least one of the channels
+ * is ready for the requested events or "timeout" (milliseconds, -1 - no
+ * timeout) expires. "revents" of the items are set. return the number of
+ * ready channels (0 on timeout) or negative error
+ */
+int32_t zvm_poll(struct PollItem *items, int32_t count, int32_t timeout);
+
+/*
+ * wrapper for zerovm "TrapScatter". sends all parts of the buffer (given
+ * by "offset" and "size") to own network channels at once. return the
+ * number of sent bytes or negative error
+ */
+int32_t zvm_scatter(char *buffer, int32_t size, struct ShufflePart *parts, int32_t count);
+
+/*
+ * wrapper for zerovm "TrapGather". receives one part (sent by zvm_scatter)
+ * from each of the channels at once. parts are put to the buffer one after
+ * another in the order they come, "offset" and "size" of the parts are
+ * set. return the number of received bytes or negative error
+ */
+int32_t zvm_gather(char *buffer, int32_t size, struct ShufflePart *parts, int32_t count);
+
+/*
+ * wrapper for zerovm "TrapCrc". gives crc32c of the data got from and
+ * put to the channel with integrity mode: crc[0] - read bytes, crc[1] -
+ * written bytes. return 0 or negative error
+ */
+int32_t zvm_crc(int desc, uint32_t *crc);
+
 /*
  * set log (if allowed). valid SetupList object must be provided.
  */
@@ -218,6 +345,14 @@ int log_msg(char *msg);
 #if ZRT_LIB
 #define main slave_main
 extern struct SetupList setup;
+
+/*
+ * set own buffer for the LOADED channel (0..2), the size of the buffer zrt
+ * allocates on the first use (NULL buffer) or disable buffering with NULL
+ * buffer and zero size. by default stdin and stdout have zrt buffers of
+ * ZRT_BUFFER_SIZE. return 0 if successful, otherwise -1
+ */
+int zrt_setbuf(int file, char *buffer, int32_t size);
 #endif
 
 #endif /* USER_SIDE */
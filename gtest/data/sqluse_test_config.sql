@@ -153,4 +153,7 @@ INSERT INTO channels VALUES('manager', 'ipc:///tmp/range-request-50', 'w', 152);
 INSERT INTO channels VALUES('manager', 'ipc:///tmp/range-request-51', 'w', 153);
 INSERT INTO channels VALUES('test', 'ipc:///tmp/test1', 'w', 3);
 INSERT INTO channels VALUES('test', 'ipc:///tmp/test1', 'r', 4);
+ALTER TABLE channels ADD COLUMN sock text DEFAULT 'REQREP';
+INSERT INTO channels VALUES('test', 'ipc:///tmp/test2', 'w', 5, 'STREAM');
+INSERT INTO channels VALUES('test', 'ipc:///tmp/test2', 'r', 6, 'STREAM');
 COMMIT;
@@ -0,0 +1,199 @@
+#!/bin/sh
+#
+# zerovm benchmarks: startup breakdown, trap round trip, TrapRead throughput,
+# mapped view scan, validation speed, teardown and batch mode jobs rate. run
+# from the repository root ("make bench").
+# each case gets own manifest, zerovm writes the job timings (-p switch),
+# results are collected to one json file (1st argument, "bench.json" default)
+#
+# nexes must be built with the nacl toolchain (see Makefile of each sample),
+# cases without nexe are reported as skipped
+#
+#  Created on: May 10, 2012
+#      Author: d'b
+
+ZEROVM=${ZEROVM:-./zerovm}
+ZVM_FLAGS=${ZVM_FLAGS:--Q}
+OUT=${1:-bench.json}
+WORK=${BENCH_DIR:-/tmp/zerovm_bench.$$}
+DATA_MB=${BENCH_DATA_MB:-256}
+TRAPS=${BENCH_TRAPS:-1000000}
+READ_SIZES=${BENCH_READ_SIZES:-"4096 65536 1048576 16777216"}
+BATCH_JOBS=${BENCH_BATCH_JOBS:-2000}
+BATCH_WORKERS=${BENCH_BATCH_WORKERS:-4}
+
+mkdir -p $WORK || exit 1
+CASES=$WORK/cases
+: > $CASES
+
+# number field from json file: field <file> <name>
+field()
+{
+  sed -n "s/.*\"$2\": \([0-9-]*\).*/\1/p" $1 | head -1
+}
+
+# manifest <name> <nexe> <command line> [input] [output] [input mode]
+manifest()
+{
+  {
+    echo "Version = 11nov2011"
+    echo "Nexe = $2"
+    echo "NexeMax = 100000000"
+    echo "Log = $WORK/$1.log"
+    echo "Report = $WORK/$1.report"
+    echo "SyscallsMax = 100000000"
+    echo "SetupCallsMax = 16"
+    echo "UserLog = $WORK/$1.user.log"
+    echo "UserLogMax = 65536"
+    echo "CommandLine = $3"
+    if [ -n "$4" ]; then
+      echo "Input = $4"
+      echo "InputMode = ${6:-1}"
+      echo "InputMax = 100000000000"
+      echo "InputMaxGet = 100000000000"
+      echo "InputMaxGetCnt = 100000000"
+    fi
+    if [ -n "$5" ]; then
+      echo "Output = $5"
+      echo "OutputMode = 1"
+      echo "OutputMax = 100000000000"
+      echo "OutputMaxGet = 100000000000"
+      echo "OutputMaxGetCnt = 100000000"
+      echo "OutputMaxPut = 100000000000"
+      echo "OutputMaxPutCnt = 100000000"
+    fi
+  } > $WORK/$1.manifest
+}
+
+# run <name> <nexe> <command line> [input] [output] [input mode]
+run()
+{
+  if [ ! -f "$2" ]; then
+    echo "$1: skipped, no $2"
+    printf '  "%s": {"skipped": "no nexe"},\n' $1 >> $CASES
+    return 1
+  fi
+
+  manifest "$@"
+  rm -f $WORK/$1.perf
+  $ZEROVM $ZVM_FLAGS -p $WORK/$1.perf -M $WORK/$1.manifest > /dev/null 2>&1
+  if [ ! -f $WORK/$1.perf ]; then
+    echo "$1: failed, see $WORK/$1.log"
+    printf '  "%s": {"failed": "no timings"},\n' $1 >> $CASES
+    return 1
+  fi
+
+  echo "$1: startup $(field $WORK/$1.perf startup_us) us," \
+      "run $(field $WORK/$1.perf run_us) us," \
+      "teardown $(field $WORK/$1.perf teardown_us) us"
+  printf '  "%s": ' $1 >> $CASES
+  sed -e '2,$s/^/  /' -e '$s/$/,/' $WORK/$1.perf >> $CASES
+  return 0
+}
+
+# test data for the channel cases
+DATA=$WORK/input.data
+dd if=/dev/urandom of=$DATA bs=1048576 count=$DATA_MB 2> /dev/null || exit 1
+
+# samples
+run hello samples/hello/hello_world.nexe ""
+run onering samples/onering/onering.nexe "" "" $WORK/onering.output.data
+run pagination samples/pagination/paging_test.nexe "" $DATA $WORK/pagination.output.data
+if run sort_generator samples/sort/generator.uint32_t.nexe "" "" $WORK/unsorted.data; then
+  run sort samples/sort/sort_uint_proper_with_args.nexe "" $WORK/unsorted.data $WORK/sorted.data
+fi
+
+# trap round trip: difference of the runs with and without traps
+TRAP_NS=null
+run trap_0 samples/bench/trap_bench.nexe "trap 0" &&
+  run trap_n samples/bench/trap_bench.nexe "trap $TRAPS" &&
+  TRAP_NS=$(( ($(field $WORK/trap_n.perf run_us) - $(field $WORK/trap_0.perf run_us)) * 1000 / $TRAPS ))
+
+# TrapRead throughput per read size (mb/s)
+READ_MBPS=""
+for size in $READ_SIZES; do
+  if run read_$size samples/bench/trap_bench.nexe "read $size" $DATA; then
+    us=$(field $WORK/read_$size.perf run_us)
+    [ "$us" -gt 0 ] || us=1
+    READ_MBPS="$READ_MBPS${READ_MBPS:+, }\"$size\": $(( DATA_MB * 1000000 / us ))"
+  fi
+done
+
+# mapped input view scan with release, no copy (mb/s)
+VIEW_MBPS=null
+if run view samples/bench/trap_bench.nexe "view 16777216" $DATA "" 0; then
+  us=$(field $WORK/view.perf run_us)
+  [ "$us" -gt 0 ] || us=1
+  VIEW_MBPS=$(( DATA_MB * 1000000 / us ))
+fi
+
+# batch mode: jobs/sec and rss per running job of the small jobs (1 kb
+# input read at once), one process per job (forked) for the reference
+BATCH_RATE=null
+BATCH_RSS=null
+FORK_RATE=null
+if [ -f samples/bench/trap_bench.nexe ]; then
+  head -c 1024 $DATA > $WORK/batch.data
+  manifest batch samples/bench/trap_bench.nexe "read 1024" $WORK/batch.data
+  i=0
+  while [ $i -lt $BATCH_JOBS ]; do
+    echo $WORK/batch.manifest
+    i=$((i + 1))
+  done > $WORK/batch.list
+  $ZEROVM $ZVM_FLAGS -B $WORK/batch.list -j $BATCH_WORKERS 2> $WORK/batch.out > /dev/null
+  line=$(grep "^batch:" $WORK/batch.out)
+  BATCH_RATE=$(echo "$line" | sed -n 's/.* \([0-9.]*\) jobs\/sec.*/\1/p')
+  BATCH_RSS=$(echo "$line" | sed -n 's/.* \([0-9]*\) kb per running job.*/\1/p')
+  [ -n "$BATCH_RATE" ] || BATCH_RATE=null
+  [ -n "$BATCH_RSS" ] || BATCH_RSS=null
+
+  jobs=$((BATCH_JOBS / 10))
+  start=$(date +%s%N)
+  i=0
+  while [ $i -lt $jobs ]; do
+    $ZEROVM $ZVM_FLAGS -M $WORK/batch.manifest > /dev/null 2>&1
+    i=$((i + 1))
+  done
+  ms=$((($(date +%s%N) - start) / 1000000))
+  [ "$ms" -gt 0 ] || ms=1
+  FORK_RATE=$((jobs * 1000 / ms))
+  echo "batch: $BATCH_RATE jobs/sec ($BATCH_WORKERS workers), $BATCH_RSS kb per running job," \
+      "forked: $FORK_RATE jobs/sec"
+else
+  echo "batch: skipped, no samples/bench/trap_bench.nexe"
+fi
+
+# validation speed of all loaded nexes (bytes per usec = mb/s)
+BYTES=0
+US=0
+for perf in $WORK/*.perf; do
+  [ -f $perf ] || continue
+  BYTES=$(( BYTES + $(field $perf text_bytes) ))
+  US=$(( US + $(field $perf validation_us) ))
+done
+VALIDATION_MBPS=null
+[ $US -gt 0 ] && VALIDATION_MBPS=$(( BYTES / US ))
+
+{
+  echo "{"
+  echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+  echo "  \"revision\": \"$(git rev-parse --short HEAD 2> /dev/null)\","
+  echo "  \"host\": \"$(uname -srm)\","
+  echo "  \"cpus\": $(grep -c ^processor /proc/cpuinfo),"
+  echo "  \"summary\": {"
+  echo "    \"trap_round_trip_ns\": $TRAP_NS,"
+  echo "    \"read_mb_per_sec\": {$READ_MBPS},"
+  echo "    \"view_mb_per_sec\": $VIEW_MBPS,"
+  echo "    \"validation_mb_per_sec\": $VALIDATION_MBPS,"
+  echo "    \"batch_jobs_per_sec\": $BATCH_RATE,"
+  echo "    \"batch_rss_kb_per_job\": $BATCH_RSS,"
+  echo "    \"forked_jobs_per_sec\": $FORK_RATE"
+  echo "  },"
+  echo "  \"cases\": {"
+  sed '$s/,$//' $CASES
+  echo "  }"
+  echo "}"
+} > $OUT
+
+echo "results: $OUT"
+[ -n "$BENCH_DIR" ] || rm -rf $WORK
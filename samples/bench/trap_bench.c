@@ -0,0 +1,68 @@
+/*
+ * load for the zerovm benchmarks (see run_bench.sh). the time is taken
+ * by zerovm itself ("run_us" of the timings), the nexe only does the work:
+ *   trap <n> - n traps failing at the arguments check (trap round trip)
+ *   read <size> - read the whole input channel by "size" chunks
+ *   view <size> - scan the whole mapped input channel view releasing
+ *                 consumed data by "size" chunks (no copy)
+ * without arguments exits at once
+ *
+ *  Created on: May 10, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "api/zvm.h"
+
+int main(int argc, char **argv)
+{
+  if(argc > 2 && strcmp(argv[1], "trap") == 0)
+  {
+    int n = atoi(argv[2]);
+    char byte;
+    int i;
+
+    /* invalid channel. the trap returns right after the check */
+    for(i = 0; i < n; ++i)
+      zvm_pread(-1, &byte, 1, 0);
+    return 0;
+  }
+
+  if(argc > 2 && strcmp(argv[1], "read") == 0)
+  {
+    int32_t size = atoi(argv[2]);
+    char *buffer = malloc(size);
+    int64_t offset = 0;
+    int32_t got;
+
+    if(buffer == NULL || size < 1) return 1;
+    while((got = zvm_pread(InputChannel, buffer, size, offset)) > 0)
+      offset += got;
+    free(buffer);
+    return got < 0 ? 2 : 0;
+  }
+
+  if(argc > 2 && strcmp(argv[1], "view") == 0)
+  {
+    int32_t size = atoi(argv[2]);
+    char *data;
+    int32_t view = zvm_view(InputChannel, &data);
+    uint32_t sum = 0;
+    int32_t offset;
+
+    if(view < 0 || size < 1) return 1;
+    for(offset = 0; offset < view; offset += size)
+    {
+      int32_t end = view - offset < size ? view : offset + size;
+      int32_t i;
+
+      /* touch every page */
+      for(i = offset; i < end; i += 4096)
+        sum += (unsigned char)data[i];
+      if(zvm_release(InputChannel, end) < 0) return 2;
+    }
+    return sum == 0xffffffff; /* keep the loop */
+  }
+
+  return 0;
+}
@@ -38,6 +38,9 @@
 #define BASE_HISTOGRAM_STEP (ARRAY_ITEMS_COUNT/CHUNK_COUNT)
 /*If MERGE_ON_FLY defined then sorted chunks received by destination nodes will only merged when obtained*/
 //#define MERGE_ON_FLY
+/*If SHUFFLE defined then sorted ranges are sent by source nodes with single zvm_scatter and
+ * received by destination nodes with single zvm_gather, zerovm serves all channels at once*/
+//#define SHUFFLE
 
 /*Currently up to 10src and 10dst nodes supported,
  * FD values should be unchanged for less or equal nodes count*/
@@ -6,6 +6,7 @@
  */
 
 
+#include "api/zvm.h"
 #include "comm.h"
 #include "comm_dst.h"
 #include "dsort.h"
@@ -70,6 +71,22 @@ repreq_read_sorted_ranges( int fdr, int nodeid,
 	WRITE_FMT_LOG(LOG_DEBUG, "[%d] channel_receive_sorted_ranges OK\n", nodeid );
 }
 
+/*reading data
+ * ranges from all source nodes (fdr..fdr+ranges_count-1) by one zvm_gather,
+ * ranges are put into dst_array one after another in order of arrival*/
+void
+gather_sorted_ranges( int fdr, int nodeid,
+		BigArrayPtr dst_array, int dst_array_len, int ranges_count ){
+	struct ShufflePart parts[SRC_NODES_COUNT];
+	assert( ranges_count <= SRC_NODES_COUNT );
+	for (int i=0; i < ranges_count; i++){
+		parts[i].desc = fdr+i;
+	}
+	int32_t recv_bytes_count = zvm_gather( (char*)dst_array, dst_array_len*sizeof(BigArrayItem), parts, ranges_count );
+	WRITE_FMT_LOG(LOG_DEBUG, "[%d] zvm_gather received=%d\n", nodeid, recv_bytes_count );
+	assert( recv_bytes_count >= 0 );
+}
+
 /*writing data:
  * 1x struct sort_result*/
 void
@@ -35,10 +35,15 @@ int main(int argc, char **argv){
 	size_t array_size = ARRAY_ITEMS_COUNT*sizeof(BigArrayItem);
 	unsorted_array = malloc( array_size );
 	memset(unsorted_array, '\0', array_size);
+#ifdef SHUFFLE
+	gather_sorted_ranges( DEST_FD_READ_SORTED_RANGES_START, nodeid, unsorted_array,
+			ARRAY_ITEMS_COUNT, SRC_NODES_COUNT );
+#else
 	repreq_read_sorted_ranges( DEST_FD_READ_SORTED_RANGES_START, nodeid, unsorted_array,
 			ARRAY_ITEMS_COUNT, SRC_NODES_COUNT );
+#endif
 
-#ifdef MERGE_ON_FLY
+#if defined(MERGE_ON_FLY) && !defined(SHUFFLE)
 	sorted_array = unsorted_array;
 #else
 	/*local sort of received pieces*/
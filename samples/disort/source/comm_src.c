@@ -6,6 +6,7 @@
  */
 
 
+#include "api/zvm.h"
 #include "comm.h"
 #include "comm_src.h"
 #include "dsort.h"
@@ -147,5 +148,19 @@ write_sorted_ranges( int fdw, const struct request_data_t* sequence, const BigAr
 	WRITE_LOG(LOG_DEBUG, "Reply from receiver OK;\n");
 }
 
-
-
+/*i/o
+ *all ranges by one zvm_scatter, range for dst node goes to first_fdw+(dst_nodeid-FIRST_DEST_NODEID)*/
+void
+scatter_sorted_ranges( int first_fdw, const struct request_data_t* sequences, int count, const BigArrayPtr src_array ){
+	struct ShufflePart parts[SRC_NODES_COUNT];
+	assert( count <= SRC_NODES_COUNT );
+	for ( int i=0; i < count; i++ ){
+		parts[i].desc = sequences[i].dst_nodeid - FIRST_DEST_NODEID + first_fdw;
+		parts[i].offset = sequences[i].first_item_index*sizeof(BigArrayItem);
+		parts[i].size = (sequences[i].last_item_index - sequences[i].first_item_index + 1)*sizeof(BigArrayItem);
+		WRITE_FMT_LOG(LOG_DEBUG, "scatter fd=%d, offset=%d, size=%d\n", parts[i].desc, parts[i].offset, parts[i].size);
+	}
+	int32_t sent = zvm_scatter( (char*)src_array, ARRAY_ITEMS_COUNT*sizeof(BigArrayItem), parts, count );
+	WRITE_FMT_LOG(LOG_DEBUG, "zvm_scatter sent=%d\n", sent);
+	assert( sent >= 0 );
+}
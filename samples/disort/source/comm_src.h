@@ -28,4 +28,7 @@ read_range_request( int fdr, struct request_data_t* sequence );
 void
 write_sorted_ranges( int fdw, const struct request_data_t* sequence, const BigArrayPtr src_array);
 
+void
+scatter_sorted_ranges( int first_fdw, const struct request_data_t* sequences, int count, const BigArrayPtr src_array);
+
 #endif /* COMM_SRC_H_ */
@@ -149,6 +149,9 @@ int main(int argc, char **argv){
 
 		/*send array data to the destination nodes, bounds for pieces of data was
 		 * received previously with range request */
+#ifdef SHUFFLE
+		scatter_sorted_ranges( SOURCE_FD_WRITE_SORTED_RANGES_START, req_data_array, SRC_NODES_COUNT, sorted_array );
+#else
 		for ( int i=0; i < SRC_NODES_COUNT; i++ ){
 			int dst_nodeid = req_data_array[i].dst_nodeid;
 			int dst_write_fd = dst_nodeid - FIRST_DEST_NODEID + SOURCE_FD_WRITE_SORTED_RANGES_START;
@@ -156,6 +159,7 @@ int main(int argc, char **argv){
 			WRITE_FMT_LOG(LOG_DEBUG, "req_data_array[i].dst_nodeid=%d", req_data_array[i].dst_nodeid );
 			write_sorted_ranges( dst_write_fd, &req_data_array[i], sorted_array );
 		}
+#endif
 		WRITE_LOG(LOG_UI, "Sending Ranges Complete-OK");
 		//sleep(1);
 
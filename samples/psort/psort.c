@@ -0,0 +1,99 @@
+/*
+ * parallel sort. reads 32-bit unsigned integers from the input channel,
+ * sorts parts of the data in separate threads, merges them and writes
+ * the result to the output channel. amount of threads is taken from
+ * "ThreadsMax" manifest keyword
+ *
+ *  Created on: May 8, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "api/zvm.h"
+
+#define MAX_PARTS 16
+
+struct Part
+{
+  uint32_t *data;
+  int64_t size;
+};
+
+static int Compare(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void *SortPart(void *arg)
+{
+  struct Part *part = arg;
+  qsort(part->data, part->size, sizeof *part->data, Compare);
+  return NULL;
+}
+
+/* merge sorted parts to "result" */
+static void Merge(struct Part *parts, int n, uint32_t *result)
+{
+  int64_t pos[MAX_PARTS] = {0};
+  int64_t total = 0;
+  int64_t i;
+  int j;
+
+  for(j = 0; j < n; ++j) total += parts[j].size;
+  for(i = 0; i < total; ++i)
+  {
+    int min = -1;
+    for(j = 0; j < n; ++j)
+      if(pos[j] < parts[j].size && (min < 0
+          || parts[j].data[pos[j]] < parts[min].data[pos[min]]))
+        min = j;
+    result[i] = parts[min].data[pos[min]++];
+  }
+}
+
+int main()
+{
+  struct SetupList setup;
+  struct Part parts[MAX_PARTS];
+  pthread_t threads[MAX_PARTS];
+  uint32_t *data, *result;
+  int64_t cnt;
+  int n, i;
+  char msg[128];
+
+  if(zvm_setup(&setup) != 0) return 1;
+  log_set(&setup);
+
+  /* main thread sorts a part too */
+  n = setup.max_threads < 1 ? 1 : setup.max_threads;
+  if(n > MAX_PARTS) n = MAX_PARTS;
+
+  cnt = setup.channels[InputChannel].fsize / sizeof *data;
+  data = malloc(cnt * sizeof *data);
+  result = malloc(cnt * sizeof *result);
+  if(data == NULL || result == NULL) return 2;
+  if(zvm_pread(InputChannel, (char*)data, cnt * sizeof *data, 0) < 0) return 3;
+
+  for(i = 0; i < n; ++i)
+  {
+    parts[i].data = data + cnt * i / n;
+    parts[i].size = cnt * (i + 1) / n - cnt * i / n;
+  }
+  for(i = 1; i < n; ++i)
+    if(pthread_create(&threads[i], NULL, SortPart, &parts[i]) != 0) return 4;
+  SortPart(&parts[0]);
+  for(i = 1; i < n; ++i)
+    pthread_join(threads[i], NULL);
+
+  Merge(parts, n, result);
+  if(zvm_pwrite(OutputChannel, (char*)result, cnt * sizeof *result, 0) < 0) return 5;
+
+  sprintf(msg, "%lld numbers sorted by %d threads\n", (long long)cnt, n);
+  log_msg(msg);
+  return 0;
+}
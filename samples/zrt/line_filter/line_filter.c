@@ -0,0 +1,86 @@
+/*
+ * line oriented text filter: copies lines of stdin containing the pattern
+ * to stdout (like grep). made to show zrt channel buffers: libc reads and
+ * writes by small blocks, without zrt buffers each block is a trap
+ *
+ * usage: line_filter <pattern> [unbuffered | mapped]
+ * "mapped" takes the lines in place from the MAPPED input (no copy at all)
+ *
+ *  Created on: May 11, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "api/zvm.h"
+
+/* strstr() for the line which is not null terminated */
+static int LineHas(const char *line, int size, const char *pattern, int len)
+{
+  int i;
+  for(i = 0; i + len <= size; ++i)
+    if(memcmp(line + i, pattern, len) == 0) return 1;
+  return 0;
+}
+
+/* lines of the MAPPED input taken in place. return found lines */
+static int MappedFilter(const char *pattern, int *lines)
+{
+  char *data;
+  char *line;
+  char *end;
+  int found = 0;
+  int size = zvm_view(InputChannel, &data);
+
+  for(line = data; size > 0 && line < data + size; line = end)
+  {
+    char *eol = memchr(line, '\n', data + size - line);
+    end = eol == NULL ? data + size : eol + 1;
+    ++*lines;
+    if(!LineHas(line, end - line, pattern, strlen(pattern))) continue;
+    fwrite(line, 1, end - line, stdout);
+    ++found;
+  }
+
+  /* the data is consumed: the read to the view itself only moves the position */
+  if(size > 0) read(InputChannel, data, size);
+  return found;
+}
+
+int main(int argc, char **argv)
+{
+  char line[4096];
+  int lines = 0;
+  int found = 0;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: line_filter <pattern> [unbuffered | mapped]\n");
+    return 1;
+  }
+
+  /* "before": every libc block is a trap */
+  if(argc > 2 && strcmp(argv[2], "unbuffered") == 0)
+  {
+    zrt_setbuf(InputChannel, NULL, 0);
+    zrt_setbuf(OutputChannel, NULL, 0);
+  }
+
+  if(argc > 2 && strcmp(argv[2], "mapped") == 0)
+  {
+    found = MappedFilter(argv[1], &lines);
+    fprintf(stderr, "%d lines, %d found\n", lines, found);
+    return 0;
+  }
+
+  while(fgets(line, sizeof line, stdin) != NULL)
+  {
+    ++lines;
+    if(strstr(line, argv[1]) == NULL) continue;
+    fputs(line, stdout);
+    ++found;
+  }
+
+  fprintf(stderr, "%d lines, %d found\n", lines, found);
+  return 0;
+}
@@ -0,0 +1,14 @@
+#!/bin/sh
+# compares the line filter with and without zrt channel buffers and with
+# the lines taken in place from the MAPPED input
+# run from this directory after the nexe is built ("make")
+cd ../../..
+DIR=samples/zrt/line_filter
+seq 1 4000000 | awk '{print "line " $1 " of the text for the filter"}' > $DIR/input.data
+for mode in unbuffered buffered mapped; do
+  ./zerovm -p $DIR/$mode.perf -M$DIR/line_filter.$mode.manifest > /dev/null
+  echo "$mode: $(sed -n 's/.*"run_us": \([0-9]*\).*/\1/p' $DIR/$mode.perf) us," \
+      "$(sed -n 's/ReportSyscalls *=//p' $DIR/line_filter.$mode.report.log)"
+done
+cmp $DIR/output.unbuffered.data $DIR/output.buffered.data &&
+  cmp $DIR/output.unbuffered.data $DIR/output.mapped.data && echo outputs are equal
@@ -56,6 +56,7 @@ int NaClDescImcShmCtor(struct NaClDescImcShm  *self,
   }
   self->h = h;
   self->size = size;
+  self->recycle = 0;
   basep->base.vtbl = (struct NaClRefCountVtbl const *) &kNaClDescImcShmVtbl;
   return 1;
 }
@@ -83,10 +84,22 @@ int NaClDescImcShmAllocCtor(struct NaClDescImcShm  *self,
   return rv;
 }
 
+void NaClDescImcShmRecycle(struct NaClDescImcShm *self) {
+  self->recycle = 1;
+}
+
 static void NaClDescImcShmDtor(struct NaClRefCount *vself) {
   struct NaClDescImcShm  *self = (struct NaClDescImcShm *) vself;
 
-  (void) NaClClose(self->h);
+  /*
+   * d'b: only the object known to be unmapped everywhere can go to the
+   * pool (imc drops its content), other objects are just closed
+   */
+  if (self->recycle) {
+    (void) NaClReleaseMemoryObject(self->h, (size_t) self->size);
+  } else {
+    (void) NaClClose(self->h);
+  }
   self->h = NACL_INVALID_HANDLE;
   vself->vtbl = (struct NaClRefCountVtbl const *) &kNaClDescVtbl;
   (*vself->vtbl->Dtor)(vself);
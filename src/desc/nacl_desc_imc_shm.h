@@ -28,6 +28,7 @@ struct NaClDescImcShm {
   NaClHandle                h;
   nacl_off64_t              size;
   /* note nacl_off64_t so struct stat incompatible */
+  int                       recycle;  /* d'b: see NaClDescImcShmRecycle() */
 };
 
 int NaClDescImcShmInternalize(struct NaClDesc          **baseptr,
@@ -52,6 +53,13 @@ int NaClDescImcShmAllocCtor(struct NaClDescImcShm  *self,
                             int                    executable)
     NACL_WUR;
 
+/*
+ * d'b: lets the dtor return the memory object to the imc pool instead of
+ * closing it. the owner calls it when no mapping of the object is left
+ * and no other process holds it, so the next sandbox gets a clean object
+ */
+void NaClDescImcShmRecycle(struct NaClDescImcShm *self);
+
 struct NaClDescImcShm *NaClDescImcShmMake(struct NaClHostDesc *nhdp)
     NACL_WUR;
 
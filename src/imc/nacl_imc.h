@@ -223,6 +223,50 @@ typedef Handle (*CreateMemoryObjectFunc)(size_t length, bool executable);
  */
 Handle CreateMemoryObject(size_t length, bool executable);
 
+/**
+ *  @nacl
+ *  Maximum number of memory objects kept by the memory object pool.
+ */
+const size_t kMemoryObjectPoolMax = 64;
+
+/**
+ *  @nacl
+ *  Enables the pool of memory objects and pre-creates count objects of
+ *  length bytes. While the pool has an object of the requested length
+ *  CreateMemoryObject() takes it instead of creating a new one. Released
+ *  objects of any length are kept by the pool. Intended for long-lived
+ *  processes which load many nexes (the dynamic text region is recycled).
+ *  @param count The number of objects to pre-create (at most
+ *               kMemoryObjectPoolMax), can be 0.
+ *  @param length The size of each object. It must be a multiple of
+ *                allocation granularity given by kMapPageSize. 0 - the
+ *                size is not known yet, the objects are pre-created by
+ *                the first request of the pool kind with its length.
+ *  @param executable Whether the objects must be mappable with PROT_EXEC.
+ *                    Only objects of this kind are served by the pool.
+ *  @return true if the pool has been filled, false otherwise.
+ */
+bool InitMemoryObjectPool(size_t count, size_t length, bool executable);
+
+/**
+ *  @nacl
+ *  Closes all memory objects kept by the pool and disables the pool.
+ */
+void FiniMemoryObjectPool();
+
+/**
+ *  @nacl
+ *  Releases a memory object created by CreateMemoryObject(). If the pool
+ *  is enabled and not full, the object content is discarded and the object
+ *  is kept for reuse, otherwise it is closed. The object must not be mapped
+ *  anywhere at the moment of the call and must be of the pool kind (see
+ *  InitMemoryObjectPool()).
+ *  @param memory The memory object to release.
+ *  @param length The size of the memory object.
+ *  @return 0 on success, and -1 upon failure.
+ */
+int ReleaseMemoryObject(Handle memory, size_t length);
+
 /**
  *  @nacl
  *  Map() prot bits
@@ -45,6 +45,19 @@ NaClHandle NaClCreateMemoryObject(size_t length, int executable) {
   return nacl::CreateMemoryObject(length, executable ? true : false);
 }
 
+int NaClInitMemoryObjectPool(size_t count, size_t length, int executable) {
+  return nacl::InitMemoryObjectPool(count, length,
+                                    executable ? true : false);
+}
+
+void NaClFiniMemoryObjectPool(void) {
+  nacl::FiniMemoryObjectPool();
+}
+
+int NaClReleaseMemoryObject(NaClHandle memory, size_t length) {
+  return nacl::ReleaseMemoryObject(memory, length);
+}
+
 void* NaClMap(void* start, size_t length, int prot, int flags,
               NaClHandle memory, off_t offset) {
   return nacl::Map(start, length, prot, flags, memory, offset);
@@ -170,6 +170,30 @@ int NaClReceiveDatagram(NaClHandle socket, NaClMessageHeader* message,
 
 NaClHandle NaClCreateMemoryObject(size_t length, int executable);
 
+/*
+ * Enables the memory object pool and pre-creates count memory objects
+ * of length bytes (length 0 - of the length of the first request).
+ * Pooled objects are handed out by NaClCreateMemoryObject() for requests
+ * of the same length. Returns non-zero if the pool has been filled.
+ */
+
+int NaClInitMemoryObjectPool(size_t count, size_t length, int executable);
+
+/*
+ * Closes all pooled memory objects and disables the pool.
+ */
+
+void NaClFiniMemoryObjectPool(void);
+
+/*
+ * Releases a memory object created by NaClCreateMemoryObject(). The
+ * object must not be mapped anywhere. It is scrubbed and returned to
+ * the pool when possible, otherwise it is closed. Returns 0 on success,
+ * -1 upon failure.
+ */
+
+int NaClReleaseMemoryObject(NaClHandle memory, size_t length);
+
 /* NaClMap() prot bits */
 #define NACL_PROT_READ    0x1   /* Mapped area can be read */
 #define NACL_PROT_WRITE   0x2   /* Mapped area can be written */
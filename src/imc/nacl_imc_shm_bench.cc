@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2012 The Native Client Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+// launch rate benchmark for the imc memory objects. every iteration
+// does what a sandbox launch does with the dynamic text object: create,
+// map, touch, unmap and release it. compared are the legacy shm_open()
+// objects, memfd_create() objects and the memory object pool.
+//
+// usage: nacl_imc_shm_bench [threads] [iterations per thread] [size in kb]
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "src/imc/nacl_imc.h"
+
+namespace {
+
+enum BenchMode { kLegacyShm, kMemfd, kPooled };
+const char *kModeNames[] = { "shm_open", "memfd", "memfd+pool" };
+
+struct BenchJob {
+  BenchMode mode;
+  int id;
+  int iterations;
+  size_t length;
+  int failures;
+};
+
+// the way objects were created before memfd_create() support
+nacl::Handle LegacyCreate(size_t length, int id) {
+  char name[64];
+  snprintf(name, sizeof name, "/nacl-shm-bench-%d.%d", getpid(), id);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0);
+  if (fd < 0) return nacl::kInvalidHandle;
+  shm_unlink(name);
+  if (ftruncate(fd, length) == -1) {
+    close(fd);
+    return nacl::kInvalidHandle;
+  }
+  return fd;
+}
+
+void* BenchThread(void* arg) {
+  BenchJob* job = static_cast<BenchJob*>(arg);
+  long page = sysconf(_SC_PAGESIZE);
+
+  for (int i = 0; i < job->iterations; ++i) {
+    nacl::Handle fd;
+    if (job->mode == kLegacyShm) {
+      fd = LegacyCreate(job->length, job->id * job->iterations + i);
+    } else {
+      fd = nacl::CreateMemoryObject(job->length, true);
+    }
+    if (fd == nacl::kInvalidHandle) {
+      ++job->failures;
+      continue;
+    }
+
+    char* p = static_cast<char*>(nacl::Map(NULL, job->length,
+        nacl::kProtRead | nacl::kProtWrite, nacl::kMapShared, fd, 0));
+    if (p == nacl::kMapFailed) {
+      ++job->failures;
+    } else {
+      for (size_t off = 0; off < job->length; off += page) p[off] = 1;
+      nacl::Unmap(p, job->length);
+    }
+
+    if (job->mode == kLegacyShm) {
+      close(fd);
+    } else {
+      nacl::ReleaseMemoryObject(fd, job->length);
+    }
+  }
+  return NULL;
+}
+
+double Now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void RunBench(BenchMode mode, int threads, int iterations, size_t length) {
+  BenchJob* jobs = new BenchJob[threads];
+  pthread_t* tids = new pthread_t[threads];
+  int failures = 0;
+
+  if (mode == kPooled) {
+    size_t count = static_cast<size_t>(threads) < nacl::kMemoryObjectPoolMax
+        ? threads : nacl::kMemoryObjectPoolMax;
+    nacl::InitMemoryObjectPool(count, length, true);
+  }
+
+  double start = Now();
+  for (int i = 0; i < threads; ++i) {
+    jobs[i].mode = mode;
+    jobs[i].id = i;
+    jobs[i].iterations = iterations;
+    jobs[i].length = length;
+    jobs[i].failures = 0;
+    pthread_create(&tids[i], NULL, BenchThread, &jobs[i]);
+  }
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(tids[i], NULL);
+    failures += jobs[i].failures;
+  }
+  double elapsed = Now() - start;
+
+  if (mode == kPooled) nacl::FiniMemoryObjectPool();
+
+  printf("%-12s threads=%-3d objects/sec=%-12.0f failures=%d\n",
+         kModeNames[mode], threads,
+         threads * static_cast<double>(iterations) / elapsed, failures);
+  delete[] jobs;
+  delete[] tids;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int threads = argc > 1 ? atoi(argv[1]) : 8;
+  int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+  size_t length = (argc > 3 ? atoi(argv[3]) : 256) * 1024;
+
+  if (threads <= 0 || iterations <= 0 || length == 0
+      || length % nacl::kMapPageSize != 0) {
+    fprintf(stderr, "usage: %s [threads] [iterations] [size in kb, "
+            "multiple of 64]\n", argv[0]);
+    return 1;
+  }
+
+  RunBench(kLegacyShm, threads, iterations, length);
+  RunBench(kMemfd, threads, iterations, length);
+  RunBench(kPooled, threads, iterations, length);
+  return 0;
+}
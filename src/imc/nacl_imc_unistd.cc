@@ -18,8 +18,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "include/atomic_ops.h"
 #include "src/imc/nacl_imc.h"
@@ -36,6 +39,58 @@ const char kNaClTempPrefixVar[] = "NACL_TMPFS_PREFIX";
 const char kShmTempPrefix[] = "/tmp/google-nacl-shm-";
 const char kShmOpenPrefix[] = "/google-nacl-shm-";
 
+// The name shown in /proc/<pid>/fd for memory objects created by
+// memfd_create(). it does not have to be unique
+const char kMemfdName[] = "nacl-shm";
+
+// memfd_create() and file sealing constants. older libc headers do not
+// define them, the values are part of the linux abi
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef MFD_EXEC
+#define MFD_EXEC 0x0010U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL 0x0001
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef F_SEAL_GROW
+#define F_SEAL_GROW 0x0004
+#endif
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE 0x02
+#endif
+
+// pool of pre-created and released memory objects (see
+// InitMemoryObjectPool()). objects of different length can be kept
+struct PooledObject {
+  Handle handle;
+  size_t length;
+};
+
+struct MemoryObjectPool {
+  pthread_mutex_t mutex;
+  bool enabled;
+  bool executable;
+  size_t count;
+  size_t reserve;  // objects to pre-create with the length of the 1st request
+  PooledObject objects[kMemoryObjectPoolMax];
+};
+
+MemoryObjectPool g_pool = { PTHREAD_MUTEX_INITIALIZER, false, false, 0, 0, {} };
+
 }  // namespace
 
 bool WouldBlock() {
@@ -81,12 +136,54 @@ static int TryShmOrTempOpen(size_t length, const char* prefix, bool use_temp) {
   }
 }
 
-static CreateMemoryObjectFunc g_create_memory_object_func = NULL;
+#if NACL_LINUX && defined(__NR_memfd_create)
+// set when the kernel does not support memfd_create() (older than 3.17)
+static volatile bool g_memfd_unsupported = false;
 
-Handle CreateMemoryObject(size_t length, bool executable) {
-  if (0 == length) {
+// creates anonymous memory object with memfd_create(). unlike
+// TryShmOrTempOpen() there is no name to generate, create and unlink, so
+// concurrent sandboxes do not contend on tmpfs directory. the size of the
+// object is sealed: nobody (including the untrusted side) can shrink it
+// under our mappings
+static int TryMemfdCreate(size_t length, bool executable) {
+  if (0 == length || g_memfd_unsupported) {
     return -1;
   }
+
+  unsigned int flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+  int m = syscall(__NR_memfd_create, kMemfdName,
+                  flags | (executable ? MFD_EXEC : 0));
+
+  // kernels older than 6.3 do not know MFD_EXEC (memfd is executable there)
+  if (m < 0 && errno == EINVAL && executable) {
+    m = syscall(__NR_memfd_create, kMemfdName, flags);
+  }
+  if (m < 0) {
+    if (errno == ENOSYS) {
+      g_memfd_unsupported = true;
+    }
+    return -1;
+  }
+
+  if (ftruncate(m, length) == -1) {
+    close(m);
+    return -1;
+  }
+
+  // sealing is not critical, the object is usable without it
+  fcntl(m, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+  return m;
+}
+#else
+static int TryMemfdCreate(size_t /* length */, bool /* executable */) {
+  return -1;
+}
+#endif
+
+static CreateMemoryObjectFunc g_create_memory_object_func = NULL;
+
+// creates memory object bypassing the pool
+static Handle CreateNewMemoryObject(size_t length, bool executable) {
   int fd;
 
   if (g_create_memory_object_func != NULL) {
@@ -95,6 +192,13 @@ Handle CreateMemoryObject(size_t length, bool executable) {
       return fd;
   }
 
+  // memfd_create() is the cheapest way. if it is not available
+  // fall back to the file based objects below
+  fd = TryMemfdCreate(length, executable);
+  if (fd >= 0) {
+    return fd;
+  }
+
   // /dev/shm is not always available on Linux.
   // Sometimes it's mounted as noexec.
   // To handle this case, sel_ldr can take a path
@@ -126,6 +230,105 @@ Handle CreateMemoryObject(size_t length, bool executable) {
   return TryShmOrTempOpen(length, kShmOpenPrefix, false);
 }
 
+Handle CreateMemoryObject(size_t length, bool executable) {
+  if (0 == length) {
+    return -1;
+  }
+
+  // take pooled object if the pool has one of the proper kind
+  if (g_pool.enabled) {
+    Handle fd = kInvalidHandle;
+    pthread_mutex_lock(&g_pool.mutex);
+    if (g_pool.enabled && g_pool.executable == executable) {
+      // the size was not known at the pool start: the 1st request gives it.
+      // the requests racing with this one wait for the objects
+      for (; g_pool.reserve > 1 && g_pool.count < kMemoryObjectPoolMax;
+           --g_pool.reserve) {
+        Handle pooled = CreateNewMemoryObject(length, executable);
+        if (pooled == kInvalidHandle) {
+          break;
+        }
+        g_pool.objects[g_pool.count].handle = pooled;
+        g_pool.objects[g_pool.count++].length = length;
+      }
+      g_pool.reserve = 0;
+
+      for (size_t i = g_pool.count; i > 0; --i) {
+        if (g_pool.objects[i - 1].length == length) {
+          fd = g_pool.objects[i - 1].handle;
+          g_pool.objects[i - 1] = g_pool.objects[--g_pool.count];
+          break;
+        }
+      }
+    }
+    pthread_mutex_unlock(&g_pool.mutex);
+    if (fd != kInvalidHandle) {
+      return fd;
+    }
+  }
+
+  return CreateNewMemoryObject(length, executable);
+}
+
+bool InitMemoryObjectPool(size_t count, size_t length, bool executable) {
+  if (count > kMemoryObjectPoolMax) {
+    return false;
+  }
+
+  FiniMemoryObjectPool();
+  pthread_mutex_lock(&g_pool.mutex);
+  g_pool.executable = executable;
+  g_pool.reserve = 0 == length ? count : 0;
+  while (0 != length && g_pool.count < count) {
+    Handle fd = CreateNewMemoryObject(length, executable);
+    if (fd == kInvalidHandle) {
+      break;
+    }
+    g_pool.objects[g_pool.count].handle = fd;
+    g_pool.objects[g_pool.count++].length = length;
+  }
+  g_pool.enabled = true;
+  pthread_mutex_unlock(&g_pool.mutex);
+  return 0 == length || g_pool.count == count;
+}
+
+void FiniMemoryObjectPool() {
+  pthread_mutex_lock(&g_pool.mutex);
+  while (g_pool.count > 0) {
+    close(g_pool.objects[--g_pool.count].handle);
+  }
+  g_pool.reserve = 0;
+  g_pool.enabled = false;
+  pthread_mutex_unlock(&g_pool.mutex);
+}
+
+int ReleaseMemoryObject(Handle memory, size_t length) {
+  if (memory == kInvalidHandle) {
+    return -1;
+  }
+
+  if (g_pool.enabled && 0 != length) {
+    // the object can go to another sandbox: drop its content. punching
+    // the hole also returns the pages to the system, the size is kept
+    if (fallocate(memory, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  0, length) == 0) {
+      bool pooled = false;
+      pthread_mutex_lock(&g_pool.mutex);
+      if (g_pool.enabled && g_pool.count < kMemoryObjectPoolMax) {
+        g_pool.objects[g_pool.count].handle = memory;
+        g_pool.objects[g_pool.count++].length = length;
+        pooled = true;
+      }
+      pthread_mutex_unlock(&g_pool.mutex);
+      if (pooled) {
+        return 0;
+      }
+    }
+  }
+
+  return close(memory);
+}
+
 void* Map(void* start, size_t length, int prot, int flags,
           Handle memory, off_t offset) {
   static const int kPosixProt[] = {
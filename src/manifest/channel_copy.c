@@ -0,0 +1,125 @@
+/*
+ * channel to channel data copy without passing the data through the
+ * user memory. used by TrapCopy
+ *
+ * the kernel copy is tried first: copy_file_range() (can share extents
+ * or copy inside the page cache), then sendfile(). if both failed the
+ * data is copied through the trusted buffer, still saving the user
+ * memory round trip and the second trap. the channels with integrity
+ * mode need the data in hands, so they are copied through the buffer
+ *
+ *  Created on: May 6, 2012
+ *      Author: d'b
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+#include "src/manifest/channel_copy.h"
+#include "src/manifest/direct_io.h"
+#include "src/manifest/crc32c.h"
+
+/* kernel copy with copy_file_range(). return copied bytes or -1 */
+static int64_t KernelCopyRange(int in, int64_t *in_offset,
+    int out, int64_t *out_offset, int64_t size)
+{
+#ifdef __NR_copy_file_range
+  int64_t done = 0;
+
+  while(done < size)
+  {
+    loff_t in_pos = *in_offset;
+    loff_t out_pos = *out_offset;
+    ssize_t n = syscall(__NR_copy_file_range, in, &in_pos, out, &out_pos,
+        (size_t)(size - done), 0);
+    if(n <= 0) return n < 0 && done == 0 ? -1 : done;
+    *in_offset += n;
+    *out_offset += n;
+    done += n;
+  }
+  return done;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/*
+ * kernel copy with sendfile(). it writes to the current file position
+ * so the output position is set first (channels use only pread/pwrite)
+ */
+static int64_t KernelSendFile(int in, int64_t *in_offset,
+    int out, int64_t *out_offset, int64_t size)
+{
+  int64_t done = 0;
+
+  if(lseek(out, *out_offset, SEEK_SET) < 0) return -1;
+  while(done < size)
+  {
+    off_t in_pos = *in_offset;
+    ssize_t n = sendfile(out, in, &in_pos, (size_t)(size - done));
+    if(n <= 0) return n < 0 && done == 0 ? -1 : done;
+    *in_offset += n;
+    *out_offset += n;
+    done += n;
+  }
+  return done;
+}
+
+/* copy through the buffer, update crc of the copied data if asked */
+static int64_t BufferCopy(int in, int64_t *in_offset,
+    int out, int64_t *out_offset, int64_t size, int direct,
+    uint32_t *crc_in, uint32_t *crc_out)
+{
+  int64_t done = 0;
+  int error = 0;
+  char *buffer;
+
+  if(posix_memalign((void**)&buffer, DIRECT_ALIGN, COPY_BUFFER_SIZE)) return -1;
+  while(done < size)
+  {
+    int32_t n = size - done > COPY_BUFFER_SIZE ? COPY_BUFFER_SIZE : size - done;
+    int32_t got, put;
+
+    got = direct ? DirectRead(in, buffer, n, *in_offset)
+        : pread(in, buffer, n, *in_offset);
+    if(got <= 0) { error = got < 0; break; }
+    put = direct ? DirectWrite(out, buffer, got, *out_offset)
+        : pwrite(out, buffer, got, *out_offset);
+    if(put <= 0) { error = 1; break; }
+    if(crc_in != NULL) *crc_in = Crc32c(*crc_in, buffer, put);
+    if(crc_out != NULL) *crc_out = Crc32c(*crc_out, buffer, put);
+
+    *in_offset += put;
+    *out_offset += put;
+    done += put;
+    if(put < n) break;
+  }
+  free(buffer);
+  return done > 0 || !error ? done : -1;
+}
+
+/* copy data from one channel file to another */
+int32_t CopyChannelData(int in, int64_t in_offset,
+    int out, int64_t out_offset, int32_t size, int direct,
+    uint32_t *crc_in, uint32_t *crc_out)
+{
+  int64_t n = -1;
+
+  if(size < 1) return 0;
+
+  /* kernel copy. o_direct files need aligned transfers, crc needs the data */
+  if(!direct && crc_in == NULL && crc_out == NULL)
+  {
+    n = KernelCopyRange(in, &in_offset, out, &out_offset, size);
+    if(n < 0 && (errno == ENOSYS || errno == EXDEV
+        || errno == EINVAL || errno == EOPNOTSUPP))
+      n = KernelSendFile(in, &in_offset, out, &out_offset, size);
+  }
+
+  if(n < 0)
+    n = BufferCopy(in, &in_offset, out, &out_offset, size, direct, crc_in, crc_out);
+  return (int32_t)n;
+}
@@ -0,0 +1,34 @@
+/*
+ * channel to channel data copy without passing the data through the
+ * user memory. used by TrapCopy
+ *
+ *  Created on: May 6, 2012
+ *      Author: d'b
+ */
+
+#ifndef CHANNEL_COPY_H_
+#define CHANNEL_COPY_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* buffer size for the copy fallback (when kernel cannot copy itself) */
+#define COPY_BUFFER_SIZE 0x100000
+
+/*
+ * copy "size" bytes from "in" file at "in_offset" to "out" file at
+ * "out_offset". uses copy_file_range(), sendfile() or read/write,
+ * whichever is available. "direct" must be set if any of files opened
+ * with O_DIRECT. not NULL "crc_in" and "crc_out" are updated with the
+ * crc32c of the copied data (the data is copied through the buffer then)
+ * return amount of copied bytes or -1 if failed
+ */
+int32_t CopyChannelData(int in, int64_t in_offset,
+    int out, int64_t out_offset, int32_t size, int direct,
+    uint32_t *crc_in, uint32_t *crc_out);
+
+EXTERN_C_END
+
+#endif /* CHANNEL_COPY_H_ */
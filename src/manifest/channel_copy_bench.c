@@ -0,0 +1,104 @@
+/*
+ * pass-through filter: copies input channel to output channel by records.
+ * compares read to the user buffer + write back (two traps, two copies)
+ * with TrapCopy engine (CopyChannelData)
+ *
+ * usage: channel_copy_bench [input file] [size in mb] [record in kb]
+ * if the input file does not exist it will be created (and removed at the end)
+ *
+ *  Created on: May 6, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "src/manifest/channel_copy.h"
+
+#define DEFAULT_FILE "channel_copy_bench.dat"
+#define DEFAULT_SIZE 256 /* mb */
+#define DEFAULT_RECORD 64 /* kb */
+#define MB 0x100000
+
+static double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* fill the file with data if it is absent */
+static int CreateFile(const char *name, int64_t size, int *created)
+{
+  char buffer[MB];
+  int64_t i;
+  int handle = open(name, O_RDONLY);
+
+  *created = 0;
+  if(handle >= 0) return close(handle);
+
+  handle = open(name, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+  if(handle < 0) return -1;
+  for(i = 0; i < (int64_t)sizeof buffer; ++i) buffer[i] = (char)(i * 31);
+  for(i = 0; i < size; i += sizeof buffer)
+    if(write(handle, buffer, sizeof buffer) != sizeof buffer) return -1;
+  *created = 1;
+  return close(handle);
+}
+
+/* copy input to output by records. "trap_copy" selects the engine */
+static void Filter(const char *title, const char *name, int record, int trap_copy)
+{
+  char output[1024];
+  char *buffer = malloc(record);
+  int64_t offset = 0;
+  int32_t size;
+  double start;
+  int in, out;
+
+  snprintf(output, sizeof output, "%s.out", name);
+  in = open(name, O_RDONLY);
+  out = open(output, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if(in < 0 || out < 0 || buffer == NULL) return;
+
+  start = Now();
+  for(;;)
+  {
+    if(trap_copy)
+      size = CopyChannelData(in, offset, out, offset, record, 0, NULL, NULL);
+    else if((size = pread(in, buffer, record, offset)) > 0)
+      size = pwrite(out, buffer, size, offset);
+    if(size < 1) break;
+    offset += size;
+  }
+  fdatasync(out);
+
+  printf("%-24s %8.1f mb/s\n", title, offset / (Now() - start) / MB);
+  close(in);
+  close(out);
+  unlink(output);
+  free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+  const char *name = argc > 1 ? argv[1] : DEFAULT_FILE;
+  int64_t size = (int64_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE) * MB;
+  int record = (argc > 3 ? atoi(argv[3]) : DEFAULT_RECORD) * 1024;
+  int created;
+
+  if(size < 1 || record < 1 || CreateFile(name, size, &created))
+  {
+    fprintf(stderr, "usage: %s [input file] [size in mb] [record in kb]\n", argv[0]);
+    return 1;
+  }
+
+  Filter("read + write", name, record, 0);
+  Filter("copy trap", name, record, 1);
+
+  if(created) unlink(name);
+  return 0;
+}
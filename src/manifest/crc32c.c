@@ -0,0 +1,179 @@
+/*
+ * crc32c of the channel data
+ *
+ * crc32 instruction has latency of 3 cycles and throughput of 1, so the
+ * long buffer is cut to 3 blocks and the blocks are computed at once.
+ * crc of the 1st block is shifted over the 2nd one (and then over the
+ * 3rd) by the tables of the "zeros operator" made once for the block
+ * size, 4 lookups instead of the carry-less multiplication
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <cpuid.h>
+#include <pthread.h>
+
+#include "src/manifest/crc32c.h"
+
+#define CRC32C_POLY 0x82f63b78 /* reversed castagnoli polynomial */
+#define LONG_BLOCK 8192 /* must be multiple of 8 */
+#define SHORT_BLOCK 256
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static int hardware;
+static uint32_t crc32c_table[256];
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+
+/* multiply the gf(2) 32x32 matrix "mat" by the vector "vec" */
+static uint32_t MatrixTimes(const uint32_t *mat, uint32_t vec)
+{
+  uint32_t sum = 0;
+
+  for(; vec != 0; vec >>= 1, ++mat)
+    if(vec & 1) sum ^= *mat;
+  return sum;
+}
+
+/* "square" = "mat" * "mat" */
+static void MatrixSquare(uint32_t *square, const uint32_t *mat)
+{
+  int i;
+  for(i = 0; i < 32; ++i)
+    square[i] = MatrixTimes(mat, mat[i]);
+}
+
+/* tables applying "size" zero bytes to the crc */
+static void ZerosTables(uint32_t zeros[4][256], size_t size)
+{
+  uint32_t even[32];
+  uint32_t odd[32];
+  uint32_t *op;
+  uint32_t row;
+  int i;
+
+  /* operator for one zero bit, then for 2 and 4 bits */
+  odd[0] = CRC32C_POLY;
+  for(i = 1, row = 1; i < 32; ++i, row <<= 1)
+    odd[i] = row;
+  MatrixSquare(even, odd);
+  MatrixSquare(odd, even);
+
+  /* square it up to the byte and further for each bit of the size */
+  for(op = odd;;)
+  {
+    MatrixSquare(even, odd);
+    op = even;
+    if((size >>= 1) == 0) break;
+    MatrixSquare(odd, even);
+    op = odd;
+    if((size >>= 1) == 0) break;
+  }
+
+  for(i = 0; i < 256; ++i)
+  {
+    zeros[0][i] = MatrixTimes(op, i);
+    zeros[1][i] = MatrixTimes(op, i << 8);
+    zeros[2][i] = MatrixTimes(op, i << 16);
+    zeros[3][i] = MatrixTimes(op, (uint32_t)i << 24);
+  }
+}
+
+/* apply the zeros tables to the crc */
+static inline uint32_t Shift(uint32_t zeros[4][256], uint32_t crc)
+{
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff]
+      ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+static void Crc32cInit()
+{
+  unsigned eax, ebx, ecx, edx;
+  uint32_t crc;
+  int i, j;
+
+  for(i = 0; i < 256; ++i)
+  {
+    for(crc = i, j = 0; j < 8; ++j)
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    crc32c_table[i] = crc;
+  }
+
+  hardware = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+  if(!hardware) return;
+  ZerosTables(crc32c_long, LONG_BLOCK);
+  ZerosTables(crc32c_short, SHORT_BLOCK);
+}
+
+static inline uint64_t Crc32Byte(uint64_t crc, uint8_t data)
+{
+  __asm__("crc32b %1, %k0" : "+r"(crc) : "rm"(data));
+  return crc;
+}
+
+static inline uint64_t Crc32Quad(uint64_t crc, uint64_t data)
+{
+  __asm__("crc32q %1, %0" : "+r"(crc) : "rm"(data));
+  return crc;
+}
+
+/* crc32c of 3 blocks of "block" bytes at once */
+#define CRC32C_BLOCKS(block, zeros) \
+  while(size >= 3 * block) \
+  { \
+    uint64_t crc1 = 0; \
+    uint64_t crc2 = 0; \
+    const uint8_t *end = next + block; \
+    do { \
+      crc0 = Crc32Quad(crc0, *(const uint64_t*)next); \
+      crc1 = Crc32Quad(crc1, *(const uint64_t*)(next + block)); \
+      crc2 = Crc32Quad(crc2, *(const uint64_t*)(next + 2 * block)); \
+      next += 8; \
+    } while(next < end); \
+    crc0 = Shift(zeros, (uint32_t)crc0) ^ crc1; \
+    crc0 = Shift(zeros, (uint32_t)crc0) ^ crc2; \
+    next += 2 * block; \
+    size -= 3 * block; \
+  }
+
+static uint32_t HardwareCrc32c(uint32_t crc, const uint8_t *next, size_t size)
+{
+  uint64_t crc0 = crc ^ 0xffffffff;
+
+  /* align the data to 8 bytes */
+  for(; size > 0 && ((uintptr_t)next & 7) != 0; --size)
+    crc0 = Crc32Byte(crc0, *next++);
+
+  CRC32C_BLOCKS(LONG_BLOCK, crc32c_long);
+  CRC32C_BLOCKS(SHORT_BLOCK, crc32c_short);
+
+  /* the tail */
+  for(; size >= 8; size -= 8, next += 8)
+    crc0 = Crc32Quad(crc0, *(const uint64_t*)next);
+  for(; size > 0; --size)
+    crc0 = Crc32Byte(crc0, *next++);
+
+  return (uint32_t)crc0 ^ 0xffffffff;
+}
+#undef CRC32C_BLOCKS
+
+static uint32_t SoftwareCrc32c(uint32_t crc, const uint8_t *next, size_t size)
+{
+  crc ^= 0xffffffff;
+  for(; size > 0; --size)
+    crc = crc32c_table[(crc ^ *next++) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffff;
+}
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size)
+{
+  pthread_once(&crc32c_once, Crc32cInit);
+  return hardware ? HardwareCrc32c(crc, data, size)
+      : SoftwareCrc32c(crc, data, size);
+}
+
+int Crc32cHardware()
+{
+  pthread_once(&crc32c_once, Crc32cInit);
+  return hardware;
+}
@@ -0,0 +1,30 @@
+/*
+ * crc32c (castagnoli polynomial) of the channel data. computed with
+ * sse4.2 crc32 instruction if the cpu has it, otherwise by the table
+ * used by the channels integrity mode (see TrapCrc)
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/*
+ * return crc32c of "size" bytes of "data" continued from "crc" (crc of
+ * the previous data, 0 for the start). thread safe
+ */
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size);
+
+/* return 1 if the hardware crc32c is used, otherwise 0 */
+int Crc32cHardware();
+
+EXTERN_C_END
+
+#endif /* CRC32C_H_ */
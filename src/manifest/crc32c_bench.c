@@ -0,0 +1,91 @@
+/*
+ * cost of the channel integrity mode. the channel i/o is a copy of the
+ * record between the page cache and the user buffer, the integrity mode
+ * adds crc32c of the record. compares memcpy of the records with
+ * crc32c of them and with both (as the trap does)
+ *
+ * usage: crc32c_bench [size in mb] [record in kb] [passes]
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "src/manifest/crc32c.h"
+
+#define DEFAULT_SIZE 256 /* mb */
+#define DEFAULT_RECORD 64 /* kb */
+#define DEFAULT_PASSES 4
+#define MB 0x100000
+
+enum BenchMode {
+  BenchCopy,
+  BenchCrc,
+  BenchCopyCrc
+};
+
+static double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* process the source by records, return throughput in mb/s */
+static double Bench(const char *title, char *source, int64_t size,
+    char *buffer, int record, int passes, enum BenchMode mode)
+{
+  uint32_t crc = 0;
+  double start = Now();
+  double rate;
+  int64_t offset;
+  int i;
+
+  for(i = 0; i < passes; ++i)
+    for(offset = 0; offset + record <= size; offset += record)
+    {
+      if(mode != BenchCrc) memcpy(buffer, source + offset, record);
+      if(mode != BenchCopy)
+        crc = Crc32c(crc, mode == BenchCrc ? source + offset : buffer, record);
+    }
+
+  rate = (double)size * passes / MB / (Now() - start);
+  printf("%-16s %10.1f mb/s (crc %08x)\n", title, rate, crc);
+  return rate;
+}
+
+int main(int argc, char **argv)
+{
+  int64_t size = (int64_t)(argc > 1 ? atoi(argv[1]) : DEFAULT_SIZE) * MB;
+  int record = (argc > 2 ? atoi(argv[2]) : DEFAULT_RECORD) * 1024;
+  int passes = argc > 3 ? atoi(argv[3]) : DEFAULT_PASSES;
+  double copy, crc, both;
+  char *source;
+  char *buffer;
+  int64_t i;
+
+  source = size > 0 ? malloc(size) : NULL;
+  buffer = record > 0 ? malloc(record) : NULL;
+  if(source == NULL || buffer == NULL || passes < 1)
+  {
+    fprintf(stderr, "usage: %s [size in mb] [record in kb] [passes]\n", argv[0]);
+    return 1;
+  }
+  for(i = 0; i < size; ++i) source[i] = (char)(i * 31);
+
+  printf("crc32c engine: %s\n", Crc32cHardware() ? "sse4.2" : "table");
+  copy = Bench("memcpy", source, size, buffer, record, passes, BenchCopy);
+  crc = Bench("crc32c", source, size, buffer, record, passes, BenchCrc);
+  both = Bench("memcpy + crc32c", source, size, buffer, record, passes, BenchCopyCrc);
+
+  /* time of crc in the copy time units */
+  printf("crc32c costs %.0f%% of the memcpy time, copy with crc is %.0f%% slower\n",
+      copy / crc * 100, (copy / both - 1) * 100);
+
+  free(source);
+  free(buffer);
+  return 0;
+}
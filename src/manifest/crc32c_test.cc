@@ -0,0 +1,115 @@
+/*
+ * crc32c_test.cc
+ * crc32c gives the known values, the same crc for the data taken at once
+ * and by parts, at any alignment (hardware blocks and the tail). the
+ * channel copy keeps crc of the integrity mode channels
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "src/manifest/crc32c.h"
+#include "src/manifest/channel_copy.h"
+
+#define DATA_SIZE (3 * 8192 * 2 + 3 * 256 + 77)
+#define IN_FILE "crc32c_test.in"
+#define OUT_FILE "crc32c_test.out"
+
+// bit by bit crc32c
+static uint32_t Reference(uint32_t crc, const unsigned char *data, size_t size)
+{
+  int i;
+
+  crc = ~crc;
+  while(size--)
+  {
+    crc ^= *data++;
+    for(i = 0; i < 8; ++i)
+      crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+  }
+  return ~crc;
+}
+
+// check values of rfc 3720 (iscsi)
+TEST(Crc32c, known_values)
+{
+  unsigned char data[32];
+  int i;
+
+  EXPECT_EQ(0xe3069283u, Crc32c(0, "123456789", 9));
+  EXPECT_EQ(0u, Crc32c(0, "", 0));
+
+  memset(data, 0, sizeof data);
+  EXPECT_EQ(0x8a9136aau, Crc32c(0, data, sizeof data));
+  memset(data, 0xff, sizeof data);
+  EXPECT_EQ(0x62a8ab43u, Crc32c(0, data, sizeof data));
+  for(i = 0; i < 32; ++i) data[i] = i;
+  EXPECT_EQ(0x46dd794eu, Crc32c(0, data, sizeof data));
+}
+
+// long data at any alignment, whole and by parts
+TEST(Crc32c, parts)
+{
+  unsigned char *data = (unsigned char*)malloc(DATA_SIZE + 8);
+  uint32_t crc;
+  int offset;
+  int i;
+
+  ASSERT_TRUE(data != NULL);
+  srand(17);
+  for(i = 0; i < DATA_SIZE + 8; ++i) data[i] = rand();
+
+  for(offset = 0; offset < 8; ++offset)
+  {
+    uint32_t expected = Reference(0, data + offset, DATA_SIZE);
+    EXPECT_EQ(expected, Crc32c(0, data + offset, DATA_SIZE)) << offset;
+
+    // parts of the size channel i/o gives
+    crc = 0;
+    for(i = 0; i < DATA_SIZE; i += 1000 + offset)
+      crc = Crc32c(crc, data + offset + i,
+          DATA_SIZE - i < 1000 + offset ? DATA_SIZE - i : 1000 + offset);
+    EXPECT_EQ(expected, crc) << offset;
+  }
+  free(data);
+}
+
+// channel copy (TrapCopy) of the integrity mode channels updates both crc
+TEST(Crc32c, copy)
+{
+  char data[DATA_SIZE];
+  uint32_t crc_in = 0;
+  uint32_t crc_out;
+  int in, out;
+  int i;
+
+  for(i = 0; i < DATA_SIZE; ++i) data[i] = (char)(i * 7);
+  in = open(IN_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  out = open(OUT_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_TRUE(in >= 0 && out >= 0);
+  ASSERT_EQ(DATA_SIZE, write(in, data, DATA_SIZE));
+
+  // output crc continues the crc of the data written before
+  crc_out = Crc32c(0, data, 100);
+  EXPECT_EQ(DATA_SIZE - 100, CopyChannelData(in, 100, out, 100,
+      DATA_SIZE - 100, 0, &crc_in, &crc_out));
+  EXPECT_EQ(Crc32c(0, data + 100, DATA_SIZE - 100), crc_in);
+  EXPECT_EQ(Crc32c(0, data, DATA_SIZE), crc_out);
+
+  close(in);
+  close(out);
+  unlink(IN_FILE);
+  unlink(OUT_FILE);
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,201 @@
+/*
+ * direct i/o for DIRECT mounted channels. channel file is opened with
+ * O_DIRECT, so data goes past the page cache. aligned parts of user
+ * requests are read/written straight from/to the sandbox memory,
+ * unaligned heads and tails are staged through aligned bounce buffers
+ *
+ *  Created on: May 4, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "src/manifest/direct_io.h"
+
+#define ALIGN_MASK (DIRECT_ALIGN - 1)
+#define IS_ALIGNED(a) ((((uint64_t)(a)) & ALIGN_MASK) == 0)
+#define ROUND_DOWN(a) ((a) & ~(int64_t)ALIGN_MASK)
+#define ROUND_UP(a) ROUND_DOWN((a) + ALIGN_MASK)
+
+/* bounce buffers pool. buffers are allocated on demand */
+static char *bounce[DIRECT_BOUNCE_COUNT];
+static int bounce_busy[DIRECT_BOUNCE_COUNT];
+static pthread_mutex_t bounce_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* take bounce buffer from the pool. return index or -1 */
+static int GetBounce()
+{
+  int i;
+  int result = -1;
+
+  pthread_mutex_lock(&bounce_mutex);
+  for(i = 0; i < DIRECT_BOUNCE_COUNT; ++i)
+  {
+    if(bounce_busy[i]) continue;
+    if(bounce[i] == NULL &&
+        posix_memalign((void**)&bounce[i], DIRECT_ALIGN, DIRECT_BOUNCE_SIZE))
+    {
+      bounce[i] = NULL;
+      break;
+    }
+    bounce_busy[i] = 1;
+    result = i;
+    break;
+  }
+  pthread_mutex_unlock(&bounce_mutex);
+  return result;
+}
+
+/* return bounce buffer to the pool */
+static void PutBounce(int i)
+{
+  pthread_mutex_lock(&bounce_mutex);
+  bounce_busy[i] = 0;
+  pthread_mutex_unlock(&bounce_mutex);
+}
+
+/*
+ * return size of the bounce transfer for the given position. if the user
+ * buffer and the file offset have the same misalignment only the head
+ * (or tail) block is bounced, the rest will be transferred directly
+ */
+static int64_t BounceLength(const char *buffer, int64_t offset, int32_t size)
+{
+  int64_t length = ROUND_UP((offset & ALIGN_MASK) + size);
+
+  if((((uint64_t)buffer - offset) & ALIGN_MASK) == 0) return DIRECT_ALIGN;
+  return length > DIRECT_BOUNCE_SIZE ? DIRECT_BOUNCE_SIZE : length;
+}
+
+/* read from O_DIRECT opened file */
+int32_t DirectRead(int handle, char *buffer, int32_t size, int64_t offset)
+{
+  int32_t done = 0;
+  int b = -1;
+
+  while(done < size)
+  {
+    int64_t pos = offset + done;
+    char *dst = buffer + done;
+    int32_t want = size - done;
+    int64_t aligned, skip, length;
+    ssize_t got;
+
+    /* aligned part: directly to the user memory */
+    if(IS_ALIGNED(pos) && IS_ALIGNED(dst) && want >= DIRECT_ALIGN)
+    {
+      length = ROUND_DOWN(want);
+      got = pread(handle, dst, length, pos);
+      if(got < 0) break;
+      done += got;
+      if(got < length) break; /* end of file */
+      continue;
+    }
+
+    /* unaligned part: through the bounce buffer */
+    if(b < 0 && (b = GetBounce()) < 0) break;
+    aligned = ROUND_DOWN(pos);
+    skip = pos - aligned;
+    length = BounceLength(dst, pos, want);
+    got = pread(handle, bounce[b], length, aligned);
+    if(got <= skip) break;
+
+    got -= skip;
+    if(got > want) got = want;
+    memcpy(dst, bounce[b] + skip, got);
+    done += got;
+    if(skip + got < length) break; /* end of file */
+  }
+
+  if(b >= 0) PutBounce(b);
+  return done > 0 || size < 1 ? done : -1;
+}
+
+/*
+ * read the block at "offset" to "buffer". the part of the block
+ * beyond the end of file is zeroed. return 0 if success
+ */
+static int ReadBlock(int handle, char *buffer, int64_t offset)
+{
+  ssize_t got = pread(handle, buffer, DIRECT_ALIGN, offset);
+  if(got < 0) return -1;
+  memset(buffer + got, 0, DIRECT_ALIGN - got);
+  return 0;
+}
+
+/* write to O_DIRECT opened file */
+int32_t DirectWrite(int handle, const char *buffer, int32_t size, int64_t offset)
+{
+  struct stat fs;
+  int64_t end = 0; /* the end of the written blocks */
+  int32_t done = 0;
+  int b = -1;
+
+  if(fstat(handle, &fs) < 0) return -1;
+
+  while(done < size)
+  {
+    int64_t pos = offset + done;
+    const char *src = buffer + done;
+    int32_t want = size - done;
+    int64_t aligned, skip, length, n;
+    ssize_t put;
+
+    /* aligned part: directly from the user memory */
+    if(IS_ALIGNED(pos) && IS_ALIGNED(src) && want >= DIRECT_ALIGN)
+    {
+      length = ROUND_DOWN(want);
+      put = pwrite(handle, src, length, pos);
+      if(put < 0) break;
+      done += put;
+      if(put < length) break;
+      continue;
+    }
+
+    /* unaligned part: read-modify-write through the bounce buffer */
+    if(b < 0 && (b = GetBounce()) < 0) break;
+    aligned = ROUND_DOWN(pos);
+    skip = pos - aligned;
+    length = BounceLength(src, pos, want);
+    n = length - skip < want ? length - skip : want;
+
+    /* partial head and tail blocks must keep the file content */
+    if(skip && ReadBlock(handle, bounce[b], aligned)) break;
+    if((skip + n) & ALIGN_MASK && (length > DIRECT_ALIGN || !skip)
+        && ReadBlock(handle, bounce[b] + length - DIRECT_ALIGN,
+            aligned + length - DIRECT_ALIGN)) break;
+
+    memcpy(bounce[b] + skip, src, n);
+    put = pwrite(handle, bounce[b], length, aligned);
+    if(put < skip + n) break;
+    done += n;
+    if(aligned + length > end) end = aligned + length;
+  }
+
+  if(b >= 0) PutBounce(b);
+
+  /* the last block was written whole. restore the real file size */
+  if(end > fs.st_size && end > offset + done)
+    if(ftruncate(handle, offset + done > fs.st_size ? offset + done : fs.st_size))
+      return -1;
+
+  return done > 0 || size < 1 ? done : -1;
+}
+
+/* release bounce buffers */
+void DirectFini()
+{
+  int i;
+
+  pthread_mutex_lock(&bounce_mutex);
+  for(i = 0; i < DIRECT_BOUNCE_COUNT; ++i)
+  {
+    free(bounce[i]);
+    bounce[i] = NULL;
+    bounce_busy[i] = 0;
+  }
+  pthread_mutex_unlock(&bounce_mutex);
+}
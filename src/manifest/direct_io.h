@@ -0,0 +1,44 @@
+/*
+ * direct i/o for DIRECT mounted channels. channel file is opened with
+ * O_DIRECT, so data goes past the page cache. aligned parts of user
+ * requests are read/written straight from/to the sandbox memory,
+ * unaligned heads and tails are staged through aligned bounce buffers
+ *
+ *  Created on: May 4, 2012
+ *      Author: d'b
+ */
+
+#ifndef DIRECT_IO_H_
+#define DIRECT_IO_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* alignment of file offsets, sizes and memory required by O_DIRECT */
+#define DIRECT_ALIGN 0x1000
+
+/* bounce buffers pool */
+#define DIRECT_BOUNCE_SIZE 0x100000
+#define DIRECT_BOUNCE_COUNT 4
+
+/*
+ * read "size" bytes from "offset" of O_DIRECT opened file to "buffer"
+ * return amount of read bytes or -1 if failed
+ */
+int32_t DirectRead(int handle, char *buffer, int32_t size, int64_t offset);
+
+/*
+ * write "size" bytes from "buffer" to "offset" of O_DIRECT opened file.
+ * the file size is kept exact (not rounded to DIRECT_ALIGN)
+ * return amount of written bytes or -1 if failed
+ */
+int32_t DirectWrite(int handle, const char *buffer, int32_t size, int64_t offset);
+
+/* release bounce buffers */
+void DirectFini();
+
+EXTERN_C_END
+
+#endif /* DIRECT_IO_H_ */
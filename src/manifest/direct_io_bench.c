@@ -0,0 +1,140 @@
+/*
+ * sequential scan of a channel in LOADED (page cache) and DIRECT modes.
+ * shows throughput and how much of the channel is left in the page cache
+ * (i.e. evicted pages of co-located jobs)
+ *
+ * usage: direct_io_bench [file] [size in mb] [chunk in kb]
+ * if the file does not exist it will be created (and removed at the end)
+ *
+ *  Created on: May 4, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "src/manifest/direct_io.h"
+
+#define DEFAULT_FILE "direct_io_bench.dat"
+#define DEFAULT_SIZE 256 /* mb */
+#define DEFAULT_CHUNK 64 /* kb */
+#define MB 0x100000
+
+static double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* fill the file with data if it is absent */
+static int CreateFile(const char *name, int64_t size, int *created)
+{
+  char buffer[MB];
+  int64_t i;
+  int handle = open(name, O_RDONLY);
+
+  *created = 0;
+  if(handle >= 0) return close(handle);
+
+  handle = open(name, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+  if(handle < 0) return -1;
+  for(i = 0; i < (int64_t)sizeof buffer; ++i) buffer[i] = (char)(i * 31);
+  for(i = 0; i < size; i += sizeof buffer)
+    if(write(handle, buffer, sizeof buffer) != sizeof buffer) return -1;
+  *created = 1;
+  return close(handle);
+}
+
+/* drop the file from the page cache */
+static void DropCache(const char *name)
+{
+  int handle = open(name, O_RDONLY);
+  if(handle < 0) return;
+  fdatasync(handle);
+  posix_fadvise(handle, 0, 0, POSIX_FADV_DONTNEED);
+  close(handle);
+}
+
+/* return percentage of the file pages in the page cache */
+static double Cached(const char *name, int64_t size)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  int64_t pages = (size + page - 1) / page;
+  unsigned char *vec = malloc(pages);
+  int64_t i, resident = 0;
+  void *p;
+  int handle = open(name, O_RDONLY);
+
+  if(handle < 0 || vec == NULL) return -1;
+  p = mmap(NULL, size, PROT_READ, MAP_SHARED, handle, 0);
+  close(handle);
+  if(p == MAP_FAILED) return -1;
+
+  if(mincore(p, size, vec) == 0)
+    for(i = 0; i < pages; ++i) resident += vec[i] & 1;
+  munmap(p, size);
+  free(vec);
+  return 100.0 * resident / pages;
+}
+
+/* read whole file as TrapRead does. "shift" misaligns the user buffer */
+static void Scan(const char *title, const char *name, int direct, int shift, int chunk)
+{
+  char *buffer;
+  int64_t offset = 0;
+  int32_t size;
+  double start;
+  int handle;
+
+  DropCache(name);
+  if(posix_memalign((void**)&buffer, DIRECT_ALIGN, chunk + DIRECT_ALIGN)) return;
+
+  start = Now();
+  handle = open(name, O_RDONLY | (direct ? O_DIRECT : 0));
+  if(handle < 0)
+  {
+    printf("%-24s cannot open (direct i/o is not supported?)\n", title);
+    free(buffer);
+    return;
+  }
+
+  for(;;)
+  {
+    size = direct ? DirectRead(handle, buffer + shift, chunk, offset)
+        : pread(handle, buffer + shift, chunk, offset);
+    if(size < 1) break;
+    offset += size;
+  }
+  close(handle);
+
+  printf("%-24s %8.1f mb/s, cached %5.1f%%\n", title,
+      offset / (Now() - start) / MB, Cached(name, offset));
+  free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+  const char *name = argc > 1 ? argv[1] : DEFAULT_FILE;
+  int64_t size = (int64_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE) * MB;
+  int chunk = (argc > 3 ? atoi(argv[3]) : DEFAULT_CHUNK) * 1024;
+  int created;
+
+  if(size < 1 || chunk < 1 || CreateFile(name, size, &created))
+  {
+    fprintf(stderr, "usage: %s [file] [size in mb] [chunk in kb]\n", argv[0]);
+    return 1;
+  }
+
+  Scan("loaded", name, 0, 0, chunk);
+  Scan("direct, aligned", name, 1, 0, chunk);
+  Scan("direct, unaligned", name, 1, 1, chunk);
+
+  if(created) unlink(name);
+  DirectFini();
+  return 0;
+}
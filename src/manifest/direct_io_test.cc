@@ -0,0 +1,109 @@
+/*
+ * direct_io_test.cc
+ * direct i/o with unaligned offsets, sizes and buffers
+ *
+ *  Created on: May 4, 2012
+ *      Author: d'b
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+#include "src/manifest/direct_io.h"
+
+#define TEST_FILE_SIZE (3 * DIRECT_BOUNCE_SIZE + 123)
+
+// test file opened with O_DIRECT (if fs allows) and buffered. contains
+// pattern of TEST_FILE_SIZE bytes
+class DirectIo : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    strcpy(name, "direct_io_test.XXXXXX");
+    buffered = mkstemp(name);
+    ASSERT_LE(0, buffered);
+    direct = open(name, O_RDWR | O_DIRECT);
+    if(direct < 0) direct = open(name, O_RDWR);
+    ASSERT_LE(0, direct);
+
+    ASSERT_EQ(0, posix_memalign((void**)&pattern, DIRECT_ALIGN, 2 * TEST_FILE_SIZE));
+    ASSERT_EQ(0, posix_memalign((void**)&buffer, DIRECT_ALIGN, 2 * TEST_FILE_SIZE));
+    for(int i = 0; i < 2 * TEST_FILE_SIZE; ++i) pattern[i] = (char)(i * 7 + 1);
+    ASSERT_EQ(TEST_FILE_SIZE, pwrite(buffered, pattern, TEST_FILE_SIZE, 0));
+  }
+
+  virtual void TearDown() {
+    close(direct);
+    close(buffered);
+    unlink(name);
+    free(pattern);
+    free(buffer);
+    DirectFini();
+  }
+
+  int64_t FileSize() {
+    struct stat fs;
+    return fstat(buffered, &fs) < 0 ? -1 : fs.st_size;
+  }
+
+  char name[64];
+  int direct;
+  int buffered;
+  char *pattern;
+  char *buffer;
+};
+
+// aligned, unaligned heads/tails and the end of file
+TEST_F(DirectIo, read)
+{
+  int64_t offsets[] = {0, 1, DIRECT_ALIGN - 1, DIRECT_ALIGN, 3 * DIRECT_ALIGN + 5,
+      TEST_FILE_SIZE - 100};
+  int32_t sizes[] = {1, 100, DIRECT_ALIGN, DIRECT_ALIGN + 1, 2 * DIRECT_BOUNCE_SIZE + 77};
+  int shifts[] = {0, 1, 5};
+
+  for(unsigned o = 0; o < sizeof offsets / sizeof *offsets; ++o)
+    for(unsigned s = 0; s < sizeof sizes / sizeof *sizes; ++s)
+      for(unsigned b = 0; b < sizeof shifts / sizeof *shifts; ++b)
+      {
+        int64_t expected = TEST_FILE_SIZE - offsets[o];
+        if(expected > sizes[s]) expected = sizes[s];
+
+        memset(buffer, 0, 2 * TEST_FILE_SIZE);
+        EXPECT_EQ(expected, DirectRead(direct, buffer + shifts[b], sizes[s], offsets[o]));
+        EXPECT_EQ(0, memcmp(buffer + shifts[b], pattern + offsets[o], expected));
+      }
+
+  // beyond the end
+  EXPECT_EQ(-1, DirectRead(direct, buffer, 100, TEST_FILE_SIZE + DIRECT_ALIGN));
+}
+
+// partial blocks keep the file content, file size stays exact
+TEST_F(DirectIo, write)
+{
+  memset(buffer, 'z', DIRECT_BOUNCE_SIZE);
+
+  // inside the file
+  EXPECT_EQ(100, DirectWrite(direct, buffer + 1, 100, DIRECT_ALIGN + 10));
+  memset(pattern + DIRECT_ALIGN + 10, 'z', 100);
+
+  // aligned middle with unaligned head and tail
+  EXPECT_EQ(3 * DIRECT_ALIGN, DirectWrite(direct, buffer + 7, 3 * DIRECT_ALIGN, 7));
+  memset(pattern + 7, 'z', 3 * DIRECT_ALIGN);
+  EXPECT_EQ(TEST_FILE_SIZE, FileSize());
+
+  // append at unaligned end
+  EXPECT_EQ(1000, DirectWrite(direct, buffer, 1000, TEST_FILE_SIZE));
+  memset(pattern + TEST_FILE_SIZE, 'z', 1000);
+  EXPECT_EQ(TEST_FILE_SIZE + 1000, FileSize());
+
+  EXPECT_EQ(TEST_FILE_SIZE + 1000, pread(buffered, buffer, 2 * TEST_FILE_SIZE, 0));
+  EXPECT_EQ(0, memcmp(buffer, pattern, TEST_FILE_SIZE + 1000));
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
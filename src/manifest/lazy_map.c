@@ -0,0 +1,383 @@
+/*
+ * lazy_map.c
+ * the handler answers the fault with UFFDIO_COPY of the cluster which
+ * starts at the faulted page. the copy stops at the page already present
+ * (EEXIST), so the cluster never overwrites anything. the stream can only
+ * be read in order: the fault fills all pages from the stream position
+ * to the cluster end
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+#include "src/manifest/lazy_map.h"
+#include "src/platform/nacl_log.h"
+
+#define ROUND_PAGE(a) (((a) + LAZY_PAGE - 1) & ~(LAZY_PAGE - 1))
+
+/* segment files of the object: not hidden regular files */
+static int SegmentFilter(const struct dirent *entry)
+{
+  return entry->d_name[0] != '.';
+}
+
+/* open the segments of the object "name". return 0 if success */
+static int OpenSegments(struct LazyMap *map, const char *name)
+{
+  struct dirent **list;
+  int count;
+  int i;
+
+  count = scandir(name, &list, SegmentFilter, alphasort);
+  if(count < 0) return -1;
+  if(count > LAZY_SEGMENTS_MAX) goto fail;
+
+  map->segment_handle = malloc((count + 1) * sizeof *map->segment_handle);
+  map->segment_start = malloc((count + 1) * sizeof *map->segment_start);
+  if(map->segment_handle == NULL || map->segment_start == NULL) goto fail;
+
+  map->segment_start[0] = 0;
+  for(map->segments = 0; map->segments < count; ++map->segments)
+  {
+    char path[PATH_MAX];
+    struct stat st;
+    int handle;
+
+    snprintf(path, sizeof path, "%s/%s", name, list[map->segments]->d_name);
+    handle = open(path, O_RDONLY);
+    if(handle < 0) goto fail;
+    map->segment_handle[map->segments] = handle;
+    if(fstat(handle, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+      ++map->segments; /* to be closed */
+      goto fail;
+    }
+    map->segment_start[map->segments + 1] = map->segment_start[map->segments] + st.st_size;
+  }
+  map->size = map->segment_start[count];
+
+  for(i = 0; i < count; ++i)
+    free(list[i]);
+  free(list);
+  return 0;
+
+fail:
+  for(i = 0; i < count; ++i)
+    free(list[i]);
+  free(list);
+  return -1;
+}
+
+struct LazyMap *LazyMapCtor(const char *name, int32_t cluster)
+{
+  struct LazyMap *map;
+  struct stat st;
+
+  if(name == NULL || stat(name, &st) != 0) return NULL;
+  if((map = calloc(1, sizeof *map)) == NULL) return NULL;
+  map->handle = -1;
+  map->uffd = -1;
+  map->stop[0] = map->stop[1] = -1;
+
+  if(cluster < LAZY_PAGE) cluster = LAZY_PAGE;
+  if(cluster > LAZY_CLUSTER_MAX) cluster = LAZY_CLUSTER_MAX;
+  map->cluster = ROUND_PAGE(cluster);
+
+  if(S_ISDIR(st.st_mode))
+  {
+    map->source = LazySegments;
+    if(OpenSegments(map, name) != 0) goto fail;
+  }
+  else
+  {
+    map->source = S_ISREG(st.st_mode) ? LazyFile : LazyStream;
+    map->size = S_ISREG(st.st_mode) ? st.st_size : -1;
+    map->handle = open(name, O_RDONLY);
+    if(map->handle < 0) goto fail;
+  }
+
+  map->bounce = malloc(map->cluster);
+  if(map->bounce == NULL) goto fail;
+  return map;
+
+fail:
+  NaClLog(LOG_ERROR, "cannot open lazy channel source %s\n", name);
+  LazyMapDtor(map);
+  return NULL;
+}
+
+/* read "size" bytes from "handle" at "offset" (-1 - current position) */
+static ssize_t ReadFully(int handle, char *buffer, size_t size, int64_t offset)
+{
+  size_t done = 0;
+
+  while(done < size)
+  {
+    ssize_t got = offset < 0 ? read(handle, buffer + done, size - done)
+        : pread(handle, buffer + done, size - done, offset + done);
+    if(got < 0 && errno == EINTR) continue;
+    if(got < 0) return -1;
+    if(got == 0) break;
+    done += got;
+  }
+  return done;
+}
+
+/*
+ * read the data at "offset" to the bounce buffer. return the size of the
+ * data (less than "size" at the source end) or -1 if failed
+ */
+static ssize_t Fetch(struct LazyMap *map, int64_t offset, size_t size)
+{
+  int64_t done = 0;
+  int lo, hi;
+
+  switch(map->source)
+  {
+    case LazyFile:
+      return ReadFully(map->handle, map->bounce, size, offset);
+
+    case LazyStream:
+      /* the stream is over at the end or at the error */
+      done = ReadFully(map->handle, map->bounce, size, -1);
+      if(done > 0) map->stream_pos += done;
+      if(done < 0 || (size_t)done < size) map->size = map->stream_pos;
+      return done;
+
+    case LazySegments:
+      /* the segment containing "offset" */
+      for(lo = 0, hi = map->segments; hi - lo > 1;)
+      {
+        int mid = (lo + hi) / 2;
+        if(map->segment_start[mid] <= offset) lo = mid;
+        else hi = mid;
+      }
+      for(; lo < map->segments && (size_t)done < size; ++lo)
+      {
+        int64_t from = offset + done - map->segment_start[lo];
+        int64_t left = map->segment_start[lo + 1] - map->segment_start[lo] - from;
+        ssize_t got;
+
+        if(left <= 0) continue;
+        if(left > (int64_t)size - done) left = size - done;
+        got = ReadFully(map->segment_handle[lo], map->bounce + done, left, from);
+        if(got < 0) return -1;
+        done += got;
+        if(got < left) break;
+      }
+      return done;
+  }
+  return -1;
+}
+
+/* wake the threads waiting for the page (filled by the other fault) */
+static void Wake(struct LazyMap *map, size_t at)
+{
+  struct uffdio_range range;
+
+  range.start = (uintptr_t)map->area + at;
+  range.len = LAZY_PAGE;
+  ioctl(map->uffd, UFFDIO_WAKE, &range);
+}
+
+/*
+ * copy the bounce buffer to the area at "at". return the copied size, it
+ * is less than "size" if the page is present already
+ */
+static size_t Copy(struct LazyMap *map, size_t at, size_t size)
+{
+  struct uffdio_copy copy;
+
+  copy.dst = (uintptr_t)map->area + at;
+  copy.src = (uintptr_t)map->bounce;
+  copy.len = size;
+  copy.mode = 0;
+  copy.copy = 0;
+  if(ioctl(map->uffd, UFFDIO_COPY, &copy) == 0) return size;
+  return copy.copy > 0 ? copy.copy : 0;
+}
+
+/* fill the cluster of the faulted page */
+static void Fill(struct LazyMap *map, uintptr_t address)
+{
+  size_t fault = (address - (uintptr_t)map->area) & ~(size_t)(LAZY_PAGE - 1);
+  size_t at = fault;
+  size_t end = fault + map->cluster;
+
+  ++map->faults;
+  if(end > map->area_size) end = map->area_size;
+
+  /* stream: the pages before the stream position are filled already */
+  if(map->source == LazyStream)
+  {
+    if(fault < (size_t)ROUND_PAGE(map->stream_pos))
+    {
+      Wake(map, fault);
+      return;
+    }
+
+    /* not over yet: read it up to the fault */
+    if(map->size < 0) at = map->stream_pos;
+  }
+
+  while(at < end)
+  {
+    size_t size = end - at < (size_t)map->cluster ? end - at : (size_t)map->cluster;
+    ssize_t got = 0;
+    size_t copied;
+
+    if(map->size < 0 || (int64_t)at < map->size)
+      got = Fetch(map, at, size);
+    if(got < 0)
+    {
+      NaClLog(LOG_ERROR, "lazy channel source error at 0x%lx, errno %d\n", at, errno);
+      ++map->errors;
+      got = 0;
+    }
+    memset(map->bounce + got, 0, size - got);
+
+    copied = Copy(map, at, size);
+    map->pages += copied / LAZY_PAGE;
+    map->bytes += copied < (size_t)got ? copied : (size_t)got;
+    if(copied < size)
+    {
+      Wake(map, fault);
+      break;
+    }
+    at += size;
+  }
+}
+
+/* fault handler thread */
+static void *Handler(void *arg)
+{
+  struct LazyMap *map = arg;
+  struct pollfd fds[2];
+
+  fds[0].fd = map->uffd;
+  fds[0].events = POLLIN;
+  fds[1].fd = map->stop[0];
+  fds[1].events = POLLIN;
+
+  for(;;)
+  {
+    struct uffd_msg msg;
+
+    if(poll(fds, 2, -1) < 0)
+    {
+      if(errno == EINTR) continue;
+      break;
+    }
+    if(fds[1].revents != 0) break;
+    if(read(map->uffd, &msg, sizeof msg) != sizeof msg) continue;
+    if(msg.event == UFFD_EVENT_PAGEFAULT)
+      Fill(map, (uintptr_t)msg.arg.pagefault.address);
+  }
+  return NULL;
+}
+
+/* return userfaultfd or -1. the kernel faults are handled if allowed */
+static int OpenUffd()
+{
+  struct uffdio_api api;
+  int uffd;
+
+  uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+#ifdef UFFD_USER_MODE_ONLY
+  if(uffd < 0 && errno == EPERM)
+  {
+    NaClLog(LOG_WARNING, "userfaultfd is limited to user mode faults\n");
+    uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+  }
+#endif
+  if(uffd < 0) return -1;
+
+  memset(&api, 0, sizeof api);
+  api.api = UFFD_API;
+  if(ioctl(uffd, UFFDIO_API, &api) != 0)
+  {
+    close(uffd);
+    return -1;
+  }
+  return uffd;
+}
+
+int LazyMapStart(struct LazyMap *map, char *area, size_t size)
+{
+  struct uffdio_register reg;
+
+  if(map == NULL || map->running || ((uintptr_t)area & (LAZY_PAGE - 1))) return -1;
+  map->area = area;
+  map->area_size = ROUND_PAGE(size);
+  if(map->area_size == 0) return 0;
+
+  if((map->uffd = OpenUffd()) < 0)
+  {
+    NaClLog(LOG_ERROR, "userfaultfd is not available, errno %d\n", errno);
+    return -1;
+  }
+
+  reg.range.start = (uintptr_t)area;
+  reg.range.len = map->area_size;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+  if(ioctl(map->uffd, UFFDIO_REGISTER, &reg) != 0
+      || (reg.ioctls & ((uint64_t)1 << _UFFDIO_COPY)) == 0
+      || pipe(map->stop) != 0)
+    goto fail;
+
+  if(pthread_create(&map->thread, NULL, Handler, map) != 0) goto fail;
+  map->running = 1;
+  return 0;
+
+fail:
+  NaClLog(LOG_ERROR, "cannot register lazy area, errno %d\n", errno);
+  close(map->uffd);
+  map->uffd = -1;
+  return -1;
+}
+
+void LazyMapStop(struct LazyMap *map)
+{
+  int i;
+
+  if(map == NULL) return;
+  if(map->running)
+  {
+    char c = 0;
+    if(write(map->stop[1], &c, 1) == 1) pthread_join(map->thread, NULL);
+    map->running = 0;
+  }
+
+  /* closing userfaultfd unregisters the area */
+  if(map->uffd >= 0) close(map->uffd);
+  if(map->stop[0] >= 0) close(map->stop[0]);
+  if(map->stop[1] >= 0) close(map->stop[1]);
+  if(map->handle >= 0) close(map->handle);
+  for(i = 0; i < map->segments; ++i)
+    close(map->segment_handle[i]);
+  map->uffd = map->stop[0] = map->stop[1] = map->handle = -1;
+  map->segments = 0;
+}
+
+void LazyMapDtor(struct LazyMap *map)
+{
+  if(map == NULL) return;
+  LazyMapStop(map);
+  free(map->segment_handle);
+  free(map->segment_start);
+  free(map->bounce);
+  free(map);
+}
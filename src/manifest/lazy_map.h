@@ -0,0 +1,93 @@
+/*
+ * lazy channel map. the area is registered with userfaultfd and filled
+ * by the trusted handler thread when touched: the faulted page and the
+ * pages after it (the cluster) are read from the source. the source is
+ * a regular file, a stream (pipe, fifo, socket) read in order or the
+ * directory of segments (object storage stand-in, the object is the
+ * segment files concatenated in the name order)
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#ifndef LAZY_MAP_H_
+#define LAZY_MAP_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* host page. the area is filled by whole pages */
+#define LAZY_PAGE 0x1000
+
+/* default cluster: the faulted page and the neighbours after it */
+#define LAZY_CLUSTER 0x10000
+
+/* the largest cluster */
+#define LAZY_CLUSTER_MAX 0x1000000
+
+/* the most segments of the object */
+#define LAZY_SEGMENTS_MAX 4096
+
+enum LazySource {
+  LazyFile,
+  LazyStream,
+  LazySegments
+};
+
+struct LazyMap
+{
+  enum LazySource source;
+  int64_t size; /* of the data, -1 - not known (stream) */
+  int32_t cluster; /* bytes filled per fault */
+
+  /* source. file and stream use "handle" */
+  int handle;
+  int segments;
+  int *segment_handle;
+  int64_t *segment_start; /* segments + 1 offsets, the last is the size */
+  int64_t stream_pos; /* stream bytes already in the area */
+
+  /* area and the fault handler */
+  char *area;
+  size_t area_size;
+  int uffd;
+  int stop[2]; /* the handler exits when the pipe is written */
+  int running;
+  pthread_t thread;
+  char *bounce; /* the cluster is read here */
+
+  /* statistics */
+  uint32_t faults;
+  uint64_t pages; /* filled (zero tail included) */
+  uint64_t bytes; /* read from the source */
+  uint32_t errors; /* source errors, the pages were zero filled */
+};
+
+/*
+ * open the source "name" and measure it. "cluster" is rounded to the
+ * pages. return the map or NULL if failed
+ */
+struct LazyMap *LazyMapCtor(const char *name, int32_t cluster);
+
+/*
+ * register "area" (page aligned, "size" is rounded up to the page) and
+ * start the fault handler. the area must be the private anonymous mapping
+ * without pages yet. return 0 if success, otherwise -1
+ */
+int LazyMapStart(struct LazyMap *map, char *area, size_t size);
+
+/*
+ * stop the handler and close the source. the statistics are kept. not
+ * filled pages of the area read as zeroes after that
+ */
+void LazyMapStop(struct LazyMap *map);
+
+void LazyMapDtor(struct LazyMap *map);
+
+EXTERN_C_END
+
+#endif /* LAZY_MAP_H_ */
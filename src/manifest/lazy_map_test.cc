@@ -0,0 +1,214 @@
+/*
+ * lazy_map_test.cc
+ * the lazy area reads as its source (file, stream, segments) while the
+ * pages are filled by clusters on faults
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+#include "src/manifest/lazy_map.h"
+
+#define DATA_SIZE 300001 /* not page aligned */
+#define AREA_SIZE 0x60000 /* larger than data */
+
+static char data[DATA_SIZE];
+
+static void MakeData()
+{
+  int i;
+  for(i = 0; i < DATA_SIZE; ++i)
+    data[i] = (char)(i * 7 % 251);
+}
+
+static char *Area()
+{
+  return (char*)mmap(NULL, AREA_SIZE, PROT_READ,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
+
+// the area bytes answer to the data, the tail is zeroes
+static void Check(char *area, int64_t size)
+{
+  int64_t offsets[] = {0, 1, 4095, 4096, 70000, 131071, 200000, 299999, 300000};
+  unsigned i;
+
+  for(i = 0; i < sizeof offsets / sizeof *offsets; ++i)
+  {
+    if(offsets[i] >= size) continue;
+    EXPECT_EQ(data[offsets[i]], area[offsets[i]]) << offsets[i];
+  }
+  EXPECT_EQ(0, area[size]);
+  EXPECT_EQ(0, area[AREA_SIZE - 1]);
+}
+
+// random lookups into the file: one fault per cluster
+TEST(LazyMap, file)
+{
+  char name[] = "/tmp/lazy_map_test.XXXXXX";
+  struct LazyMap *map;
+  char *area = Area();
+  int handle;
+
+  MakeData();
+  handle = mkstemp(name);
+  ASSERT_EQ(DATA_SIZE, write(handle, data, DATA_SIZE));
+  close(handle);
+  ASSERT_TRUE(area != MAP_FAILED);
+
+  map = LazyMapCtor(name, LAZY_CLUSTER);
+  ASSERT_TRUE(map != NULL);
+  EXPECT_EQ(LazyFile, map->source);
+  EXPECT_EQ(DATA_SIZE, map->size);
+  ASSERT_EQ(0, LazyMapStart(map, area, AREA_SIZE));
+
+  // the counters are only read when the handler is stopped
+  EXPECT_EQ(data[100], area[100]);
+  EXPECT_EQ(data[LAZY_CLUSTER - 1], area[LAZY_CLUSTER - 1]);
+  Check(area, DATA_SIZE);
+  EXPECT_EQ(0, memcmp(area, data, DATA_SIZE));
+  LazyMapStop(map);
+  EXPECT_EQ((uint64_t)DATA_SIZE, map->bytes);
+  EXPECT_GT(map->pages, (uint64_t)DATA_SIZE / LAZY_PAGE);
+  EXPECT_LE(map->pages, (uint64_t)AREA_SIZE / LAZY_PAGE);
+  EXPECT_EQ(0u, map->errors);
+  EXPECT_LT(map->faults, (uint32_t)(AREA_SIZE / LAZY_PAGE));
+
+  LazyMapDtor(map);
+  munmap(area, AREA_SIZE);
+  unlink(name);
+}
+
+// single page clusters: only the touched pages are read
+TEST(LazyMap, no_prefetch)
+{
+  char name[] = "/tmp/lazy_map_test.XXXXXX";
+  struct LazyMap *map;
+  char *area = Area();
+  int handle;
+
+  MakeData();
+  handle = mkstemp(name);
+  ASSERT_EQ(DATA_SIZE, write(handle, data, DATA_SIZE));
+  close(handle);
+
+  map = LazyMapCtor(name, 1);
+  ASSERT_TRUE(map != NULL);
+  EXPECT_EQ(LAZY_PAGE, map->cluster);
+  ASSERT_EQ(0, LazyMapStart(map, area, AREA_SIZE));
+  EXPECT_EQ(data[5000], area[5000]);
+  EXPECT_EQ(data[250000], area[250000]);
+  EXPECT_EQ(data[5001], area[5001]);
+  LazyMapStop(map);
+  EXPECT_EQ(2u, map->faults);
+  EXPECT_EQ(2u, map->pages);
+  EXPECT_EQ((uint64_t)2 * LAZY_PAGE, map->bytes);
+
+  LazyMapDtor(map);
+  munmap(area, AREA_SIZE);
+  unlink(name);
+}
+
+static void *Writer(void *arg)
+{
+  int handle = *(int*)arg;
+  int done = 0;
+
+  while(done < DATA_SIZE)
+  {
+    int n = write(handle, data + done, DATA_SIZE - done > 1000 ? 1000 : DATA_SIZE - done);
+    if(n <= 0) break;
+    done += n;
+  }
+  close(handle);
+  return NULL;
+}
+
+// the stream is read in order up to the touched page
+TEST(LazyMap, stream)
+{
+  char name[64];
+  struct LazyMap *map;
+  char *area = Area();
+  pthread_t thread;
+  int pipes[2];
+
+  MakeData();
+  ASSERT_EQ(0, pipe(pipes));
+  snprintf(name, sizeof name, "/dev/fd/%d", pipes[0]);
+  map = LazyMapCtor(name, LAZY_CLUSTER);
+  close(pipes[0]);
+  ASSERT_TRUE(map != NULL);
+  EXPECT_EQ(LazyStream, map->source);
+  EXPECT_EQ(-1, map->size);
+  ASSERT_EQ(0, LazyMapStart(map, area, AREA_SIZE));
+  ASSERT_EQ(0, pthread_create(&thread, NULL, Writer, &pipes[1]));
+
+  EXPECT_EQ(data[200000], area[200000]);
+  EXPECT_EQ(data[10], area[10]);
+  Check(area, DATA_SIZE);
+  pthread_join(thread, NULL);
+
+  LazyMapStop(map);
+  EXPECT_EQ(DATA_SIZE, map->size);
+  EXPECT_EQ((uint64_t)DATA_SIZE, map->bytes);
+  LazyMapDtor(map);
+  munmap(area, AREA_SIZE);
+}
+
+// the object is the segments concatenated in the name order
+TEST(LazyMap, segments)
+{
+  char dir[] = "/tmp/lazy_map_test.XXXXXX";
+  int sizes[] = {5000, 100000, 1, DATA_SIZE - 105001};
+  struct LazyMap *map;
+  char *area = Area();
+  char path[256];
+  int done = 0;
+  int i;
+
+  MakeData();
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  for(i = 0; i < 4; ++i)
+  {
+    int handle;
+    snprintf(path, sizeof path, "%s/%08d", dir, i);
+    handle = open(path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    ASSERT_EQ(sizes[i], write(handle, data + done, sizes[i]));
+    close(handle);
+    done += sizes[i];
+  }
+
+  map = LazyMapCtor(dir, LAZY_CLUSTER);
+  ASSERT_TRUE(map != NULL);
+  EXPECT_EQ(LazySegments, map->source);
+  EXPECT_EQ(4, map->segments);
+  EXPECT_EQ(DATA_SIZE, map->size);
+  ASSERT_EQ(0, LazyMapStart(map, area, AREA_SIZE));
+  Check(area, DATA_SIZE);
+  EXPECT_EQ(0, memcmp(area, data, DATA_SIZE));
+  LazyMapDtor(map);
+  munmap(area, AREA_SIZE);
+
+  for(i = 0; i < 4; ++i)
+  {
+    snprintf(path, sizeof path, "%s/%08d", dir, i);
+    unlink(path);
+  }
+  rmdir(dir);
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
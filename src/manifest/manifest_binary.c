@@ -0,0 +1,396 @@
+/*
+ * manifest_binary.c
+ * all references of the compiled manifest are offsets from the start of
+ * the file, so it is used right where mapped. the mapping is private and
+ * writable: the values are given away as "char*" like the text manifest
+ * values, the page is only copied if somebody writes there
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_parser.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/manifest_binary.h"
+#include "src/platform/nacl_log.h"
+
+/* sections of the compiled manifest */
+#define RECORDS(h) ((struct BinaryRecord*)((h) + 1))
+#define ARGV(h) ((uint32_t*)(RECORDS(h) + (h)->records))
+#define STRINGS(h) ((char*)(ARGV(h) + (h)->argc))
+#define STRING(h, at) ((at) == 0 ? NULL : (char*)(h) + (at))
+
+/* strings of the manifest being compiled */
+struct Strings
+{
+  char *data;
+  uint32_t size;
+  uint32_t allocated;
+  uint32_t base; /* offset of the strings in the file */
+};
+
+/* add the string, return its offset in the file or 0 if "s" is NULL/empty */
+static uint32_t Put(struct Strings *strings, const char *s)
+{
+  uint32_t at = strings->size;
+  uint32_t len;
+
+  if(s == NULL || *s == '\0' || strings->data == NULL) return 0;
+  len = strlen(s) + 1;
+  if(strings->size + len > strings->allocated)
+  {
+    char *p;
+    do strings->allocated *= 2; while(strings->size + len > strings->allocated);
+    p = realloc(strings->data, strings->allocated);
+    if(p == NULL)
+    {
+      free(strings->data);
+      strings->data = NULL;
+      return 0;
+    }
+    strings->data = p;
+  }
+  memcpy(strings->data + at, s, len);
+  strings->size += len;
+  return strings->base + at;
+}
+
+/* add the fixed length field (may be not terminated) */
+static uint32_t PutField(struct Strings *strings, const char *field, size_t size)
+{
+  char s[X_OBJECT_META_TAG_LEN + 1];
+
+  if(size >= sizeof s) size = sizeof s - 1;
+  strncpy(s, field, size);
+  s[size] = '\0';
+  return Put(strings, s);
+}
+
+/* by key, the same keys in the manifest order */
+static int CompareRecords(const void *a, const void *b)
+{
+  const struct MasterManifestRecord *x = *(const struct MasterManifestRecord**)a;
+  const struct MasterManifestRecord *y = *(const struct MasterManifestRecord**)b;
+  int result = strcmp(x->key, y->key);
+  return result != 0 ? result : (x > y) - (x < y);
+}
+
+int BinaryManifestWrite(struct NaClApp *nap, const char *name)
+{
+  struct Manifest *manifest = nap->manifest;
+  struct SystemList *system = manifest->system_setup;
+  struct SetupList *user = manifest->user_setup;
+  struct MasterManifestRecord **sorted;
+  struct BinaryRecord *records;
+  struct BinaryManifest header;
+  struct Strings strings;
+  char *args[BINARY_ARGS_MAX + 1];
+  uint32_t argv[BINARY_ARGS_MAX];
+  char *cmd_line = NULL;
+  char *saveptr;
+  char tmp[PATH_MAX];
+  FILE *f = NULL;
+  uint32_t i;
+  int ok;
+
+  if(name == NULL || manifest == NULL || manifest->binary != NULL
+      || system == NULL || user == NULL) return -1;
+  memset(&header, 0, sizeof header);
+
+  /* nexe command line split the same way zerovm does it */
+  if(get_value_by_key(nap, "CommandLine") != NULL)
+  {
+    if((cmd_line = strdup(get_value_by_key(nap, "CommandLine"))) == NULL) return -1;
+    args[0] = strtok_r(cmd_line, " \t", &saveptr);
+    while(args[header.argc] != NULL && header.argc < BINARY_ARGS_MAX)
+      args[++header.argc] = strtok_r(NULL, " \t", &saveptr);
+    if(args[header.argc] != NULL)
+    {
+      NaClLog(LOG_ERROR, "more than %d nexe arguments\n", BINARY_ARGS_MAX);
+      free(cmd_line);
+      return -1;
+    }
+  }
+
+  header.magic = BINARY_MANIFEST_MAGIC;
+  header.version = BINARY_MANIFEST_VERSION;
+  header.self_size = sizeof header;
+  header.channels = CHANNELS_COUNT;
+  header.records = manifest->master_records;
+  header.strings = (uint32_t)(STRINGS(&header) - (char*)&header);
+
+  strings.base = header.strings;
+  strings.size = 0;
+  strings.allocated = 0x1000;
+  strings.data = malloc(strings.allocated);
+  sorted = malloc((header.records + 1) * sizeof *sorted);
+  records = malloc((header.records + 1) * sizeof *records);
+
+  /* zerovm settings */
+  header.zvm_version = Put(&strings, system->version);
+  header.zerovm = Put(&strings, system->zerovm);
+  header.log = Put(&strings, system->log);
+  header.report = Put(&strings, system->report);
+  header.nexe = Put(&strings, system->nexe);
+  header.blob = Put(&strings, system->blob);
+  header.nexe_etag = Put(&strings, system->nexe_etag);
+  header.syscall_profile = Put(&strings, system->syscall_profile);
+  header.nexe_max = system->nexe_max;
+  header.timeout = system->timeout;
+  header.kill_timeout = system->kill_timeout;
+  header.done_fd = system->done_fd;
+
+  /* user policy */
+  header.max_mem = user->max_mem;
+  header.max_cpu = user->max_cpu;
+  header.max_syscalls = user->max_syscalls;
+  header.max_setup_calls = user->max_setup_calls;
+  header.max_threads = user->max_threads;
+  header.content_type = PutField(&strings, user->content_type, CONTENT_TYPE_LEN);
+  header.timestamp = PutField(&strings, user->timestamp, TIMESTAMP_LEN);
+  header.x_object_meta_tag = PutField(&strings, user->x_object_meta_tag, X_OBJECT_META_TAG_LEN);
+  header.user_etag = PutField(&strings, user->user_etag, USER_TAG_LEN);
+
+  /* channels */
+  for(i = 0; i < CHANNELS_COUNT; ++i)
+  {
+    struct PreOpenedFileDesc *channel = &user->channels[i];
+    struct BinaryChannel *record = &header.channel[i];
+
+    if(!channel->name) continue;
+    record->name = Put(&strings, (char*)channel->name);
+    record->mounted = channel->mounted;
+    record->max_size = channel->max_size;
+    record->max_get_size = channel->max_get_size;
+    record->max_put_size = channel->max_put_size;
+    record->max_gets = channel->max_gets;
+    record->max_puts = channel->max_puts;
+    record->hints = channel->hints;
+    record->prefetch = channel->prefetch;
+    record->window = channel->window;
+    record->integrity = channel->integrity;
+  }
+
+  /* records and the command line */
+  if(sorted != NULL && records != NULL)
+  {
+    for(i = 0; i < header.records; ++i)
+      sorted[i] = &manifest->master[i];
+    qsort(sorted, header.records, sizeof *sorted, CompareRecords);
+    for(i = 0; i < header.records; ++i)
+    {
+      records[i].key = Put(&strings, sorted[i]->key);
+      records[i].value = Put(&strings, sorted[i]->value);
+    }
+  }
+  for(i = 0; i < header.argc; ++i)
+    argv[i] = Put(&strings, args[i]);
+  header.size = header.strings + strings.size;
+
+  /* other jobs may use the manifest right now: write aside and replace */
+  snprintf(tmp, sizeof tmp, "%s.%d", name, getpid());
+  ok = sorted != NULL && records != NULL && strings.data != NULL
+      && (f = fopen(tmp, "wb")) != NULL;
+  if(ok)
+  {
+    ok = fwrite(&header, sizeof header, 1, f) == 1
+        && fwrite(records, sizeof *records, header.records, f) == header.records
+        && fwrite(argv, sizeof *argv, header.argc, f) == header.argc
+        && fwrite(strings.data, 1, strings.size, f) == strings.size;
+    ok = fclose(f) == 0 && ok;
+  }
+  free(sorted);
+  free(records);
+  free(strings.data);
+  free(cmd_line);
+
+  if(!ok || rename(tmp, name) != 0)
+  {
+    NaClLog(LOG_ERROR, "cannot write compiled manifest %s\n", name);
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/* return non-zero if the string offset is broken */
+static int BadString(const struct BinaryManifest *bm, uint32_t at)
+{
+  return at != 0 && (at < bm->strings || at >= bm->size);
+}
+
+/* return 0 if all the offsets point to the strings */
+static int CheckStrings(const struct BinaryManifest *bm)
+{
+  uint32_t fields[] = {bm->zvm_version, bm->zerovm, bm->log, bm->report,
+      bm->nexe, bm->blob, bm->nexe_etag, bm->syscall_profile, bm->content_type,
+      bm->timestamp, bm->x_object_meta_tag, bm->user_etag};
+  uint32_t i;
+
+  for(i = 0; i < sizeof fields / sizeof *fields; ++i)
+    if(BadString(bm, fields[i])) return -1;
+  for(i = 0; i < CHANNELS_COUNT; ++i)
+    if(BadString(bm, bm->channel[i].name)) return -1;
+  for(i = 0; i < bm->records; ++i)
+    if(RECORDS(bm)[i].key == 0 || RECORDS(bm)[i].value == 0
+        || BadString(bm, RECORDS(bm)[i].key) || BadString(bm, RECORDS(bm)[i].value))
+      return -1;
+  for(i = 0; i < bm->argc; ++i)
+    if(ARGV(bm)[i] == 0 || BadString(bm, ARGV(bm)[i])) return -1;
+  return 0;
+}
+
+int BinaryManifestMap(const char *name, struct NaClApp *nap)
+{
+  struct BinaryManifest *bm;
+  struct stat st;
+  uint32_t magic;
+  void *p;
+  int handle;
+
+  /* the text manifest goes to the parser */
+  if((handle = open(name, O_RDONLY)) < 0) return -1;
+  if(pread(handle, &magic, sizeof magic, 0) != sizeof magic
+      || magic != BINARY_MANIFEST_MAGIC)
+  {
+    close(handle);
+    return -1;
+  }
+
+  if(fstat(handle, &st) != 0 || st.st_size < (off_t)sizeof *bm
+      || st.st_size > MAX_MAP_SIZE)
+  {
+    close(handle);
+    NaClLog(LOG_ERROR, "compiled manifest %s is broken\n", name);
+    return 0;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+  close(handle);
+  if(p == MAP_FAILED) return 0;
+
+  /* sections must fit and the strings must be terminated */
+  bm = p;
+  if(bm->version != BINARY_MANIFEST_VERSION || bm->self_size != sizeof *bm
+      || bm->channels != CHANNELS_COUNT || bm->size != st.st_size
+      || bm->records == 0 || bm->records > bm->size || bm->argc > BINARY_ARGS_MAX
+      || STRINGS(bm) > (char*)p + bm->size || STRINGS(bm) - (char*)p != bm->strings
+      || ((char*)p)[bm->size - 1] != '\0' || CheckStrings(bm) != 0)
+  {
+    NaClLog(LOG_ERROR, "compiled manifest %s is broken\n", name);
+    munmap(p, st.st_size);
+    return 0;
+  }
+
+  if((nap->manifest = calloc(1, sizeof *nap->manifest)) == NULL)
+  {
+    munmap(p, st.st_size);
+    return 0;
+  }
+  nap->manifest->binary = bm;
+  nap->manifest->master_records = bm->records;
+  return bm->records;
+}
+
+void BinaryManifestUnmap(struct BinaryManifest *bm)
+{
+  if(bm != NULL) munmap(bm, bm->size);
+}
+
+char *BinaryManifestGet(const struct BinaryManifest *bm, const char *key)
+{
+  const struct BinaryRecord *records = RECORDS(bm);
+  uint32_t lo = 0, hi = bm->records;
+
+  /* the first record with the key */
+  while(lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if(strcmp((char*)bm + records[mid].key, key) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  if(lo < bm->records && strcmp((char*)bm + records[lo].key, key) == 0)
+    return STRING(bm, records[lo].value);
+  return NULL;
+}
+
+void BinaryUserPolicy(const struct BinaryManifest *bm, struct SetupList *policy)
+{
+  policy->max_cpu = bm->max_cpu;
+  policy->max_mem = bm->max_mem;
+  policy->max_setup_calls = bm->max_setup_calls;
+  policy->max_syscalls = bm->max_syscalls;
+  policy->max_threads = bm->max_threads;
+
+#define STRNCPY_SET(a, at, n) if(at) strncpy(a, (char*)bm + (at), n);
+  STRNCPY_SET(policy->content_type, bm->content_type, CONTENT_TYPE_LEN);
+  STRNCPY_SET(policy->timestamp, bm->timestamp, TIMESTAMP_LEN);
+  STRNCPY_SET(policy->x_object_meta_tag, bm->x_object_meta_tag, X_OBJECT_META_TAG_LEN);
+  STRNCPY_SET(policy->user_etag, bm->user_etag, USER_TAG_LEN);
+#undef STRNCPY_SET
+}
+
+void BinarySystemPolicy(const struct BinaryManifest *bm, struct SystemList *policy)
+{
+  policy->version = STRING(bm, bm->zvm_version);
+  policy->zerovm = STRING(bm, bm->zerovm);
+  policy->log = STRING(bm, bm->log);
+  policy->report = STRING(bm, bm->report);
+  policy->nexe = STRING(bm, bm->nexe);
+  policy->blob = STRING(bm, bm->blob);
+  policy->nexe_etag = STRING(bm, bm->nexe_etag);
+  policy->syscall_profile = STRING(bm, bm->syscall_profile);
+  policy->nexe_max = bm->nexe_max;
+  policy->timeout = bm->timeout;
+  policy->kill_timeout = bm->kill_timeout;
+  policy->done_fd = bm->done_fd;
+}
+
+int32_t BinaryConstructChannel(const struct BinaryManifest *bm,
+    struct PreOpenedFileDesc *channel, enum ChannelType ch)
+{
+  const struct BinaryChannel *record = &bm->channel[ch];
+
+  channel->self_size = sizeof *channel;
+  channel->name = (uint64_t)(uintptr_t)STRING(bm, record->name);
+  if(!channel->name) return 1;
+  channel->mounted = record->mounted;
+  channel->type = ch;
+
+  channel->max_size = record->max_size;
+  channel->max_get_size = record->max_get_size;
+  channel->max_gets = record->max_gets;
+  channel->max_put_size = record->max_put_size;
+  channel->max_puts = record->max_puts;
+  channel->prefetch = record->prefetch;
+  channel->window = record->window;
+  channel->hints = record->hints;
+  channel->integrity = record->integrity;
+
+  channel->crc_get = 0;
+  channel->crc_put = 0;
+  channel->cnt_get_size = 0;
+  channel->cnt_gets = 0;
+  channel->cnt_put_size = 0;
+  channel->cnt_puts = 0;
+  channel->high_water = -1;
+  return 0;
+}
+
+int BinaryCommandLine(const struct BinaryManifest *bm, char **argv)
+{
+  uint32_t i;
+
+  for(i = 0; i < bm->argc; ++i)
+    argv[i] = STRING(bm, ARGV(bm)[i]);
+  argv[i] = NULL;
+  return bm->argc;
+}
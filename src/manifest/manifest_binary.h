@@ -0,0 +1,136 @@
+/*
+ * compiled (binary) manifest. the text manifest converted by
+ * zerovm-manifest-compile: the settings zerovm needs are stored as the
+ * typed fields (SystemList, SetupList, channels, nexe command line), all
+ * key/value records are kept sorted for get_value_by_key(). the file is
+ * mapped as is and used without parsing
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#ifndef MANIFEST_BINARY_H_
+#define MANIFEST_BINARY_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+#include "api/zvm.h"
+
+EXTERN_C_BEGIN
+
+struct NaClApp;
+struct SystemList;
+
+#define BINARY_MANIFEST_MAGIC 0x464e4d5a /* "ZMNF" */
+#define BINARY_MANIFEST_VERSION 1
+
+/* nexe command line arguments. nexe_argv also has argv[0] and NULL */
+#define BINARY_ARGS_MAX 126
+
+/* strings are the offsets from the start of the file, 0 - not set */
+struct BinaryChannel
+{
+  uint32_t name; /* 0 - channel is not in the manifest */
+  int32_t mounted;
+  int64_t max_size;
+  int64_t max_get_size;
+  int64_t max_put_size;
+  int32_t max_gets;
+  int32_t max_puts;
+  int32_t hints;
+  int32_t prefetch;
+  int32_t window;
+  int32_t integrity;
+};
+
+struct BinaryRecord
+{
+  uint32_t key;
+  uint32_t value;
+};
+
+/*
+ * layout: header, records (sorted by key, the first of the same keys
+ * goes first), command line, strings
+ */
+struct BinaryManifest
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t self_size; /* of this header, the layout check */
+  uint32_t size; /* of the whole file */
+  uint32_t channels; /* CHANNELS_COUNT */
+  uint32_t records;
+  uint32_t argc;
+  uint32_t strings; /* offset of the strings */
+
+  /* SystemList */
+  uint32_t zvm_version;
+  uint32_t zerovm;
+  uint32_t log;
+  uint32_t report;
+  uint32_t nexe;
+  uint32_t blob;
+  uint32_t nexe_etag;
+  uint32_t syscall_profile;
+  int32_t nexe_max;
+  int32_t timeout;
+  int32_t kill_timeout;
+  int32_t done_fd;
+
+  /* SetupList */
+  uint32_t max_mem;
+  int32_t max_cpu;
+  int32_t max_syscalls;
+  int32_t max_setup_calls;
+  int32_t max_threads;
+  uint32_t content_type;
+  uint32_t timestamp;
+  uint32_t x_object_meta_tag;
+  uint32_t user_etag;
+  uint32_t reserved;
+
+  struct BinaryChannel channel[CHANNELS_COUNT];
+};
+
+/*
+ * write the compiled manifest "name" from the text manifest of "nap". user
+ * and system policies must be set up and the channels constructed
+ * return 0 if success, otherwise -1
+ */
+int BinaryManifestWrite(struct NaClApp *nap, const char *name);
+
+/*
+ * map the compiled manifest "name" to "nap" (in place of parse_manifest)
+ * return count of records, 0 if the manifest is broken, -1 if the file is
+ * not a compiled manifest
+ */
+int BinaryManifestMap(const char *name, struct NaClApp *nap);
+
+void BinaryManifestUnmap(struct BinaryManifest *bm);
+
+/* return value by key or NULL */
+char *BinaryManifestGet(const struct BinaryManifest *bm, const char *key);
+
+/* set limits and custom attributes of the user policy */
+void BinaryUserPolicy(const struct BinaryManifest *bm, struct SetupList *policy);
+
+/* set zerovm settings (the command line is set by BinaryCommandLine) */
+void BinarySystemPolicy(const struct BinaryManifest *bm, struct SystemList *policy);
+
+/*
+ * set the channel from the compiled record (the same as ConstructChannel)
+ * return 0 if the channel is set in manifest, otherwise - 1
+ */
+int32_t BinaryConstructChannel(const struct BinaryManifest *bm,
+    struct PreOpenedFileDesc *channel, enum ChannelType ch);
+
+/*
+ * put the nexe arguments (BINARY_ARGS_MAX at most) and NULL to "argv"
+ * return count of arguments
+ */
+int BinaryCommandLine(const struct BinaryManifest *bm, char **argv);
+
+EXTERN_C_END
+
+#endif /* MANIFEST_BINARY_H_ */
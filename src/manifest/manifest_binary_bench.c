@@ -0,0 +1,138 @@
+/*
+ * job startup cost of the manifest: text manifest (fread, strtok, key
+ * lookups, channel keys built with sprintf) against the compiled one
+ * (mmap and the typed fields). each load sets up the policies, the nexe
+ * command line and all channels, as zerovm does before the nexe start
+ *
+ * usage: manifest_binary_bench [loads]
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_parser.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/manifest_binary.h"
+
+#define TEXT_FILE "/tmp/manifest_binary_bench.manifest"
+#define BINARY_FILE "/tmp/manifest_binary_bench.binary"
+#define DEFAULT_LOADS 20000
+
+static double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the manifest of the usual job: all channels, limits, attributes */
+static int CreateManifest(const char *name)
+{
+  char *prefixes[] = CHANNEL_PREFIXES;
+  FILE *f = fopen(name, "w");
+  int i;
+
+  if(f == NULL) return -1;
+  fprintf(f, "Version = %s\nNexe = /tmp/job.nexe\nNexeMax = 33554432\n"
+      "Log = /tmp/job.log\nReport = /tmp/job.report\nTimeout = 60\n"
+      "KillTimeout = 70\nMemMax = 268435456\nCPUMax = 30000\n"
+      "SyscallsMax = 1000000\nSetupCallsMax = 10\nThreadsMax = 4\n"
+      "ContentType = application/octet-stream\nTimeStamp = 1337000000\n"
+      "XObjectMetaTag = node-17 part-0042 of 0128\nUserETag = none\n"
+      "CommandLine = -v --input /dev/input --output /dev/output -k 12 --sort\n",
+      MANIFEST_VERSION);
+  for(i = 0; i < CHANNELS_COUNT; ++i)
+    fprintf(f, "%s = /tmp/job.%s\n%sMode = %d\n%sMax = 1073741824\n"
+        "%sMaxGet = 1073741824\n%sMaxGetCnt = 65536\n%sMaxPut = 1073741824\n"
+        "%sMaxPutCnt = 65536\n%sPrefetch = 4\n%sHint = sequential willneed\n",
+        prefixes[i], prefixes[i], prefixes[i], i == 0 ? 1 : 0, prefixes[i],
+        prefixes[i], prefixes[i], prefixes[i], prefixes[i], prefixes[i], prefixes[i]);
+  return fclose(f);
+}
+
+/* load the manifest like zerovm LoadManifest() and the channels setup */
+static int Load(struct NaClApp *nap, const char *name)
+{
+  char *argv[BINARY_ARGS_MAX + 2];
+  char *saveptr;
+  char *cmd_line;
+  enum ChannelType ch;
+  int argc = 1;
+
+  if(!parse_manifest(name, nap)) return -1;
+  SetupUserPolicy(nap);
+  SetupSystemPolicy(nap);
+
+  if(nap->manifest->binary != NULL)
+    argc += BinaryCommandLine(nap->manifest->binary, argv + 1);
+  else
+  {
+    cmd_line = get_value_by_key(nap, "CommandLine");
+    argv[argc] = cmd_line ? strtok_r(cmd_line, " \t", &saveptr) : NULL;
+    while(argv[argc] && argc <= BINARY_ARGS_MAX)
+      argv[++argc] = strtok_r(NULL, " \t", &saveptr);
+  }
+
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+    ConstructChannel(nap, ch);
+  return argc;
+}
+
+static double Bench(const char *title, const char *name, int loads)
+{
+  static struct NaClApp nap;
+  double start = Now();
+  double us;
+  int i;
+
+  for(i = 0; i < loads; ++i)
+  {
+    if(Load(&nap, name) < 0)
+    {
+      fprintf(stderr, "cannot load %s\n", name);
+      return -1;
+    }
+    free_manifest(&nap);
+  }
+
+  us = (Now() - start) * 1e6 / loads;
+  printf("%-18s %8.2f us per job\n", title, us);
+  return us;
+}
+
+int main(int argc, char **argv)
+{
+  static struct NaClApp nap;
+  int loads = argc > 1 ? atoi(argv[1]) : DEFAULT_LOADS;
+  enum ChannelType ch;
+  double text, binary;
+
+  if(loads < 1 || CreateManifest(TEXT_FILE) != 0)
+  {
+    fprintf(stderr, "usage: %s [loads]\n", argv[0]);
+    return 1;
+  }
+
+  /* compile it as zerovm-manifest-compile does */
+  if(!parse_manifest(TEXT_FILE, &nap)) return 1;
+  SetupUserPolicy(&nap);
+  SetupSystemPolicy(&nap);
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+    ConstructChannel(&nap, ch);
+  if(BinaryManifestWrite(&nap, BINARY_FILE) != 0) return 1;
+  free_manifest(&nap);
+
+  text = Bench("text manifest", TEXT_FILE, loads);
+  binary = Bench("compiled manifest", BINARY_FILE, loads);
+  if(text > 0 && binary > 0) printf("speedup %.1fx\n", text / binary);
+
+  unlink(TEXT_FILE);
+  unlink(BINARY_FILE);
+  return 0;
+}
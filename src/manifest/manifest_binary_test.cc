@@ -0,0 +1,204 @@
+/*
+ * manifest_binary_test.cc
+ * the compiled manifest answers to the text one: the same settings,
+ * channels, command line and records. the broken one is refused
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_parser.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/manifest_binary.h"
+
+#define TEXT_FILE "manifest_binary_test.manifest"
+#define BINARY_FILE "manifest_binary_test.binary"
+
+static struct NaClApp text;
+static struct NaClApp binary;
+
+// write the text manifest
+static void WriteText(const char *body)
+{
+  FILE *f = fopen(TEXT_FILE, "w");
+  ASSERT_TRUE(f != NULL);
+  fprintf(f, "Version = %s\n%s", MANIFEST_VERSION, body);
+  fclose(f);
+}
+
+// parse and set up the manifest as zerovm does, return the nexe arguments count
+static int Load(struct NaClApp *nap, const char *name, char **argv)
+{
+  char *saveptr;
+  char *cmd_line;
+  int ch;
+  int argc = 0;
+
+  if(!parse_manifest(name, nap)) return -1;
+  SetupUserPolicy(nap);
+  SetupSystemPolicy(nap);
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+    ConstructChannel(nap, (enum ChannelType)ch);
+
+  if(nap->manifest->binary != NULL)
+    return BinaryCommandLine(nap->manifest->binary, argv);
+  cmd_line = get_value_by_key(nap, (char*)"CommandLine");
+  argv[argc] = cmd_line ? strtok_r(cmd_line, " \t", &saveptr) : NULL;
+  while(argv[argc])
+    argv[++argc] = strtok_r(NULL, " \t", &saveptr);
+  return argc;
+}
+
+// compile the text manifest as zerovm-manifest-compile does
+static int Compile(const char *name, const char *compiled)
+{
+  static struct NaClApp nap;
+  int ch;
+  int code;
+
+  if(!parse_manifest(name, &nap)) return -1;
+  SetupUserPolicy(&nap);
+  SetupSystemPolicy(&nap);
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+    ConstructChannel(&nap, (enum ChannelType)ch);
+  code = BinaryManifestWrite(&nap, compiled);
+  free_manifest(&nap);
+  return code;
+}
+
+#define EXPECT_SAME_STR(a, b) \
+  do { \
+    if((a) == NULL || (b) == NULL) EXPECT_EQ((a) == NULL, (b) == NULL); \
+    else EXPECT_STREQ(a, b); \
+  } while(0)
+
+// compiled manifest gives the same job as the text one
+TEST(BinaryManifest, same_as_text)
+{
+  char *text_argv[BINARY_ARGS_MAX + 1];
+  char *binary_argv[BINARY_ARGS_MAX + 1];
+  struct SystemList *ts, *bs;
+  struct SetupList *tu, *bu;
+  int argc;
+  int i;
+
+  WriteText("Nexe = /tmp/a.nexe\nNexeMax = 1000\nTimeout = 50\nDoneFd = 7\n"
+      "MemMax = 268435456\nThreadsMax = 3\nContentType = text/plain\n"
+      "XObjectMetaTag = tag\nCommandLine = -a  b\tc\nCustom = 1\nCustom = 2\n"
+      "Input = /tmp/in\nInputMode = 4\nInputMax = 100\nInputMaxGetCnt = 5\n"
+      "InputHint = random, willneed\nInputPrefetch = 2\nInputIntegrity = 1\n"
+      "UserLog = /tmp/log\nUserLogMaxPut = 77\n");
+  ASSERT_EQ(0, Compile(TEXT_FILE, BINARY_FILE));
+  argc = Load(&text, TEXT_FILE, text_argv);
+  ASSERT_EQ(3, argc);
+  ASSERT_EQ(argc, Load(&binary, BINARY_FILE, binary_argv));
+  ASSERT_TRUE(binary.manifest->binary != NULL);
+  EXPECT_EQ(text.manifest->master_records, binary.manifest->master_records);
+
+  // settings
+  ts = text.manifest->system_setup;
+  bs = binary.manifest->system_setup;
+  EXPECT_SAME_STR(ts->version, bs->version);
+  EXPECT_SAME_STR(ts->nexe, bs->nexe);
+  EXPECT_SAME_STR(ts->log, bs->log);
+  EXPECT_SAME_STR(ts->report, bs->report);
+  EXPECT_EQ(ts->nexe_max, bs->nexe_max);
+  EXPECT_EQ(ts->timeout, bs->timeout);
+  EXPECT_EQ(7, bs->done_fd);
+
+  tu = text.manifest->user_setup;
+  bu = binary.manifest->user_setup;
+  EXPECT_EQ(tu->max_mem, bu->max_mem);
+  EXPECT_EQ(3, bu->max_threads);
+  EXPECT_STREQ("text/plain", bu->content_type);
+  EXPECT_STREQ("tag", bu->x_object_meta_tag);
+  EXPECT_EQ(0, bu->timestamp[0]);
+
+  // channels
+  for(i = 0; i < CHANNELS_COUNT; ++i)
+  {
+    struct PreOpenedFileDesc *t = &tu->channels[i];
+    struct PreOpenedFileDesc *b = &bu->channels[i];
+
+    EXPECT_SAME_STR((char*)t->name, (char*)b->name);
+    EXPECT_EQ(t->mounted, b->mounted) << i;
+    EXPECT_EQ(t->type, b->type) << i;
+    EXPECT_EQ(t->max_size, b->max_size) << i;
+    EXPECT_EQ(t->max_gets, b->max_gets) << i;
+    EXPECT_EQ(t->max_put_size, b->max_put_size) << i;
+    EXPECT_EQ(t->hints, b->hints) << i;
+    EXPECT_EQ(t->prefetch, b->prefetch) << i;
+    EXPECT_EQ(t->integrity, b->integrity) << i;
+  }
+  EXPECT_EQ(HintRandom | HintWillNeed, bu->channels[InputChannel].hints);
+  EXPECT_EQ(1, bu->channels[InputChannel].integrity);
+  EXPECT_EQ(0u, bu->channels[OutputChannel].name);
+
+  // command line and records
+  for(i = 0; i <= argc; ++i)
+    EXPECT_SAME_STR(text_argv[i], binary_argv[i]);
+  EXPECT_STREQ("1", get_value_by_key(&binary, (char*)"Custom"));
+  EXPECT_STREQ("/tmp/in", get_value_by_key(&binary, (char*)"Input"));
+  EXPECT_STREQ("4", get_value_by_key(&binary, (char*)"InputMode"));
+  EXPECT_EQ(NULL, get_value_by_key(&binary, (char*)"Output"));
+  EXPECT_EQ(NULL, get_value_by_key(&binary, (char*)"zzz"));
+
+  free_manifest(&text);
+  free_manifest(&binary);
+  EXPECT_EQ(NULL, binary.manifest);
+}
+
+// damaged file is refused, the text manifest is not taken for compiled
+TEST(BinaryManifest, broken)
+{
+  struct BinaryManifest header;
+  FILE *f;
+  long size;
+
+  WriteText("Nexe = /tmp/a.nexe\n");
+  EXPECT_EQ(-1, BinaryManifestMap(TEXT_FILE, &binary));
+  ASSERT_EQ(0, Compile(TEXT_FILE, BINARY_FILE));
+
+  // truncated
+  f = fopen(BINARY_FILE, "r+");
+  ASSERT_TRUE(f != NULL);
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  ASSERT_EQ(0, ftruncate(fileno(f), size - 1));
+  EXPECT_EQ(0, BinaryManifestMap(BINARY_FILE, &binary));
+
+  // string outside of the file
+  ASSERT_EQ(0, ftruncate(fileno(f), size));
+  fseek(f, 0, SEEK_SET);
+  ASSERT_EQ(1u, fread(&header, sizeof header, 1, f));
+  header.nexe = size + 10;
+  fseek(f, 0, SEEK_SET);
+  ASSERT_EQ(1u, fwrite(&header, sizeof header, 1, f));
+  fflush(f);
+  EXPECT_EQ(0, BinaryManifestMap(BINARY_FILE, &binary));
+
+  // other layout
+  header.nexe = 0;
+  header.channels = CHANNELS_COUNT + 1;
+  fseek(f, 0, SEEK_SET);
+  ASSERT_EQ(1u, fwrite(&header, sizeof header, 1, f));
+  fclose(f);
+  EXPECT_EQ(0, BinaryManifestMap(BINARY_FILE, &binary));
+  EXPECT_EQ(0, parse_manifest(BINARY_FILE, &binary));
+
+  unlink(TEXT_FILE);
+  unlink(BINARY_FILE);
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,59 @@
+/*
+ * zerovm-manifest-compile: convert the text manifest to the compiled
+ * (binary) one. the text is parsed and the policies are set up by the
+ * same code zerovm uses, so both manifests answer to the same job
+ *
+ * usage: zerovm-manifest-compile <text manifest> <compiled manifest>
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/manifest_parser.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/manifest_binary.h"
+
+int main(int argc, char **argv)
+{
+  static struct NaClApp nap;
+  enum ChannelType ch;
+  int code;
+
+  if(argc != 3)
+  {
+    fprintf(stderr, "usage: %s <text manifest> <compiled manifest>\n", argv[0]);
+    return 1;
+  }
+
+  if(!parse_manifest(argv[1], &nap))
+  {
+    fprintf(stderr, "Invalid manifest file \"%s\".\n", argv[1]);
+    return 1;
+  }
+  if(nap.manifest->binary != NULL)
+  {
+    fprintf(stderr, "%s is compiled already\n", argv[1]);
+    free_manifest(&nap);
+    return 1;
+  }
+
+  SetupUserPolicy(&nap);
+  SetupSystemPolicy(&nap);
+  if(nap.manifest->system_setup->version == NULL
+      || strcmp(nap.manifest->system_setup->version, MANIFEST_VERSION))
+  {
+    fprintf(stderr, "%s: wrong manifest version\n", argv[1]);
+    free_manifest(&nap);
+    return 1;
+  }
+  for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+    ConstructChannel(&nap, ch);
+
+  code = BinaryManifestWrite(&nap, argv[2]);
+  if(code != 0) fprintf(stderr, "cannot write %s\n", argv[2]);
+  free_manifest(&nap);
+  return code != 0;
+}
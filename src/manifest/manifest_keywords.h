@@ -17,14 +17,18 @@ enum IOKeys {
   InputMaxGetCnt, /* how many times allowed to invoke "get" syscall. n/a for mounted resiources */
   InputMaxPut, /* n/a */
   InputMaxPutCnt, /* n/a */
-  InputMode, /* 0 - premounted channel, 1 - preloaded, 2 - preallocated from network */
+  InputMode, /* 0 - premounted channel, 1 - preloaded, 2 - preallocated from network, 3 - direct */
+  InputHint, /* access pattern hints: sequential, random, willneed, dontneed */
+  InputPrefetch, /* megabytes to read ahead of the user, 0 - disabled */
+  InputWindow, /* megabytes of premounted channel mapped at once, 0 - whole channel */
   Output, /* name of the output channel/file */
   OutputMax, /* channel/file length limit */
   OutputMaxGet, /* bytes count allowed to get */
   OutputMaxGetCnt, /* how many times allowed to invoke "get" syscall. n/a for mounted resiources */
   OutputMaxPut, /* bytes count allowed to put */
   OutputMaxPutCnt, /* how many times allowed to invoke "put" syscall. n/a for mounted resiources */
-  OutputMode, /* 0 - premounted channel, 1 - preloaded, 2 - preallocated from network */
+  OutputMode, /* 0 - premounted channel, 1 - preloaded, 2 - preallocated from network, 3 - direct */
+  OutputHint, /* access pattern hints: sequential, random, dontneed */
   UserLog, /* user log file name. gets/puts/e.t.c. are unlimited */
   UserLogMax, /* file length limit */
   UserMaxLogGet, /* n/a */
@@ -77,9 +81,10 @@ enum Control {
   Timeout, /* maximum zerovm time to run */
   KillTimeout, /* zerovm time to live */
   MemMax, /* size of memory available for nexe */
-  CPUMax, /* cpu time allotted to nexe */
+  CPUMax, /* cpu time allotted to nexe (milliseconds, all threads) */
   SyscallsMax, /* syscalls allowed nexe to invoke */
   SetupCallsMax, /* setup calls allowed nexe to invoke */
+  ThreadsMax, /* user threads allowed (main thread included), 0 - single threaded */
   Blob, /* blob library if it will retain */
   CommandLine /* command line for nexe */
 };
@@ -25,12 +25,18 @@
  */
 #include "src/manifest/manifest_parser.h"
 #include "src/manifest/manifest_setup.h"
+#include "src/manifest/manifest_binary.h"
 
 
 /* public function. return value from manifest by given key */
 char* get_value_by_key(struct NaClApp *nap, char *key)
 {
 	int i;
+
+	/* d'b: compiled manifest records are sorted */
+	if(nap->manifest->binary != NULL)
+		return BinaryManifestGet(nap->manifest->binary, key);
+
 	for(i = 0; i < nap->manifest->master_records; ++i)
 	{
 		if(strcmp(key, nap->manifest->master[i].key) == 0)
@@ -106,10 +112,15 @@ int parse_manifest(const char *name, struct NaClApp *nap)
 {
 	char *str = NULL;
 	char *p;
+	char *saveptr;
 	int count = 0;
 	int size;
 	FILE *f = NULL;
 
+	/* d'b: compiled manifest is mapped and used as is */
+	if((count = BinaryManifestMap(name, nap)) >= 0) return count;
+	count = 0;
+
 	/* get manifest size */
   if ((size = GetFileSize(name)) == -1)
     ERR("cannot get manifest file size\n");
@@ -117,6 +128,7 @@ int parse_manifest(const char *name, struct NaClApp *nap)
 	/* allocate memory for the Manifest object, manifest text and pointers */
   nap->manifest = (struct Manifest*) malloc(sizeof(*nap->manifest));
 	if(nap->manifest == NULL) ERR("cannot allocate memory to hold manifest object\n");
+	memset(nap->manifest, 0, sizeof(*nap->manifest));
 	str = (char*) malloc(size);
 	if(str == NULL) ERR("cannot allocate memory to hold text of manifest\n");
 	nap->manifest->master = (struct MasterManifestRecord*) malloc(4 * size);
@@ -124,17 +136,21 @@ int parse_manifest(const char *name, struct NaClApp *nap)
 
   /* read manifest */
 	f = fopen(name, "r");
+	if(f == NULL) ERR("cannot open manifest file\n");
   if(size != (int)fread(str, 1, size, f)) ERR("cannot read manifest file\n");
 
-  /* warning: the order of extracting pair key/value does matter */
-  p = strtok(str, EOL);
+  /*
+   * warning: the order of extracting pair key/value does matter
+   * note: strtok_r() since many manifests can be parsed in parallel
+   */
+  p = strtok_r(str, EOL, &saveptr);
   while(p)
   {
     nap->manifest->master[count].value = get_value(p);
     nap->manifest->master[count].key = get_key(p);
   	if (nap->manifest->master[count].key && nap->manifest->master[count].value) ++count;
 
-		p = strtok(NULL, EOL);
+		p = strtok_r(NULL, EOL, &saveptr);
   }
 
   /* initialize given NaClApp structure */
@@ -143,8 +159,26 @@ int parse_manifest(const char *name, struct NaClApp *nap)
 	nap->manifest->master = realloc(nap->manifest->master, sizeof(struct MasterManifestRecord) * count);
 	if (nap->manifest->master == NULL) ERR("manifest master records memory reallocation error\n");
 
+	nap->manifest->text = str;
 	fclose(f);
 	return count;
 }
 #undef FREE
 #undef ERR
+
+/* public function. release manifest and all its parts */
+void free_manifest(struct NaClApp *nap)
+{
+  struct Manifest *manifest = nap->manifest;
+  if(manifest == NULL) return;
+
+  if(manifest->system_setup != NULL) free(manifest->system_setup->cmd_line);
+  free(manifest->system_setup);
+  free(manifest->user_setup);
+  free(manifest->report);
+  free(manifest->master);
+  free(manifest->text);
+  BinaryManifestUnmap(manifest->binary);
+  free(manifest);
+  nap->manifest = NULL;
+}
@@ -29,6 +29,12 @@ extern uint64_t GetFileSize(const char *name);
  */
 int parse_manifest(const char *name, struct NaClApp *nap);
 
+/*
+ * release "manifest" of the given NaClApp structure with user/system
+ * policies and report. the field will be set to NULL
+ */
+void free_manifest(struct NaClApp *nap);
+
 /*
  * get value by key from the manifest. if not found - NULL
  */
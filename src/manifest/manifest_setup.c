@@ -17,6 +17,13 @@
 #include "src/service_runtime/nacl_memory_object.h"
 #include "src/platform/nacl_log.h"
 #include "src/service_runtime/nacl_syscall_handlers.h"
+#include "src/service_runtime/nacl_syscall_profile.h"
+#include "src/manifest/mem_release.h"
+#include "src/manifest/lazy_map.h"
+#include "src/manifest/manifest_binary.h"
+#ifdef NETWORKING
+#  include "src/networking/zvm_netw.h"
+#endif
 
 #include <src/manifest/manifest_parser.h>
 #include <src/manifest/manifest_setup.h>
@@ -32,6 +39,29 @@ static void GetChannelPrefixById(enum ChannelType ch, char *prefix)
   strcpy(prefix, prefixes[ch]);
 }
 
+/*
+ * return channel hints bitmask parsed from "hints" string (comma or
+ * space delimited hint names). unknown hints are ignored
+ */
+int32_t GetChannelHints(const char *hints)
+{
+  char *names[] = CHANNEL_HINTS;
+  int32_t result = 0;
+  int i;
+
+  if(!hints) return 0;
+  while(*hints)
+  {
+    int len = strcspn(hints, ", \t");
+    for(i = 0; i < sizeof(names)/sizeof(*names); ++i)
+      if(len == strlen(names[i]) && !strncmp(hints, names[i], len))
+        result |= 1 << i;
+    hints += len;
+    hints += strspn(hints, ", \t");
+  }
+  return result;
+}
+
 /*
  * construct i/o channel and update SetupList with not mounted channel
  * if successful return 0, otherwise - 1
@@ -40,8 +70,13 @@ static void GetChannelPrefixById(enum ChannelType ch, char *prefix)
 int32_t ConstructChannel(struct NaClApp *nap, enum ChannelType ch)
 {
   /* allocate channel */
-  char prefix[1024];
+  char prefix[64]; /* the longest channel prefix fits */
   struct PreOpenedFileDesc *channel = &nap->manifest->user_setup->channels[ch];
+
+  /* d'b: compiled manifest has the channel ready */
+  if(nap->manifest->binary != NULL)
+    return BinaryConstructChannel(nap->manifest->binary, channel, ch);
+
   channel->self_size = sizeof(*channel); /* set self size */
   GetChannelPrefixById(ch, prefix);
 
@@ -54,7 +89,7 @@ int32_t ConstructChannel(struct NaClApp *nap, enum ChannelType ch)
     char str[1024];\
     char *p;\
     if(!limit) break;\
-    sprintf(str, "%s%s", prefix, limit);\
+    snprintf(str, sizeof str, "%s%s", prefix, limit);\
     p = get_value_by_key(nap, str);\
     a = p ? atoll(p) : 0;\
   } while (0);
@@ -72,11 +107,26 @@ int32_t ConstructChannel(struct NaClApp *nap, enum ChannelType ch)
   SET_LIMIT(channel->max_put_size, "MaxPut");
   SET_LIMIT(channel->max_puts, "MaxPutCnt");
 
+  /* set i/o hints */
+  SET_LIMIT(channel->prefetch, "Prefetch");
+  SET_LIMIT(channel->window, "Window");
+  {
+    char key[1024];
+    snprintf(key, sizeof key, "%sHint", prefix);
+    channel->hints = GetChannelHints(get_value_by_key(nap, key));
+  }
+
+  /* set integrity mode */
+  SET_LIMIT(channel->integrity, "Integrity");
+  channel->crc_get = 0;
+  channel->crc_put = 0;
+
   /* set counters */
   channel->cnt_get_size = 0;
   channel->cnt_gets = 0;
   channel->cnt_put_size = 0;
   channel->cnt_puts = 0;
+  channel->high_water = -1;
 
 #undef SET_LIMIT
   return 0;
@@ -114,6 +164,32 @@ void SetupReportSettings(struct NaClApp *nap)
    */
   struct Report *report = malloc(sizeof(*report));
   COND_ABORT(!report, "cannot allocate memory for report\n");
+  memset(report, 0, sizeof *report);
+
+  /*
+   * sandboxes sharing the process count own thread since the job start
+   * (the thread runs jobs one by one). maxrss is always of the process
+   */
+  if(nap->multi_tenant)
+  {
+    struct rusage self;
+    struct rusage *u = &report->usage;
+    const struct rusage *s = &nap->job_usage;
+
+    getrusage(RUSAGE_THREAD, u);
+    getrusage(RUSAGE_SELF, &self);
+    timersub(&u->ru_utime, &s->ru_utime, &u->ru_utime);
+    timersub(&u->ru_stime, &s->ru_stime, &u->ru_stime);
+    u->ru_maxrss = self.ru_maxrss;
+    u->ru_minflt -= s->ru_minflt;
+    u->ru_majflt -= s->ru_majflt;
+    u->ru_inblock -= s->ru_inblock;
+    u->ru_oublock -= s->ru_oublock;
+    u->ru_nvcsw -= s->ru_nvcsw;
+    u->ru_nivcsw -= s->ru_nivcsw;
+  }
+  else
+    getrusage(RUSAGE_SELF, &report->usage);
 
   /* set results. note: etag is temporary disabled  */
   report->etag = MakeEtag(nap);
@@ -132,17 +208,114 @@ void SetupReportSettings(struct NaClApp *nap)
  */
 void AnswerManifestPut(struct NaClApp *nap, char *report)
 {
-  sprintf(report,
+  struct Report *r = nap->manifest->report;
+  struct SetupList *policy = nap->manifest->user_setup;
+  char *phases[] = JOB_PHASES;
+  int size = MAX_MANIFEST_LEN;
+  int len;
+  int i;
+
+/* append to the report, the tail is cut if there is no space */
+#define REPORT(...) \
+  do {\
+    len += snprintf(report + len, size > len ? size - len : 0, __VA_ARGS__);\
+  } while(0)
+
+  len = snprintf(report, size,
     "ReportRetCode        =%d\n"
     "ReportEtag           =%s\n"
     "ReportUserRetCode    =%d\n"
     "ReportContentType    =%s\n"
     "ReportXObjectMetaTag =%s\n",
-    nap->manifest->report->ret_code,
-    nap->manifest->report->etag,
-    nap->manifest->report->user_ret_code,
-    nap->manifest->report->content_type,
-    nap->manifest->report->x_object_meta_tag);
+    r->ret_code,
+    r->etag,
+    r->user_ret_code,
+    r->content_type,
+    r->x_object_meta_tag);
+
+  /* phase timings (microseconds) */
+  for(i = 0; i < PHASES_COUNT; ++i)
+    REPORT("ReportTime%-11s=%"NACL_PRId64"\n", phases[i], r->times[i]);
+
+  /* resources */
+  REPORT("ReportCpuUser        =%"NACL_PRId64"\n",
+      (int64_t)r->usage.ru_utime.tv_sec * 1000000 + r->usage.ru_utime.tv_usec);
+  REPORT("ReportCpuSys         =%"NACL_PRId64"\n",
+      (int64_t)r->usage.ru_stime.tv_sec * 1000000 + r->usage.ru_stime.tv_usec);
+  REPORT("ReportMaxRss         =%ld\n", r->usage.ru_maxrss);
+  REPORT("ReportMinorFaults    =%ld\n", r->usage.ru_minflt);
+  REPORT("ReportMajorFaults    =%ld\n", r->usage.ru_majflt);
+  REPORT("ReportVolCtxSwitches =%ld\n", r->usage.ru_nvcsw);
+  REPORT("ReportInvCtxSwitches =%ld\n", r->usage.ru_nivcsw);
+
+  /* channels: gets, puts, got bytes, put bytes */
+  for(i = 0; i < CHANNELS_COUNT; ++i)
+  {
+    struct PreOpenedFileDesc *channel = &policy->channels[i];
+    char prefix[1024];
+
+    if(!channel->name) continue;
+    GetChannelPrefixById(i, prefix);
+    REPORT("Report%-15s=%d %d %"NACL_PRId64" %"NACL_PRId64"\n", prefix,
+        channel->cnt_gets, channel->cnt_puts,
+        channel->cnt_get_size, channel->cnt_put_size);
+  }
+
+  /* integrity mode channels: crc32c of the read and written data */
+  for(i = 0; i < CHANNELS_COUNT; ++i)
+  {
+    struct PreOpenedFileDesc *channel = &policy->channels[i];
+    char prefix[1024];
+
+    if(!channel->name || !channel->integrity) continue;
+    GetChannelPrefixById(i, prefix);
+    strcat(prefix, "Crc");
+    REPORT("Report%-15s=%08x %08x\n", prefix, channel->crc_get, channel->crc_put);
+  }
+
+#ifdef NETWORKING
+  /* network channels with integrity mode: fd:crc of read:crc of written */
+  {
+    struct commf_crc_t crcs[SHUFFLE_PARTS_MAX];
+    int count = commf_crc_list(crcs, SHUFFLE_PARTS_MAX);
+
+    if(count > 0) REPORT("ReportNetCrc         =");
+    for(i = 0; i < count; ++i)
+      REPORT("%d:%08x:%08x ", crcs[i].fd, crcs[i].crc_get, crcs[i].crc_put);
+    if(count > 0) REPORT("\n");
+  }
+#endif
+
+  /* lazy channels: faults, filled pages, bytes read, source errors */
+  for(i = 0; nap->lazy_maps != NULL && i < CHANNELS_COUNT; ++i)
+  {
+    struct LazyMap *map = nap->lazy_maps[i];
+    char prefix[1024];
+
+    if(map == NULL) continue;
+    GetChannelPrefixById(i, prefix);
+    strcat(prefix, "Faults");
+    REPORT("Report%-15s=%u %"NACL_PRIu64" %"NACL_PRIu64" %u\n", prefix,
+        map->faults, map->pages, map->bytes, map->errors);
+  }
+
+  /* syscalls used by the nexe: number:count */
+  REPORT("ReportSyscalls       =");
+  for(i = 0; i < NACL_MAX_SYSCALLS; ++i)
+    if(nap->syscall_counts[i] != 0)
+      REPORT("%d:%u ", i, nap->syscall_counts[i]);
+  REPORT("\n");
+
+  /* time of the syscalls (if profiled): number:cycles */
+  if(nap->syscall_profile != NULL)
+  {
+    REPORT("ReportSyscallCycles  =");
+    for(i = 0; i < NACL_MAX_SYSCALLS; ++i)
+      if(nap->syscall_profile->count[i] != 0)
+        REPORT("%d:%"NACL_PRIu64" ", i, nap->syscall_profile->cycles[i]);
+    REPORT("\n");
+  }
+#undef REPORT
 }
 
 #define TRANSET(var, str)\
@@ -160,24 +333,35 @@ void SetupUserPolicy(struct NaClApp *nap)
   /* allocate space for policy */
   struct SetupList *policy = malloc(sizeof(*policy));
   COND_ABORT(!policy, "cannot allocate memory for user policy\n");
+  memset(policy, 0, sizeof(*policy));
   policy->self_size = sizeof(*policy); /* set self size */
 
-  /* setup limits */
-  TRANSET(policy->max_cpu, "CPUMax");
-  TRANSET(policy->max_mem, "MemMax");
-  TRANSET(policy->max_setup_calls, "SetupCallsMax");
-  TRANSET(policy->max_syscalls, "SyscallsMax");
-
   /* setup counters */
   policy->cnt_cpu = 0;
   policy->cnt_cpu_last = 0;
   policy->cnt_mem = 0;
   policy->cnt_setup_calls = 0;
   policy->cnt_syscalls = 0;
+  policy->cnt_threads = 1;
   policy->heap_ptr = 0; /* set user heap to NULL until it allocated */
 
   /* clear syscallback */
   policy->syscallback = 0;
+  nap->manifest->user_setup = policy;
+
+  /* d'b: compiled manifest has the limits and attributes ready */
+  if(nap->manifest->binary != NULL)
+  {
+    BinaryUserPolicy(nap->manifest->binary, policy);
+    return;
+  }
+
+  /* setup limits */
+  TRANSET(policy->max_cpu, "CPUMax");
+  TRANSET(policy->max_mem, "MemMax");
+  TRANSET(policy->max_setup_calls, "SetupCallsMax");
+  TRANSET(policy->max_syscalls, "SyscallsMax");
+  TRANSET(policy->max_threads, "ThreadsMax");
 
   /* setup custom attributes */
 #define STRNCPY_NULL(a, b, n) if ((a) && (b)) strncpy(a, b, n);
@@ -186,7 +370,6 @@ void SetupUserPolicy(struct NaClApp *nap)
   STRNCPY_NULL(policy->x_object_meta_tag, get_value_by_key(nap, "XObjectMetaTag"), X_OBJECT_META_TAG_LEN);
   STRNCPY_NULL(policy->user_etag, get_value_by_key(nap, "UserETag"), USER_TAG_LEN);
 #undef STRNCPY_NULL
-  nap->manifest->user_setup = policy;
 }
 
 /*
@@ -198,6 +381,16 @@ void SetupSystemPolicy(struct NaClApp *nap)
   /* allocate space for policy */
   struct SystemList *policy = malloc(sizeof(*policy));
   COND_ABORT(!policy, "cannot allocate memory for system policy\n");
+  memset(policy, 0, sizeof(*policy));
+
+  nap->manifest->system_setup = policy;
+
+  /* d'b: compiled manifest has the settings ready */
+  if(nap->manifest->binary != NULL)
+  {
+    BinarySystemPolicy(nap->manifest->binary, policy);
+    return;
+  }
 
   /* get zerovm settings */
   policy->version = get_value_by_key(nap, "Version");
@@ -208,12 +401,12 @@ void SetupSystemPolicy(struct NaClApp *nap)
   policy->nexe = get_value_by_key(nap, "Nexe");
   policy->blob = get_value_by_key(nap, "Blob");
   policy->nexe_etag = get_value_by_key(nap, "NexeEtag");
+  policy->syscall_profile = get_value_by_key(nap, "SyscallProfile");
 
   TRANSET(policy->nexe_max, "NexeMax");
   TRANSET(policy->timeout, "Timeout");
   TRANSET(policy->kill_timeout, "KillTimeout");
-
-  nap->manifest->system_setup = policy;
+  TRANSET(policy->done_fd, "DoneFd");
 }
 
 /*
@@ -257,6 +450,10 @@ void PreallocateUserMemory(struct NaClApp *nap)
 
   /* why 0xfffff000? 1. 0x1000 reserved for error codes 2. it is still larger then 4gb - stack */
   COND_ABORT(policy->heap_ptr > 0xfffff000, "cannot preallocate memory for user\n");
+
+  /* memory freed by the nexe will be given back to the system */
+  nap->mem_release = MemReleaseCtor();
+  COND_ABORT(nap->mem_release == NULL, "cannot allocate freed memory tracker\n");
 }
 
 /*
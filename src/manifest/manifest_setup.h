@@ -10,9 +10,16 @@
 
 EXTERN_C_BEGIN
 
+#include <sys/resource.h>
+#include "include/nacl_compiler_annotations.h"
 #include "api/zvm.h"
 
-#define COND_ABORT(cond, msg) if(cond) {fprintf(stderr, "%s\n", msg); exit(1);}
+struct NaClApp;
+
+/* the failed job ends (see sel_ldr.h). in batch mode only the job ends */
+NORETURN void NaClJobAbort(int code);
+
+#define COND_ABORT(cond, msg) if(cond) {fprintf(stderr, "%s\n", msg); NaClJobAbort(1);}
 #define MAX_MAP_SIZE 0x80000000u
 
 /*
@@ -39,8 +46,24 @@ struct SystemList
   char *nexe_etag; /* digital signature. reserved for a future "short" nexe validation */
   int32_t timeout;
   int32_t kill_timeout;
+  char *syscall_profile; /* syscalls profile file name, NULL - disabled */
+  int32_t done_fd; /* pipe signalled when the report is ready, 0 - none */
 };
 
+/* phases of the job timed for the report */
+enum JobPhase {
+  PhaseQualify,
+  PhaseSnapshot,
+  PhaseLoad,
+  PhaseValidate,
+  PhaseMount,
+  PhaseRun,
+  PhaseTeardown,
+  PHASES_COUNT
+};
+
+#define JOB_PHASES {"Qualify", "Snapshot", "Load", "Validate", "Mount", "Run", "Teardown"}
+
 struct Report
 {
   int32_t ret_code; /* zerovm return code */
@@ -48,6 +71,10 @@ struct Report
   int32_t user_ret_code; /* nexe return code */
   char *content_type; /* custom user attribute */
   char *x_object_meta_tag; /* custom user attribute */
+
+  /* resources of the job. set by SetupReportSettings() and the caller */
+  int64_t times[PHASES_COUNT]; /* phase timings in microseconds */
+  struct rusage usage; /* of the process or of the job in batch mode. maxrss - of the process */
 };
 
 /*
@@ -60,6 +87,8 @@ struct Manifest
   /* text manifest given by proxy */
   uint32_t master_records; /* amount of records in master manifest */
   struct MasterManifestRecord *master; /* array of master records */
+  char *text; /* manifest file content. master records point into it */
+  struct BinaryManifest *binary; /* compiled manifest (mapped), NULL - text */
 
   /* limits, file i/o and counters for user program */
   /* user hints also could be passed through this structure */
@@ -74,12 +103,16 @@ struct Manifest
 
 /*
  * construct Report (zerovm report to proxy) part of manifest structure
+ * and take the resources usage. phase timings are zeroed, the caller
+ * should set them
  * note: malloc(). must be called only once
  */
 void SetupReportSettings(struct NaClApp *nap);
 
 /*
- * prepare string containing proxi requested tags
+ * prepare string containing proxi requested tags, timings, resources
+ * usage, channels and syscalls counters
+ * note: "report" must have MAX_MANIFEST_LEN bytes
  */
 void AnswerManifestPut(struct NaClApp *nap, char *report);
 
@@ -108,6 +141,11 @@ char* MakeEtag(struct NaClApp *nap);
  */
 int32_t ConstructChannel(struct NaClApp *nap, enum ChannelType ch);
 
+/*
+ * return channel hints bitmask parsed from given string
+ */
+int32_t GetChannelHints(const char *hints);
+
 /*
  * preallocate memory area of given size. abort if fail
  */
@@ -9,6 +9,7 @@
 #include "api/zvm.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
 //#include "src/manifest/manifest_setup.c" // trick simplifies work with static (or not defined) functions
 
 // construct valid NaClApp object (with manifest and stuff)
@@ -25,6 +26,7 @@ struct NaClApp* allocate_nap(void)
 
   nap->manifest->master = NULL;
   nap->manifest->master_records = 0;
+  nap->manifest->binary = NULL;
   nap->manifest->report = (struct Report*) malloc(sizeof(struct Report));
   nap->manifest->user_setup = (struct SetupList*) malloc(sizeof(struct SetupList));
   nap->manifest->system_setup = (struct SystemList*) malloc(sizeof(struct SystemList));
@@ -128,13 +130,27 @@ TEST(SetupReportSettings_test, empty_cases)
 TEST(AnswerManifestPut_test, full_case)
 {
   struct NaClApp *nap = allocate_nap();
-  char report[1024];
+  char report[MAX_MANIFEST_LEN];
+  char dummy[] = "dummy";
 
+  memset(nap->manifest->report, 0, sizeof(struct Report));
+  memset(nap->manifest->user_setup, 0, sizeof(struct SetupList));
+  memset(nap->syscall_counts, 0, sizeof nap->syscall_counts);
+  nap->syscall_profile = NULL;
+  nap->lazy_maps = NULL;
   nap->manifest->report->ret_code = 0;
   nap->manifest->report->etag = (char*)"0";
   nap->manifest->report->user_ret_code = 0;
   nap->manifest->report->content_type = (char*)"0";
   nap->manifest->report->x_object_meta_tag = (char*)"0";
+  nap->manifest->report->times[PhaseRun] = 1500;
+  nap->manifest->report->usage.ru_utime.tv_sec = 1;
+  nap->manifest->report->usage.ru_maxrss = 4096;
+  nap->manifest->user_setup->channels[InputChannel].name = (intptr_t)dummy;
+  nap->manifest->user_setup->channels[InputChannel].cnt_gets = 2;
+  nap->manifest->user_setup->channels[InputChannel].cnt_get_size = 100;
+  nap->syscall_counts[0] = 3;
+  nap->syscall_counts[30] = 1;
 
   AnswerManifestPut(nap, report);
   EXPECT_STREQ(
@@ -142,7 +158,23 @@ TEST(AnswerManifestPut_test, full_case)
       "ReportEtag           =0\n"
       "ReportUserRetCode    =0\n"
       "ReportContentType    =0\n"
-      "ReportXObjectMetaTag =0\n", report);
+      "ReportXObjectMetaTag =0\n"
+      "ReportTimeQualify    =0\n"
+      "ReportTimeSnapshot   =0\n"
+      "ReportTimeLoad       =0\n"
+      "ReportTimeValidate   =0\n"
+      "ReportTimeMount      =0\n"
+      "ReportTimeRun        =1500\n"
+      "ReportTimeTeardown   =0\n"
+      "ReportCpuUser        =1000000\n"
+      "ReportCpuSys         =0\n"
+      "ReportMaxRss         =4096\n"
+      "ReportMinorFaults    =0\n"
+      "ReportMajorFaults    =0\n"
+      "ReportVolCtxSwitches =0\n"
+      "ReportInvCtxSwitches =0\n"
+      "ReportInput          =2 0 100 0\n"
+      "ReportSyscalls       =0:3 30:1 \n", report);
 
   free_nap(nap);
 }
@@ -204,6 +236,51 @@ TEST(SetupSystemPolicy_test, not_initialized_case)
   free_nap(nap);
 }
 
+// int32_t GetChannelHints(const char *hints)
+TEST(GetChannelHints_test, all_cases)
+{
+  EXPECT_EQ(0, GetChannelHints(NULL));
+  EXPECT_EQ(0, GetChannelHints(""));
+  EXPECT_EQ(0, GetChannelHints("sequentially"));
+  EXPECT_EQ(HintSequential, GetChannelHints("sequential"));
+  EXPECT_EQ(HintSequential | HintWillNeed, GetChannelHints("sequential,willneed"));
+  EXPECT_EQ(HintRandom | HintDontNeed, GetChannelHints(" random ,, dontneed "));
+}
+
+// cpu time of the long run (> 2^31 clock() ticks) is counted right
+TEST(CpuClock_test, long_run)
+{
+  struct NaClApp *nap = allocate_nap();
+  struct SetupList *policy = nap->manifest->user_setup;
+
+  memset(policy, 0, sizeof *policy);
+  nap->multi_tenant = 0;
+  nap->cpu_clock_users = 0;
+  nap->cpu_clock = 0;
+  nap->cpu_clock_last = 0;
+
+  // 2 slices of 3000 seconds each
+  ResumeCpuClock(nap);
+  nap->cpu_clock_last -= (int64_t)3000 * CLOCKS_PER_SEC;
+  PauseCpuClock(nap);
+  EXPECT_GE(policy->cnt_cpu, 3000000);
+  EXPECT_LT(policy->cnt_cpu, 3001000);
+  ResumeCpuClock(nap);
+  nap->cpu_clock_last -= (int64_t)3000 * CLOCKS_PER_SEC;
+  PauseCpuClock(nap);
+  EXPECT_GE(policy->cnt_cpu, 6000000);
+  EXPECT_LT(policy->cnt_cpu, 6001000);
+
+  policy->max_cpu = 5900000;
+  EXPECT_NE(0, CpuLimitExceeded(nap));
+  policy->max_cpu = 6100000;
+  EXPECT_EQ(0, CpuLimitExceeded(nap));
+  policy->max_cpu = 0;
+  EXPECT_EQ(0, CpuLimitExceeded(nap));
+
+  free_nap(nap);
+}
+
 //void PreallocateUserMemory(struct NaClApp *nap) -- useless so far
 
 // system counters acessors -- needless so far. to remove in the future
@@ -0,0 +1,122 @@
+/*
+ * freed ranges tracker. ranges are kept sorted and merged with the
+ * neighbours, so the nexe freeing the heap piece by piece costs one
+ * madvise() per batch. MADV_DONTNEED is used (not MADV_FREE): the pages
+ * leave the resident set at once and read as zeroes if used again
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "src/manifest/mem_release.h"
+#include "src/platform/nacl_log.h"
+
+struct MemRelease *MemReleaseCtor()
+{
+  return calloc(1, sizeof(struct MemRelease));
+}
+
+void MemReleaseDtor(struct MemRelease *mr)
+{
+  free(mr);
+}
+
+void MemReleaseFlush(struct MemRelease *mr)
+{
+  int i;
+
+  if(mr == NULL) return;
+  for(i = 0; i < mr->count; ++i)
+  {
+    if(madvise((void*)mr->start[i], mr->end[i] - mr->start[i], MADV_DONTNEED) != 0)
+      NaClLog(LOG_ERROR, "cannot release 0x%lx bytes at 0x%lx, errno %d\n",
+          mr->end[i] - mr->start[i], mr->start[i], errno);
+    else
+      mr->released += mr->end[i] - mr->start[i];
+    ++mr->calls;
+  }
+  mr->count = 0;
+  mr->pending = 0;
+}
+
+/* remove the range "i" */
+static void Remove(struct MemRelease *mr, int i)
+{
+  mr->pending -= mr->end[i] - mr->start[i];
+  memmove(&mr->start[i], &mr->start[i + 1], (mr->count - i - 1) * sizeof *mr->start);
+  memmove(&mr->end[i], &mr->end[i + 1], (mr->count - i - 1) * sizeof *mr->end);
+  --mr->count;
+}
+
+/* insert the range before "i" */
+static void Insert(struct MemRelease *mr, int i, uintptr_t start, uintptr_t end)
+{
+  memmove(&mr->start[i + 1], &mr->start[i], (mr->count - i) * sizeof *mr->start);
+  memmove(&mr->end[i + 1], &mr->end[i], (mr->count - i) * sizeof *mr->end);
+  mr->start[i] = start;
+  mr->end[i] = end;
+  mr->pending += end - start;
+  ++mr->count;
+}
+
+void MemReleaseFree(struct MemRelease *mr, uintptr_t start, size_t size)
+{
+  uintptr_t end = (start + size) & ~(uintptr_t)(RELEASE_PAGE - 1);
+  int i;
+
+  if(mr == NULL) return;
+  start = (start + RELEASE_PAGE - 1) & ~(uintptr_t)(RELEASE_PAGE - 1);
+  if(start >= end) return;
+
+  /* absorb overlapping and adjacent ranges */
+  for(i = 0; i < mr->count && mr->end[i] < start; ++i);
+  while(i < mr->count && mr->start[i] <= end)
+  {
+    if(mr->start[i] < start) start = mr->start[i];
+    if(mr->end[i] > end) end = mr->end[i];
+    Remove(mr, i);
+  }
+
+  if(mr->count == RELEASE_RANGES)
+  {
+    MemReleaseFlush(mr);
+    i = 0;
+  }
+  Insert(mr, i, start, end);
+  if(mr->pending >= RELEASE_BATCH) MemReleaseFlush(mr);
+}
+
+void MemReleaseUse(struct MemRelease *mr, uintptr_t start, size_t size)
+{
+  uintptr_t end = (start + size + RELEASE_PAGE - 1) & ~(uintptr_t)(RELEASE_PAGE - 1);
+  int i;
+
+  if(mr == NULL || size == 0) return;
+
+  /* cut the used pages out of the ranges */
+  start &= ~(uintptr_t)(RELEASE_PAGE - 1);
+  for(i = 0; i < mr->count && mr->end[i] <= start; ++i);
+  while(i < mr->count && mr->start[i] < end)
+  {
+    uintptr_t head = mr->start[i];
+    uintptr_t tail = mr->end[i];
+
+    Remove(mr, i);
+    if(head < start) Insert(mr, i++, head, start);
+    if(tail > end)
+    {
+      /* no room for the split: other ranges are outside, release them */
+      if(mr->count == RELEASE_RANGES)
+      {
+        MemReleaseFlush(mr);
+        i = 0;
+      }
+      Insert(mr, i, end, tail);
+      break;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/*
+ * release of the freed user memory in "whole chunk" mode (MemMax). the
+ * chunk is allocated once, munmap/mmap/sbrk of the nexe do not go to the
+ * system. pages freed by the nexe are collected as the coalesced ranges
+ * and given back to the system (madvise) by batches, so the resident
+ * memory follows the nexe needs instead of its high-water mark
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#ifndef MEM_RELEASE_H_
+#define MEM_RELEASE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* host page. only whole pages of the freed range are released */
+#define RELEASE_PAGE 0x1000
+
+/* pending (freed, not released yet) bytes which cause the release */
+#define RELEASE_BATCH 0x100000
+
+/* the most pending ranges. when full they are released */
+#define RELEASE_RANGES 64
+
+struct MemRelease
+{
+  uintptr_t start[RELEASE_RANGES]; /* sorted, not adjacent ranges */
+  uintptr_t end[RELEASE_RANGES];
+  int count;
+  size_t pending; /* bytes in the ranges */
+
+  /* statistics */
+  uint64_t released; /* bytes */
+  uint32_t calls; /* madvise() calls */
+};
+
+/* return empty tracker or NULL if failed */
+struct MemRelease *MemReleaseCtor();
+void MemReleaseDtor(struct MemRelease *mr);
+
+/*
+ * the memory (system address) is freed by the nexe. whole pages of it
+ * will be released with the batch
+ */
+void MemReleaseFree(struct MemRelease *mr, uintptr_t start, size_t size);
+
+/* the memory is allocated again. pending pages of it must be kept */
+void MemReleaseUse(struct MemRelease *mr, uintptr_t start, size_t size);
+
+/* release all pending ranges now */
+void MemReleaseFlush(struct MemRelease *mr);
+
+EXTERN_C_END
+
+#endif /* MEM_RELEASE_H_ */
@@ -0,0 +1,202 @@
+/*
+ * mem_release_test.cc
+ * freed ranges are merged, reused pages are kept, released pages leave
+ * the resident set. the benchmark shows resident memory of the heap which
+ * grows and shrinks with and without the release
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "src/manifest/mem_release.h"
+
+#define PAGES 16
+#define HEAP_SIZE 0x4000000 /* benchmark heap, 64mb */
+#define CYCLES 8
+
+// return the number of resident pages in the area
+static int Resident(char *area, int pages)
+{
+  unsigned char vec[PAGES];
+  int count = 0;
+  int i;
+
+  if(mincore(area, pages * RELEASE_PAGE, vec) != 0) return -1;
+  for(i = 0; i < pages; ++i)
+    count += vec[i] & 1;
+  return count;
+}
+
+// resident set of the process in bytes
+static long Rss()
+{
+  long size = 0, rss = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+
+  if(f == NULL) return -1;
+  if(fscanf(f, "%ld %ld", &size, &rss) != 2) rss = -1;
+  fclose(f);
+  return rss * sysconf(_SC_PAGESIZE);
+}
+
+// adjacent and overlapping ranges become one, partial pages are not taken
+TEST(MemRelease, coalesce)
+{
+  struct MemRelease *mr = MemReleaseCtor();
+  uintptr_t base = 0x10000000;
+
+  ASSERT_TRUE(mr != NULL);
+  MemReleaseFree(mr, base, RELEASE_PAGE);
+  MemReleaseFree(mr, base + 2 * RELEASE_PAGE, RELEASE_PAGE);
+  EXPECT_EQ(2, mr->count);
+  MemReleaseFree(mr, base + RELEASE_PAGE, RELEASE_PAGE);
+  EXPECT_EQ(1, mr->count);
+  EXPECT_EQ(base, mr->start[0]);
+  EXPECT_EQ(base + 3 * RELEASE_PAGE, mr->end[0]);
+  EXPECT_EQ((size_t)3 * RELEASE_PAGE, mr->pending);
+
+  // not a whole page
+  MemReleaseFree(mr, base + 5 * RELEASE_PAGE + 1, RELEASE_PAGE);
+  EXPECT_EQ(1, mr->count);
+
+  // the overlapping range absorbs the old one
+  MemReleaseFree(mr, base - RELEASE_PAGE, 5 * RELEASE_PAGE);
+  EXPECT_EQ(1, mr->count);
+  EXPECT_EQ(base - RELEASE_PAGE, mr->start[0]);
+  EXPECT_EQ(base + 4 * RELEASE_PAGE, mr->end[0]);
+  EXPECT_EQ(0u, mr->calls);
+  MemReleaseDtor(mr);
+}
+
+// reused pages are cut out of the pending ranges
+TEST(MemRelease, use)
+{
+  struct MemRelease *mr = MemReleaseCtor();
+  uintptr_t base = 0x10000000;
+
+  ASSERT_TRUE(mr != NULL);
+  MemReleaseFree(mr, base, 8 * RELEASE_PAGE);
+  MemReleaseUse(mr, base + 2 * RELEASE_PAGE + 1, RELEASE_PAGE);
+  ASSERT_EQ(2, mr->count);
+  EXPECT_EQ(base + 2 * RELEASE_PAGE, mr->end[0]);
+  EXPECT_EQ(base + 4 * RELEASE_PAGE, mr->start[1]);
+  EXPECT_EQ((size_t)6 * RELEASE_PAGE, mr->pending);
+
+  MemReleaseUse(mr, base, 2 * RELEASE_PAGE);
+  MemReleaseUse(mr, base + 7 * RELEASE_PAGE, 4 * RELEASE_PAGE);
+  ASSERT_EQ(1, mr->count);
+  EXPECT_EQ(base + 4 * RELEASE_PAGE, mr->start[0]);
+  EXPECT_EQ(base + 7 * RELEASE_PAGE, mr->end[0]);
+  MemReleaseDtor(mr);
+}
+
+// flush releases the freed pages and only them
+TEST(MemRelease, flush)
+{
+  struct MemRelease *mr = MemReleaseCtor();
+  char *area = (char*)mmap(NULL, PAGES * RELEASE_PAGE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  ASSERT_TRUE(mr != NULL);
+  ASSERT_TRUE(area != MAP_FAILED);
+  memset(area, 'x', PAGES * RELEASE_PAGE);
+  EXPECT_EQ(PAGES, Resident(area, PAGES));
+
+  MemReleaseFree(mr, (uintptr_t)area, 4 * RELEASE_PAGE);
+  MemReleaseFree(mr, (uintptr_t)area + 8 * RELEASE_PAGE, 8 * RELEASE_PAGE);
+  MemReleaseUse(mr, (uintptr_t)area + 10 * RELEASE_PAGE, RELEASE_PAGE);
+  EXPECT_EQ(PAGES, Resident(area, PAGES));
+  MemReleaseFlush(mr);
+
+  EXPECT_EQ(0, mr->count);
+  EXPECT_EQ(3u, mr->calls);
+  EXPECT_EQ((uint64_t)11 * RELEASE_PAGE, mr->released);
+  EXPECT_EQ(PAGES - 11, Resident(area, PAGES));
+  EXPECT_EQ('x', area[10 * RELEASE_PAGE]);
+  EXPECT_EQ(0, area[0]);
+
+  munmap(area, PAGES * RELEASE_PAGE);
+  MemReleaseDtor(mr);
+}
+
+// the full tracker releases the ranges instead of losing them
+TEST(MemRelease, overflow)
+{
+  struct MemRelease *mr = MemReleaseCtor();
+  char *area = (char*)mmap(NULL, 2 * (RELEASE_RANGES + 1) * RELEASE_PAGE,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  int i;
+
+  ASSERT_TRUE(mr != NULL);
+  ASSERT_TRUE(area != MAP_FAILED);
+  for(i = 0; i <= RELEASE_RANGES; ++i)
+    MemReleaseFree(mr, (uintptr_t)area + 2 * i * RELEASE_PAGE, RELEASE_PAGE);
+  EXPECT_EQ(1, mr->count);
+  EXPECT_EQ((uint32_t)RELEASE_RANGES, mr->calls);
+
+  munmap(area, 2 * (RELEASE_RANGES + 1) * RELEASE_PAGE);
+  MemReleaseDtor(mr);
+}
+
+// heap of the nexe grows to the top and shrinks to 1/8 by 64kb pieces
+static void Cycles(struct MemRelease *mr, long *series)
+{
+  char *heap = (char*)mmap(NULL, HEAP_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  size_t piece = 0x10000;
+  size_t top = 0;
+  int i;
+
+  ASSERT_TRUE(heap != MAP_FAILED);
+  for(i = 0; i < CYCLES; ++i)
+  {
+    /* grow */
+    for(; top < HEAP_SIZE; top += piece)
+    {
+      MemReleaseUse(mr, (uintptr_t)heap + top, piece);
+      memset(heap + top, i + 1, piece);
+    }
+
+    /* shrink */
+    for(; top > HEAP_SIZE / 8; top -= piece)
+      MemReleaseFree(mr, (uintptr_t)heap + top - piece, piece);
+    series[i] = Rss();
+  }
+
+  munmap(heap, HEAP_SIZE);
+}
+
+// resident memory after each shrink with and without the release
+TEST(MemRelease, rss_benchmark)
+{
+  struct MemRelease *mr = MemReleaseCtor();
+  long kept[CYCLES];
+  long released[CYCLES];
+  int i;
+
+  ASSERT_TRUE(mr != NULL);
+  Cycles(NULL, kept);
+  Cycles(mr, released);
+
+  printf("cycle    rss kept     rss released\n");
+  for(i = 0; i < CYCLES; ++i)
+    printf("%5d %10ldkb %14ldkb\n", i, kept[i] >> 10, released[i] >> 10);
+  printf("%u madvise() calls, %llu bytes released\n",
+      mr->calls, (unsigned long long)mr->released);
+
+  /* 7/8 of the heap is given back, less the last batch */
+  EXPECT_LT(released[CYCLES - 1], kept[CYCLES - 1] - HEAP_SIZE / 2);
+  EXPECT_LE(mr->calls, (uint32_t)(CYCLES * (HEAP_SIZE / RELEASE_BATCH)));
+  MemReleaseDtor(mr);
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
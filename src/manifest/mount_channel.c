@@ -7,10 +7,15 @@
  */
 #include <stdio.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include <src/manifest/manifest_parser.h>
 #include <src/manifest/manifest_setup.h>
 #include "src/manifest/mount_channel.h"
+#include "src/manifest/premap.h"
+#include "src/manifest/readahead.h"
+#include "src/manifest/direct_io.h"
 
 /*
  * mount given channel (must be constructed) with a given mode/attributes
@@ -21,6 +26,10 @@ int MountChannel(struct NaClApp *nap, enum ChannelType ch)
   struct PreOpenedFileDesc *channel = &nap->manifest->user_setup->channels[ch];
   if(channel)
   {
+    /* the nexe reads and writes the mapping itself, nothing to crc */
+    COND_ABORT(channel->integrity && (channel->mounted == MAPPED
+        || channel->mounted == LAZY), "integrity mode needs preloaded channel\n");
+
     switch(channel->mounted)
     {
       int code;
@@ -28,7 +37,12 @@ int MountChannel(struct NaClApp *nap, enum ChannelType ch)
         code = PremapChannel(nap, channel);
         COND_ABORT(code, "cannot premap channel\n");
         break;
+      case LAZY:
+        code = LazyMapChannel(nap, channel);
+        COND_ABORT(code, "cannot register lazy channel\n");
+        break;
       case LOADED:
+      case DIRECT:
         code = PreloadChannel(nap, channel);
         COND_ABORT(code, "cannot preload channel\n");
         break;
@@ -44,6 +58,62 @@ int MountChannel(struct NaClApp *nap, enum ChannelType ch)
   return 0;
 }
 
+/*
+ * the orchestrator waiting for the job end signal (DoneFd) reads the
+ * output channels right away, their data must be on the disk
+ */
+static int SyncNeeded(struct NaClApp *nap, enum ChannelType ch)
+{
+  return nap->manifest->system_setup->done_fd > 0
+      && (ch == OutputChannel || ch == LogChannel);
+}
+
+/* sync the data of trimmed (closed) channel file. removed log is skipped */
+static int SyncChannelFile(struct PreOpenedFileDesc *channel)
+{
+  int handle = open((char*)channel->name, O_RDONLY);
+  int code;
+
+  if(handle < 0) return errno == ENOENT ? 0 : -1;
+  code = fdatasync(handle);
+  close(handle);
+  return code;
+}
+
+/*
+ * unmount given channel. mapped channels are unmapped and trimmed,
+ * loaded channels are closed. return 0 - when everything is ok,
+ * otherwise - negative error
+ */
+int UnmountChannel(struct NaClApp *nap, enum ChannelType ch)
+{
+  struct PreOpenedFileDesc *channel = &nap->manifest->user_setup->channels[ch];
+  int code = 0;
+
+  if(!channel->name) return 0; /* channel is not constructed */
+  switch(channel->mounted)
+  {
+    case MAPPED:
+    case LAZY:
+      /* lazy channel handler thread is stopped before the unmap */
+      code = UnmapChannel(nap, channel);
+      if(code == 0 && SyncNeeded(nap, ch)) code = SyncChannelFile(channel);
+      break;
+    case LOADED:
+    case DIRECT:
+      if(channel->handle < 0) break;
+      StopChannelPrefetch(channel);
+      if(SyncNeeded(nap, ch)) code = fdatasync(channel->handle);
+      code |= close(channel->handle);
+      if(channel->mounted == DIRECT) DirectFini();
+      channel->handle = -1;
+      break;
+    default:
+      break;
+  }
+  return code;
+}
+
 /*
  * return size of given file or -1 (max_size) if fail
  */
@@ -24,6 +24,13 @@ struct PreOpenedFileDesc *GetChannelById(
  */
 int MountChannel(struct NaClApp *nap, enum ChannelType ch);
 
+/*
+ * unmount given channel: release resources, trim output file to the
+ * written data size. with DoneFd output and log files are synced
+ * return 0 - when everything is ok, otherwise - negative error
+ */
+int UnmountChannel(struct NaClApp *nap, enum ChannelType ch);
+
 /*
  * return size of given file or -1 (max_size) if fail
  */
@@ -39,6 +46,11 @@ int PreloadChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
  */
 int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
 
+/*
+ * unmap given mapped channel. return 0 if success, otherwise negative errcode
+ */
+int UnmapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
+
 /*
  * preallocate given network channel. return 0 if success, otherwise negative errcode
  */
@@ -12,6 +12,7 @@
 
 #include <src/manifest/preload.h>
 #include "src/manifest/mount_channel.h"
+#include "src/manifest/readahead.h"
 
 /*
  * infere file open flags by channel prefix
@@ -45,10 +46,16 @@ int PreloadChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
 {
   /* debug checks */
   if(!channel->name) return -1; /* channel is not constructed. skip it */
-  COND_ABORT(channel->mounted != LOADED, "channel is not supposed to be loaded\n");
+  COND_ABORT(channel->mounted != LOADED && channel->mounted != DIRECT,
+             "channel is not supposed to be loaded\n");
 
-  /* open file */
-  channel->handle = open((char*)channel->name, GetChannelOpenFlags(channel), S_IRWXU);
+  /* open file. fall back to the page cache if fs does not support direct i/o */
+  channel->handle = -1;
+  if(channel->mounted == DIRECT)
+    channel->handle = open((char*)channel->name,
+        GetChannelOpenFlags(channel) | O_DIRECT, S_IRWXU);
+  if(channel->handle < 0)
+    channel->handle = open((char*)channel->name, GetChannelOpenFlags(channel), S_IRWXU);
   COND_ABORT(channel->handle < 0, "channel open error\n");
 
   /* check if given file in bounds of manifest limits */
@@ -57,6 +64,10 @@ int PreloadChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
   COND_ABORT(channel->max_size < channel->fsize,
              "channel legnth exceeded policy limit\n");
 
+  /* advise kernel about channel usage, start read ahead */
+  ApplyChannelHints(channel);
+  COND_ABORT(StartChannelPrefetch(channel), "cannot start channel prefetch\n");
+
   /* mounting finalization */
   channel->bsize = -1; /* will be provided by user */
   return 0;
@@ -9,14 +9,23 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "src/desc/nacl_desc_io.h"
 #include "src/service_runtime/include/bits/mman.h"
+#include "src/service_runtime/nacl_config.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/service_runtime/nacl_syscall_handlers.h"
 #include "src/manifest/premap.h"
 #include "src/manifest/manifest_setup.h"
 #include "src/manifest/mount_channel.h"
+#include "src/manifest/readahead.h"
+#include "src/manifest/lazy_map.h"
 
 #define GET_FLAGS(FLAGS, channel)\
 do{\
@@ -45,19 +54,339 @@ static int GetChannelMapProt(struct PreOpenedFileDesc* channel)
 
 /*
  * preallocate channel. for output files only. since we cannot say how much user
- * program will use we only can allocate max size provided for current channel
+ * program will use we only can set the size of the mapped region: max size or
+ * the channel window if given. the mapping cannot be larger than CHANNEL_MAP_LIMIT,
+ * the larger channel is cut to it. the file is extended (sparse) to back the
+ * whole mapping, after the mapping StartChannelGrowth() trims it back
  * note: must be called from PremapChannel() after file opened and measured
- * note: user_log file will be trimmed to asciiz string size it contain
+ * note: the file will be trimmed to the written data size by UnmapChannel()
  */
-static void PreallocateChannel(struct PreOpenedFileDesc* channel)
+void PreallocateChannel(struct PreOpenedFileDesc* channel)
 {
-  if(channel->fsize != channel->max_size &&
-      (channel->type == OutputChannel || channel->type == LogChannel))
+  int64_t size = channel->max_size;
+
+  if(channel->type != OutputChannel && channel->type != LogChannel) return;
+  if(channel->window > 0 && channel->window * CHANNEL_WINDOW_UNIT < size)
+    size = channel->window * CHANNEL_WINDOW_UNIT;
+  if(size > CHANNEL_MAP_LIMIT)
   {
-    int ret_code = ftruncate(channel->handle, channel->max_size);
+    NaClLog(LOG_WARNING, "mapped output channel is cut to %lld bytes\n",
+        CHANNEL_MAP_LIMIT);
+    size = CHANNEL_MAP_LIMIT;
+  }
+
+  if(channel->fsize < size)
+  {
+    int ret_code = ftruncate(channel->handle, size);
     COND_ABORT(ret_code < 0, "cannot set the channel size\n");
-    channel->fsize = channel->max_size;
+    channel->fsize = size;
+  }
+}
+
+/* mapped output channel which file grows when nexe touches the mapping */
+struct ChannelGrowth
+{
+  char *start; /* of the mapping, NULL - free slot */
+  int64_t size; /* of the mapping */
+  int64_t end; /* of the file */
+  int handle;
+  int reserve; /* the blocks of the windows are allocated */
+};
+
+/* the most mapped outputs of all sessions (batch mode) */
+#define GROWTH_SLOTS 64
+
+static struct ChannelGrowth growth[GROWTH_SLOTS];
+static volatile int growth_lock = 0;
+static struct sigaction growth_chain; /* SIGBUS action replaced by ours */
+static __thread char *growth_fault = NULL; /* the last address grown */
+
+/* the lock is also taken by the fault handler, it must not sleep */
+static void GrowthLock()
+{
+  while(__sync_lock_test_and_set(&growth_lock, 1)) sched_yield();
+}
+
+static void GrowthUnlock()
+{
+  __sync_lock_release(&growth_lock);
+}
+
+/* end of the last data extent of the file or -1 if cannot seek for data */
+static int64_t DataEnd(int handle)
+{
+  off_t pos = 0;
+  off_t end = 0;
+
+  errno = 0;
+  for(;;)
+  {
+    off_t data = lseek(handle, pos, SEEK_DATA);
+    if(data < 0) break;
+    end = lseek(handle, data, SEEK_HOLE);
+    if(end < 0) break;
+    pos = end;
+  }
+  return end <= 0 && errno == EINVAL ? -1 : end;
+}
+
+/* extend the file to the window containing "offset". return 0 if success */
+static int GrowFile(struct ChannelGrowth *g, int64_t offset)
+{
+  int64_t end = (offset / CHANNEL_GROWTH_WINDOW + 1) * CHANNEL_GROWTH_WINDOW;
+
+  if(end > g->size) end = g->size;
+  if(g->reserve && fallocate(g->handle, 0, g->end, end - g->end) == 0)
+    g->end = end;
+  else if(ftruncate(g->handle, end) == 0)
+    g->end = end;
+  return g->end == end ? 0 : -1;
+}
+
+/*
+ * SIGBUS handler. the fault behind the end of the growing file extends the
+ * file, other faults go to the replaced action. the same address faulted
+ * twice by the thread is not ours (i/o error, no space)
+ */
+static void GrowthSignal(int sig, siginfo_t *info, void *ctx)
+{
+  char *addr = info->si_addr;
+  int handled = 0;
+  int error = errno;
+  int i;
+
+  GrowthLock();
+  for(i = 0; i < GROWTH_SLOTS; ++i)
+  {
+    struct ChannelGrowth *g = &growth[i];
+    if(g->start == NULL || addr < g->start || addr >= g->start + g->size)
+      continue;
+
+    /* other thread could grow the file after the fault */
+    if(addr - g->start < g->end)
+      handled = growth_fault != addr;
+    else
+      handled = GrowFile(g, addr - g->start) == 0;
+    break;
+  }
+  GrowthUnlock();
+
+  growth_fault = handled ? addr : NULL;
+  errno = error;
+  if(handled) return;
+
+  if(growth_chain.sa_flags & SA_SIGINFO)
+    growth_chain.sa_sigaction(sig, info, ctx);
+  else if(growth_chain.sa_handler != SIG_DFL && growth_chain.sa_handler != SIG_IGN)
+    growth_chain.sa_handler(sig);
+  else
+    signal(sig, SIG_DFL); /* the fault repeats and ends the process */
+}
+
+/* set the growth handler in front of the existing one */
+static void GrowthInstall()
+{
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof sa);
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = GrowthSignal;
+  sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  COND_ABORT(sigaction(SIGBUS, &sa, &growth_chain) != 0,
+      "cannot set output channels growth handler\n");
+}
+
+/*
+ * the file of mapped output channel is trimmed to the data it has and grows
+ * by CHANNEL_GROWTH_WINDOW when nexe touches the mapping behind the file end
+ * (SIGBUS). the blocks of the windows are allocated if the file system keeps
+ * them a hole (reserved blocks reported as data would be kept by the trim).
+ * note: trusted i/o into the mapping behind the file end fails (EFAULT)
+ * note: the channel handle must be kept opened until UnmapChannel()
+ */
+int StartChannelGrowth(struct PreOpenedFileDesc* channel, char *buffer)
+{
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  struct ChannelGrowth *g = NULL;
+  int64_t data;
+  int64_t end;
+  int64_t reserve;
+  int i;
+
+  if(channel->type != OutputChannel && channel->type != LogChannel) return 0;
+  if(channel->bsize == 0) return 0;
+  if(channel->handle < 0) return -INTERNAL_ERR;
+
+  /* the file cannot be measured, keep it backing the whole mapping */
+  data = DataEnd(channel->handle);
+  if(data < 0) return 0;
+
+  /* the first window after the data the file already has */
+  end = (data + CHANNEL_GROWTH_WINDOW - 1) / CHANNEL_GROWTH_WINDOW * CHANNEL_GROWTH_WINDOW;
+  if(end < CHANNEL_GROWTH_WINDOW) end = CHANNEL_GROWTH_WINDOW;
+  if(end >= channel->bsize) return 0;
+
+  pthread_once(&once, GrowthInstall);
+  GrowthLock();
+  for(i = 0; i < GROWTH_SLOTS && g == NULL; ++i)
+    if(growth[i].start == NULL) g = &growth[i];
+  if(g != NULL)
+  {
+    g->start = buffer;
+    g->size = channel->bsize;
+    g->end = end;
+    g->handle = channel->handle;
+    g->reserve = 0;
+  }
+  GrowthUnlock();
+
+  if(g == NULL)
+  {
+    NaClLog(LOG_WARNING, "too many mapped outputs, the file backs the whole mapping\n");
+    return 0;
   }
+  if(ftruncate(channel->handle, end) != 0) return -INTERNAL_ERR;
+
+  /*
+   * reserve the window if the reserved blocks are not reported as data. the
+   * probe is written through the mapping as nexe does, the probe page is
+   * dropped (punched) with the reservation or alone
+   */
+  reserve = (data + NACL_MAP_PAGESIZE - 1) & ~((int64_t)NACL_MAP_PAGESIZE - 1);
+  if(reserve < end && fallocate(channel->handle, 0, reserve, end - reserve) == 0)
+  {
+    int64_t size = end - reserve;
+
+    buffer[reserve] = 0;
+    g->reserve = lseek(channel->handle, reserve, SEEK_HOLE) == reserve + NACL_PAGESIZE;
+    if(g->reserve) size = NACL_PAGESIZE;
+    fallocate(channel->handle, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+        reserve, size);
+  }
+  return 0;
+}
+
+/* the mapping is going to be unmapped, its faults are not handled anymore */
+static void StopChannelGrowth(char *buffer)
+{
+  int i;
+
+  GrowthLock();
+  for(i = 0; i < GROWTH_SLOTS; ++i)
+    if(growth[i].start == buffer) growth[i].start = NULL;
+  GrowthUnlock();
+}
+
+/*
+ * return the size of data written to the mapped output channel. if nexe
+ * reported the size (high_water, see TrapUserSetup) it is used, otherwise
+ * the end of the last data extent of the file. the extent end is rounded
+ * up to the file system block. "handle" is opened channel file
+ */
+int64_t GetChannelHighWater(struct PreOpenedFileDesc* channel, int handle)
+{
+  int64_t end;
+
+  /* nexe reported the data size */
+  if(channel->high_water >= 0) return channel->high_water;
+
+  /* file system cannot seek for data, keep the whole file */
+  end = DataEnd(handle);
+  if(end < 0) end = lseek(handle, 0, SEEK_END);
+  if(end > channel->bsize) end = channel->bsize;
+  return end < 0 ? 0 : end;
+}
+
+/*
+ * unmap given channel and trim the channel file to the size of written data.
+ * empty user log is removed. return 0 if success, otherwise negative errcode
+ */
+int UnmapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
+{
+  char *buffer;
+  int handle;
+  int ret_code;
+
+  if(!channel->buffer) return 0;
+  buffer = (char*)NaClUserToSys(nap, (uint32_t)channel->buffer);
+
+  /* lazy channel: no more faults will be handled, the counters are kept */
+  if(channel->mounted == LAZY && nap->lazy_maps != NULL)
+    LazyMapStop(nap->lazy_maps[channel->type]);
+
+  /* input channels has nothing to trim. windowed channel keeps own file */
+  if(channel->type != OutputChannel && channel->type != LogChannel)
+  {
+    if(channel->handle >= 0) close(channel->handle);
+    channel->handle = -1;
+    return munmap(buffer, channel->bsize);
+  }
+
+  /* the growing output keeps own file */
+  handle = channel->handle;
+  channel->handle = -1;
+  if(handle < 0) handle = open((char*)channel->name, O_RDWR);
+  if(handle < 0) return -1;
+
+  channel->fsize = GetChannelHighWater(channel, handle);
+
+  /* user log is a text, zero tail of the last block is not a data */
+  if(channel->type == LogChannel && channel->high_water < 0)
+    while(channel->fsize > 0 && buffer[channel->fsize - 1] == 0) --channel->fsize;
+  StopChannelGrowth(buffer);
+  ret_code = munmap(buffer, channel->bsize);
+  channel->buffer = 0;
+
+  if(channel->type == LogChannel && channel->fsize == 0)
+    ret_code |= remove((char*)channel->name);
+  else
+    ret_code |= ftruncate(handle, channel->fsize);
+
+  close(handle);
+  return ret_code ? -1 : 0;
+}
+
+/*
+ * prepare the mapped channel to be used by nexe directly (zero copy view):
+ * input channel mapping is (re)protected read only, the kernel is advised
+ * with the channel hints. "buffer" is the channel mapping (system address)
+ * return 0 if success, otherwise negative errcode
+ */
+int ViewChannel(struct PreOpenedFileDesc* channel, char *buffer)
+{
+  size_t size = channel->bsize;
+
+  if(size == 0) return 0;
+  if(channel->type == InputChannel && mprotect(buffer, size, PROT_READ) != 0)
+    return -INTERNAL_ERR;
+
+  if(channel->hints & HintSequential) madvise(buffer, size, MADV_SEQUENTIAL);
+  if(channel->hints & HintRandom) madvise(buffer, size, MADV_RANDOM);
+  if(channel->hints & HintWillNeed) madvise(buffer, size, MADV_WILLNEED);
+  return 0;
+}
+
+/*
+ * nexe has consumed the mapped input channel up to "offset". pages below
+ * it are dropped from the sandbox (will be read again from the file if
+ * touched). the consumed part is kept in "released" and cannot go back,
+ * the newly consumed bytes are counted as read
+ * return 0 if success, otherwise negative errcode
+ */
+int ReleaseChannel(struct PreOpenedFileDesc* channel, char *buffer, int64_t offset)
+{
+  int64_t from = channel->released & ~((int64_t)NACL_PAGESIZE - 1);
+  int64_t to = offset & ~((int64_t)NACL_PAGESIZE - 1);
+
+  if(offset < channel->released || offset > channel->bsize)
+    return -INSANE_OFFSET;
+  if(to > from && madvise(buffer + from, to - from, MADV_DONTNEED) != 0)
+    return -INTERNAL_ERR;
+
+  ++channel->cnt_gets;
+  channel->cnt_get_size += offset - channel->released;
+  channel->released = offset;
+  return 0;
 }
 
 /*
@@ -67,6 +396,7 @@ static void PreallocateChannel(struct PreOpenedFileDesc* channel)
 int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
 {
   int desc;
+  int64_t size;
   struct NaClHostDesc *hd = malloc(sizeof(*hd));
 
   /* debug checks */
@@ -84,20 +414,152 @@ int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
   PreallocateChannel(channel);
   COND_ABORT(channel->max_size < channel->fsize, "channel legnth exceeded policy limit\n");
 
+  /* hints are kept by the open file which is referenced by the mapping */
+  ApplyChannelHints(channel);
+
   /* construct nacl descriptor */
   hd->d = channel->handle;
   desc = NaClSetAvail(nap, ((struct NaClDesc *) NaClDescIoDescMake(hd)));
 
-  /* map whole file into the memory. address cannot be higher than stack */
-  channel->buffer = NaClCommonSysMmapIntern(nap, NULL, channel->fsize,
+  /* windowed channel only maps the window, the rest is mapped on demand */
+  size = channel->fsize;
+  channel->window_offset = 0;
+  if(channel->window > 0 && channel->type == InputChannel)
+  {
+    int64_t window = channel->window * CHANNEL_WINDOW_UNIT;
+    COND_ABORT(window > MAX_MAP_SIZE, "channel window is too large\n");
+    if(size > window) size = window;
+  }
+
+  /* map the file into the memory. address cannot be higher than stack */
+  channel->buffer = NaClCommonSysMmapIntern(nap, NULL, size,
       GetChannelMapProt(channel), GetChannelMapFlags(channel), desc, 0);
   COND_ABORT((uint32_t)channel->buffer > 0xFF000000, "channel map error\n");
 
 
   /* mounting finalization */
+  channel->bsize = size; /* whole file or the window */
+  if(channel->type == OutputChannel || channel->type == LogChannel
+      || (channel->window > 0 && channel->type == InputChannel))
+  {
+    /* the window is remapped (the output grows) from own copy of the file handle */
+    int handle = dup(channel->handle);
+    COND_ABORT(handle < 0, "cannot keep mapped channel opened\n");
+    close(channel->handle);
+    channel->handle = handle;
+    if(channel->type == InputChannel) return 0;
+    return StartChannelGrowth(channel,
+        (char*)NaClUserToSys(nap, (uint32_t)channel->buffer));
+  }
   close(channel->handle);
-  channel->bsize = channel->fsize; /* yes. mapped file always put to memory whole */
   channel->handle = -1; /* there is no opened file for mapped channel */
 
   return 0;
 }
+
+/* bytes filled per fault of the lazy channel: "prefetch" or by the hints */
+static int32_t LazyCluster(struct PreOpenedFileDesc* channel)
+{
+  if(channel->prefetch > 0)
+    return channel->prefetch * PREFETCH_UNIT > LAZY_CLUSTER_MAX
+        ? LAZY_CLUSTER_MAX : channel->prefetch * PREFETCH_UNIT;
+  if(channel->hints & HintRandom) return LAZY_PAGE;
+  if(channel->hints & HintSequential) return LAZY_CLUSTER * 16;
+  return LAZY_CLUSTER;
+}
+
+/*
+ * reserve the memory of the lazy channel and register it for the fault
+ * handler which reads the pages from the channel source when touched. the
+ * size of the stream (pipe) is not known, the whole allowed size is
+ * reserved, the data is followed by zeroes
+ * return 0 if success, otherwise negative errcode
+ */
+int LazyMapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel)
+{
+  struct LazyMap *map;
+  int64_t size;
+
+  COND_ABORT(!channel, "channel is not constructed\n");
+  COND_ABORT(channel->mounted != LAZY, "channel is not supposed to be lazy\n");
+  COND_ABORT(channel->type != InputChannel, "only input channel can be lazy\n");
+  COND_ABORT(!channel->name, "cannot resolve channel name\n");
+
+  map = LazyMapCtor((char*)channel->name, LazyCluster(channel));
+  if(map == NULL) return -INTERNAL_ERR;
+  size = map->size < 0 ? channel->max_size : map->size;
+  COND_ABORT(channel->max_size < map->size, "channel legnth exceeded policy limit\n");
+  COND_ABORT(size > MAX_MAP_SIZE, "lazy channel is too large\n");
+
+  if(nap->lazy_maps == NULL)
+  {
+    nap->lazy_maps = calloc(CHANNELS_COUNT, sizeof *nap->lazy_maps);
+    COND_ABORT(nap->lazy_maps == NULL, "cannot allocate lazy channels\n");
+  }
+  nap->lazy_maps[channel->type] = map;
+
+  channel->handle = -1;
+  channel->fsize = size;
+  channel->bsize = size;
+  channel->buffer = 0;
+  if(size == 0) return 0;
+
+  /* anonymous memory without pages, they come from the handler */
+  channel->buffer = NaClCommonSysMmapIntern(nap, NULL, size, NACL_ABI_PROT_READ,
+      NACL_ABI_MAP_PRIVATE | NACL_ABI_MAP_ANONYMOUS, -1, 0);
+  COND_ABORT((uint32_t)channel->buffer > 0xFF000000, "channel map error\n");
+
+  if(LazyMapStart(map, (char*)NaClUserToSys(nap, (uint32_t)channel->buffer), size) != 0)
+    return -INTERNAL_ERR;
+  return 0;
+}
+
+/*
+ * move the window of the channel to "offset". the new data is mapped over
+ * the old one (MAP_FIXED) so the window keeps its address and there is no
+ * moment when it is unmapped. the part of the window behind the channel
+ * end is filled with zeroes. the read limits are checked before the window
+ * is touched, the failed tail leaves the window moved but its tail inaccessible.
+ * "buffer" is the window (system address)
+ * return the size of channel data in the window, otherwise negative errcode
+ */
+int32_t MoveChannelWindow(struct PreOpenedFileDesc* channel,
+    char *buffer, int64_t offset)
+{
+  int64_t size;
+  int64_t mapped;
+
+  if(channel->window < 1 || channel->handle < 0) return -INVALID_MODE;
+  if(offset < 0 || offset >= channel->fsize) return -INSANE_OFFSET;
+  if(offset & (NACL_MAP_PAGESIZE - 1)) return -INSANE_OFFSET;
+  if(channel->cnt_gets >= channel->max_gets) return -OUT_OF_LIMITS;
+
+  size = channel->fsize - offset;
+  if(size > channel->bsize) size = channel->bsize;
+  if(channel->cnt_get_size + size > channel->max_get_size) return -OUT_OF_LIMITS;
+  mapped = (size + NACL_PAGESIZE - 1) & ~((int64_t)NACL_PAGESIZE - 1);
+
+  /* the data of the old window will not be needed again */
+  if(channel->hints & HintDontNeed)
+    posix_fadvise(channel->handle, channel->window_offset,
+        channel->bsize, POSIX_FADV_DONTNEED);
+
+  if(mmap(buffer, mapped, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+      channel->handle, offset) == MAP_FAILED) return -INTERNAL_ERR;
+
+  /* the window shows the new data from now even if the tail fails */
+  channel->window_offset = offset;
+  channel->released = 0; /* the new window data is not consumed yet */
+  ++channel->cnt_gets;
+  channel->cnt_get_size += size;
+
+  if(mapped < channel->bsize
+      && mmap(buffer + mapped, channel->bsize - mapped, PROT_READ,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+  {
+    /* the old data must not be seen behind the new one */
+    mprotect(buffer + mapped, channel->bsize - mapped, PROT_NONE);
+    return -INTERNAL_ERR;
+  }
+  return (int32_t)size;
+}
@@ -15,9 +15,73 @@
 #define CHANNEL_MAP_FLAGS {NACL_ABI_MAP_PRIVATE, NACL_ABI_MAP_SHARED, NACL_ABI_MAP_SHARED, -1, -1}
 #define CHANNEL_MAP_PROT {NACL_ABI_PROT_READ, NACL_ABI_PROT_WRITE, NACL_ABI_PROT_READ | NACL_ABI_PROT_WRITE, -1, -1}
 
+EXTERN_C_BEGIN
+
+/* the largest mapping of output channel (larger one is cut). user address space is only 4gb */
+#define CHANNEL_MAP_LIMIT 0x40000000LL
+
+/* mapped output channel file grows by this step, the step is reserved if possible */
+#define CHANNEL_GROWTH_WINDOW 0x100000LL
+
+/* channel "window" is given in megabytes */
+#define CHANNEL_WINDOW_UNIT 0x100000LL
+
 /*
  * premap given file (channel). return 0 if success, otherwise negative errcode
  */
 int PremapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
 
+/*
+ * reserve the memory of the lazy input channel and start its fault handler
+ * return 0 if success, otherwise negative errcode
+ */
+int LazyMapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
+
+/*
+ * unmap given channel, trim output channel file to the written data size
+ * return 0 if success, otherwise negative errcode
+ */
+int UnmapChannel(struct NaClApp *nap, struct PreOpenedFileDesc* channel);
+
+/*
+ * protect input channel view read only and apply channel hints to the
+ * mapping. return 0 if success, otherwise negative errcode
+ */
+int ViewChannel(struct PreOpenedFileDesc* channel, char *buffer);
+
+/*
+ * drop the pages of mapped input channel consumed by nexe (below "offset")
+ * return 0 if success, otherwise negative errcode
+ */
+int ReleaseChannel(struct PreOpenedFileDesc* channel, char *buffer, int64_t offset);
+
+/*
+ * move the window of the windowed input channel to "offset" (multiple of
+ * NACL_MAP_PAGESIZE). return the size of channel data in the window,
+ * otherwise negative errcode
+ */
+int32_t MoveChannelWindow(struct PreOpenedFileDesc* channel,
+    char *buffer, int64_t offset);
+
+/*
+ * set the size of output channel file to the mapped size (max size or the
+ * channel window). note: must be called after file opened and measured
+ */
+void PreallocateChannel(struct PreOpenedFileDesc* channel);
+
+/*
+ * trim the file of mapped output channel to the data and the growth window,
+ * the file grows when nexe touches the mapping behind its end. "buffer" is
+ * the channel mapping (system address), the channel handle must be opened
+ * return 0 if success, otherwise negative errcode
+ */
+int StartChannelGrowth(struct PreOpenedFileDesc* channel, char *buffer);
+
+/*
+ * return the size of data written to the mapped output channel
+ */
+int64_t GetChannelHighWater(struct PreOpenedFileDesc* channel, int handle);
+
+EXTERN_C_END
+
 #endif /* PREMAP_H_ */
@@ -0,0 +1,301 @@
+/*
+ * premap_test.cc
+ * output channel preallocation and trimming, input view release
+ *
+ *  Created on: Apr 30, 2012
+ *      Author: d'b
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+#include "api/zvm.h"
+#include "src/service_runtime/sel_ldr.h"
+#include "src/manifest/premap.h"
+#include "src/service_runtime/nacl_config.h"
+
+#define TEST_MAX_SIZE 0x100000000LL /* 4gb */
+#define TEST_DATA_SIZE 1024
+#define TEST_USER_ADDR 0x10000
+
+// construct output channel with opened temporary file
+static void make_channel(struct PreOpenedFileDesc *channel, char *name)
+{
+  memset(channel, 0, sizeof *channel);
+  channel->handle = mkstemp(name);
+  ASSERT_LE(0, channel->handle);
+  channel->name = (uintptr_t)name;
+  channel->type = OutputChannel;
+  channel->mounted = MAPPED;
+  channel->max_size = TEST_MAX_SIZE;
+  channel->fsize = 0;
+  channel->high_water = -1;
+}
+
+// return size of the file
+static int64_t file_size(const char *name)
+{
+  struct stat fs;
+  if(stat(name, &fs) < 0) return -1;
+  return fs.st_size;
+}
+
+// 4gb output channel which got 1kb of data
+TEST(PremapChannel, trim_4gb_output_to_1kb)
+{
+  struct NaClApp nap;
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+  char *buffer;
+
+  // output file is extended to the channel window, not to 4gb
+  make_channel(&channel, name);
+  channel.window = CHANNEL_MAP_LIMIT / CHANNEL_WINDOW_UNIT;
+  PreallocateChannel(&channel);
+  EXPECT_EQ(CHANNEL_MAP_LIMIT, channel.fsize);
+  EXPECT_EQ(CHANNEL_MAP_LIMIT, file_size(name));
+
+  // emulate the nexe mapping and output
+  channel.bsize = channel.fsize;
+  buffer = (char*)mmap(NULL, channel.bsize, PROT_READ | PROT_WRITE,
+      MAP_SHARED, channel.handle, 0);
+  ASSERT_NE(MAP_FAILED, buffer);
+  close(channel.handle);
+  channel.handle = -1;
+  memset(buffer, 'x', TEST_DATA_SIZE);
+  buffer[TEST_DATA_SIZE - 1] = 0;
+  channel.high_water = TEST_DATA_SIZE;
+
+  nap.addr_bits = 32;
+  nap.mem_start = (uintptr_t)buffer - TEST_USER_ADDR;
+  channel.buffer = TEST_USER_ADDR;
+
+  EXPECT_EQ(0, UnmapChannel(&nap, &channel));
+  EXPECT_EQ(TEST_DATA_SIZE, channel.fsize);
+  EXPECT_EQ(TEST_DATA_SIZE, file_size(name));
+  unlink(name);
+}
+
+// mapping of the whole 4gb channel does not fit the user space, it is cut
+TEST(PremapChannel, too_large_output)
+{
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+
+  make_channel(&channel, name);
+  PreallocateChannel(&channel);
+  EXPECT_EQ(CHANNEL_MAP_LIMIT, channel.fsize);
+  EXPECT_EQ(CHANNEL_MAP_LIMIT, file_size(name));
+  close(channel.handle);
+  unlink(name);
+}
+
+// map the preallocated output channel and start its growth
+static char *map_growing(struct NaClApp *nap, struct PreOpenedFileDesc *channel)
+{
+  char *buffer;
+
+  PreallocateChannel(channel);
+  channel->bsize = channel->fsize;
+  buffer = (char*)mmap(NULL, channel->bsize, PROT_READ | PROT_WRITE,
+      MAP_SHARED, channel->handle, 0);
+  if(buffer == MAP_FAILED) return NULL;
+  if(StartChannelGrowth(channel, buffer) != 0) return NULL;
+
+  nap->addr_bits = 32;
+  nap->mem_start = (uintptr_t)buffer - TEST_USER_ADDR;
+  channel->buffer = TEST_USER_ADDR;
+  return buffer;
+}
+
+// the file grows by the windows touched by nexe
+TEST(StartChannelGrowth, grows_by_windows)
+{
+  struct NaClApp nap;
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+  char *buffer;
+
+  make_channel(&channel, name);
+  buffer = map_growing(&nap, &channel);
+  ASSERT_TRUE(buffer != NULL);
+  EXPECT_EQ(CHANNEL_GROWTH_WINDOW, file_size(name));
+
+  buffer[0] = 'x';
+  EXPECT_EQ(CHANNEL_GROWTH_WINDOW, file_size(name));
+  buffer[5 * CHANNEL_GROWTH_WINDOW + 1] = 'y';
+  EXPECT_EQ(6 * CHANNEL_GROWTH_WINDOW, file_size(name));
+  EXPECT_EQ('y', buffer[5 * CHANNEL_GROWTH_WINDOW + 1]);
+  EXPECT_EQ(0, buffer[2 * CHANNEL_GROWTH_WINDOW]);
+
+  // the last byte of the mapping
+  buffer[channel.bsize - 1] = 'z';
+  EXPECT_EQ(channel.bsize, file_size(name));
+
+  channel.high_water = channel.bsize;
+  EXPECT_EQ(0, UnmapChannel(&nap, &channel));
+  EXPECT_EQ(-1, channel.handle);
+  unlink(name);
+}
+
+// 4gb output channel got 1kb of data and did not report its size
+TEST(StartChannelGrowth, trim_unreported_4gb_output)
+{
+  struct NaClApp nap;
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+  struct stat fs;
+  char *buffer;
+
+  make_channel(&channel, name);
+  ASSERT_EQ(0, fstat(channel.handle, &fs));
+  buffer = map_growing(&nap, &channel);
+  ASSERT_TRUE(buffer != NULL);
+  memset(buffer, 'x', TEST_DATA_SIZE);
+
+  // the size is detected by the file system block, reserved blocks are not data
+  EXPECT_EQ(0, UnmapChannel(&nap, &channel));
+  EXPECT_EQ(channel.fsize, file_size(name));
+  EXPECT_LE(TEST_DATA_SIZE, channel.fsize);
+  EXPECT_GE(fs.st_blksize, channel.fsize);
+  unlink(name);
+}
+
+// nexe reported size has priority over detected one
+TEST(GetChannelHighWater, reported_size)
+{
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+  char buffer[4 * TEST_DATA_SIZE];
+
+  make_channel(&channel, name);
+  memset(buffer, 0, sizeof buffer);
+  memset(buffer, 'x', TEST_DATA_SIZE);
+  channel.bsize = 4 * NACL_PAGESIZE;
+  ASSERT_EQ((ssize_t)sizeof buffer, write(channel.handle, buffer, sizeof buffer));
+  ASSERT_EQ(0, ftruncate(channel.handle, channel.bsize));
+
+  // written zeroes are kept, the hole after the data is not
+  EXPECT_EQ((int64_t)sizeof buffer,
+      GetChannelHighWater(&channel, channel.handle));
+
+  // unless nexe reported the size
+  channel.high_water = 2 * TEST_DATA_SIZE;
+  EXPECT_EQ(2 * TEST_DATA_SIZE, GetChannelHighWater(&channel, channel.handle));
+  channel.high_water = 0;
+  EXPECT_EQ(0, GetChannelHighWater(&channel, channel.handle));
+
+  close(channel.handle);
+  unlink(name);
+}
+
+// consumed pages of the input view are dropped, the rest is kept
+TEST(ReleaseChannel, drops_consumed_pages)
+{
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+  char *buffer;
+  int64_t size = 4 * NACL_PAGESIZE;
+
+  make_channel(&channel, name);
+  channel.type = InputChannel;
+  channel.bsize = size;
+  ASSERT_EQ(0, ftruncate(channel.handle, size));
+
+  // private changes of the mapping show which pages were dropped
+  buffer = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE, channel.handle, 0);
+  ASSERT_NE(MAP_FAILED, buffer);
+  memset(buffer, 'x', size);
+
+  // read counter is not the consumed offset (e.g. window moves add to it)
+  channel.cnt_get_size = size;
+
+  // only whole pages bellow the offset are released
+  EXPECT_EQ(0, ReleaseChannel(&channel, buffer, NACL_PAGESIZE + 1));
+  EXPECT_EQ(0, buffer[0]);
+  EXPECT_EQ('x', buffer[NACL_PAGESIZE]);
+  EXPECT_EQ(NACL_PAGESIZE + 1, channel.released);
+  EXPECT_EQ(size + NACL_PAGESIZE + 1, channel.cnt_get_size);
+
+  EXPECT_EQ(0, ReleaseChannel(&channel, buffer, 3 * NACL_PAGESIZE));
+  EXPECT_EQ(0, buffer[NACL_PAGESIZE]);
+  EXPECT_EQ(0, buffer[2 * NACL_PAGESIZE]);
+  EXPECT_EQ('x', buffer[3 * NACL_PAGESIZE]);
+  EXPECT_EQ(2, channel.cnt_gets);
+
+  // cannot go back or beyond the view
+  EXPECT_EQ(-INSANE_OFFSET, ReleaseChannel(&channel, buffer, NACL_PAGESIZE));
+  EXPECT_EQ(-INSANE_OFFSET, ReleaseChannel(&channel, buffer, size + 1));
+  EXPECT_EQ(3 * NACL_PAGESIZE, channel.released);
+  EXPECT_EQ(size + 3 * NACL_PAGESIZE, channel.cnt_get_size);
+
+  munmap(buffer, size);
+  close(channel.handle);
+  unlink(name);
+}
+
+// window is remapped in place, the tail behind the channel end is zeroed
+TEST(MoveChannelWindow, moves_in_place)
+{
+  struct PreOpenedFileDesc channel;
+  char name[] = "/tmp/premap_test.XXXXXX";
+  char *buffer;
+  int64_t window = 2 * NACL_MAP_PAGESIZE;
+
+  // each 64kb of the channel is filled with own number
+  make_channel(&channel, name);
+  channel.type = InputChannel;
+  channel.window = 1;
+  channel.max_gets = 10;
+  channel.max_get_size = window + NACL_MAP_PAGESIZE + TEST_DATA_SIZE;
+  channel.fsize = 3 * NACL_MAP_PAGESIZE + TEST_DATA_SIZE;
+  for(int i = 0; i < 4; ++i) {
+    char chunk[NACL_MAP_PAGESIZE];
+    int64_t size = i < 3 ? NACL_MAP_PAGESIZE : TEST_DATA_SIZE;
+    memset(chunk, '0' + i, size);
+    ASSERT_EQ(size, write(channel.handle, chunk, size));
+  }
+
+  buffer = (char*)mmap(NULL, window, PROT_READ, MAP_PRIVATE, channel.handle, 0);
+  ASSERT_NE(MAP_FAILED, buffer);
+  channel.bsize = window;
+
+  // the whole window is data
+  EXPECT_EQ(window, MoveChannelWindow(&channel, buffer, NACL_MAP_PAGESIZE));
+  EXPECT_EQ('1', buffer[0]);
+  EXPECT_EQ('2', buffer[window - 1]);
+
+  // the window is only partly filled at the channel end
+  EXPECT_EQ(NACL_MAP_PAGESIZE + TEST_DATA_SIZE,
+      MoveChannelWindow(&channel, buffer, 2 * NACL_MAP_PAGESIZE));
+  EXPECT_EQ('2', buffer[0]);
+  EXPECT_EQ('3', buffer[NACL_MAP_PAGESIZE + TEST_DATA_SIZE - 1]);
+  EXPECT_EQ(0, buffer[NACL_MAP_PAGESIZE + TEST_DATA_SIZE]);
+  EXPECT_EQ(0, buffer[window - 1]);
+  EXPECT_EQ(2 * NACL_MAP_PAGESIZE, channel.window_offset);
+  EXPECT_EQ(2, channel.cnt_gets);
+
+  // unaligned or out of the channel
+  EXPECT_EQ(-INSANE_OFFSET, MoveChannelWindow(&channel, buffer, 1));
+  EXPECT_EQ(-INSANE_OFFSET, MoveChannelWindow(&channel, buffer, 4 * NACL_MAP_PAGESIZE));
+
+  // read bytes limit is reached, the window is not moved
+  EXPECT_EQ(-OUT_OF_LIMITS, MoveChannelWindow(&channel, buffer, 0));
+  EXPECT_EQ('2', buffer[0]);
+  EXPECT_EQ(2 * NACL_MAP_PAGESIZE, channel.window_offset);
+  EXPECT_EQ(2, channel.cnt_gets);
+
+  munmap(buffer, window);
+  close(channel.handle);
+  unlink(name);
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
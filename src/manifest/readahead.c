@@ -0,0 +1,195 @@
+/*
+ * page cache control for channels: access pattern hints and
+ * trusted prefetch thread which reads ahead of the user
+ *
+ * the kernel only sees small and irregular user reads. here they are
+ * supplemented with posix_fadvise() hints given in manifest. for the
+ * channels with "prefetch" set a trusted thread keeps the page cache
+ * filled "prefetch" megabytes ahead of the user read offset
+ *
+ *  Created on: May 2, 2012
+ *      Author: d'b
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "src/manifest/readahead.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/service_runtime/nacl_globals.h"
+#include "src/service_runtime/sel_ldr.h"
+
+/* trusted side channel state. indexed by channel type */
+struct ChannelReadahead
+{
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int running; /* prefetch thread is active */
+  int handle; /* channel file */
+  int64_t fsize; /* channel file size */
+  int64_t window; /* prefetch window size */
+  int64_t user_pos; /* end of the last user read */
+  int64_t ahead_pos; /* end of the prefetched data */
+  int64_t last_offset; /* last "dontneed" write */
+  int64_t last_size;
+};
+
+/*
+ * return state of the channel. each sandbox has own states, allocated
+ * on the first use and released with the sandbox. the process wide
+ * states are used when there is no sandbox (benchmarks)
+ */
+static struct ChannelReadahead *GetState(struct PreOpenedFileDesc *channel)
+{
+  static struct ChannelReadahead process_state[CHANNELS_COUNT];
+
+  if(gnap == NULL) return &process_state[channel->type];
+  if(gnap->readahead == NULL)
+  {
+    gnap->readahead = calloc(CHANNELS_COUNT, sizeof *gnap->readahead);
+    COND_ABORT(gnap->readahead == NULL, "cannot allocate readahead state\n");
+  }
+  return &gnap->readahead[channel->type];
+}
+
+/* advise kernel about channel access pattern */
+void ApplyChannelHints(struct PreOpenedFileDesc *channel)
+{
+  int handle = channel->handle;
+
+  if(handle < 0 || channel->hints == 0) return;
+
+  if(channel->hints & HintSequential)
+    posix_fadvise(handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if(channel->hints & HintRandom)
+    posix_fadvise(handle, 0, 0, POSIX_FADV_RANDOM);
+  if((channel->hints & HintWillNeed) && channel->type == InputChannel)
+    posix_fadvise(handle, 0, channel->fsize, POSIX_FADV_WILLNEED);
+}
+
+/* prefetch thread. reads channel by chunks keeping window ahead of user */
+static void *PrefetchThread(void *arg)
+{
+  struct ChannelReadahead *ra = arg;
+
+  pthread_mutex_lock(&ra->mutex);
+  while(ra->running)
+  {
+    int64_t target = ra->user_pos + ra->window;
+    int64_t offset = ra->ahead_pos;
+    int64_t size;
+
+    /* user moved out of the window (seek), start from the user offset */
+    if(offset < ra->user_pos || offset > target) offset = ra->user_pos;
+    if(target > ra->fsize) target = ra->fsize;
+
+    /* nothing to read, wait for user */
+    if(offset >= target)
+    {
+      ra->ahead_pos = offset;
+      pthread_cond_wait(&ra->cond, &ra->mutex);
+      continue;
+    }
+
+    size = target - offset;
+    if(size > PREFETCH_CHUNK) size = PREFETCH_CHUNK;
+    pthread_mutex_unlock(&ra->mutex);
+
+    readahead(ra->handle, offset, size);
+
+    pthread_mutex_lock(&ra->mutex);
+    ra->ahead_pos = offset + size;
+  }
+  pthread_mutex_unlock(&ra->mutex);
+  return NULL;
+}
+
+/* move prefetch window, drop used pages */
+void ChannelReadDone(struct PreOpenedFileDesc *channel, int64_t offset, int32_t size)
+{
+  struct ChannelReadahead *ra = GetState(channel);
+
+  if(size < 1) return;
+  if(ra->running)
+  {
+    pthread_mutex_lock(&ra->mutex);
+    ra->user_pos = offset + size;
+    pthread_cond_signal(&ra->cond);
+    pthread_mutex_unlock(&ra->mutex);
+  }
+
+  if(channel->hints & HintDontNeed)
+    posix_fadvise(channel->handle, offset, size, POSIX_FADV_DONTNEED);
+}
+
+/*
+ * start writeback of the written data. written before data is
+ * waited for and dropped from the page cache
+ */
+void ChannelWriteDone(struct PreOpenedFileDesc *channel, int64_t offset, int32_t size)
+{
+  struct ChannelReadahead *ra = GetState(channel);
+
+  if(size < 1 || !(channel->hints & HintDontNeed)) return;
+
+  sync_file_range(channel->handle, offset, size, SYNC_FILE_RANGE_WRITE);
+  if(ra->last_size > 0)
+  {
+    sync_file_range(channel->handle, ra->last_offset, ra->last_size,
+        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(channel->handle, ra->last_offset, ra->last_size, POSIX_FADV_DONTNEED);
+  }
+  ra->last_offset = offset;
+  ra->last_size = size;
+}
+
+/* start prefetch thread for the channel */
+int StartChannelPrefetch(struct PreOpenedFileDesc *channel)
+{
+  struct ChannelReadahead *ra = GetState(channel);
+
+  ra->last_size = 0;
+  if(channel->prefetch < 1 || channel->type != InputChannel) return 0;
+  if(ra->running) return -1;
+
+  pthread_mutex_init(&ra->mutex, NULL);
+  pthread_cond_init(&ra->cond, NULL);
+  ra->handle = channel->handle;
+  ra->fsize = channel->fsize;
+  ra->window = (int64_t)channel->prefetch * PREFETCH_UNIT;
+  ra->user_pos = 0;
+  ra->ahead_pos = 0;
+  ra->running = 1;
+
+  if(pthread_create(&ra->thread, NULL, PrefetchThread, ra) != 0)
+  {
+    ra->running = 0;
+    return -1;
+  }
+  return 0;
+}
+
+/* stop the channel prefetch thread, flush pending "dontneed" writes */
+void StopChannelPrefetch(struct PreOpenedFileDesc *channel)
+{
+  struct ChannelReadahead *ra = GetState(channel);
+
+  if(ra->last_size > 0)
+  {
+    sync_file_range(channel->handle, ra->last_offset, ra->last_size,
+        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(channel->handle, ra->last_offset, ra->last_size, POSIX_FADV_DONTNEED);
+    ra->last_size = 0;
+  }
+
+  if(!ra->running) return;
+  pthread_mutex_lock(&ra->mutex);
+  ra->running = 0;
+  pthread_cond_signal(&ra->cond);
+  pthread_mutex_unlock(&ra->mutex);
+  pthread_join(ra->thread, NULL);
+  pthread_mutex_destroy(&ra->mutex);
+  pthread_cond_destroy(&ra->cond);
+}
@@ -0,0 +1,50 @@
+/*
+ * page cache control for channels: access pattern hints and
+ * trusted prefetch thread which reads ahead of the user
+ *
+ *  Created on: May 2, 2012
+ *      Author: d'b
+ */
+
+#ifndef READAHEAD_H_
+#define READAHEAD_H_
+
+#include "api/zvm.h"
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* prefetch thread reads by chunks of this size */
+#define PREFETCH_CHUNK 0x100000
+
+/* channel "prefetch" is given in megabytes */
+#define PREFETCH_UNIT 0x100000
+
+/*
+ * advise kernel about channel access pattern. channel file must be opened
+ * note: channel hints are set from manifest
+ */
+void ApplyChannelHints(struct PreOpenedFileDesc *channel);
+
+/*
+ * must be called after user read/write of the channel. moves the prefetch
+ * window, drops already used pages if channel has "dontneed" hint
+ */
+void ChannelReadDone(struct PreOpenedFileDesc *channel, int64_t offset, int32_t size);
+void ChannelWriteDone(struct PreOpenedFileDesc *channel, int64_t offset, int32_t size);
+
+/*
+ * start prefetch thread for the channel. return 0 if success (or prefetch
+ * is not requested), otherwise negative errcode
+ */
+int StartChannelPrefetch(struct PreOpenedFileDesc *channel);
+
+/*
+ * stop the channel prefetch thread (if started) and flush pending
+ * "dontneed" writes. must be called before the channel file closed
+ */
+void StopChannelPrefetch(struct PreOpenedFileDesc *channel);
+
+EXTERN_C_END
+
+#endif /* READAHEAD_H_ */
@@ -0,0 +1,125 @@
+/*
+ * sequential scan of LOADED input channel on cold page cache with and
+ * without channel hints / prefetch thread. emulates nexe which reads
+ * the channel with TrapRead by small chunks and does some work on them
+ *
+ * usage: readahead_bench [file] [size in mb] [chunk in kb]
+ * if the file does not exist it will be created (and removed at the end)
+ *
+ *  Created on: May 2, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "src/manifest/readahead.h"
+#include "src/manifest/manifest_setup.h"
+
+#define DEFAULT_FILE "/tmp/readahead_bench.dat"
+#define DEFAULT_SIZE 256 /* mb */
+#define DEFAULT_CHUNK 64 /* kb */
+
+static double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* fill the file with data if it is absent */
+static int CreateFile(const char *name, int64_t size, int *created)
+{
+  char buffer[PREFETCH_CHUNK];
+  int64_t i;
+  int handle = open(name, O_RDONLY);
+
+  *created = 0;
+  if(handle >= 0) return close(handle);
+
+  handle = open(name, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+  if(handle < 0) return -1;
+  for(i = 0; i < (int64_t)sizeof buffer; ++i) buffer[i] = (char)(i * 31);
+  for(i = 0; i < size; i += sizeof buffer)
+    if(write(handle, buffer, sizeof buffer) != sizeof buffer) return -1;
+  *created = 1;
+  return close(handle);
+}
+
+/* drop the file from the page cache */
+static void DropCache(const char *name)
+{
+  int handle = open(name, O_RDONLY);
+  if(handle < 0) return;
+  fdatasync(handle);
+  posix_fadvise(handle, 0, 0, POSIX_FADV_DONTNEED);
+  close(handle);
+}
+
+/* read whole channel as TrapRead does, return throughput in mb/s */
+static double Scan(const char *name, const char *hints, int prefetch, int chunk)
+{
+  struct PreOpenedFileDesc channel;
+  char *buffer = malloc(chunk);
+  int64_t offset = 0;
+  uint32_t sum = 0;
+  double start;
+  int32_t size;
+
+  DropCache(name);
+  memset(&channel, 0, sizeof channel);
+  channel.type = InputChannel;
+  channel.hints = GetChannelHints(hints);
+  channel.prefetch = prefetch;
+
+  start = Now();
+  channel.handle = open(name, O_RDONLY);
+  if(channel.handle < 0 || buffer == NULL) return 0;
+  channel.fsize = lseek(channel.handle, 0, SEEK_END);
+  ApplyChannelHints(&channel);
+  StartChannelPrefetch(&channel);
+
+  while((size = pread(channel.handle, buffer, chunk, offset)) > 0)
+  {
+    int32_t i;
+    ChannelReadDone(&channel, offset, size);
+    offset += size;
+
+    /* user work */
+    for(i = 0; i < size; ++i) sum = sum * 33 + buffer[i];
+  }
+
+  StopChannelPrefetch(&channel);
+  close(channel.handle);
+  free(buffer);
+  if(sum == 1) printf(" "); /* keep the work */
+  return offset / (Now() - start) / PREFETCH_UNIT;
+}
+
+int main(int argc, char **argv)
+{
+  const char *name = argc > 1 ? argv[1] : DEFAULT_FILE;
+  int64_t size = (int64_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE) * PREFETCH_UNIT;
+  int chunk = (argc > 3 ? atoi(argv[3]) : DEFAULT_CHUNK) * 1024;
+  int created;
+
+  if(size < 1 || chunk < 1 || CreateFile(name, size, &created))
+  {
+    fprintf(stderr, "usage: %s [file] [size in mb] [chunk in kb]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-28s %8.1f mb/s\n", "no hints", Scan(name, NULL, 0, chunk));
+  printf("%-28s %8.1f mb/s\n", "sequential", Scan(name, "sequential", 0, chunk));
+  printf("%-28s %8.1f mb/s\n", "sequential,willneed",
+      Scan(name, "sequential,willneed", 0, chunk));
+  printf("%-28s %8.1f mb/s\n", "prefetch 16mb", Scan(name, NULL, 16, chunk));
+  printf("%-28s %8.1f mb/s\n", "sequential,dontneed+prefetch",
+      Scan(name, "sequential,dontneed", 16, chunk));
+
+  if(created) unlink(name);
+  return 0;
+}
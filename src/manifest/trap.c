@@ -9,16 +9,25 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/time.h>
 
 #include "src/manifest/trap.h"
 #include "src/manifest/manifest_setup.h"
+#include "src/manifest/readahead.h"
+#include "src/manifest/direct_io.h"
+#include "src/manifest/channel_copy.h"
+#include "src/manifest/premap.h"
+#include "src/manifest/trap_journal.h"
+#include "src/manifest/crc32c.h"
 #include "src/platform/nacl_log.h"
 #include "api/zvm.h"
 #include "src/service_runtime/sel_ldr.h"
 #include "src/service_runtime/nacl_globals.h"
+#include "src/service_runtime/nacl_user_thread.h"
 #include "src/platform/nacl_exit.h"
 #ifdef NETWORKING
 #  include "src/networking/zvm_netw.h"
@@ -38,15 +47,37 @@ EXTERN_C_BEGIN
 #include "src/networking/zmq_netw.h"
 EXTERN_C_END
 
-/* pause cpu time counting. update cnt_cpu */
+/*
+ * cpu time of the sandbox in clock() ticks. clock() counts the whole
+ * process, so sandboxes sharing the process (one thread each) use
+ * the cpu time of own thread
+ */
+static clock_t CpuClock(struct NaClApp *nap)
+{
+  struct timespec ts;
+
+  if(!nap->multi_tenant) return clock();
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (clock_t)ts.tv_sec * CLOCKS_PER_SEC
+      + ts.tv_nsec / (1000000000 / CLOCKS_PER_SEC);
+}
+
+/*
+ * pause cpu time counting. update cnt_cpu. clock() counts all threads
+ * so the clock only stops when the last user thread enters the syscall.
+ * ticks are accumulated in 64 bits, cnt_cpu gets milliseconds
+ * note: must be called under trusted lock
+ */
 void PauseCpuClock(struct NaClApp *nap)
 {
   if(nap->manifest)
   {
-    clock_t current = clock();
-    struct SetupList *policy = nap->manifest->user_setup;
-    policy->cnt_cpu += current - policy->cnt_cpu_last;
-    policy->cnt_cpu_last = current;
+    int64_t current = CpuClock(nap);
+    nap->cpu_clock += current - nap->cpu_clock_last;
+    nap->cpu_clock_last = current;
+    nap->manifest->user_setup->cnt_cpu =
+        (int32_t)(nap->cpu_clock / (CLOCKS_PER_SEC / 1000));
+    if(nap->cpu_clock_users > 0) --nap->cpu_clock_users;
   }
 }
 
@@ -55,18 +86,27 @@ void ResumeCpuClock(struct NaClApp *nap)
 {
   if(nap->manifest)
   {
-    nap->manifest->user_setup->cnt_cpu_last = clock();
+    if(nap->cpu_clock_users++ == 0)
+      nap->cpu_clock_last = CpuClock(nap);
   }
 }
 
+/* return non zero if user program used more cpu than allowed */
+int CpuLimitExceeded(struct NaClApp *nap)
+{
+  struct SetupList *policy;
+
+  if(nap->manifest == NULL) return 0;
+  policy = nap->manifest->user_setup;
+  return policy->max_cpu > 0 && policy->cnt_cpu > policy->max_cpu;
+}
+
 /*
- * user exit. invokes long jump to main(). uses global var.
+ * user exit. invokes long jump to main() (from any user thread)
  */
 static int32_t TrapExitHandle(struct NaClApp *nap, int32_t code)
 {
-  NaClLog(1, "Exit syscall handler: %d\n", code);
-  nap->exit_status = code;
-  longjmp(user_exit, code);
+  UserJobExit(nap, code);
 
   /* not reached. added to avoid compiler warning */
   return code;
@@ -139,7 +179,10 @@ int32_t TrapReadHandle(struct NaClApp *nap,
 	  int capab = ENOTALLOWED;
 	  capab = capabilities_for_file_fd(desc);
 	  if ( capab == EREAD || capab == EREADWRITE ){
+		  /* blocks on the peer, other user threads must not wait for it */
+		  TrustedUnlock();
 		  retcode = commf_read(desc, sys_buffer, size);
+		  TrustedLock();
 		  if ( -1 == retcode  ){
 			  NaClLog(LOG_ERROR, "%s() read file %d error\n", __func__, desc );
 			  NaClAbort();
@@ -170,7 +213,7 @@ int32_t TrapReadHandle(struct NaClApp *nap,
   /*
    * todo: make it function with editable list of available channels
    */
-  if(fd->mounted != LOADED) return -INVALID_MODE;
+  if(fd->mounted != LOADED && fd->mounted != DIRECT) return -INVALID_MODE;
 
   /* check arguments sanity */
   if(size < 1) return -INSANE_SIZE;
@@ -189,7 +232,15 @@ int32_t TrapReadHandle(struct NaClApp *nap,
   fd->cnt_get_size += size;
 
   /* read data */
-  retcode = pread(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  if(fd->mounted == DIRECT)
+    retcode = DirectRead(fd->handle, sys_buffer, size, offset);
+  else
+    retcode = pread(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  ChannelReadDone(fd, offset, retcode);
+
+  /* integrity mode */
+  if(fd->integrity && retcode > 0)
+    fd->crc_get = Crc32c(fd->crc_get, sys_buffer, retcode);
 
   return retcode;
 }
@@ -224,7 +275,10 @@ int32_t TrapWriteHandle(struct NaClApp *nap,
 	  int capab = ENOTALLOWED;
 	  capab = capabilities_for_file_fd(desc);
 	  if ( capab == EWRITE || capab == EREADWRITE ){
+		  /* blocks on the peer, other user threads must not wait for it */
+		  TrustedUnlock();
 		  retcode = commf_write(desc, sys_buffer, size);
+		  TrustedLock();
 		  if ( -1 == retcode  ){
 			  NaClLog(LOG_ERROR, "%s() write file %d error\n", __func__, desc );
 			  NaClAbort();
@@ -249,7 +303,7 @@ int32_t TrapWriteHandle(struct NaClApp *nap,
   /*
    * todo: make it function with editable list of available channels
    */
-  if(fd->mounted != LOADED) return -INVALID_MODE;
+  if(fd->mounted != LOADED && fd->mounted != DIRECT) return -INVALID_MODE;
 
   /* check arguments sanity */
   if(size < 1) return -INSANE_SIZE;
@@ -267,12 +321,337 @@ int32_t TrapWriteHandle(struct NaClApp *nap,
   ++fd->cnt_puts;
   fd->cnt_put_size += size;
 
-  /* read data */
-  retcode = pwrite(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  /* write data */
+  if(fd->mounted == DIRECT)
+    retcode = DirectWrite(fd->handle, sys_buffer, size, offset);
+  else
+    retcode = pwrite(fd->handle, sys_buffer, (size_t)size, (off_t)offset);
+  ChannelWriteDone(fd, offset, retcode);
+
+  /* integrity mode */
+  if(fd->integrity && retcode > 0)
+    fd->crc_put = Crc32c(fd->crc_put, sys_buffer, retcode);
+
+  return retcode;
+}
+
+/*
+ * copy specified amount of bytes from "src" channel at "src_offset" to
+ * "dst" channel at "dst_offset" without passing data through user memory.
+ * accounted as read of "src" and write of "dst"
+ * return amount of copied bytes or negative error code if call failed
+ */
+static int32_t TrapCopyHandle(struct NaClApp *nap,
+    enum ChannelType src, int64_t src_offset,
+    enum ChannelType dst, int64_t dst_offset, int32_t size)
+{
+  struct PreOpenedFileDesc *in;
+  struct PreOpenedFileDesc *out;
+  int64_t tail;
+  int32_t retcode;
+
+  NaClLog(4, "%s() invoked: src=%d, src_offset=%ld, dst=%d, dst_offset=%ld, size=%d\n",
+      __func__, src, src_offset, dst, dst_offset, size);
+
+  /* same channels TrapRead/TrapWrite allow */
+  if(src != InputChannel && src != OutputChannel) return -INVALID_DESC;
+  if(dst != OutputChannel) return -INVALID_DESC;
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  in = &nap->manifest->user_setup->channels[src];
+  out = &nap->manifest->user_setup->channels[dst];
+  if(in->mounted != LOADED && in->mounted != DIRECT) return -INVALID_MODE;
+  if(out->mounted != LOADED && out->mounted != DIRECT) return -INVALID_MODE;
+
+  /* check arguments sanity */
+  if(size < 1) return -INSANE_SIZE;
+  if(src_offset < 0 || dst_offset < 0) return -INSANE_OFFSET;
+
+  /* check limits of both channels */
+  if(src_offset >= in->fsize || dst_offset >= out->fsize) return -OUT_OF_BOUNDS;
+  if(in->cnt_gets >= in->max_gets) return -OUT_OF_LIMITS;
+  if(out->cnt_puts >= out->max_puts) return -OUT_OF_LIMITS;
+
+  tail = in->max_get_size - in->cnt_get_size;
+  if(size > tail) size = tail;
+  tail = out->max_put_size - out->cnt_put_size;
+  if(size > tail) size = tail;
+  if(size < 1) return -OUT_OF_LIMITS;
+
+  /* update counters (even if syscall failed) */
+  ++in->cnt_gets;
+  in->cnt_get_size += size;
+  ++out->cnt_puts;
+  out->cnt_put_size += size;
+
+  /* copy data. integrity mode channels get the crc of the copied data */
+  retcode = CopyChannelData(in->handle, src_offset, out->handle, dst_offset,
+      size, in->mounted == DIRECT || out->mounted == DIRECT,
+      in->integrity ? &in->crc_get : NULL, out->integrity ? &out->crc_put : NULL);
+  ChannelReadDone(in, src_offset, retcode);
+  ChannelWriteDone(out, dst_offset, retcode);
 
   return retcode;
 }
 
+/*
+ * give nexe direct access to the mapped channel. user address of the
+ * channel data is stored to "data" (user address of the pointer)
+ * return the size of the view or negative error code if call failed
+ */
+static int32_t TrapViewHandle(struct NaClApp *nap,
+    enum ChannelType desc, uint32_t data)
+{
+  struct PreOpenedFileDesc *fd;
+  uintptr_t sys_data;
+
+  NaClLog(4, "%s() invoked: desc=%d, data=0x%x\n", __func__, desc, data);
+
+  /* network channels cannot be mapped */
+  if(desc < InputChannel || desc > LogChannel) return -INVALID_DESC;
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  fd = &nap->manifest->user_setup->channels[desc];
+  if((fd->mounted != MAPPED && fd->mounted != LAZY) || fd->buffer == 0)
+    return -INVALID_MODE;
+
+  sys_data = NaClUserToSysAddrRange(nap, data, sizeof(uint32_t));
+  if(sys_data == kNaClBadAddress) return -INVALID_BUFFER;
+
+  if(ViewChannel(fd, (char*)NaClUserToSys(nap, (uint32_t)fd->buffer)) != 0)
+    return -INTERNAL_ERR;
+
+  *(uint32_t*)sys_data = (uint32_t)fd->buffer;
+  return fd->bsize;
+}
+
+/*
+ * nexe has consumed the mapped input channel view up to "offset",
+ * consumed pages are dropped. return 0 or negative error code
+ */
+static int32_t TrapReleaseHandle(struct NaClApp *nap,
+    enum ChannelType desc, int64_t offset)
+{
+  struct PreOpenedFileDesc *fd;
+
+  NaClLog(4, "%s() invoked: desc=%d, offset=%ld\n", __func__, desc, offset);
+
+  if(desc != InputChannel) return -INVALID_DESC;
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  fd = &nap->manifest->user_setup->channels[desc];
+  if(fd->mounted != MAPPED || fd->buffer == 0) return -INVALID_MODE;
+
+  /* the window is replaced as a whole when moved */
+  if(fd->window > 0) return -INVALID_MODE;
+
+  return ReleaseChannel(fd,
+      (char*)NaClUserToSys(nap, (uint32_t)fd->buffer), offset);
+}
+
+/*
+ * move the window of the windowed mapped channel to the channel "offset"
+ * return the size of the channel data in the window or negative error code
+ */
+static int32_t TrapWindowHandle(struct NaClApp *nap,
+    enum ChannelType desc, int64_t offset)
+{
+  struct PreOpenedFileDesc *fd;
+
+  NaClLog(4, "%s() invoked: desc=%d, offset=%ld\n", __func__, desc, offset);
+
+  if(desc != InputChannel) return -INVALID_DESC;
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  fd = &nap->manifest->user_setup->channels[desc];
+  if(fd->mounted != MAPPED || fd->buffer == 0) return -INVALID_MODE;
+
+  return MoveChannelWindow(fd,
+      (char*)NaClUserToSys(nap, (uint32_t)fd->buffer), offset);
+}
+
+/*
+ * wait for the channels readiness. local channels are always ready (file
+ * i/o does not wait for the peer), network ones are polled by zvm_netw
+ * return the number of ready channels or negative error code
+ */
+static int32_t TrapPollHandle(struct NaClApp *nap,
+    uint32_t items, int32_t count, int32_t timeout)
+{
+  struct PollItem *sys_items;
+  int32_t ready = 0;
+  int i;
+#ifdef NETWORKING
+  struct commf_pollitem_t netw_items[POLL_ITEMS_MAX];
+  int netw_index[POLL_ITEMS_MAX];
+  int netw_count = 0;
+#endif
+
+  NaClLog(4, "%s() invoked: items=0x%x, count=%d, timeout=%d\n",
+      __func__, items, count, timeout);
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  if(count < 1 || count > POLL_ITEMS_MAX) return -INSANE_SIZE;
+  sys_items = (struct PollItem*)NaClUserToSysAddrRange(nap, items, count * sizeof *sys_items);
+  if((uintptr_t)sys_items == kNaClBadAddress) return -INVALID_BUFFER;
+
+  for(i = 0; i < count; ++i)
+  {
+    struct PollItem *item = &sys_items[i];
+    struct PreOpenedFileDesc *fd;
+
+    item->revents = 0;
+#ifdef NETWORKING
+    if(capabilities_for_file_fd(item->desc) != ENOTALLOWED)
+    {
+      netw_items[netw_count].fd = item->desc;
+      netw_items[netw_count].events = item->events;
+      netw_index[netw_count++] = i;
+      continue;
+    }
+#endif
+    if(item->desc < InputChannel || item->desc >= CHANNELS_COUNT) return -INVALID_DESC;
+    fd = &nap->manifest->user_setup->channels[item->desc];
+    if(fd->name == 0) return -INVALID_DESC;
+
+    if(item->desc == InputChannel) item->revents = item->events & PollRead;
+    else item->revents = item->events & PollWrite;
+    ready += item->revents != 0;
+  }
+
+#ifdef NETWORKING
+  /* network channels: do not wait if some local channel is ready */
+  if(netw_count > 0)
+  {
+    int result;
+
+    /* the wait can be endless, other user threads must not wait for it */
+    TrustedUnlock();
+    result = commf_poll(netw_items, netw_count, ready ? 0 : timeout);
+    TrustedLock();
+    if(result < 0) return -INTERNAL_ERR;
+
+    /* the user memory could be changed meanwhile */
+    sys_items = (struct PollItem*)NaClUserToSysAddrRange(nap, items, count * sizeof *sys_items);
+    if((uintptr_t)sys_items == kNaClBadAddress) return -INVALID_BUFFER;
+    for(i = 0; i < netw_count; ++i)
+    {
+      sys_items[netw_index[i]].revents = netw_items[i].revents;
+      ready += netw_items[i].revents != 0;
+    }
+  }
+#else
+  UNREFERENCED_PARAMETER(timeout);
+#endif
+
+  return ready;
+}
+
+/*
+ * all-to-all shuffle of the user buffer over the network channels. scatter
+ * sends the parts to own channels, gather receives one part from each
+ * channel and lays the parts one after another. all channels are served
+ * at once by zvm_netw i/o threads
+ * return the number of sent/received bytes or negative error code
+ */
+static int32_t TrapShuffleHandle(struct NaClApp *nap, int gather,
+    uint32_t buffer, int32_t size, uint32_t parts, int32_t count)
+{
+  struct ShufflePart *sys_parts;
+  char *sys_buffer;
+  int64_t total = 0; /* parts can overlap */
+  int i, j;
+#ifdef NETWORKING
+  struct commf_part_t netw_parts[SHUFFLE_PARTS_MAX];
+  ssize_t result;
+#endif
+
+  NaClLog(4, "%s() invoked: gather=%d, buffer=0x%x, size=%d, parts=0x%x, count=%d\n",
+      __func__, gather, buffer, size, parts, count);
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  if(size < 0 || count < 1 || count > SHUFFLE_PARTS_MAX) return -INSANE_SIZE;
+  sys_buffer = (char*)NaClUserToSysAddrRange(nap, buffer, size);
+  if((uintptr_t)sys_buffer == kNaClBadAddress) return -INVALID_BUFFER;
+  sys_parts = (struct ShufflePart*)NaClUserToSysAddrRange(nap, parts, count * sizeof *sys_parts);
+  if((uintptr_t)sys_parts == kNaClBadAddress) return -INVALID_BUFFER;
+
+  /* one part per channel, scattered parts must be inside the buffer */
+  for(i = 0; i < count; ++i)
+  {
+    for(j = 0; j < i; ++j)
+      if(sys_parts[j].desc == sys_parts[i].desc) return -INVALID_DESC;
+    if(gather) continue;
+    if(sys_parts[i].offset < 0 || sys_parts[i].size < 0
+        || sys_parts[i].size > size - sys_parts[i].offset) return -OUT_OF_BOUNDS;
+    total += sys_parts[i].size;
+  }
+  if(total > INT32_MAX) return -INSANE_SIZE;
+
+#ifdef NETWORKING
+  for(i = 0; i < count; ++i)
+  {
+    if(capabilities_for_file_fd(sys_parts[i].desc) != (gather ? EREAD : EWRITE))
+      return -INVALID_DESC;
+    netw_parts[i].fd = sys_parts[i].desc;
+    netw_parts[i].offset = sys_parts[i].offset;
+    netw_parts[i].size = sys_parts[i].size;
+  }
+
+  /* the transfer can take long, other user threads must not wait for it */
+  TrustedUnlock();
+  if(!gather)
+    result = commf_scatter(netw_parts, count, sys_buffer);
+  else
+    result = commf_gather(netw_parts, count, sys_buffer, size);
+  TrustedLock();
+  if(result < 0) return -INTERNAL_ERR;
+  if(!gather) return result;
+
+  for(i = 0; i < count; ++i)
+  {
+    sys_parts[i].offset = netw_parts[i].offset;
+    sys_parts[i].size = netw_parts[i].size;
+  }
+  return result;
+#else
+  /* only network channels can be shuffled */
+  return -INVALID_DESC;
+#endif
+}
+
+/*
+ * crc32c of the data read from and written to the channel with the
+ * integrity mode. stored to "crc" (user address of 2 uint32_t)
+ * return 0 or negative error code if call failed
+ */
+static int32_t TrapCrcHandle(struct NaClApp *nap, int desc, uint32_t crc)
+{
+  struct PreOpenedFileDesc *fd;
+  uint32_t *sys_crc;
+
+  NaClLog(4, "%s() invoked: desc=%d, crc=0x%x\n", __func__, desc, crc);
+
+  if(nap == NULL) return -INTERNAL_ERR;
+  sys_crc = (uint32_t*)NaClUserToSysAddrRange(nap, crc, 2 * sizeof *sys_crc);
+  if((uintptr_t)sys_crc == kNaClBadAddress) return -INVALID_BUFFER;
+
+#ifdef NETWORKING
+  if(capabilities_for_file_fd(desc) != ENOTALLOWED)
+    return commf_crc(desc, &sys_crc[0], &sys_crc[1]) == 0 ? 0 : -INVALID_MODE;
+#endif
+
+  /* same channels TrapRead/TrapWrite allow */
+  if(desc != InputChannel && desc != OutputChannel) return -INVALID_DESC;
+  fd = &nap->manifest->user_setup->channels[desc];
+  if(!fd->integrity) return -INVALID_MODE;
+  if(fd->mounted != LOADED && fd->mounted != DIRECT) return -INVALID_MODE;
+
+  sys_crc[0] = fd->crc_get;
+  sys_crc[1] = fd->crc_put;
+  return 0;
+}
+
 /*
  * user request to change limits for system resources. for now we only can decrease bounds
  * return: function update given SetupList object (hint) and if there were
@@ -318,12 +697,39 @@ static int32_t TrapUserSetupHandle(struct NaClApp *nap, struct SetupList *h)
     TRY_UPDATE(hint_channel->max_put_size, policy_channel->max_put_size);
     TRY_UPDATE(hint_channel->max_puts, policy_channel->max_puts);
 
+    /*
+     * nexe reports the end of data written to mapped output channel in
+     * high_water. the channel will be trimmed to this size. 1st time the
+     * field is only set in hint
+     */
+    if(policy_channel->mounted == MAPPED && policy_channel->buffer
+        && (ch == OutputChannel || ch == LogChannel)
+        && policy->cnt_setup_calls > 1
+        && hint_channel->high_water != policy_channel->high_water)
+    {
+      if(hint_channel->high_water >= 0
+          && hint_channel->high_water <= policy_channel->bsize)
+        policy_channel->high_water = hint_channel->high_water;
+      else retcode = ERR_CODE;
+    }
+
     /* set readonly i/o fields */
     hint_channel->bsize = policy_channel->bsize;
     hint_channel->buffer = policy_channel->buffer;
     hint_channel->fsize = policy_channel->fsize;
+    hint_channel->window = policy_channel->window;
+    hint_channel->window_offset = policy_channel->window_offset;
+    hint_channel->released = policy_channel->released;
+    hint_channel->high_water = policy_channel->high_water;
     hint_channel->type = policy_channel->type;
     hint_channel->mounted = policy_channel->mounted; /* assumed safe to share with user */
+    hint_channel->cnt_gets = policy_channel->cnt_gets;
+    hint_channel->cnt_puts = policy_channel->cnt_puts;
+    hint_channel->cnt_get_size = policy_channel->cnt_get_size;
+    hint_channel->cnt_put_size = policy_channel->cnt_put_size;
+    hint_channel->integrity = policy_channel->integrity;
+    hint_channel->crc_get = policy_channel->crc_get;
+    hint_channel->crc_put = policy_channel->crc_put;
     /* not real handle but just a stream number coinciding with stdin/stdout/stderr */
     hint_channel->handle = ch;
   }
@@ -333,10 +739,12 @@ static int32_t TrapUserSetupHandle(struct NaClApp *nap, struct SetupList *h)
   TRY_UPDATE(hint->max_mem, policy->max_mem);
   TRY_UPDATE(hint->max_syscalls, policy->max_syscalls);
   TRY_UPDATE(hint->max_setup_calls, policy->max_setup_calls);
+  TRY_UPDATE(hint->max_threads, policy->max_threads);
 
   /* set system fields n/a to change */
   hint->self_size = policy->self_size; /* set self size */
   hint->heap_ptr = policy->heap_ptr; /* set self size */
+  hint->cnt_threads = policy->cnt_threads;
   STRNCPY_NULL(hint->content_type, policy->content_type, CONTENT_TYPE_LEN);
   STRNCPY_NULL(hint->timestamp, policy->timestamp, TIMESTAMP_LEN);
   STRNCPY_NULL(hint->user_etag, policy->user_etag, USER_TAG_LEN);
@@ -350,6 +758,203 @@ static int32_t TrapUserSetupHandle(struct NaClApp *nap, struct SetupList *h)
   return retcode;
 }
 
+/* amount of the trap arguments kept in the journal */
+static int JournalArgs(uint64_t call)
+{
+  switch(call)
+  {
+    case TrapUserSetup: return 1;
+    case TrapRead: case TrapWrite: return 4;
+    case TrapCopy: return 5;
+    case TrapView: case TrapRelease: case TrapWindow: case TrapCrc: return 2;
+    case TrapPoll: return 3;
+    case TrapScatter: case TrapGather: return 4;
+    default: return 0;
+  }
+}
+
+/* return system address of the user buffer or NULL if it is not valid */
+static void *UserBuffer(struct NaClApp *nap, uint64_t addr, size_t size)
+{
+  uintptr_t sys = NaClUserToSysAddrRange(nap, (uintptr_t)addr, size);
+  return sys == kNaClBadAddress ? NULL : (void*)sys;
+}
+
+/* copy of the gather results: parts table and the data. NULL if failed */
+static char *GatherRecord(struct NaClApp *nap, uint64_t *sys_args, int32_t received)
+{
+  size_t table = (int32_t)sys_args[5] * sizeof(struct ShufflePart);
+  void *parts = UserBuffer(nap, sys_args[4], table);
+  void *buffer = UserBuffer(nap, sys_args[2], received);
+  char *record;
+
+  if(parts == NULL || buffer == NULL) return NULL;
+  if((record = malloc(table + received)) == NULL) return NULL;
+  memcpy(record, parts, table);
+  memcpy(record + table, buffer, received);
+  return record;
+}
+
+/*
+ * record the trap to the journal: data got by the nexe (read data and
+ * the setup) is stored, only digest of the written data is kept
+ */
+static void RecordTrap(struct NaClApp *nap, uint64_t *sys_args, int32_t retcode)
+{
+  struct JournalEntry entry;
+  void *data = NULL;
+  char *shuffle = NULL;
+
+  memset(&entry, 0, sizeof entry);
+  entry.call = (uint32_t)sys_args[0];
+  entry.retcode = retcode;
+  memcpy(entry.args, sys_args + 2, JournalArgs(*sys_args) * sizeof *entry.args);
+
+  switch(*sys_args)
+  {
+    case TrapRead:
+      if(retcode > 0 && (data = UserBuffer(nap, sys_args[3], retcode)) != NULL)
+        entry.size = retcode;
+      break;
+    case TrapWrite:
+      if(retcode > 0 && (data = UserBuffer(nap, sys_args[3], retcode)) != NULL)
+        entry.digest = JournalDigest(data, retcode);
+      data = NULL;
+      break;
+    case TrapUserSetup:
+      if((data = UserBuffer(nap, sys_args[2], sizeof(struct SetupList))) != NULL)
+        entry.size = sizeof(struct SetupList);
+      break;
+    case TrapPoll:
+      if(retcode >= 0 && (data = UserBuffer(nap, sys_args[2],
+          (int32_t)sys_args[3] * sizeof(struct PollItem))) != NULL)
+        entry.size = (int32_t)sys_args[3] * sizeof(struct PollItem);
+      break;
+    case TrapCrc:
+      if(retcode == 0 && (data = UserBuffer(nap, sys_args[3], 2 * sizeof(uint32_t))) != NULL)
+        entry.size = 2 * sizeof(uint32_t);
+      break;
+    case TrapCopy:
+      /* the data does not pass the user memory, the arguments and result are enough */
+      break;
+    case TrapScatter:
+      if(retcode > 0 && (data = UserBuffer(nap, sys_args[2], (int32_t)sys_args[3])) != NULL)
+        entry.digest = JournalDigest(data, (int32_t)sys_args[3]);
+      data = NULL;
+      break;
+    case TrapGather:
+      /* the parts table followed by the gathered data */
+      if(retcode >= 0 && (shuffle = GatherRecord(nap, sys_args, retcode)) != NULL)
+      {
+        data = shuffle;
+        entry.size = (int32_t)sys_args[5] * sizeof(struct ShufflePart) + retcode;
+      }
+      break;
+    default:
+      break;
+  }
+  if(data != NULL) entry.digest = JournalDigest(data, entry.size);
+
+  if(JournalWrite(nap->journal, &entry, data) != 0)
+    NaClLog(LOG_ERROR, "cannot record trap %ld\n", *sys_args);
+  free(shuffle);
+}
+
+/*
+ * replay the trap from the journal. the nexe gets the recorded results
+ * and data, channel i/o is not done. the trap must be the same as
+ * recorded (same nexe, same order of traps), otherwise the trap fails
+ * note: jobs with mapped (lazy) channels are neither recorded nor replayed
+ */
+static int32_t ReplayTrap(struct NaClApp *nap, uint64_t *sys_args)
+{
+  const struct JournalEntry *entry;
+  const void *data;
+  void *buffer;
+  void *parts;
+  size_t table;
+
+  if(*sys_args == TrapExit) return TrapExitHandle(nap, (int32_t) sys_args[2]);
+
+  entry = JournalRead(nap->journal, &data);
+  if(entry == NULL || entry->call != *sys_args
+      || memcmp(entry->args, sys_args + 2, JournalArgs(*sys_args) * sizeof *entry->args))
+  {
+    NaClLog(LOG_ERROR, "trap %ld diverged from the journal\n", *sys_args);
+    return -INTERNAL_ERR;
+  }
+
+  switch(*sys_args)
+  {
+    case TrapRead:
+      if(entry->size == 0) break;
+      buffer = UserBuffer(nap, sys_args[3], entry->size);
+      if(buffer == NULL) return -INVALID_BUFFER;
+      memcpy(buffer, data, entry->size);
+      break;
+    case TrapWrite:
+      if(entry->retcode <= 0) break;
+      buffer = UserBuffer(nap, sys_args[3], entry->retcode);
+      if(buffer == NULL) return -INVALID_BUFFER;
+      if(JournalDigest(buffer, entry->retcode) != entry->digest)
+      {
+        NaClLog(LOG_ERROR, "replayed write data differ from the journal\n");
+        return -INTERNAL_ERR;
+      }
+      break;
+    case TrapCopy:
+      /* the recorded amount. the channels are not touched, as with writes */
+      break;
+    case TrapUserSetup:
+      /* limits and syscallback must be set anyway */
+      TrapUserSetupHandle(nap, (struct SetupList*) sys_args[2]);
+      buffer = UserBuffer(nap, sys_args[2], entry->size);
+      if(buffer != NULL) memcpy(buffer, data, entry->size);
+      break;
+    case TrapScatter:
+      if(entry->retcode <= 0) break;
+      buffer = UserBuffer(nap, sys_args[2], (int32_t)sys_args[3]);
+      if(buffer == NULL) return -INVALID_BUFFER;
+      if(JournalDigest(buffer, (int32_t)sys_args[3]) != entry->digest)
+      {
+        NaClLog(LOG_ERROR, "replayed scatter data differ from the journal\n");
+        return -INTERNAL_ERR;
+      }
+      break;
+    case TrapGather:
+      if(entry->size == 0) break;
+      table = (int32_t)sys_args[5] * sizeof(struct ShufflePart);
+      if(entry->size < table)
+      {
+        NaClLog(LOG_ERROR, "broken gather in the journal\n");
+        return -INTERNAL_ERR;
+      }
+      parts = UserBuffer(nap, sys_args[4], table);
+      buffer = UserBuffer(nap, sys_args[2], entry->size - table);
+      if(parts == NULL || buffer == NULL) return -INVALID_BUFFER;
+      memcpy(parts, data, table);
+      memcpy(buffer, (const char*)data + table, entry->size - table);
+      break;
+    case TrapCrc:
+      /* the recorded crc, the channels are not read on replay */
+      if(entry->size == 0) break;
+      buffer = UserBuffer(nap, sys_args[3], entry->size);
+      if(buffer == NULL) return -INVALID_BUFFER;
+      memcpy(buffer, data, entry->size);
+      break;
+    case TrapPoll:
+      /* the recorded readiness */
+      if(entry->size == 0) break;
+      buffer = UserBuffer(nap, sys_args[2], entry->size);
+      if(buffer == NULL) return -INVALID_BUFFER;
+      memcpy(buffer, data, entry->size);
+      break;
+    default:
+      break;
+  }
+  return entry->retcode;
+}
+
 /*
  * "One Ring" syscall main routine. in the future will replace nacl syscalls.
  * "args" is an array of syscall name and its arguments
@@ -365,6 +970,10 @@ int32_t TrapHandler(struct NaClApp *nap, uint32_t args)
   sys_args = (uint64_t*)NaClUserToSys(nap, (uintptr_t) args);
   NaClLog(4, "Trap arguments address = 0x%lx\n", (intptr_t)sys_args);
 
+  /* replayed job gets the results from the journal */
+  if(nap->journal != NULL && JournalGetMode(nap->journal) == JournalReplay)
+    return ReplayTrap(nap, sys_args);
+
   switch(*sys_args)
   {
     case TrapExit:
@@ -381,12 +990,39 @@ int32_t TrapHandler(struct NaClApp *nap, uint32_t args)
       retcode = TrapWriteHandle(nap,
           (enum ChannelType)sys_args[2], (char*)sys_args[3], (int32_t)sys_args[4], sys_args[5]);
       break;
+    case TrapCopy:
+      retcode = TrapCopyHandle(nap, (enum ChannelType)sys_args[2], sys_args[3],
+          (enum ChannelType)sys_args[4], sys_args[5], (int32_t)sys_args[6]);
+      break;
+    case TrapView:
+      retcode = TrapViewHandle(nap, (enum ChannelType)sys_args[2], (uint32_t)sys_args[3]);
+      break;
+    case TrapRelease:
+      retcode = TrapReleaseHandle(nap, (enum ChannelType)sys_args[2], sys_args[3]);
+      break;
+    case TrapWindow:
+      retcode = TrapWindowHandle(nap, (enum ChannelType)sys_args[2], sys_args[3]);
+      break;
+    case TrapPoll:
+      retcode = TrapPollHandle(nap,
+          (uint32_t)sys_args[2], (int32_t)sys_args[3], (int32_t)sys_args[4]);
+      break;
+    case TrapScatter:
+    case TrapGather:
+      retcode = TrapShuffleHandle(nap, *sys_args == TrapGather, (uint32_t)sys_args[2],
+          (int32_t)sys_args[3], (uint32_t)sys_args[4], (int32_t)sys_args[5]);
+      break;
+    case TrapCrc:
+      retcode = TrapCrcHandle(nap, (int)sys_args[2], (uint32_t)sys_args[3]);
+      break;
     default:
       retcode = ERR_CODE;
       NaClLog(LOG_ERROR, "function %ld is not supported\n", *sys_args);
       break;
   }
 
+  if(nap->journal != NULL) RecordTrap(nap, sys_args, retcode);
+
   NaClLog(4, "leaving Trap with code = 0x%x\n", retcode);
   return retcode;
 }
@@ -30,6 +30,9 @@ void PauseCpuClock(struct NaClApp *nap);
 /* resume cpu time counting */
 void ResumeCpuClock(struct NaClApp *nap);
 
+/* return non zero if user program used more cpu than allowed */
+int CpuLimitExceeded(struct NaClApp *nap);
+
 EXTERN_C_END
 
 #endif /* TRAP_H_ */
@@ -0,0 +1,166 @@
+/*
+ * trap journal. the recorded traps are collected in the memory buffer
+ * (like tracers do) and written by large blocks, so the recording costs
+ * a copy of the data got by the nexe and a digest of the data put. the
+ * replayed journal is mapped and read in place
+ *
+ * journal: JOURNAL_MAGIC, then entries. each entry is followed by the
+ * stored data padded to 8 bytes
+ *
+ *  Created on: May 12, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src/manifest/trap_journal.h"
+
+#define PADDED(size) (((size) + 7) & ~7u)
+#define FNV_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct TrapJournal
+{
+  enum JournalMode mode;
+  int handle;
+  char *buffer; /* record: collected entries. replay: mapped journal */
+  size_t size; /* record: used part of the buffer. replay: journal size */
+  size_t pos; /* replay: the next entry */
+};
+
+/* write the buffer to the journal file. return 0 if success */
+static int Flush(struct TrapJournal *journal)
+{
+  size_t done = 0;
+
+  while(done < journal->size)
+  {
+    ssize_t got = write(journal->handle, journal->buffer + done, journal->size - done);
+    if(got < 0) return -1;
+    done += got;
+  }
+  journal->size = 0;
+  return 0;
+}
+
+/* append to the buffer, large blocks bypass it. return 0 if success */
+static int Append(struct TrapJournal *journal, const void *data, size_t size)
+{
+  if(journal->size + size > JOURNAL_BUFFER && Flush(journal) != 0) return -1;
+  if(size > JOURNAL_BUFFER / 2)
+    return write(journal->handle, data, size) == (ssize_t)size ? 0 : -1;
+
+  memcpy(journal->buffer + journal->size, data, size);
+  journal->size += size;
+  return 0;
+}
+
+struct TrapJournal *JournalCtor(const char *name, enum JournalMode mode)
+{
+  struct TrapJournal *journal = calloc(1, sizeof *journal);
+  struct stat st;
+
+  if(journal == NULL) return NULL;
+  journal->mode = mode;
+
+  if(mode == JournalRecord)
+  {
+    journal->handle = open(name, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    journal->buffer = malloc(JOURNAL_BUFFER);
+    if(journal->handle < 0 || journal->buffer == NULL) goto fail;
+    if(Append(journal, JOURNAL_MAGIC, PADDED(sizeof JOURNAL_MAGIC - 1)) != 0) goto fail;
+    return journal;
+  }
+
+  /* replay */
+  journal->handle = open(name, O_RDONLY);
+  if(journal->handle < 0 || fstat(journal->handle, &st) != 0) goto fail;
+  journal->size = st.st_size;
+  if(journal->size < sizeof JOURNAL_MAGIC - 1) goto fail;
+  journal->buffer = mmap(NULL, journal->size, PROT_READ, MAP_PRIVATE, journal->handle, 0);
+  if(journal->buffer == MAP_FAILED)
+  {
+    journal->buffer = NULL;
+    goto fail;
+  }
+  madvise(journal->buffer, journal->size, MADV_SEQUENTIAL);
+  if(memcmp(journal->buffer, JOURNAL_MAGIC, sizeof JOURNAL_MAGIC - 1) != 0) goto fail;
+  journal->pos = PADDED(sizeof JOURNAL_MAGIC - 1);
+  return journal;
+
+fail:
+  JournalDtor(journal);
+  return NULL;
+}
+
+int JournalDtor(struct TrapJournal *journal)
+{
+  int ret_code = 0;
+
+  if(journal == NULL) return 0;
+  if(journal->mode == JournalRecord)
+  {
+    if(journal->handle >= 0) ret_code = Flush(journal);
+    free(journal->buffer);
+  }
+  else if(journal->buffer != NULL)
+    munmap(journal->buffer, journal->size);
+
+  if(journal->handle >= 0) ret_code |= close(journal->handle);
+  free(journal);
+  return ret_code ? -1 : 0;
+}
+
+enum JournalMode JournalGetMode(const struct TrapJournal *journal)
+{
+  return journal->mode;
+}
+
+int JournalWrite(struct TrapJournal *journal,
+    const struct JournalEntry *entry, const void *data)
+{
+  static const char zeroes[8];
+  uint32_t pad = PADDED(entry->size) - entry->size;
+
+  if(journal->mode != JournalRecord) return -1;
+  if(Append(journal, entry, sizeof *entry) != 0) return -1;
+  if(entry->size == 0) return 0;
+  if(Append(journal, data, entry->size) != 0) return -1;
+  return pad ? Append(journal, zeroes, pad) : 0;
+}
+
+const struct JournalEntry *JournalRead(struct TrapJournal *journal,
+    const void **data)
+{
+  const struct JournalEntry *entry;
+
+  if(journal->mode != JournalReplay) return NULL;
+  if(journal->size - journal->pos < sizeof *entry) return NULL;
+  entry = (const struct JournalEntry*)(journal->buffer + journal->pos);
+  if(journal->size - journal->pos - sizeof *entry < PADDED(entry->size)) return NULL;
+
+  *data = journal->buffer + journal->pos + sizeof *entry;
+  journal->pos += sizeof *entry + PADDED(entry->size);
+  return entry;
+}
+
+uint64_t JournalDigest(const void *data, uint32_t size)
+{
+  const unsigned char *p = data;
+  uint64_t hash = FNV_BASIS;
+  uint32_t i = 0;
+
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, p + i, sizeof word);
+    hash = (hash ^ word) * FNV_PRIME;
+  }
+  for(; i < size; ++i)
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  return hash;
+}
@@ -0,0 +1,71 @@
+/*
+ * trap journal. binary log of the channel i/o traps: arguments, results
+ * and the data digests (data got by the nexe is stored too). recorded
+ * journal can be replayed: the nexe gets the same results without the
+ * original channels, so any job can be turned to the repeatable test
+ *
+ *  Created on: May 12, 2012
+ *      Author: d'b
+ */
+
+#ifndef TRAP_JOURNAL_H_
+#define TRAP_JOURNAL_H_
+
+#include <stdint.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* journal file starts with it. version is the last character */
+#define JOURNAL_MAGIC "ZVMTRAP1"
+
+/* records are collected in the buffer of this size and written at once */
+#define JOURNAL_BUFFER 0x100000
+
+/* the largest amount of trap arguments (TrapCopy) */
+#define JOURNAL_ARGS 5
+
+enum JournalMode {
+  JournalRecord,
+  JournalReplay
+};
+
+/* one trap. followed by "size" bytes of the data */
+struct JournalEntry
+{
+  uint32_t call; /* enum TrapCalls */
+  int32_t retcode;
+  uint64_t args[JOURNAL_ARGS]; /* trap arguments, unused are zeroes */
+  uint64_t digest; /* of the data passed by the trap */
+  uint32_t size; /* size of the stored data */
+  uint32_t reserved;
+};
+
+/* open the journal for the record or replay. return NULL if failed */
+struct TrapJournal *JournalCtor(const char *name, enum JournalMode mode);
+
+/* flush and close the journal. return 0 if success, otherwise -1 */
+int JournalDtor(struct TrapJournal *journal);
+
+enum JournalMode JournalGetMode(const struct TrapJournal *journal);
+
+/*
+ * append the entry and its data (entry->size bytes) to the journal
+ * return 0 if success, otherwise -1
+ */
+int JournalWrite(struct TrapJournal *journal,
+    const struct JournalEntry *entry, const void *data);
+
+/*
+ * return the next entry of the replayed journal and set "data" to the
+ * stored data. return NULL if the journal is over or broken
+ */
+const struct JournalEntry *JournalRead(struct TrapJournal *journal,
+    const void **data);
+
+/* digest of the data (64-bit fnv-1a over 8 byte words) */
+uint64_t JournalDigest(const void *data, uint32_t size);
+
+EXTERN_C_END
+
+#endif /* TRAP_JOURNAL_H_ */
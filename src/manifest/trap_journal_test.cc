@@ -0,0 +1,109 @@
+/*
+ * trap_journal_test.cc
+ * recorded traps are replayed in the same order with the same data
+ *
+ *  Created on: May 12, 2012
+ *      Author: d'b
+ */
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "api/zvm.h"
+#include "src/manifest/trap_journal.h"
+
+#define TEST_DATA_SIZE 1021 /* not padded */
+
+// record read, write and large read, replay them
+TEST(TrapJournal, record_and_replay)
+{
+  char name[] = "/tmp/trap_journal_test.XXXXXX";
+  static char large[JOURNAL_BUFFER];
+  char data[TEST_DATA_SIZE];
+  struct JournalEntry entry;
+  const struct JournalEntry *got;
+  const void *stored;
+  struct TrapJournal *journal;
+
+  close(mkstemp(name));
+  memset(data, 'x', sizeof data);
+  memset(large, 'y', sizeof large);
+
+  journal = JournalCtor(name, JournalRecord);
+  ASSERT_TRUE(journal != NULL);
+  memset(&entry, 0, sizeof entry);
+  entry.call = TrapRead;
+  entry.retcode = entry.size = sizeof data;
+  entry.args[3] = 12345;
+  entry.digest = JournalDigest(data, sizeof data);
+  EXPECT_EQ(0, JournalWrite(journal, &entry, data));
+
+  entry.call = TrapWrite;
+  entry.size = 0;
+  EXPECT_EQ(0, JournalWrite(journal, &entry, NULL));
+
+  entry.call = TrapRead;
+  entry.retcode = entry.size = sizeof large;
+  EXPECT_EQ(0, JournalWrite(journal, &entry, large));
+  EXPECT_EQ(0, JournalDtor(journal));
+
+  // entries come back in the same order, data is in place
+  journal = JournalCtor(name, JournalReplay);
+  ASSERT_TRUE(journal != NULL);
+  EXPECT_EQ(JournalReplay, JournalGetMode(journal));
+
+  got = JournalRead(journal, &stored);
+  ASSERT_TRUE(got != NULL);
+  EXPECT_EQ((uint32_t)TrapRead, got->call);
+  EXPECT_EQ(12345u, got->args[3]);
+  EXPECT_EQ(0, memcmp(data, stored, sizeof data));
+  EXPECT_EQ(JournalDigest(data, sizeof data), got->digest);
+
+  got = JournalRead(journal, &stored);
+  ASSERT_TRUE(got != NULL);
+  EXPECT_EQ((uint32_t)TrapWrite, got->call);
+  EXPECT_EQ(0u, got->size);
+
+  got = JournalRead(journal, &stored);
+  ASSERT_TRUE(got != NULL);
+  EXPECT_EQ(sizeof large, got->size);
+  EXPECT_EQ(0, memcmp(large, stored, sizeof large));
+
+  EXPECT_TRUE(JournalRead(journal, &stored) == NULL);
+  EXPECT_EQ(0, JournalDtor(journal));
+  unlink(name);
+}
+
+// not a journal
+TEST(TrapJournal, bad_journal)
+{
+  char name[] = "/tmp/trap_journal_test.XXXXXX";
+  int handle = mkstemp(name);
+
+  ASSERT_EQ(8, write(handle, "ZVMTRAP0", 8));
+  close(handle);
+  EXPECT_TRUE(JournalCtor(name, JournalReplay) == NULL);
+  EXPECT_TRUE(JournalCtor("/nonexistent/journal", JournalReplay) == NULL);
+  unlink(name);
+}
+
+// digest depends on every byte
+TEST(TrapJournal, digest)
+{
+  char data[TEST_DATA_SIZE];
+
+  memset(data, 0, sizeof data);
+  uint64_t digest = JournalDigest(data, sizeof data);
+  data[sizeof data - 1] = 1;
+  EXPECT_NE(digest, JournalDigest(data, sizeof data));
+  data[sizeof data - 1] = 0;
+  data[0] = 1;
+  EXPECT_NE(digest, JournalDigest(data, sizeof data));
+  EXPECT_NE(JournalDigest(data, 0), JournalDigest(data, 1));
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
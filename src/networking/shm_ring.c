@@ -0,0 +1,440 @@
+/*
+ * shm_ring.c
+ * the ring header is shared by both sides. producer owns "head", consumer
+ * owns "tail", each side bumps the sequence the other side sleeps on. the
+ * sleeping side sets its "waits" flag first and re-checks the ring, so the
+ * wakeup cannot be lost. the sleep is limited: each SHM_RING_CHECK seconds
+ * the side checks its peer process is still alive. a side which polls the
+ * ring sets the same flag and the peer also rings its doorbell: a fifo next
+ * to the ring object, so the ring can be polled with other descriptors
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "src/networking/shm_ring.h"
+
+#define CACHE_LINE 64
+#define HEADER_SIZE 0x1000
+#define BELL_DATA 0 /* rung by the writer, polled by the reader */
+#define BELL_SPACE 1 /* rung by the reader, polled by the writer */
+
+struct ShmRingHeader
+{
+  uint32_t magic; /* set by the writer when the ring is ready */
+  uint32_t size;
+
+  /* producer side */
+  uint64_t head __attribute__((aligned(CACHE_LINE)));
+  uint32_t data_seq; /* bumped when data added or stream is over */
+  uint32_t reader_waits;
+  uint32_t eof;
+  int32_t writer_pid;
+
+  /* consumer side */
+  uint64_t tail __attribute__((aligned(CACHE_LINE)));
+  uint32_t space_seq; /* bumped when data removed */
+  uint32_t writer_waits;
+  int32_t reader_pid; /* 0 - the reader is not attached yet */
+};
+
+struct ShmRing
+{
+  char name[NAME_MAX];
+  int writer;
+  struct ShmRingHeader *header; /* NULL - reader is not attached yet */
+  char *data;
+  int bell[2]; /* doorbells, -1 - not opened */
+};
+
+int IsShmEndpoint(const char *endpoint)
+{
+  return endpoint != NULL && strncmp(endpoint, SHM_SCHEME, sizeof SHM_SCHEME - 1) == 0;
+}
+
+/* "shm:///tmp/ranges-2-3" -> "/zvm_tmp_ranges-2-3" */
+static int ShmName(const char *endpoint, char *name)
+{
+  const char *path = endpoint + sizeof SHM_SCHEME - 1;
+  int i;
+
+  if(strlen(path) + sizeof "/zvm" >= NAME_MAX) return -1;
+  strcpy(name, "/zvm");
+  for(i = 4; *path != '\0'; ++path, ++i)
+    name[i] = *path == '/' ? '_' : *path;
+  name[i] = '\0';
+  return 0;
+}
+
+/* sleep until "seq" changes or SHM_RING_CHECK expires. return 0 if expired */
+static int Wait(uint32_t *seq, uint32_t value)
+{
+  struct timespec timeout = {SHM_RING_CHECK, 0};
+  return syscall(SYS_futex, seq, FUTEX_WAIT, value, &timeout, NULL, 0) != 0
+      && errno == ETIMEDOUT ? 0 : 1;
+}
+
+/*
+ * the peer did not move the ring for another SHM_RING_CHECK ("idle" counts
+ * them). return not 0 if the peer process is gone or never appeared
+ */
+static int PeerLost(const int32_t *pid, int *idle)
+{
+  int32_t peer = __atomic_load_n(pid, __ATOMIC_ACQUIRE);
+
+  ++*idle;
+  if(peer == 0) return *idle * SHM_RING_CHECK >= SHM_RING_TIMEOUT;
+  return kill(peer, 0) != 0 && errno == ESRCH;
+}
+
+static void Wake(uint32_t *seq)
+{
+  syscall(SYS_futex, seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* "/zvm_tmp_ranges-2-3" -> "/dev/shm/zvm_tmp_ranges-2-3.data" */
+static void BellPath(const struct ShmRing *ring, int bell, char *path)
+{
+  snprintf(path, PATH_MAX, "/dev/shm%s.%s", ring->name,
+      bell == BELL_DATA ? "data" : "space");
+}
+
+/*
+ * open both doorbells, writer ("create") makes fresh fifos. read-write open
+ * of the fifo never blocks and keeps it usable whatever the peer does
+ * return 0 if success
+ */
+static int BellsOpen(struct ShmRing *ring, int create)
+{
+  char path[PATH_MAX];
+  int i;
+
+  for(i = 0; i < 2; ++i)
+  {
+    BellPath(ring, i, path);
+    if(create)
+    {
+      unlink(path);
+      if(mkfifo(path, S_IRUSR | S_IWUSR) != 0) return -1;
+    }
+    if((ring->bell[i] = open(path, O_RDWR | O_NONBLOCK)) < 0) return -1;
+  }
+  return 0;
+}
+
+static void BellsUnlink(struct ShmRing *ring)
+{
+  char path[PATH_MAX];
+  int i;
+
+  for(i = 0; i < 2; ++i)
+  {
+    BellPath(ring, i, path);
+    unlink(path);
+  }
+}
+
+static void BellsClose(struct ShmRing *ring)
+{
+  int i;
+
+  for(i = 0; i < 2; ++i)
+    if(ring->bell[i] >= 0) close(ring->bell[i]);
+  ring->bell[0] = ring->bell[1] = -1;
+}
+
+/* wake the peer polling the doorbell. full fifo is ringing already */
+static void Ring(int bell)
+{
+  char c = 0;
+  while(bell >= 0 && write(bell, &c, 1) < 0 && errno == EINTR);
+}
+
+/* map the ring object. return 0 if success */
+static int Map(struct ShmRing *ring, int handle)
+{
+  void *p = mmap(NULL, HEADER_SIZE + SHM_RING_SIZE,
+      PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+
+  close(handle);
+  if(p == MAP_FAILED) return -1;
+  ring->header = p;
+  ring->data = (char*)p + HEADER_SIZE;
+  return 0;
+}
+
+/*
+ * reader: wait for the ring created by the writer, "tries" times by 1ms
+ * (the ring object and then the ready ring). return 0 if success
+ */
+static int Attach(struct ShmRing *ring, int tries)
+{
+  struct timespec pause = {0, 1000000};
+  struct stat st;
+  int i;
+
+  for(i = 0; i < tries; ++i)
+  {
+    int handle;
+
+    if(i > 0) nanosleep(&pause, NULL);
+    handle = shm_open(ring->name, O_RDWR, 0);
+    if(handle < 0) continue;
+    if(fstat(handle, &st) != 0 || st.st_size < HEADER_SIZE + SHM_RING_SIZE)
+    {
+      close(handle);
+      continue;
+    }
+    if(Map(ring, handle) != 0) return -1;
+
+    /* the writer may still be setting it up (doorbells are made first) */
+    for(;;)
+    {
+      if(__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE) == SHM_RING_MAGIC)
+      {
+        /* both sides have it open, the names are not needed anymore */
+        if(BellsOpen(ring, 0) != 0) BellsClose(ring);
+        __atomic_store_n(&ring->header->reader_pid, getpid(), __ATOMIC_RELEASE);
+        shm_unlink(ring->name);
+        BellsUnlink(ring);
+        return 0;
+      }
+      if(++i >= tries) break;
+      nanosleep(&pause, NULL);
+    }
+    break;
+  }
+
+  if(ring->header != NULL)
+    munmap(ring->header, HEADER_SIZE + SHM_RING_SIZE);
+  ring->header = NULL;
+  return -1;
+}
+
+struct ShmRing *ShmRingOpen(const char *endpoint, int writer)
+{
+  struct ShmRing *ring;
+  int handle;
+
+  if(!IsShmEndpoint(endpoint)) return NULL;
+  if((ring = calloc(1, sizeof *ring)) == NULL) return NULL;
+  ring->bell[0] = ring->bell[1] = -1;
+  if(ShmName(endpoint, ring->name) != 0) goto fail;
+  ring->writer = writer;
+  if(!writer) return ring;
+
+  /* the ring can be polled only with the doorbells, but works without */
+  if(BellsOpen(ring, 1) != 0)
+  {
+    BellsClose(ring);
+    BellsUnlink(ring);
+  }
+
+  /* writer: fresh ring, the stale one (if any) left by the failed session */
+  shm_unlink(ring->name);
+  handle = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if(handle < 0) goto fail;
+  if(ftruncate(handle, HEADER_SIZE + SHM_RING_SIZE) != 0)
+  {
+    close(handle);
+    shm_unlink(ring->name);
+    goto fail;
+  }
+  if(Map(ring, handle) != 0)
+  {
+    shm_unlink(ring->name);
+    goto fail;
+  }
+  ring->header->size = SHM_RING_SIZE;
+  ring->header->writer_pid = getpid();
+  __atomic_store_n(&ring->header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+  return ring;
+
+fail:
+  BellsClose(ring);
+  BellsUnlink(ring);
+  free(ring);
+  return NULL;
+}
+
+void ShmRingClose(struct ShmRing *ring)
+{
+  if(ring == NULL) return;
+  if(ring->header != NULL)
+  {
+    if(ring->writer)
+    {
+      __atomic_store_n(&ring->header->eof, 1, __ATOMIC_RELEASE);
+      __atomic_add_fetch(&ring->header->data_seq, 1, __ATOMIC_SEQ_CST);
+      Wake(&ring->header->data_seq);
+      Ring(ring->bell[BELL_DATA]);
+    }
+    munmap(ring->header, HEADER_SIZE + SHM_RING_SIZE);
+  }
+  BellsClose(ring);
+  free(ring);
+}
+
+int ShmRingReady(struct ShmRing *ring)
+{
+  struct ShmRingHeader *header;
+  uint64_t used;
+
+  if(ring == NULL) return 0;
+
+  /* reader which is not attached yet takes one look for the ring */
+  if(ring->header == NULL && (ring->writer || Attach(ring, 1) != 0)) return 0;
+  header = ring->header;
+
+  used = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE)
+      - __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+  if(ring->writer) return used < SHM_RING_SIZE;
+  return used > 0 || __atomic_load_n(&header->eof, __ATOMIC_ACQUIRE);
+}
+
+int ShmRingArm(struct ShmRing *ring)
+{
+  uint32_t *waits;
+  char drain[64];
+  int bell;
+
+  if(ring == NULL || ring->header == NULL) return -1;
+  bell = ring->bell[ring->writer ? BELL_SPACE : BELL_DATA];
+  if(bell < 0) return -1;
+
+  /* the flag goes first, then the ring is checked (as with the futex) */
+  waits = ring->writer ? &ring->header->writer_waits : &ring->header->reader_waits;
+  __atomic_store_n(waits, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while(read(bell, drain, sizeof drain) > 0);
+  if(ShmRingReady(ring))
+  {
+    __atomic_store_n(waits, 0, __ATOMIC_SEQ_CST);
+    return -1;
+  }
+  return bell;
+}
+
+void ShmRingDisarm(struct ShmRing *ring)
+{
+  if(ring == NULL || ring->header == NULL) return;
+  __atomic_store_n(ring->writer ? &ring->header->writer_waits
+      : &ring->header->reader_waits, 0, __ATOMIC_SEQ_CST);
+}
+
+ssize_t ShmRingWrite(struct ShmRing *ring, const char *buf, size_t count)
+{
+  struct ShmRingHeader *header;
+  size_t done = 0;
+  int spin = 0;
+  int idle = 0;
+
+  if(ring == NULL || !ring->writer || ring->header == NULL) return -1;
+  header = ring->header;
+
+  while(done < count)
+  {
+    uint64_t head = header->head;
+    uint64_t space = SHM_RING_SIZE - (head - __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE));
+    uint64_t chunk, pos, first;
+
+    /* ring is full: spin a little, then sleep until the reader takes data */
+    if(space == 0)
+    {
+      uint32_t seq;
+      if(++spin < SHM_RING_SPIN) continue;
+      seq = __atomic_load_n(&header->space_seq, __ATOMIC_SEQ_CST);
+      __atomic_store_n(&header->writer_waits, 1, __ATOMIC_SEQ_CST);
+      if(__atomic_load_n(&header->tail, __ATOMIC_SEQ_CST) == head - SHM_RING_SIZE
+          && Wait(&header->space_seq, seq) == 0
+          && PeerLost(&header->reader_pid, &idle))
+        return -1;
+      __atomic_store_n(&header->writer_waits, 0, __ATOMIC_SEQ_CST);
+      continue;
+    }
+    spin = 0;
+    idle = 0;
+
+    chunk = count - done < space ? count - done : space;
+    pos = head & (SHM_RING_SIZE - 1);
+    first = SHM_RING_SIZE - pos < chunk ? SHM_RING_SIZE - pos : chunk;
+    memcpy(ring->data + pos, buf + done, first);
+    memcpy(ring->data, buf + done + first, chunk - first);
+    done += chunk;
+
+    /* publish and wake the reader if it sleeps */
+    __atomic_store_n(&header->head, head + chunk, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&header->data_seq, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&header->reader_waits, __ATOMIC_SEQ_CST))
+    {
+      Wake(&header->data_seq);
+      Ring(ring->bell[BELL_DATA]);
+    }
+  }
+  return done;
+}
+
+ssize_t ShmRingRead(struct ShmRing *ring, char *buf, size_t count)
+{
+  struct ShmRingHeader *header;
+  int spin = 0;
+  int idle = 0;
+
+  if(ring == NULL || ring->writer || count == 0) return -1;
+  if(ring->header == NULL && Attach(ring, SHM_RING_TIMEOUT * 1000) != 0) return -1;
+  header = ring->header;
+
+  for(;;)
+  {
+    uint64_t tail = header->tail;
+    uint64_t ready = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) - tail;
+    uint64_t chunk, pos, first;
+
+    /* ring is empty: end of stream or wait for the writer */
+    if(ready == 0)
+    {
+      uint32_t seq;
+      if(__atomic_load_n(&header->eof, __ATOMIC_ACQUIRE)
+          && __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == tail) return 0;
+      if(++spin < SHM_RING_SPIN) continue;
+      seq = __atomic_load_n(&header->data_seq, __ATOMIC_SEQ_CST);
+      __atomic_store_n(&header->reader_waits, 1, __ATOMIC_SEQ_CST);
+      if(__atomic_load_n(&header->head, __ATOMIC_SEQ_CST) == tail
+          && !__atomic_load_n(&header->eof, __ATOMIC_SEQ_CST)
+          && Wait(&header->data_seq, seq) == 0
+          && PeerLost(&header->writer_pid, &idle))
+        return -1;
+      __atomic_store_n(&header->reader_waits, 0, __ATOMIC_SEQ_CST);
+      continue;
+    }
+
+    chunk = count < ready ? count : ready;
+    pos = tail & (SHM_RING_SIZE - 1);
+    first = SHM_RING_SIZE - pos < chunk ? SHM_RING_SIZE - pos : chunk;
+    memcpy(buf, ring->data + pos, first);
+    memcpy(buf + first, ring->data, chunk - first);
+
+    /* release the space and wake the writer if it sleeps */
+    __atomic_store_n(&header->tail, tail + chunk, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&header->space_seq, 1, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&header->writer_waits, __ATOMIC_SEQ_CST))
+    {
+      Wake(&header->space_seq);
+      Ring(ring->bell[BELL_SPACE]);
+    }
+    return chunk;
+  }
+}
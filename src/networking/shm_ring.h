@@ -0,0 +1,68 @@
+/*
+ * shm_ring.h
+ * shared memory transport for the nodes working on the same host. channel
+ * with "shm://path" endpoint is single producer / single consumer ring of
+ * bytes in the tmpfs object named after the path. no sockets, no framing:
+ * writer copies data to the ring, reader copies it out. the sides only go
+ * to the kernel (futex) when the ring is full or empty
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_SCHEME "shm://"
+#define SHM_RING_MAGIC 0x5a524e47 /* "ZRNG" */
+#define SHM_RING_SIZE 0x800000 /* ring data size, power of 2 */
+#define SHM_RING_SPIN 2000 /* checks before going to sleep */
+#define SHM_RING_TIMEOUT 30 /* seconds one side waits for the other to appear */
+#define SHM_RING_CHECK 1 /* seconds of sleep before the side checks its peer is alive */
+
+/* return not 0 if the endpoint is shm:// one */
+int IsShmEndpoint(const char *endpoint);
+
+/*
+ * writer creates the ring (stale one is removed), reader only remembers the
+ * name and attaches on the first read, so nodes can open channels in any order
+ * return NULL if failed
+ */
+struct ShmRing *ShmRingOpen(const char *endpoint, int writer);
+
+/*
+ * return not 0 if the ring can be read (data or end of stream) by the
+ * reader or written by the writer without waiting. never waits
+ */
+int ShmRingReady(struct ShmRing *ring);
+
+/*
+ * prepare the ring for poll(): return the descriptor which becomes readable
+ * when the ring gets ready for this side, or -1 if it is ready already or
+ * cannot be polled (reader is not attached yet). the peer rings the
+ * descriptor until ShmRingDisarm() is called
+ */
+int ShmRingArm(struct ShmRing *ring);
+
+/* the side does not poll the ring anymore (see ShmRingArm) */
+void ShmRingDisarm(struct ShmRing *ring);
+
+/* writer marks the end of stream. free resources */
+void ShmRingClose(struct ShmRing *ring);
+
+/*
+ * write all "count" bytes, wait for the space if needed. return count or -1
+ * (also if the reader is gone or did not attach in SHM_RING_TIMEOUT)
+ */
+ssize_t ShmRingWrite(struct ShmRing *ring, const char *buf, size_t count);
+
+/*
+ * read up to "count" bytes, wait if the ring is empty
+ * return read bytes, 0 if stream is over or -1 if error (or the writer is gone)
+ */
+ssize_t ShmRingRead(struct ShmRing *ring, char *buf, size_t count);
+
+#endif /* SHM_RING_H_ */
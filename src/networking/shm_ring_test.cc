@@ -0,0 +1,260 @@
+/*
+ * shm_ring_test.cc
+ * data goes through the ring unchanged, end of stream is seen by the reader,
+ * the writer does not wait forever for the gone reader, the armed ring wakes poll().
+ * same host benchmark: throughput for 4KB and 1MB messages, round trip
+ * latency of the small message between two processes and the fan-in of
+ * many sources with skewed latencies read in fixed order or ready first
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#include <stdio.h>
+#include <sched.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "gtest/gtest.h"
+extern "C" {
+#include "src/networking/shm_ring.h"
+}
+
+#define ENDPOINT "shm:///tmp/shm_ring_test"
+#define ENDPOINT_BACK "shm:///tmp/shm_ring_test_back"
+#define BENCH_TOTAL 0x10000000LL
+#define BENCH_ROUNDS 100000
+
+static double Now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// writer in the child process, reader here. checks data and the end
+TEST(ShmRing, transfer) {
+  const int size = 3 * SHM_RING_SIZE + 12345; // wraps the ring several times
+  char *buf = (char*)malloc(size);
+  for (int i = 0; i < size; ++i) buf[i] = (char)(i * 7);
+
+  ShmRing *writer = ShmRingOpen(ENDPOINT, 1);
+  ASSERT_TRUE(writer != NULL);
+  if (fork() == 0) {
+    _exit(ShmRingWrite(writer, buf, size) == size ? 0 : 1);
+  }
+
+  ShmRing *reader = ShmRingOpen(ENDPOINT, 0);
+  ASSERT_TRUE(reader != NULL);
+  char *got = (char*)calloc(size, 1);
+  ssize_t done = 0;
+  while (done < size) {
+    ssize_t n = ShmRingRead(reader, got + done, 4097);
+    ASSERT_GT(n, 0);
+    done += n;
+  }
+  EXPECT_EQ(0, memcmp(buf, got, size));
+
+  int status;
+  wait(&status);
+  EXPECT_EQ(0, WEXITSTATUS(status));
+  ShmRingClose(writer);
+  EXPECT_EQ(0, ShmRingRead(reader, got, size));
+  ShmRingClose(reader);
+  free(buf);
+  free(got);
+}
+
+// the writer does not sleep forever on the full ring when the reader is gone
+TEST(ShmRing, reader_gone) {
+  const int size = 2 * SHM_RING_SIZE;
+  char *buf = (char*)calloc(size, 1);
+  ShmRing *writer = ShmRingOpen(ENDPOINT, 1);
+  ASSERT_TRUE(writer != NULL);
+
+  if (fork() == 0) {
+    ShmRing *reader = ShmRingOpen(ENDPOINT, 0);
+    _exit(ShmRingRead(reader, buf, 1) == 1 ? 0 : 1);
+  }
+  ASSERT_EQ(1, ShmRingWrite(writer, buf, 1));
+  int status;
+  wait(&status);
+  EXPECT_EQ(0, WEXITSTATUS(status));
+
+  double start = Now();
+  EXPECT_EQ(-1, ShmRingWrite(writer, buf, size));
+  EXPECT_GT(SHM_RING_CHECK * 3, Now() - start);
+  ShmRingClose(writer);
+  free(buf);
+}
+
+// armed ring wakes poll() when the writer adds data, not ready ring is not armed
+TEST(ShmRing, poll_doorbell) {
+  char msg[64] = {0};
+  ShmRing *writer = ShmRingOpen(ENDPOINT, 1);
+  ShmRing *reader = ShmRingOpen(ENDPOINT, 0);
+  ASSERT_TRUE(writer != NULL && reader != NULL);
+  ASSERT_EQ(0, ShmRingReady(reader)); // attaches
+
+  struct pollfd bell = {ShmRingArm(reader), POLLIN, 0};
+  ASSERT_LE(0, bell.fd);
+  EXPECT_EQ(0, poll(&bell, 1, 0));
+  if (fork() == 0) {
+    usleep(50000);
+    _exit(ShmRingWrite(writer, msg, sizeof msg) == sizeof msg ? 0 : 1);
+  }
+  double start = Now();
+  EXPECT_EQ(1, poll(&bell, 1, 2000));
+  EXPECT_GT(0.5, Now() - start);
+  ShmRingDisarm(reader);
+  wait(NULL);
+
+  // data is there, nothing to wait for
+  EXPECT_EQ(-1, ShmRingArm(reader));
+  EXPECT_EQ((ssize_t)sizeof msg, ShmRingRead(reader, msg, sizeof msg));
+  ShmRingClose(writer);
+  ShmRingClose(reader);
+}
+
+TEST(ShmRing, bad_endpoints) {
+  EXPECT_TRUE(ShmRingOpen("ipc:///tmp/test1", 1) == NULL);
+  EXPECT_TRUE(ShmRingOpen(NULL, 0) == NULL);
+  EXPECT_EQ(0, IsShmEndpoint("tcp://127.0.0.1:5000"));
+  EXPECT_NE(0, IsShmEndpoint(ENDPOINT));
+}
+
+// MB per second of the transfer by messages of the given size
+static double Throughput(int msg_size) {
+  char *buf = (char*)malloc(msg_size);
+  memset(buf, 1, msg_size);
+  ShmRing *writer = ShmRingOpen(ENDPOINT, 1);
+  EXPECT_TRUE(writer != NULL);
+
+  double start = Now();
+  if (fork() == 0) {
+    for (long long done = 0; done < BENCH_TOTAL; done += msg_size)
+      ShmRingWrite(writer, buf, msg_size);
+    ShmRingClose(writer);
+    _exit(0);
+  }
+  ShmRing *reader = ShmRingOpen(ENDPOINT, 0);
+  long long done = 0;
+  for (ssize_t n; (n = ShmRingRead(reader, buf, msg_size)) > 0;) done += n;
+  double time = Now() - start;
+  wait(NULL);
+
+  EXPECT_EQ(BENCH_TOTAL, done);
+  ShmRingClose(reader);
+  ShmRingClose(writer);
+  free(buf);
+  return done / time / 0x100000;
+}
+
+TEST(ShmRing, bench_throughput) {
+  printf("shm ring 4KB messages: %.1f MB/s\n", Throughput(0x1000));
+  printf("shm ring 1MB messages: %.1f MB/s\n", Throughput(0x100000));
+}
+
+// round trip of 64 bytes message: ping in one ring, pong in another
+TEST(ShmRing, bench_latency) {
+  char msg[64] = {0};
+  ShmRing *ping = ShmRingOpen(ENDPOINT, 1);
+  ShmRing *pong_in = ShmRingOpen(ENDPOINT_BACK, 0);
+  ASSERT_TRUE(ping != NULL && pong_in != NULL);
+
+  if (fork() == 0) {
+    ShmRing *ping_in = ShmRingOpen(ENDPOINT, 0);
+    ShmRing *pong = ShmRingOpen(ENDPOINT_BACK, 1);
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+      for (ssize_t got = 0; got < (ssize_t)sizeof msg;)
+        got += ShmRingRead(ping_in, msg + got, sizeof msg - got);
+      ShmRingWrite(pong, msg, sizeof msg);
+    }
+    ShmRingClose(pong);
+    ShmRingClose(ping_in);
+    _exit(0);
+  }
+
+  double start = Now();
+  for (int i = 0; i < BENCH_ROUNDS; ++i) {
+    ShmRingWrite(ping, msg, sizeof msg);
+    for (ssize_t got = 0; got < (ssize_t)sizeof msg;) {
+      ssize_t n = ShmRingRead(pong_in, msg + got, sizeof msg - got);
+      ASSERT_GT(n, 0);
+      got += n;
+    }
+  }
+  double time = Now() - start;
+  wait(NULL);
+  printf("shm ring round trip: %.2f us\n", time * 1000000 / BENCH_ROUNDS);
+
+  ShmRingClose(ping);
+  ShmRingClose(pong_in);
+}
+
+// source "n" sends timestamped messages, the higher "n" the slower
+#define FAN_SOURCES 64
+#define FAN_MESSAGES 50
+#define FAN_PAUSE_US 20
+
+static void FanSource(const char *endpoint, int n) {
+  ShmRing *ring = ShmRingOpen(endpoint, 1);
+  for (int i = 0; ring != NULL && i < FAN_MESSAGES; ++i) {
+    usleep(FAN_PAUSE_US * (n + 1));
+    double sent = Now();
+    ShmRingWrite(ring, (char*)&sent, sizeof sent);
+  }
+  ShmRingClose(ring);
+  _exit(0);
+}
+
+// mean delay (microseconds) between the send and the consume
+static double FanIn(int ready_first) {
+  ShmRing *readers[FAN_SOURCES];
+  char endpoint[64];
+  double delay = 0;
+  int left = FAN_SOURCES * FAN_MESSAGES;
+
+  for (int n = 0; n < FAN_SOURCES; ++n) {
+    snprintf(endpoint, sizeof endpoint, ENDPOINT "_fan_%d", n);
+    if (fork() == 0) FanSource(endpoint, n);
+    readers[n] = ShmRingOpen(endpoint, 0); // attached by the first read
+  }
+
+  for (int turn = 0; left > 0; turn = (turn + 1) % FAN_SOURCES) {
+    double sent;
+    int got = 0;
+
+    // ready first: take the message from any source which has it
+    if (ready_first) {
+      for (int n = 0; n < FAN_SOURCES && !got; ++n) {
+        if (!ShmRingReady(readers[(turn + n) % FAN_SOURCES])) continue;
+        got = ShmRingRead(readers[(turn + n) % FAN_SOURCES], (char*)&sent, sizeof sent) > 0;
+      }
+      if (!got) sched_yield();
+    } else {
+      got = ShmRingRead(readers[turn], (char*)&sent, sizeof sent) > 0;
+    }
+    if (!got) continue;
+    delay += Now() - sent;
+    --left;
+  }
+
+  for (int n = 0; n < FAN_SOURCES; ++n) {
+    ShmRingClose(readers[n]);
+    wait(NULL);
+  }
+  return delay * 1000000 / (FAN_SOURCES * FAN_MESSAGES);
+}
+
+TEST(ShmRing, bench_fan_in) {
+  printf("fan-in of %d sources, fixed order: %.0f us mean delay\n", FAN_SOURCES, FanIn(0));
+  printf("fan-in of %d sources, ready first: %.0f us mean delay\n", FAN_SOURCES, FanIn(1));
+}
+
+// main. no need to change
+int main(int argc, char *argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
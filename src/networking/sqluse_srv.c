@@ -7,6 +7,7 @@
 
 #include "src/networking/zmq_netw.h"
 #include "src/networking/sqluse_srv.h"
+#include "src/networking/topology.h"
 #include "src/networking/errcodes.h"
 #include "src/platform/nacl_log.h"
 
@@ -18,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
 
 #define SQL_QUERY "select * from channels;\0"
@@ -33,57 +35,96 @@ struct db_record_t* match_db_record_by_fd(struct db_records_t *records, int fd){
 	return NULL;
 }
 
+/*add record of the row to records array
+ *@param templates if not 0 endpoints are kept as is, without "%d" substitution*/
+static struct db_record_t* add_dbrecord(struct db_records_t *records, int argc, char **argv, int templates){
+	struct db_record_t *frecord = NULL;
+	//if need to expand array
+	if ( records->count >= records->maxcount ){
+		records->maxcount += DB_RECORDS_GRANULARITY;
+		records->array = realloc(records->array, sizeof(struct db_record_t)*records->maxcount);
+	}
+	frecord = &records->array[records->count++];
+	memset(frecord, '\0', sizeof(struct db_record_t));
+	frecord->sock = ESOCKET_REQREP; /*default socket type, if sock column is absent*/
+	/*loop by table columns count*/
+	for(int i=0; i<argc; i++){
+		const char *col_value = argv[i];
+		int len_value;
+		if ( !col_value ) continue;
+		len_value = strlen(col_value);
+		switch(i){
+		case ECOL_NODENAME:
+			frecord->nodename = malloc( len_value+1 );
+			strcpy(frecord->nodename, col_value);
+			frecord->nodename[len_value] = '\0';
+			break;
+		case ECOL_ENDPOINT:
+			if ( !templates && strstr(col_value, "%d\0") ){
+				//needs to be postprocessed
+				frecord->endpoint = malloc( len_value+20 );
+				memset(frecord->endpoint, '\0', len_value+20);
+				sprintf(frecord->endpoint, col_value, records->cid);
+			}
+			else{
+				frecord->endpoint = malloc( len_value+1 );
+				strcpy(frecord->endpoint, col_value);
+				frecord->endpoint[len_value] = '\0';
+			break;
+		}
+		case ECOL_FMODE:
+			strncpy(&(frecord->fmode), col_value, 1);
+			break;
+		case ECOL_FD:
+			frecord->fd = atoi( col_value );
+			break;
+		case ECOL_SOCK:
+			if ( !strcmp(col_value, STREAM) )
+				frecord->sock = ESOCKET_STREAM;
+			break;
+		}
+	}
+	/*shm:// endpoint selects shared memory ring whatever sock column says*/
+	if ( IsShmEndpoint(frecord->endpoint) )
+		frecord->sock = ESOCKET_SHM;
+	return frecord;
+}
+
 /* In use case it's should not be directly called, but only as callback for sqlite API;
  *@param argc columns count
  *@param argv columns values */
 int get_dbrecords_callback(void *file_records, int argc, char **argv, char **azColName){
 	if ( file_records ){
-		struct db_record_t *frecord = NULL;
-		struct db_records_t *records = (struct db_records_t *) file_records;
-		//if need to expand array
-		if ( records->count >= records->maxcount ){
-			records->maxcount += DB_RECORDS_GRANULARITY;
-			records->array = realloc(records->array, sizeof(struct db_record_t)*records->maxcount);
-		}
-		frecord = &records->array[records->count++];
-		frecord->sock = ESOCKET_REQREP; /*use same socket type for all files*/
-		/*loop by table columns count*/
-		for(int i=0; i<argc; i++){
-			const char *col_value = argv[i];
-			int len_value = strlen(col_value);
-			switch(i){
-			case ECOL_NODENAME:
-				frecord->nodename = malloc( len_value+1 );
-				strcpy(frecord->nodename, col_value);
-				frecord->nodename[len_value] = '\0';
-				break;
-			case ECOL_ENDPOINT:
-				if ( strstr(col_value, "%d\0") ){
-					//needs to be postprocessed
-					frecord->endpoint = malloc( len_value+20 );
-					memset(frecord->endpoint, '\0', len_value+20);
-					sprintf(frecord->endpoint, col_value, records->cid);
-				}
-				else{
-					frecord->endpoint = malloc( len_value+1 );
-					strcpy(frecord->endpoint, col_value);
-					frecord->endpoint[len_value] = '\0';
-				break;
-			}
-			case ECOL_FMODE:
-				strncpy(&(frecord->fmode), col_value, 1);
-				break;
-			case ECOL_FD:
-				frecord->fd = atoi( col_value );
-				break;
-			}
-		}
+		struct db_record_t *frecord = add_dbrecord((struct db_records_t *) file_records, argc, argv, 0);
 		NaClLog(LOG_INFO, "nodename:%s, sock=%d, endpoint=%s, fmode=%c, fd=%d\n",
 				frecord->nodename, frecord->sock,frecord->endpoint, frecord->fmode, frecord->fd);
 	}
 	return 0;
 }
 
+/*callback for topology compilation: rows of all nodes, endpoints unchanged*/
+static int get_topology_callback(void *file_records, int argc, char **argv, char **azColName){
+	struct db_record_t *frecord = add_dbrecord((struct db_records_t *) file_records, argc, argv, 1);
+	/*row without nodename belongs to no node*/
+	if ( !frecord->nodename ){
+		free(frecord->endpoint);
+		--((struct db_records_t *) file_records)->count;
+	}
+	else if ( !frecord->endpoint ){
+		frecord->endpoint = malloc(1);
+		frecord->endpoint[0] = '\0';
+	}
+	return 0;
+}
+
+static void free_dbrecords(struct db_records_t *db_records){
+	for ( int i=0; i < db_records->count; i++ ){
+		free(db_records->array[i].nodename);
+		free(db_records->array[i].endpoint);
+	}
+	free(db_records->array);
+}
+
 /*Issue db request.
  * @param path DB filename
  * @param nodename which records are needed
@@ -92,7 +133,7 @@ int get_all_records_from_dbtable(const char *path, const char *nodename, struct
 	sqlite3 *db = NULL;
 	char *zErrMsg = 0;
 	int rc = 0;
-	char sqlstr[100];
+	char *sqlstr;
 
 	if ( !path || !nodename || !db_records) return ERR_BAD_ARG;
 	rc = sqlite3_open( path, &db);
@@ -105,8 +146,10 @@ int get_all_records_from_dbtable(const char *path, const char *nodename, struct
 	db_records->maxcount = DB_RECORDS_GRANULARITY;
 	db_records->array = malloc( sizeof(struct db_record_t)*db_records->maxcount );
 	db_records->count = 0;
-	sprintf(sqlstr, "select * from channels where nodename='%s';", nodename);
+	/*quoted by sqlite, nodename can be of any length and contain quotes*/
+	sqlstr = sqlite3_mprintf("select * from channels where nodename=%Q;", nodename);
 	rc = sqlite3_exec(db, sqlstr, get_dbrecords_callback, db_records, &zErrMsg);
+	sqlite3_free(sqlstr);
 	if ( SQLITE_OK != rc ){
 		NaClLog(LOG_ERROR, "Sql statement : %s, exec error text=%s, errcode=%d\n",
 				SQL_QUERY, sqlite3_errmsg(db), rc);
@@ -117,5 +160,49 @@ int get_all_records_from_dbtable(const char *path, const char *nodename, struct
 	return ERR_OK;
 }
 
+int compile_topology(const char *path, const char *topology_path){
+	struct db_records_t db_records;
+	sqlite3 *db = NULL;
+	char *zErrMsg = 0;
+	int rc = 0;
 
+	if ( !path || !topology_path ) return ERR_BAD_ARG;
+	rc = sqlite3_open( path, &db);
+	if( rc ){
+		NaClLog(LOG_ERROR, "Can't open database file=%s, errtext %s, errcode=%d\n",
+				path, sqlite3_errmsg(db), rc);
+		sqlite3_close(db);
+		return ERR_ERROR;
+	}
+	memset(&db_records, '\0', sizeof(struct db_records_t));
+	rc = sqlite3_exec(db, SQL_QUERY, get_topology_callback, &db_records, &zErrMsg);
+	sqlite3_free(zErrMsg);
+	sqlite3_close(db);
+	if ( SQLITE_OK != rc ){
+		NaClLog(LOG_ERROR, "Sql statement : %s, exec error errcode=%d\n", SQL_QUERY, rc);
+		free_dbrecords(&db_records);
+		return ERR_ERROR;
+	}
+	rc = TopologyWrite(topology_path, path, db_records.array, db_records.count);
+	free_dbrecords(&db_records);
+	return rc;
+}
+
+int get_node_records(const char *path, const char *nodename, struct db_records_t *db_records){
+	char topology_path[PATH_MAX];
+	int err;
 
+	if ( !path || !nodename || !db_records) return ERR_BAD_ARG;
+	snprintf(topology_path, sizeof(topology_path), "%s" TOPOLOGY_SUFFIX, path);
+	if ( ERR_OK == TopologyRead(topology_path, path, nodename, db_records) ){
+		NaClLog(LOG_INFO, "nodename:%s, %d records from topology cache %s\n",
+				nodename, db_records->count, topology_path);
+		return ERR_OK;
+	}
+
+	/*cache is absent or stale: query db, then compile cache for next jobs*/
+	err = get_all_records_from_dbtable(path, nodename, db_records);
+	if ( ERR_OK == err && ERR_OK != compile_topology(path, topology_path) )
+		NaClLog(LOG_INFO, "topology cache %s is not updated\n", topology_path);
+	return err;
+}
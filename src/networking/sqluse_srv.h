@@ -25,8 +25,10 @@ struct db_records_t{
 #define FILE_TYPE_MSQ "msq\0"
 
 #define REQREP  "REQREP\0"
+#define STREAM  "STREAM\0"
 
-enum { ECOL_NODENAME=0, ECOL_ENDPOINT, ECOL_FMODE, ECOL_FD, ECOL_COLUMNS_COUNT};
+/*sock column is optional, REQREP if absent; endpoints "shm://path" are always SHM*/
+enum { ECOL_NODENAME=0, ECOL_ENDPOINT, ECOL_FMODE, ECOL_FD, ECOL_SOCK, ECOL_COLUMNS_COUNT};
 
 
 struct db_record_t{
@@ -50,4 +52,14 @@ int get_dbrecords_callback(void *file_records, int argc, char **argv, char **azC
  * @param db_records data structure to get results, should be only valid pointer*/
 int get_all_records_from_dbtable(const char *path, const char *nodename, struct db_records_t *db_records);
 
+/*Compile channels table of all nodes into binary topology cache (see topology.h).
+ * @param path DB filename
+ * @param topology_path cache filename
+ * @return ERR_OK or ERR_ERROR*/
+int compile_topology(const char *path, const char *topology_path);
+
+/*Read node records from topology cache "<path>.topo", if cache is absent or stale
+ * issue db request and compile cache for next launches. Parameters as above*/
+int get_node_records(const char *path, const char *nodename, struct db_records_t *db_records);
+
 #endif /* SQLUSE_CLI_H_ */
@@ -6,12 +6,16 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sqlite3.h>
 
 #include "gtest/gtest.h"
 #include "src/platform/nacl_log.h"
 #include "src/networking/errcodes.h"
 extern "C" {
 #include "src/networking/sqluse_srv.h"
+#include "src/networking/topology.h"
 }
 
 #define TEST_NODENAME "test\0"
@@ -22,6 +26,11 @@ extern "C" {
 #define TEST_REQREP "REQREP\0"
 
 #define SERVER_DB_PATH "gtest/data/zerovm_test.db"
+#define TOPOLOGY_PATH "/tmp/sqluse_srv_test.topo"
+#define BENCH_DB_PATH "/tmp/sqluse_srv_bench.db"
+#define BENCH_NODES 1000
+#define BENCH_CHANNELS 10
+#define BENCH_LAUNCHES 200
 
 // Test harness for routines in sqluse_srv.c
 class SqlUseSrvTests : public ::testing::Test {
@@ -82,11 +91,112 @@ TEST_F(SqlUseSrvTests, TestDbItemsParser) {
 	row_values_array[ECOL_ENDPOINT] = (char*)TEST_ENDPOINT;
 	row_values_array[ECOL_FMODE] = (char*)TEST_MODE_W;
 	row_values_array[ECOL_FD] = (char*)TEST_FD;
+	row_values_array[ECOL_SOCK] = (char*)TEST_REQREP;
 	get_dbrecords_callback( &db_records, ECOL_COLUMNS_COUNT, row_values_array, NULL);
 	ASSERT_TRUE( 1==db_records.count );
 }
 
 
+/*cache gives same records as db*/
+TEST_F(SqlUseSrvTests, TestTopologyCache) {
+	struct db_records_t from_db;
+	struct db_records_t from_cache;
+	memset(&from_db, '\0', sizeof(struct db_records_t));
+	memset(&from_cache, '\0', sizeof(struct db_records_t));
+	from_db.cid = from_cache.cid = 7;
+	unlink(TOPOLOGY_PATH);
+	EXPECT_EQ( ERR_NOT_FOUND, TopologyRead(TOPOLOGY_PATH, SERVER_DB_PATH, "manager", &from_cache) );
+
+	ASSERT_EQ( ERR_OK, compile_topology(SERVER_DB_PATH, TOPOLOGY_PATH) );
+	ASSERT_EQ( ERR_OK, get_all_records_from_dbtable(SERVER_DB_PATH, "manager", &from_db) );
+	ASSERT_EQ( ERR_OK, TopologyRead(TOPOLOGY_PATH, SERVER_DB_PATH, "manager", &from_cache) );
+	ASSERT_EQ( from_db.count, from_cache.count );
+	qsort( from_db.array, from_db.count, sizeof(struct db_record_t), records_comparator );
+	qsort( from_cache.array, from_cache.count, sizeof(struct db_record_t), records_comparator );
+	for (int i=0; i < from_db.count; i++){
+		EXPECT_STREQ( from_db.array[i].nodename, from_cache.array[i].nodename );
+		EXPECT_STREQ( from_db.array[i].endpoint, from_cache.array[i].endpoint );
+		EXPECT_EQ( from_db.array[i].fd, from_cache.array[i].fd );
+		EXPECT_EQ( from_db.array[i].fmode, from_cache.array[i].fmode );
+		EXPECT_EQ( from_db.array[i].sock, from_cache.array[i].sock );
+		/*records own the strings, the cache is unmapped*/
+		free(from_cache.array[i].nodename);
+		free(from_cache.array[i].endpoint);
+	}
+	free(from_cache.array);
+
+	/*unknown node has no channels*/
+	EXPECT_EQ( ERR_OK, TopologyRead(TOPOLOGY_PATH, SERVER_DB_PATH, "nosuchnode", &from_cache) );
+	EXPECT_EQ( 0, from_cache.count );
+	/*cache of another db is stale*/
+	EXPECT_EQ( ERR_NOT_FOUND, TopologyRead(TOPOLOGY_PATH, TOPOLOGY_PATH, "manager", &from_cache) );
+	unlink(TOPOLOGY_PATH);
+}
+
+static double now(){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*startup of the node with 10k rows channels table: sqlite query against cache*/
+TEST_F(SqlUseSrvTests, BenchTopologyCache) {
+	sqlite3 *db = NULL;
+	char nodename[32];
+	double start, db_time, cache_time;
+	unlink(BENCH_DB_PATH);
+	ASSERT_EQ( SQLITE_OK, sqlite3_open(BENCH_DB_PATH, &db) );
+	sqlite3_exec(db, "create table channels(nodename text, endpoint text, fmode character(1), fd int, sock text);"
+			"begin transaction;", NULL, NULL, NULL);
+	for (int n=0; n < BENCH_NODES; n++){
+		for (int c=0; c < BENCH_CHANNELS; c++){
+			char *sql = sqlite3_mprintf("insert into channels values('node%d', 'ipc:///tmp/bench-%d-%d', '%c', %d, 'STREAM');",
+					n, n, c, c % 2 ? 'r' : 'w', c + 3);
+			sqlite3_exec(db, sql, NULL, NULL, NULL);
+			sqlite3_free(sql);
+		}
+	}
+	sqlite3_exec(db, "commit;", NULL, NULL, NULL);
+	sqlite3_close(db);
+	ASSERT_EQ( ERR_OK, compile_topology(BENCH_DB_PATH, BENCH_DB_PATH TOPOLOGY_SUFFIX) );
+
+	start = now();
+	for (int i=0; i < BENCH_LAUNCHES; i++){
+		struct db_records_t records;
+		memset(&records, '\0', sizeof(struct db_records_t));
+		snprintf(nodename, sizeof(nodename), "node%d", i * 7 % BENCH_NODES);
+		ASSERT_EQ( ERR_OK, get_all_records_from_dbtable(BENCH_DB_PATH, nodename, &records) );
+		ASSERT_EQ( BENCH_CHANNELS, records.count );
+		for (int j=0; j < records.count; j++){
+			free(records.array[j].nodename);
+			free(records.array[j].endpoint);
+		}
+		free(records.array);
+	}
+	db_time = (now() - start) / BENCH_LAUNCHES;
+
+	start = now();
+	for (int i=0; i < BENCH_LAUNCHES; i++){
+		struct db_records_t records;
+		memset(&records, '\0', sizeof(struct db_records_t));
+		snprintf(nodename, sizeof(nodename), "node%d", i * 7 % BENCH_NODES);
+		ASSERT_EQ( ERR_OK, get_node_records(BENCH_DB_PATH, nodename, &records) );
+		ASSERT_EQ( BENCH_CHANNELS, records.count );
+		for (int j=0; j < records.count; j++){
+			free(records.array[j].nodename);
+			free(records.array[j].endpoint);
+		}
+		free(records.array);
+	}
+	cache_time = (now() - start) / BENCH_LAUNCHES;
+
+	printf("%d rows: sqlite query %.1f us, topology cache %.1f us per node startup\n",
+			BENCH_NODES * BENCH_CHANNELS, db_time * 1000000, cache_time * 1000000);
+	unlink(BENCH_DB_PATH);
+	unlink(BENCH_DB_PATH TOPOLOGY_SUFFIX);
+}
+
+
 int main(int argc, char **argv) {
 	testing::InitGoogleTest(&argc, argv);
 	NaClLogSetVerbosity(-10); /*just disable logging attempts*/
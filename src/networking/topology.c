@@ -0,0 +1,289 @@
+/*
+ * topology.c
+ * cache layout: header, hash buckets (node index + 1, 0 - empty), nodes
+ * (records of the node are contiguous), records, strings. all references
+ * are offsets from the start of the file, so it is used right where mapped
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src/networking/topology.h"
+#include "src/networking/zmq_netw.h"
+#include "src/networking/errcodes.h"
+#include "src/platform/nacl_log.h"
+
+struct TopologyHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  int64_t db_size; /* the db the cache was made from */
+  int64_t db_mtime_sec;
+  int64_t db_mtime_nsec;
+  uint32_t buckets; /* power of 2 */
+  uint32_t nodes;
+  uint32_t records;
+  uint32_t size; /* of the whole cache */
+};
+
+struct TopologyNode
+{
+  uint32_t name;
+  uint32_t hash;
+  uint32_t first;
+  uint32_t count;
+};
+
+struct TopologyRecord
+{
+  uint32_t endpoint;
+  int32_t fd;
+  int32_t sock;
+  char fmode;
+  char reserved[3];
+};
+
+/* fnv-1a */
+static uint32_t Hash(const char *s)
+{
+  uint32_t hash = 2166136261U;
+  for(; *s != '\0'; ++s)
+    hash = (hash ^ (unsigned char)*s) * 16777619U;
+  return hash;
+}
+
+static int CompareNodenames(const void *a, const void *b)
+{
+  return strcmp((*(const struct db_record_t**)a)->nodename,
+      (*(const struct db_record_t**)b)->nodename);
+}
+
+/* sections of the cache */
+#define BUCKETS(h) ((uint32_t*)((h) + 1))
+#define NODES(h) ((struct TopologyNode*)(BUCKETS(h) + (h)->buckets))
+#define RECORDS(h) ((struct TopologyRecord*)(NODES(h) + (h)->nodes))
+#define STRINGS(h) ((char*)(RECORDS(h) + (h)->records))
+
+/* return 0 if the cache header answers to the db */
+static int SameDb(const struct TopologyHeader *header, const char *db_path)
+{
+  struct stat st;
+
+  if(stat(db_path, &st) != 0) return -1;
+  return header->db_size == st.st_size && header->db_mtime_sec == st.st_mtim.tv_sec
+      && header->db_mtime_nsec == st.st_mtim.tv_nsec ? 0 : -1;
+}
+
+int TopologyWrite(const char *path, const char *db_path,
+    const struct db_record_t *records, int count)
+{
+  const struct db_record_t **sorted;
+  struct TopologyHeader header;
+  struct TopologyHeader *cache;
+  struct stat st;
+  char tmp[PATH_MAX];
+  size_t strings = 0;
+  uint32_t at;
+  FILE *f;
+  int i, n;
+
+  if(path == NULL || db_path == NULL || count < 0 || stat(db_path, &st) != 0) return ERR_ERROR;
+
+  /* records of the same node together */
+  if((sorted = malloc((count + 1) * sizeof *sorted)) == NULL) return ERR_ERROR;
+  for(i = 0; i < count; ++i)
+  {
+    sorted[i] = &records[i];
+    strings += strlen(records[i].nodename) + strlen(records[i].endpoint) + 2;
+  }
+  qsort(sorted, count, sizeof *sorted, CompareNodenames);
+
+  memset(&header, 0, sizeof header);
+  header.magic = TOPOLOGY_MAGIC;
+  header.version = TOPOLOGY_VERSION;
+  header.db_size = st.st_size;
+  header.db_mtime_sec = st.st_mtim.tv_sec;
+  header.db_mtime_nsec = st.st_mtim.tv_nsec;
+  header.records = count;
+  for(i = 0; i < count; ++i)
+    header.nodes += i == 0 || strcmp(sorted[i - 1]->nodename, sorted[i]->nodename) != 0;
+  for(header.buckets = 1; header.buckets < 2 * header.nodes; header.buckets <<= 1);
+  header.size = sizeof header + header.buckets * sizeof(uint32_t)
+      + header.nodes * sizeof(struct TopologyNode)
+      + header.records * sizeof(struct TopologyRecord) + strings;
+
+  /* build the whole cache in memory */
+  if((cache = calloc(1, header.size)) == NULL)
+  {
+    free(sorted);
+    return ERR_ERROR;
+  }
+  *cache = header;
+  at = (uint32_t)(STRINGS(cache) - (char*)cache);
+  for(i = 0, n = -1; i < count; ++i)
+  {
+    struct TopologyRecord *record = &RECORDS(cache)[i];
+
+    if(n < 0 || strcmp(sorted[i - 1]->nodename, sorted[i]->nodename) != 0)
+    {
+      struct TopologyNode *node = &NODES(cache)[++n];
+      uint32_t bucket;
+
+      node->name = at;
+      node->hash = Hash(sorted[i]->nodename);
+      node->first = i;
+      strcpy((char*)cache + at, sorted[i]->nodename);
+      at += strlen(sorted[i]->nodename) + 1;
+
+      for(bucket = node->hash; BUCKETS(cache)[bucket & (header.buckets - 1)] != 0; ++bucket);
+      BUCKETS(cache)[bucket & (header.buckets - 1)] = n + 1;
+    }
+    ++NODES(cache)[n].count;
+
+    record->endpoint = at;
+    record->fd = sorted[i]->fd;
+    record->sock = sorted[i]->sock;
+    record->fmode = sorted[i]->fmode;
+    strcpy((char*)cache + at, sorted[i]->endpoint);
+    at += strlen(sorted[i]->endpoint) + 1;
+  }
+  free(sorted);
+
+  /* other jobs may read the cache right now: write aside and replace */
+  snprintf(tmp, sizeof tmp, "%s.%d", path, getpid());
+  f = fopen(tmp, "wb");
+  n = f != NULL && fwrite(cache, header.size, 1, f) == 1;
+  if(f != NULL) n = fclose(f) == 0 && n;
+  free(cache);
+  if(!n || rename(tmp, path) != 0)
+  {
+    NaClLog(LOG_ERROR, "cannot write topology cache %s\n", path);
+    unlink(tmp);
+    return ERR_ERROR;
+  }
+  return ERR_OK;
+}
+
+/* return the mapped cache or NULL if it is absent or broken */
+static const struct TopologyHeader *Map(const char *path)
+{
+  const struct TopologyHeader *header;
+  struct stat st;
+  void *p;
+  int handle;
+
+  if((handle = open(path, O_RDONLY)) < 0) return NULL;
+  if(fstat(handle, &st) != 0 || st.st_size < (off_t)sizeof *header)
+  {
+    close(handle);
+    return NULL;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+  close(handle);
+  if(p == MAP_FAILED) return NULL;
+
+  /* sections must fit and the strings must be terminated */
+  header = p;
+  if(header->magic != TOPOLOGY_MAGIC || header->version != TOPOLOGY_VERSION
+      || header->size != st.st_size || ((char*)p)[st.st_size - 1] != '\0'
+      || header->buckets == 0 || (header->buckets & (header->buckets - 1)) != 0
+      || header->nodes > header->buckets || header->records > header->size
+      || STRINGS(header) > (char*)p + header->size)
+  {
+    munmap(p, st.st_size);
+    return NULL;
+  }
+  return header;
+}
+
+int TopologyRead(const char *path, const char *db_path,
+    const char *nodename, struct db_records_t *db_records)
+{
+  const struct TopologyHeader *header;
+  const struct TopologyNode *node = NULL;
+  uint32_t hash, bucket, n;
+  uint32_t strings;
+  uint32_t i;
+  int retcode = ERR_OK;
+
+  if(path == NULL || db_path == NULL || nodename == NULL || db_records == NULL)
+    return ERR_BAD_ARG;
+  if((header = Map(path)) == NULL) return ERR_NOT_FOUND;
+  if(SameDb(header, db_path) != 0)
+  {
+    NaClLog(LOG_INFO, "topology cache %s is stale\n", path);
+    munmap((void*)header, header->size);
+    return ERR_NOT_FOUND;
+  }
+
+  /* the node */
+  hash = Hash(nodename);
+  strings = (uint32_t)(STRINGS(header) - (char*)header);
+  for(bucket = hash; bucket - hash < header->buckets
+      && (n = BUCKETS(header)[bucket & (header->buckets - 1)]) != 0; ++bucket)
+  {
+    const struct TopologyNode *candidate = &NODES(header)[n - 1];
+
+    if(n > header->nodes || candidate->name < strings || candidate->name >= header->size
+        || candidate->first + candidate->count > header->records) break;
+    if(candidate->hash == hash && strcmp((char*)header + candidate->name, nodename) == 0)
+    {
+      node = candidate;
+      break;
+    }
+  }
+
+  /* records. the strings are copied, the cache is not needed after */
+  db_records->count = db_records->maxcount = node == NULL ? 0 : node->count;
+  db_records->array = calloc(db_records->count + 1, sizeof *db_records->array);
+  for(i = 0; db_records->array != NULL && i < (uint32_t)db_records->count; ++i)
+  {
+    const struct TopologyRecord *record = &RECORDS(header)[node->first + i];
+    struct db_record_t *frecord = &db_records->array[i];
+    const char *endpoint = (char*)header + record->endpoint;
+
+    if(record->endpoint < strings || record->endpoint >= header->size)
+    {
+      NaClLog(LOG_ERROR, "topology cache %s is broken\n", path);
+      retcode = ERR_NOT_FOUND;
+      break;
+    }
+
+    frecord->fd = record->fd;
+    frecord->sock = record->sock;
+    frecord->fmode = record->fmode;
+    frecord->nodename = strdup((char*)header + node->name);
+    if(strstr(endpoint, "%d") == NULL)
+      frecord->endpoint = strdup(endpoint);
+    else if((frecord->endpoint = malloc(strlen(endpoint) + 20)) != NULL)
+      sprintf(frecord->endpoint, endpoint, db_records->cid);
+    if(frecord->nodename == NULL || frecord->endpoint == NULL)
+    {
+      retcode = ERR_NO_MEMORY;
+      break;
+    }
+  }
+  munmap((void*)header, header->size);
+  if(db_records->array == NULL) retcode = ERR_NO_MEMORY;
+  if(retcode == ERR_OK) return ERR_OK;
+
+  /* nothing is given on error */
+  for(i = 0; db_records->array != NULL && i < (uint32_t)db_records->count; ++i)
+  {
+    free(db_records->array[i].nodename);
+    free(db_records->array[i].endpoint);
+  }
+  free(db_records->array);
+  db_records->array = NULL;
+  db_records->count = db_records->maxcount = 0;
+  return retcode;
+}
@@ -0,0 +1,39 @@
+/*
+ * topology.h
+ * compiled channels topology: the channels table of the networking db
+ * written to the binary file next to the db ("<db>.topo"). the file is
+ * mapped as is, the node records are found by the nodename hash, so the
+ * job startup needs neither sqlite nor the parsing. the cache keeps the
+ * size and mtime of the db it was made from, the stale cache is ignored
+ *
+ *  Created on: May 14, 2012
+ *      Author: d'b
+ */
+
+#ifndef TOPOLOGY_H_
+#define TOPOLOGY_H_
+
+#include "src/networking/sqluse_srv.h"
+
+#define TOPOLOGY_SUFFIX ".topo"
+#define TOPOLOGY_MAGIC 0x4f50545a /* "ZTPO" */
+#define TOPOLOGY_VERSION 1
+
+/*
+ * write the cache of the db "db_path" from the records of all nodes. the
+ * endpoints are kept as is ("%d" is substituted by the reader)
+ * return ERR_OK or ERR_ERROR
+ */
+int TopologyWrite(const char *path, const char *db_path,
+    const struct db_record_t *records, int count);
+
+/*
+ * map the cache and put the records of the node to "db_records" (node
+ * without channels gets no records). strings of the records are copied,
+ * they are freed as the ones got from the db. the cache is unmapped
+ * return ERR_OK, ERR_NOT_FOUND if the cache is absent, stale or broken
+ */
+int TopologyRead(const char *path, const char *db_path,
+    const char *nodename, struct db_records_t *db_records);
+
+#endif /* TOPOLOGY_H_ */
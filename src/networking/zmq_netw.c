@@ -18,7 +18,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <errno.h>
 
+/*updated atomically: scatter/gather transfer the parts from own threads*/
 static uint32_t __bytes_recv = 0;
 static uint32_t __bytes_sent = 0;
 
@@ -34,6 +36,8 @@ int init_zeromq_pool(struct zeromq_pool * zpool){
 		zpool->count_max=ESOCKF_ARRAY_GRANULARITY;
 		/*allocated memory for array should be free at the zeromq_term */
 		zpool->sockf_array = malloc(zpool->count_max * sizeof(struct sock_file_t));
+		zpool->fd_index = NULL;
+		zpool->fd_index_size = 0;
 		if ( zpool->sockf_array ) {
 			memset(zpool->sockf_array, '\0', zpool->count_max*sizeof(struct sock_file_t));
 			for (int i=0; i < zpool->count_max; i++)
@@ -63,6 +67,8 @@ int zeromq_term(struct zeromq_pool* zpool){
 	if ( !zpool ) return ERR_BAD_ARG;
 
 	free(zpool->sockf_array), zpool->sockf_array = NULL;
+	free(zpool->fd_index), zpool->fd_index = NULL;
+	zpool->fd_index_size = 0;
 
 	/*destroy zmq context*/
 	if (zpool->context){
@@ -85,14 +91,31 @@ int zeromq_term(struct zeromq_pool* zpool){
 }
 
 struct sock_file_t* sockf_by_fd(struct zeromq_pool* zpool, int fd){
-	if ( zpool && zpool->sockf_array ){
-		for (int i=0; i < zpool->count_max; i++)
-			if ( !zpool->sockf_array[i].unused && zpool->sockf_array[i].fs_fd == fd )
-				return &zpool->sockf_array[i];
+	if ( zpool && zpool->sockf_array && zpool->fd_index ){
+		if ( fd >= 0 && fd < zpool->fd_index_size && zpool->fd_index[fd] ){
+			struct sock_file_t* sockf = &zpool->sockf_array[zpool->fd_index[fd]-1];
+			if ( !sockf->unused && sockf->fs_fd == fd )
+				return sockf;
+		}
 	}
 	return NULL;
 }
 
+/*remember array index of fd socket, grow fd index if needed*/
+static int index_sockf_fd(struct zeromq_pool* zpool, int fd, int array_index){
+	if ( fd < 0 ) return ERR_BAD_ARG;
+	if ( fd >= zpool->fd_index_size ){
+		int size = fd + ESOCKF_ARRAY_GRANULARITY;
+		int *fd_index = realloc(zpool->fd_index, size * sizeof(int));
+		if ( !fd_index ) return ERR_NO_MEMORY;
+		memset(fd_index + zpool->fd_index_size, '\0', (size - zpool->fd_index_size) * sizeof(int));
+		zpool->fd_index = fd_index;
+		zpool->fd_index_size = size;
+	}
+	zpool->fd_index[fd] = array_index + 1;
+	return ERR_OK;
+}
+
 int add_sockf_copy_to_array(struct zeromq_pool* zpool, struct sock_file_t* sockf){
 	struct sock_file_t* sockf_add = NULL;
 	int err = ERR_OK;
@@ -125,6 +148,8 @@ int add_sockf_copy_to_array(struct zeromq_pool* zpool, struct sock_file_t* sockf
 			}
 		}
 	}while(!sockf_add || ERR_OK!=err);
+	err = index_sockf_fd(zpool, sockf->fs_fd, sockf_add - zpool->sockf_array);
+	if ( ERR_OK != err ) return err;
 	*sockf_add = *sockf;
 	sockf_add->unused = 0;
 	return err;
@@ -140,6 +165,8 @@ int remove_sockf_from_array_by_fd(struct zeromq_pool* zpool, int fd){
 	for (int i=0; i < zpool->count_max; i++)
 		if ( zpool->sockf_array[i].fs_fd == fd){
 			zpool->sockf_array[i].unused = 1;
+			if ( fd >= 0 && fd < zpool->fd_index_size )
+				zpool->fd_index[fd] = 0;
 			err = ERR_OK;
 			break;
 		}
@@ -205,6 +232,34 @@ struct sock_file_t* open_sockf(struct zeromq_pool* zpool, struct db_records_t *d
 					NaClLog(LOG_ERROR, "zmq_bind errno %d, status %s\n", zmq_errno(), zmq_strerror(zmq_errno()));
 				}
 				break;
+			case ESOCKET_STREAM:
+				/*writer binds, reader connects like REQREP does; credits go back by the same socket*/
+				NaClLog(LOG_INFO, "open socket: ESOCKET_STREAM, %s, sock type ZMQ_PAIR\n", db_record->endpoint);
+				sockf->capabilities = EREADWRITE;
+				sockf->netw_socket = zmq_socket( zpool->context, ZMQ_PAIR );
+				if (sockf->netw_socket){
+					if ( 'r' == db_record->fmode )
+						err= zmq_connect(sockf->netw_socket, db_record->endpoint);
+					else if ( 'w' == db_record->fmode )
+						err= zmq_bind(sockf->netw_socket, db_record->endpoint);
+					NaClLog(LOG_INFO, "stream socket status err %d\n", err);
+				}
+				else
+					err = ERR_ERROR;
+				if ( err ){
+					NaClLog(LOG_ERROR, "stream socket errno %d, status %s\n", zmq_errno(), zmq_strerror(zmq_errno()));
+				}
+				break;
+			case ESOCKET_SHM:
+				/*writer creates ring now, reader attaches to it at first read*/
+				NaClLog(LOG_INFO, "open socket: ESOCKET_SHM, %s\n", db_record->endpoint);
+				sockf->capabilities = 'r' == db_record->fmode ? EREAD : EWRITE;
+				sockf->ring = ShmRingOpen(db_record->endpoint, 'w' == db_record->fmode);
+				if ( !sockf->ring ){
+					NaClLog(LOG_ERROR, "cannot open shared memory ring %s\n", db_record->endpoint);
+					err = ERR_ERROR;
+				}
+				break;
 			case ESOCKET_UNKNOWN:
 			default:
 				NaClLog(LOG_ERROR, "open socket: unknown socket\n");
@@ -214,7 +269,8 @@ struct sock_file_t* open_sockf(struct zeromq_pool* zpool, struct db_records_t *d
 
 			if ( err != ERR_OK ){
 				NaClLog(LOG_ERROR, "close opened socket, free sockf, because connect|bind failed\n");
-				zmq_close( sockf->netw_socket );
+				if ( sockf->netw_socket )
+					zmq_close( sockf->netw_socket );
 				free(sockf), sockf = NULL;
 			}
 
@@ -241,9 +297,26 @@ int close_sockf(struct zeromq_pool* zpool, struct sock_file_t *sockf){
 	if ( !zpool || !sockf ) return ERR_BAD_ARG;
 	NaClLog(LOG_INFO, "fd=%d\n", sockf->fs_fd);
 
+	if ( sockf->ring ){
+		/*writer marks end of stream*/
+		ShmRingClose(sockf->ring);
+		sockf->ring = NULL;
+	}
+
+	if ( sockf->pending_msg ){
+		/*drop unread tail of stream message*/
+		zmq_msg_close( (zmq_msg_t*)sockf->pending_msg );
+		free(sockf->pending_msg), sockf->pending_msg = NULL;
+	}
+
 	if( sockf->netw_socket ){
 		int err = 0;
-		if ( 'w' == sockf->access_mode ){
+		if ( ESOCKET_STREAM == sockf->sock_type && 'w' == sockf->access_mode ){
+			/*let reader know stream is over*/
+			err = write_sockf_eof(sockf);
+			NaClLog(LOG_INFO, "stream eof inside close err =%d\n", err);
+		}
+		else if ( 'w' == sockf->access_mode ){
 			NaClLog(LOG_INFO, "zmq_recv ZMQ_NOBLOCK workaround zmq_send bug\n");
 			zmq_msg_t msg;
 			zmq_msg_init (&msg);
@@ -275,6 +348,12 @@ ssize_t  write_sockf(struct sock_file_t *sockf, const char *buf, size_t size){
 	NaClLog(LOG_INFO, "%p, %p, %d\n", (void*)sockf, (void*)buf, (int)size);
 	if ( !sockf || !buf || !size || size==SIZE_MAX ) return -1;
 	if ( EWRITE != sockf->capabilities && EREADWRITE != sockf->capabilities  ) return -1;
+	if ( sockf->ring ){
+		wrote = ShmRingWrite(sockf->ring, buf, size);
+		if ( wrote > 0 )
+			__sync_fetch_and_add(&__bytes_sent, wrote);
+		return wrote;
+	}
 
 	err = zmq_msg_init_size (&msg, size);
 	if ( err != 0 ){
@@ -294,7 +373,7 @@ ssize_t  write_sockf(struct sock_file_t *sockf, const char *buf, size_t size){
 		zmq_msg_close (&msg);
 	}
 	if ( wrote > 0 )
-		__bytes_sent +=wrote;
+		__sync_fetch_and_add(&__bytes_sent, wrote);
 	return wrote;
 }
 
@@ -304,6 +383,12 @@ ssize_t read_sockf(struct sock_file_t *sockf, char *buf, size_t count){
 	NaClLog(LOG_INFO, "%p, %p, %d\n", (void*)sockf, (void*)buf, (int)count);
 	if ( !sockf || !buf || !count || count==SIZE_MAX ) return -1;
 	if ( EREAD != sockf->capabilities && EREADWRITE != sockf->capabilities  ) return -1;
+	if ( sockf->ring ){
+		ssize_t got = ShmRingRead(sockf->ring, buf, count);
+		if ( got > 0 )
+			__sync_fetch_and_add(&__bytes_recv, got);
+		return got;
+	}
 
 	NaClLog(LOG_INFO, "count=%d", (int)count);
 	if ( sockf->netw_socket ){
@@ -328,12 +413,69 @@ ssize_t read_sockf(struct sock_file_t *sockf, char *buf, size_t count){
 		memcpy (buf, recv_data, bytes_read_from_socket);
 		zmq_msg_close (&msg);
 		if ( bytes_read_from_socket > 0 )
-			__bytes_recv+=bytes_read_from_socket;
+			__sync_fetch_and_add(&__bytes_recv, bytes_read_from_socket);
 	}
 	return bytes_read_from_socket;
 }
 
 
+ssize_t read_sockf_part(struct sock_file_t *sockf, char *buf, size_t count, int noblock, int *empty){
+	zmq_msg_t *msg;
+	size_t msg_size;
+	size_t bytes;
+	if ( empty ) *empty = 0;
+	if ( !sockf || !buf || !count || count==SIZE_MAX ) return -1;
+	if ( EREAD != sockf->capabilities && EREADWRITE != sockf->capabilities  ) return -1;
+	if ( !sockf->netw_socket ) return -1;
+
+	/*get new message if there is no unread tail of previous one*/
+	if ( !sockf->pending_msg ){
+		int err;
+		msg = malloc(sizeof(zmq_msg_t));
+		if ( !msg ) return -1;
+		zmq_msg_init (msg);
+		err = zmq_recv ( sockf->netw_socket, msg, noblock ? ZMQ_NOBLOCK : 0);
+		if ( 0 != err ){
+			int errnum = zmq_errno();
+			zmq_msg_close (msg);
+			free(msg);
+			if ( noblock && EAGAIN == errnum ){
+				if ( empty ) *empty = 1;
+				return 0;
+			}
+			NaClLog(LOG_ERROR, "zmq_recv err %d, errno %d, status %s\n", err, errnum, zmq_strerror(errnum) );
+			return -1;
+		}
+		sockf->pending_msg = msg;
+		sockf->pending_pos = 0;
+	}
+
+	/*copy as much as fits, keep the tail*/
+	msg = (zmq_msg_t*)sockf->pending_msg;
+	msg_size = zmq_msg_size (msg);
+	bytes = min( msg_size - sockf->pending_pos, count );
+	memcpy (buf, (char*)zmq_msg_data (msg) + sockf->pending_pos, bytes);
+	sockf->pending_pos += bytes;
+	if ( sockf->pending_pos == msg_size ){
+		zmq_msg_close (msg);
+		free(msg), sockf->pending_msg = NULL;
+	}
+	__sync_fetch_and_add(&__bytes_recv, bytes);
+	return bytes;
+}
+
+
+int write_sockf_eof(struct sock_file_t *sockf){
+	int err;
+	zmq_msg_t msg;
+	if ( !sockf || !sockf->netw_socket ) return ERR_BAD_ARG;
+	zmq_msg_init (&msg);
+	err = zmq_send ( sockf->netw_socket, &msg, 0);
+	zmq_msg_close (&msg);
+	return err ? ERR_ERROR : ERR_OK;
+}
+
+
 int open_all_comm_files(struct zeromq_pool* zpool, struct db_records_t *db_records){
 	int err = ERR_OK;
 	NaClLog(LOG_INFO, "open_all_comm_files %p, %p", (void*)zpool, (void*)db_records);
@@ -17,19 +17,29 @@
  * Pair of sock_file_t file sockets related to single REQ/REP zmq socket, and should be used
  * sequently: one read, one write. After reading, data should be wrote into file socket and vice versa;
  * Either zmq will raise errors;
+ * STREAM use PAIR zeromq socket: writer binds, reader connects. Data goes from writer to reader
+ * without lockstep, reader sends credits (zvm_netw_header_t) back to let writer stream more data;
+ * Stream reader can read part of message, unread tail is kept by sock_file_t for next read;
+ * SHM is used for endpoints "shm://path" instead of zeromq socket, for nodes on the same host.
+ * Data goes through shared memory ring (see shm_ring.h), write_sockf/read_sockf are working for it too;
+ * INTEGRITY: socket with integrity flag keeps crc32c of the user data crossed it, separately for read and written,
+ * so the sender crc_put can be compared to the receiver crc_get. It is computed by commf calls (zvm_netw.c),
+ * protocol headers and credits are not counted;
  */
 
 #ifndef ZMQ_NETW_H_
 #define ZMQ_NETW_H_
 
 #include "sqluse_srv.h"
+#include "shm_ring.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 
 #define min(a,b) (a < b ? a : b )
 
-enum {ESOCKET_UNKNOWN, ESOCKET_REQREP=1};
+enum {ESOCKET_UNKNOWN, ESOCKET_REQREP=1, ESOCKET_STREAM=2, ESOCKET_SHM=3};
 
 struct sock_file_t{
 	void *netw_socket;
@@ -38,6 +48,13 @@ struct sock_file_t{
 	int capabilities;
 	int fs_fd;
 	int unused; /*used by zeromq_pool*/
+	uint64_t credit; /*stream writer: bytes can be sent; stream reader: bytes read but not granted back*/
+	void *pending_msg; /*stream reader: partially read zmq message, NULL if none*/
+	size_t pending_pos; /*stream reader: read position inside of pending_msg*/
+	struct ShmRing *ring; /*ESOCKET_SHM, NULL for zeromq sockets*/
+	int integrity; /*not 0 - crc32c of the user data crossed the socket is computed*/
+	uint32_t crc_get; /*crc32c of the user data read*/
+	uint32_t crc_put; /*crc32c of the user data written*/
 };
 
 enum { ESOCKF_ARRAY_GRANULARITY=10 };
@@ -45,10 +62,12 @@ struct zeromq_pool{
 	void *context;
 	struct sock_file_t* sockf_array;
 	int count_max;
+	int *fd_index; /*fd -> index in sockf_array + 1, 0 if fd has no socket*/
+	int fd_index_size;
 };
 
 
-/*find sock in array*/
+/*find sock in array, O(1) by fd index*/
 struct sock_file_t* sockf_by_fd(struct zeromq_pool* zpool, int fd);
 /*add sock to array*/
 int add_sockf_copy_to_array(struct zeromq_pool* zpool, struct sock_file_t* sockf);
@@ -75,6 +94,13 @@ int close_sockf(struct zeromq_pool* zpool, struct sock_file_t *sockf);
 ssize_t write_sockf(struct sock_file_t *sockf, const char *buf, size_t count);
 /*stream read file socket*/
 ssize_t read_sockf(struct sock_file_t *sockf, char *buf, size_t count);
+/*read file socket without loosing data: if message is larger than count, rest of message will be
+ *returned by next calls; message of zero size returns 0 (end of stream);
+ *@param noblock if not 0 and no message arrived return 0 and set *empty to 1, empty can be NULL
+ *@return read bytes count, -1 if error*/
+ssize_t read_sockf_part(struct sock_file_t *sockf, char *buf, size_t count, int noblock, int *empty);
+/*send message of zero size to mark end of stream*/
+int write_sockf_eof(struct sock_file_t *sockf);
 
 /*open all sockets connections; It can be used instead explicitly opening of file sockets;
  *Use close_all_comm_files to close file sockets;  */
@@ -37,6 +37,8 @@ struct zeromq_pool *CreateArrayPoolNoZmq(){
 	struct zeromq_pool * pool = (struct zeromq_pool*) malloc(sizeof(struct zeromq_pool));
 	assert(pool);
 	pool->count_max = ESOCKF_ARRAY_GRANULARITY;
+	pool->fd_index = NULL;
+	pool->fd_index_size = 0;
 	pool->sockf_array = (struct sock_file_t*) malloc(pool->count_max * sizeof(struct sock_file_t));
 	EXPECT_NE(pool->sockf_array, (void*)NULL);
 	if ( pool->sockf_array ) {
@@ -56,6 +58,7 @@ void FreeArrayPoolNoZmq( struct zeromq_pool *pool){
 		if ( pool->sockf_array ){
 			free(pool->sockf_array);
 		}
+		free(pool->fd_index);
 		free(pool);
 	}
 }
@@ -129,7 +132,7 @@ TEST_F(ZmqNetwTests, TestSockfArrayFinditems) {
 }
 
 TEST_F(ZmqNetwTests, TestInitTermZmqNetwPool) {
-	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool *));
+	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool));
 	EXPECT_EQ(ERR_OK, init_zeromq_pool(zpool) );
 	EXPECT_EQ(ERR_OK, zeromq_term(zpool) );
 	free(zpool);
@@ -137,7 +140,7 @@ TEST_F(ZmqNetwTests, TestInitTermZmqNetwPool) {
 
 
 TEST_F(ZmqNetwTests, TestSockfOpenClose) {
-	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool *));
+	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool));
 	EXPECT_EQ(ERR_OK, init_zeromq_pool(zpool) );
 	/*zmq init ok, create db_records struct*/
 	struct db_records_t db_records = {NULL, 0, DB_RECORDS_GRANULARITY, 0};
@@ -166,7 +169,7 @@ TEST_F(ZmqNetwTests, TestSockfOpenClose) {
 }
 
 TEST_F(ZmqNetwTests, TestSockfCommunicationReqRep) {
-	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool *));
+	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool));
 	EXPECT_EQ(ERR_OK, init_zeromq_pool(zpool) );
 	/*zmq init ok, create db_records struct*/
 	struct db_records_t db_records = {NULL, 0, DB_RECORDS_GRANULARITY, 0};
@@ -236,8 +239,61 @@ TEST_F(ZmqNetwTests, TestSockfCommunicationReqRep) {
 }
 
 
+TEST_F(ZmqNetwTests, TestSockfCommunicationStream) {
+	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool));
+	EXPECT_EQ(ERR_OK, init_zeromq_pool(zpool) );
+	struct db_records_t db_records = {NULL, 0, DB_RECORDS_GRANULARITY, 0};
+	db_records.array = (struct db_record_t*)malloc( sizeof(struct db_record_t)*db_records.maxcount );
+	memset(db_records.array, '\0', sizeof(struct db_record_t)*db_records.maxcount);
+	struct db_record_t *record1 = &db_records.array[db_records.count++];
+	record1->fd = 3;
+	record1->fmode = 'w';
+	record1->endpoint = (char*)__endpoint1;
+	record1->sock = ESOCKET_STREAM;
+	struct db_record_t *record2 = &db_records.array[db_records.count++];
+	record2->fd = 4;
+	record2->fmode = 'r';
+	record2->endpoint = (char*)__endpoint1;
+	record2->sock = ESOCKET_STREAM;
+	struct sock_file_t* w_sockf = open_sockf( zpool, &db_records, 3);
+	EXPECT_NE( (struct sock_file_t*)NULL, w_sockf);
+	struct sock_file_t* r_sockf = open_sockf( zpool, &db_records, 4);
+	EXPECT_NE( (struct sock_file_t*)NULL, r_sockf);
+	char *buf = alloc_fill_random(TEST_DATA_SIZE);
+	char *buf2 = (char*)malloc(TEST_DATA_SIZE);
+	int empty = 0;
+
+	/*nothing sent yet*/
+	EXPECT_EQ( 0, read_sockf_part(r_sockf, buf2, TEST_DATA_SIZE, 1, &empty) );
+	EXPECT_EQ( 1, empty );
+	/*several messages without lockstep, message tail is not lost*/
+	EXPECT_EQ( TEST_DATA_SIZE, write_sockf(w_sockf, buf, TEST_DATA_SIZE) );
+	EXPECT_EQ( 6, write_sockf(w_sockf, "buffer", 6) );
+	EXPECT_EQ( TEST_DATA_SIZE/4, read_sockf_part(r_sockf, buf2, TEST_DATA_SIZE/4, 0, NULL) );
+	EXPECT_EQ( TEST_DATA_SIZE-TEST_DATA_SIZE/4,
+			read_sockf_part(r_sockf, buf2+TEST_DATA_SIZE/4, TEST_DATA_SIZE, 0, NULL) );
+	EXPECT_EQ( 0, memcmp(buf, buf2, TEST_DATA_SIZE) );
+	EXPECT_EQ( 6, read_sockf_part(r_sockf, buf2, TEST_DATA_SIZE, 0, NULL) );
+	EXPECT_EQ( 0, memcmp("buffer", buf2, 6) );
+	/*credits go back by the same socket*/
+	EXPECT_EQ( 3, write_sockf(r_sockf, "crd", 3) );
+	EXPECT_EQ( 3, read_sockf_part(w_sockf, buf2, 3, 0, NULL) );
+	/*end of stream*/
+	EXPECT_EQ( ERR_OK, write_sockf_eof(w_sockf) );
+	EXPECT_EQ( 0, read_sockf_part(r_sockf, buf2, TEST_DATA_SIZE, 0, &empty) );
+	EXPECT_EQ( 0, empty );
+
+	free(buf);
+	free(buf2);
+	close_sockf(zpool, w_sockf);
+	close_sockf(zpool, r_sockf);
+	EXPECT_EQ(ERR_OK, zeromq_term(zpool) );
+	free(zpool);
+}
+
+
 TEST_F(ZmqNetwTests, TestSockfIfZmqInitFailed) {
-	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool *));
+	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool));
 	EXPECT_EQ(ERR_OK, init_zeromq_pool(zpool) );
 	/*term zmq context, emulate zmq init failed*/
 	zmq_term(zpool->context);
@@ -299,7 +355,7 @@ TEST_F(ZmqNetwTests, TestSockfBadArgs) {
 
 
 TEST_F(ZmqNetwTests, TestSockfOpenAllCloseAll) {
-	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool *));
+	struct zeromq_pool *zpool = (struct zeromq_pool *) malloc(sizeof(struct zeromq_pool));
 	struct db_records_t db_records = {NULL, 0, DB_RECORDS_GRANULARITY, 0};
 	EXPECT_EQ(ERR_OK, init_zeromq_pool(zpool) );
 	EXPECT_EQ(ERR_OK, get_all_records_from_dbtable(TEST_DB_PATH, "manager\0", &db_records ) );
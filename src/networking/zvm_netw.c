@@ -12,12 +12,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "src/platform/nacl_log.h"
 #include "src/networking/zmq_netw.h"
 #include "src/networking/zvm_netw.h"
 #include "src/networking/sqluse_srv.h"
 #include "src/networking/errcodes.h"
+#include "src/manifest/crc32c.h"
 #include "zmq.h"
 
 static struct db_records_t* __db_records = NULL;
@@ -43,15 +46,16 @@ static uint64_t get_file_size(const char *name)
 int
 capabilities_for_file_fd(int fd){
 	if ( __db_records ){
-		struct db_record_t* db_record = match_db_record_by_fd( __db_records, fd);
-		if ( db_record ){
-			if ( 'r' == db_record->fmode )
+		/*opened socket keeps file mode, fd index is faster than db records search*/
+		struct sock_file_t* sockf = sockf_by_fd(__zpool, fd);
+		if ( sockf ){
+			if ( 'r' == sockf->access_mode )
 				return EREAD;
-			else if ( 'w' == db_record->fmode )
+			else if ( 'w' == sockf->access_mode )
 				return EWRITE;
 		}
 		else{
-			NaClLog(LOG_ERROR, "%s() db_record is NULL for specified fd=%d\n", __func__, fd );
+			NaClLog(LOG_INFO, "%s() socket is NULL for specified fd=%d\n", __func__, fd );
 		}
 	}
 	else{
@@ -61,6 +65,230 @@ capabilities_for_file_fd(int fd){
 }
 
 
+/*stream reader: let writer send "bytes" more*/
+static int grant_credit(struct sock_file_t *sockf, uint32_t bytes){
+	struct zvm_netw_header_t header = DEFAULT_ZVM_NETW_HEAD;
+	header.req_len = bytes;
+	if ( sizeof(header) != write_sockf(sockf, (const char*)&header, sizeof(header)) ){
+		NaClLog(LOG_ERROR, "%s() fd=%d, cannot send credit\n", __func__, sockf->fs_fd );
+		return ERR_ERROR;
+	}
+	return ERR_OK;
+}
+
+/*stream writer: collect arrived credits, if "wait" block until at least one arrive*/
+static int take_credits(struct sock_file_t *sockf, int wait){
+	struct zvm_netw_header_t header;
+	int empty = 0;
+	for(;;){
+		ssize_t got = read_sockf_part(sockf, (char*)&header, sizeof(header), !wait, &empty);
+		if ( empty ) return ERR_OK;
+		if ( sizeof(header) != got || PROTOID != header.protoid ){
+			NaClLog(LOG_ERROR, "%s() fd=%d, bad credit\n", __func__, sockf->fs_fd );
+			return ERR_ERROR;
+		}
+		sockf->credit += header.req_len;
+		wait = 0;
+	}
+}
+
+static ssize_t stream_read(struct sock_file_t *sockf, char *buf, size_t count){
+	ssize_t read_bytes = read_sockf_part(sockf, buf, count, 0, NULL);
+	if ( read_bytes > 0 ){
+		/*grant back read bytes by large portions*/
+		sockf->credit += read_bytes;
+		if ( sockf->credit >= STREAM_CREDIT/2 ){
+			if ( ERR_OK != grant_credit(sockf, sockf->credit) ) return -1;
+			sockf->credit = 0;
+		}
+	}
+	return read_bytes;
+}
+
+static ssize_t stream_write(struct sock_file_t *sockf, const char *buf, size_t count){
+	size_t sent = 0;
+	while ( sent < count ){
+		size_t chunk;
+		if ( ERR_OK != take_credits(sockf, 0 == sockf->credit) ) return -1;
+		chunk = min(count - sent, sockf->credit);
+		if ( (ssize_t)chunk != write_sockf(sockf, buf + sent, chunk) ) return -1;
+		sockf->credit -= chunk;
+		sent += chunk;
+	}
+	return sent;
+}
+
+/*stream readers grant first credits right away, so writers can start before first read*/
+static int grant_initial_credits(struct zeromq_pool *zpool, struct db_records_t *db_records){
+	for (int i=0; i < db_records->count; i++){
+		struct db_record_t *record = &db_records->array[i];
+		if ( ESOCKET_STREAM == record->sock && 'r' == record->fmode ){
+			struct sock_file_t *sockf = sockf_by_fd(zpool, record->fd);
+			if ( !sockf || ERR_OK != grant_credit(sockf, STREAM_CREDIT) ) return ERR_ERROR;
+		}
+	}
+	return ERR_OK;
+}
+
+
+/*readiness of item which does not need zmq_poll, 0 if not known yet*/
+static short ready_without_poll(struct sock_file_t *sockf, short events){
+	if ( ESOCKET_SHM == sockf->sock_type )
+		return ShmRingReady(sockf->ring) ? events : 0;
+	if ( 'r' == sockf->access_mode ){
+		if ( ESOCKET_REQREP == sockf->sock_type ) return events & COMMF_POLLIN;
+		return sockf->pending_msg ? events & COMMF_POLLIN : 0;
+	}
+	if ( ESOCKET_STREAM == sockf->sock_type && sockf->credit > 0 )
+		return events & COMMF_POLLOUT;
+	return 0;
+}
+
+void commf_integrity(int read, int write){
+	if ( !__zpool ) return;
+	for (int i=0; i < __zpool->count_max; i++){
+		struct sock_file_t *sockf = &__zpool->sockf_array[i];
+		if ( sockf->unused ) continue;
+		sockf->integrity = 'r' == sockf->access_mode ? read : write;
+		sockf->crc_get = sockf->crc_put = 0;
+	}
+}
+
+/*integrity mode: crc of the user data only, protocol headers and credits are not counted*/
+static void payload_crc(int fd, const char *buf, ssize_t bytes, int write){
+	struct sock_file_t *sockf = sockf_by_fd(__zpool, fd);
+	if ( !sockf || !sockf->integrity || bytes <= 0 ) return;
+	if ( write )
+		sockf->crc_put = Crc32c(sockf->crc_put, buf, bytes);
+	else
+		sockf->crc_get = Crc32c(sockf->crc_get, buf, bytes);
+}
+
+int commf_crc(int fd, uint32_t *crc_get, uint32_t *crc_put){
+	struct sock_file_t *sockf = __zpool ? sockf_by_fd(__zpool, fd) : NULL;
+	if ( !sockf || !sockf->integrity ) return -1;
+	*crc_get = sockf->crc_get;
+	*crc_put = sockf->crc_put;
+	return 0;
+}
+
+int commf_crc_list(struct commf_crc_t *items, int count){
+	int filled = 0;
+	if ( !__zpool || !items ) return 0;
+	for (int i=0; i < __zpool->count_max && filled < count; i++){
+		struct sock_file_t *sockf = &__zpool->sockf_array[i];
+		if ( sockf->unused || !sockf->integrity ) continue;
+		items[filled].fd = sockf->fs_fd;
+		items[filled].crc_get = sockf->crc_get;
+		items[filled].crc_put = sockf->crc_put;
+		++filled;
+	}
+	return filled;
+}
+
+
+#define POLL_SLICE_MS 1 /*rings which cannot be polled (not attached reader) are checked that often*/
+#define ZMQ_POLL_UNIT 1000 /*zeromq 2 poll timeout is in microseconds*/
+
+int commf_poll(struct commf_pollitem_t *items, int count, long timeout_ms){
+	zmq_pollitem_t *zitems;
+	int *zindex;
+	int zcount = 0;
+	int rings = 0; /*not polled, checked by slices*/
+	int armed = 0; /*polled by the doorbells*/
+	int ready = 0;
+	if ( !__zpool || !items || count < 1 ) return -1;
+	zitems = malloc(count * sizeof(zmq_pollitem_t));
+	zindex = malloc(count * sizeof(int));
+	if ( !zitems || !zindex ){
+		free(zitems), free(zindex);
+		return -1;
+	}
+
+	/*what is known without waiting. the rest goes to zmq_poll: reader waits for
+	 *data, writer for request (REQREP) or credit (STREAM), shm ring for its doorbell*/
+	for (int i=0; i < count; i++){
+		struct sock_file_t *sockf = sockf_by_fd(__zpool, items[i].fd);
+		if ( !sockf ){
+			for (int j=0; j < zcount; j++)
+				if ( !zitems[j].socket ) ShmRingDisarm(sockf_by_fd(__zpool, items[zindex[j]].fd)->ring);
+			free(zitems), free(zindex);
+			return -1;
+		}
+		items[i].revents = ready_without_poll(sockf, items[i].events);
+		if ( !items[i].revents && items[i].events ){
+			zitems[zcount].socket = sockf->netw_socket;
+			zitems[zcount].fd = 0;
+			if ( ESOCKET_SHM == sockf->sock_type ){
+				zitems[zcount].socket = NULL;
+				zitems[zcount].fd = ShmRingArm(sockf->ring);
+				/*ready meanwhile or not attached yet*/
+				if ( zitems[zcount].fd < 0 ){
+					items[i].revents = ready_without_poll(sockf, items[i].events);
+					rings += !items[i].revents;
+				}
+			}
+			if ( zitems[zcount].socket || zitems[zcount].fd >= 0 ){
+				armed += !zitems[zcount].socket;
+				zitems[zcount].events = ZMQ_POLLIN;
+				zitems[zcount].revents = 0;
+				zindex[zcount++] = i;
+			}
+		}
+		ready += 0 != items[i].revents;
+	}
+
+	for(;;){
+		long slice = ready ? 0 : rings && (timeout_ms < 0 || timeout_ms > POLL_SLICE_MS) ?
+				POLL_SLICE_MS : timeout_ms;
+		if ( zcount ){
+			if ( zmq_poll(zitems, zcount, slice < 0 ? -1 : slice * ZMQ_POLL_UNIT) < 0 ){
+				NaClLog(LOG_ERROR, "zmq_poll errno %d, status %s\n", zmq_errno(), zmq_strerror(zmq_errno()));
+				ready = -1;
+				break;
+			}
+			for (int i=0; i < zcount; i++){
+				struct commf_pollitem_t *item = &items[zindex[i]];
+				if ( !(zitems[i].revents & ZMQ_POLLIN) || item->revents ) continue;
+				if ( !zitems[i].socket ){
+					/*rung doorbell. rearming drains it and tells if the ring is ready*/
+					struct sock_file_t *sockf = sockf_by_fd(__zpool, item->fd);
+					if ( ShmRingArm(sockf->ring) >= 0 ) continue;
+					item->revents = ready_without_poll(sockf, item->events);
+					ready += 0 != item->revents;
+					continue;
+				}
+				++ready;
+				item->revents = item->events & (EREAD == capabilities_for_file_fd(item->fd) ? COMMF_POLLIN : COMMF_POLLOUT);
+			}
+		}
+		else if ( slice > 0 ){
+			struct timespec pause = {0, slice * 1000000};
+			nanosleep(&pause, NULL);
+		}
+		if ( ready || 0 == timeout_ms ) break;
+		if ( !rings && !armed ) break; /*zmq_poll timed out*/
+
+		/*shm rings which are not polled*/
+		for (int i=0; i < count; i++){
+			struct sock_file_t *sockf = sockf_by_fd(__zpool, items[i].fd);
+			if ( ESOCKET_SHM == sockf->sock_type && !items[i].revents
+					&& (items[i].revents = ready_without_poll(sockf, items[i].events)) )
+				++ready;
+		}
+		if ( ready ) break;
+		if ( timeout_ms > 0 && (timeout_ms -= slice) <= 0 ) break;
+	}
+
+	/*the peers do not need to ring anymore*/
+	for (int i=0; i < zcount; i++)
+		if ( !zitems[i].socket ) ShmRingDisarm(sockf_by_fd(__zpool, items[zindex[i]].fd)->ring);
+	free(zitems);
+	free(zindex);
+	return ready;
+}
+
+
 int init_zvm_networking(const char *dbname, const char *nodename, int nodeid){
 	uint64_t db_size = 0;
 
@@ -73,7 +301,7 @@ int init_zvm_networking(const char *dbname, const char *nodename, int nodeid){
 	if ( -1 != db_size && 0 != db_size ){
 		int err = 0;
 		NaClLog(LOG_INFO, "reading database = %s, cid=%d, nodename=%s\n", dbname, nodeid, nodename);
-		err = get_all_records_from_dbtable(dbname, nodename, __db_records);
+		err = get_node_records(dbname, nodename, __db_records);
 		if ( err ){
 			NaClLog(LOG_ERROR, "database %s read error= %d\n", dbname, err);
 			return EZVM_DBREADERR;
@@ -82,6 +310,8 @@ int init_zvm_networking(const char *dbname, const char *nodename, int nodeid){
 			init_zeromq_pool(__zpool);
 			if ( ERR_OK != open_all_comm_files(__zpool, __db_records) )
 				return EZVM_SOCK_ERROR;
+			if ( ERR_OK != grant_initial_credits(__zpool, __db_records) )
+				return EZVM_SOCK_ERROR;
 		}
 	}
 	else{
@@ -100,14 +330,21 @@ int term_zvm_networking(){
 		NaClLog(LOG_ERROR, "close_all_comm_files err=%d", err);
 		return EZVM_SOCK_ERROR;
 	}
-	else{
-		NaClLog(LOG_INFO, "close_all_comm_files OK");
-		return EZVM_OK;
+	NaClLog(LOG_INFO, "close_all_comm_files OK");
+	/*zmq_term waits until closed sockets flushed queued messages, the last
+	 *replies of the node are lost if process exits before*/
+	err = zeromq_term(__zpool);
+	free(__zpool), __zpool = NULL;
+	if ( ERR_OK != err ){
+		NaClLog(LOG_ERROR, "zeromq_term err=%d", err);
+		return EZVM_SOCK_ERROR;
 	}
+	return EZVM_OK;
 }
 
 
-ssize_t commf_read(int fd, char *buf, size_t count){
+/*read user data by the socket protocol, no crc*/
+static ssize_t channel_read(int fd, char *buf, size_t count){
 	struct sock_file_t* sockf = NULL;
 	int capab = capabilities_for_file_fd(fd);
 	ssize_t read_bytes = -1;
@@ -130,6 +367,15 @@ ssize_t commf_read(int fd, char *buf, size_t count){
 			read_bytes = read_sockf(sockf, buf, count);
 			NaClLog(LOG_ERROR, "%s() read ok from fd=%d, requested%d, readed=%d\n", __func__, fd, (int)count, (int)read_bytes );
 		}
+		else if ( sockf->sock_type == ESOCKET_SHM ){
+			/*same host peer: data is taken right from shared memory ring*/
+			read_bytes = read_sockf(sockf, buf, count);
+		}
+		else if ( sockf->sock_type == ESOCKET_STREAM ){
+			/*no request, data is already on the way*/
+			read_bytes = stream_read(sockf, buf, count);
+			NaClLog(LOG_INFO, "%s() stream fd=%d, requested=%d, read=%d\n", __func__, fd, (int)count, (int)read_bytes );
+		}
 		else{
 			NaClLog(LOG_ERROR, "%s() for fd=%d, unsupported socket type=%d\n", __func__, fd, sockf->sock_type );
 		}
@@ -141,7 +387,8 @@ ssize_t commf_read(int fd, char *buf, size_t count){
 }
 
 
-ssize_t commf_write(int fd, const char *buf, size_t count){
+/*write user data by the socket protocol, no crc*/
+static ssize_t channel_write(int fd, const char *buf, size_t count){
 	struct sock_file_t* sockf = NULL;
 	int capab = capabilities_for_file_fd(fd);
 	ssize_t wrote_bytes = -1;
@@ -166,6 +413,15 @@ ssize_t commf_write(int fd, const char *buf, size_t count){
 			wrote_bytes = sdata;
 			NaClLog(LOG_ERROR, "%s() read ok from fd=%d, requested%d, readed=%d\n", __func__, fd, (int)count, (int)wrote_bytes );
 		}
+		else if ( sockf->sock_type == ESOCKET_SHM ){
+			/*same host peer: ring has own flow control*/
+			wrote_bytes = write_sockf(sockf, buf, count);
+		}
+		else if ( sockf->sock_type == ESOCKET_STREAM ){
+			/*no waiting for request while there are credits*/
+			wrote_bytes = stream_write(sockf, buf, count);
+			NaClLog(LOG_INFO, "%s() stream fd=%d, count=%d, wrote=%d\n", __func__, fd, (int)count, (int)wrote_bytes );
+		}
 		else{
 			NaClLog(LOG_ERROR, "%s() for fd=%d, unsupported socket type=%d\n", __func__, fd, sockf->sock_type );
 		}
@@ -177,4 +433,155 @@ ssize_t commf_write(int fd, const char *buf, size_t count){
 }
 
 
+ssize_t commf_read(int fd, char *buf, size_t count){
+	ssize_t read_bytes = channel_read(fd, buf, count);
+	payload_crc(fd, buf, read_bytes, 0);
+	return read_bytes;
+}
+
+
+ssize_t commf_write(int fd, const char *buf, size_t count){
+	ssize_t wrote_bytes = channel_write(fd, buf, count);
+	payload_crc(fd, buf, wrote_bytes, 1);
+	return wrote_bytes;
+}
+
+
 
+
+
+#define SHUFFLE_STACK_SIZE 0x40000 /*i/o thread only calls channel_read|channel_write*/
+
+/*state shared by i/o threads of one shuffle*/
+struct shuffle_t{
+	struct commf_part_t *parts;
+	char *buf;
+	size_t size;
+	size_t filled;  /*gather: buf is taken up to*/
+	int error;
+	pthread_mutex_t lock;
+};
+
+struct shuffle_thread_t{
+	struct shuffle_t *shuffle;
+	int index;
+	pthread_t thread;
+};
+
+/*read|write whole count bytes, channel calls can return part of data.
+ *payload (not the part header) is counted by the integrity mode*/
+static int commf_transfer(int fd, char *buf, size_t count, int write, int payload){
+	size_t done = 0;
+	while ( done < count ){
+		ssize_t bytes = write ? channel_write(fd, buf + done, count - done) : channel_read(fd, buf + done, count - done);
+		if ( payload ) payload_crc(fd, buf + done, bytes, write);
+		if ( bytes <= 0 ){
+			NaClLog(LOG_ERROR, "%s() fd=%d, transferred %d of %d\n", __func__, fd, (int)done, (int)count );
+			return ERR_ERROR;
+		}
+		done += bytes;
+	}
+	return ERR_OK;
+}
+
+static void *scatter_part(void *arg){
+	struct shuffle_thread_t *self = (struct shuffle_thread_t*)arg;
+	struct commf_part_t *part = &self->shuffle->parts[self->index];
+	struct zvm_netw_header_t header = DEFAULT_ZVM_NETW_HEAD;
+	header.req_len = part->size;
+	if ( ERR_OK != commf_transfer(part->fd, (char*)&header, sizeof(header), 1, 0) ||
+			ERR_OK != commf_transfer(part->fd, self->shuffle->buf + part->offset, part->size, 1, 1) )
+		__sync_fetch_and_or(&self->shuffle->error, 1);
+	return NULL;
+}
+
+static void *gather_part(void *arg){
+	struct shuffle_thread_t *self = (struct shuffle_thread_t*)arg;
+	struct shuffle_t *shuffle = self->shuffle;
+	struct commf_part_t *part = &shuffle->parts[self->index];
+	struct zvm_netw_header_t header;
+	int fits;
+
+	if ( ERR_OK != commf_transfer(part->fd, (char*)&header, sizeof(header), 0, 0) || PROTOID != header.protoid ){
+		__sync_fetch_and_or(&shuffle->error, 1);
+		return NULL;
+	}
+
+	/*first come, first placed*/
+	pthread_mutex_lock(&shuffle->lock);
+	fits = header.req_len <= shuffle->size - shuffle->filled;
+	if ( fits ){
+		part->offset = shuffle->filled;
+		part->size = header.req_len;
+		shuffle->filled += header.req_len;
+	}
+	pthread_mutex_unlock(&shuffle->lock);
+
+	if ( !fits ){
+		NaClLog(LOG_ERROR, "%s() fd=%d, part of %u bytes does not fit\n", __func__, part->fd, header.req_len );
+		__sync_fetch_and_or(&shuffle->error, 1);
+	}
+	else if ( ERR_OK != commf_transfer(part->fd, shuffle->buf + part->offset, part->size, 0, 1) )
+		__sync_fetch_and_or(&shuffle->error, 1);
+	return NULL;
+}
+
+/*run i/o thread per part and wait them all*/
+static int run_shuffle(struct shuffle_t *shuffle, int count, void *(*routine)(void*)){
+	struct shuffle_thread_t *threads = malloc(count * sizeof(struct shuffle_thread_t));
+	pthread_attr_t attr;
+	int started = 0;
+	if ( !threads ) return ERR_ERROR;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, SHUFFLE_STACK_SIZE);
+	for ( ; started < count; started++ ){
+		threads[started].shuffle = shuffle;
+		threads[started].index = started;
+		if ( 0 != pthread_create(&threads[started].thread, &attr, routine, &threads[started]) ){
+			NaClLog(LOG_ERROR, "%s() cannot start i/o thread\n", __func__ );
+			shuffle->error = 1;
+			break;
+		}
+	}
+	for (int i=0; i < started; i++)
+		pthread_join(threads[i].thread, NULL);
+	pthread_attr_destroy(&attr);
+	free(threads);
+	return shuffle->error ? ERR_ERROR : ERR_OK;
+}
+
+ssize_t commf_scatter(const struct commf_part_t *parts, int count, const char *buf){
+	struct shuffle_t shuffle;
+	ssize_t sent = 0;
+	if ( !__zpool || !parts || count < 1 ) return -1;
+	for (int i=0; i < count; i++){
+		if ( EWRITE != capabilities_for_file_fd(parts[i].fd) ) return -1;
+		sent += parts[i].size;
+	}
+
+	memset(&shuffle, '\0', sizeof(shuffle));
+	shuffle.parts = (struct commf_part_t*)parts;
+	shuffle.buf = (char*)buf;
+	if ( ERR_OK != run_shuffle(&shuffle, count, scatter_part) ) return -1;
+	return sent;
+}
+
+ssize_t commf_gather(struct commf_part_t *parts, int count, char *buf, size_t size){
+	struct shuffle_t shuffle;
+	int err;
+	if ( !__zpool || !parts || count < 1 ) return -1;
+	for (int i=0; i < count; i++){
+		if ( EREAD != capabilities_for_file_fd(parts[i].fd) ) return -1;
+		parts[i].offset = parts[i].size = 0;
+	}
+
+	memset(&shuffle, '\0', sizeof(shuffle));
+	shuffle.parts = parts;
+	shuffle.buf = buf;
+	shuffle.size = size;
+	pthread_mutex_init(&shuffle.lock, NULL);
+	err = run_shuffle(&shuffle, count, gather_part);
+	pthread_mutex_destroy(&shuffle.lock);
+	return ERR_OK == err ? (ssize_t)shuffle.filled : -1;
+}
@@ -14,6 +14,13 @@
 #define PROTOVER 0x0001
 #define DEFAULT_ZVM_NETW_HEAD {PROTOID, PROTOVER, 0, 0,0,0}
 
+/*STREAM channels: reader grants this amount of bytes in advance and grants back every
+ *STREAM_CREDIT/2 bytes it has read, writer streams data while it has credits, so
+ *writer and reader are working without waiting each other for a round trip;
+ *larger window only queues more out of cache data, 1mb messages get slower*/
+#define STREAM_CREDIT 0x200000
+
+/*REQREP: request of req_len bytes; STREAM: credit of req_len bytes sent by reader*/
 struct zvm_netw_header_t{
 	uint16_t protoid;
 	uint16_t protover;
@@ -35,6 +42,15 @@ struct zeromq_pool * zpool_forunittest();
 int init_zvm_networking(const char *dbname, const char *nodename, int nodeid);
 int term_zvm_networking();
 
+/*events of commf_poll*/
+enum { COMMF_POLLIN=1, COMMF_POLLOUT=2 };
+
+struct commf_pollitem_t{
+	int fd;
+	short events;
+	short revents;
+};
+
 /*Get capability for file, for unsupported return ENOTALLOWED*/
 int
 capabilities_for_file_fd(int fd);
@@ -44,5 +60,50 @@ ssize_t commf_write(int fd, const char *buf, size_t count);
 /*stream read communication file*/
 ssize_t commf_read(int fd, char *buf, size_t count);
 
+/*crc32c of the data crossed communication file in integrity mode*/
+struct commf_crc_t{
+	int fd;
+	uint32_t crc_get; /*of the bytes read*/
+	uint32_t crc_put; /*of the bytes written*/
+};
+
+/*turn integrity mode on for files opened for read (read!=0) and|or for write (write!=0);
+ *crc is computed by commf_read/commf_write and the shuffle over the user data only,
+ *request headers and stream credits are not counted*/
+void commf_integrity(int read, int write);
+/*get crc of the file in integrity mode
+ *@return 0 if ok, -1 if file has no socket or integrity mode is off*/
+int commf_crc(int fd, uint32_t *crc_get, uint32_t *crc_put);
+/*fill items with crc of the files in integrity mode, up to count items
+ *@return filled items count*/
+int commf_crc_list(struct commf_crc_t *items, int count);
+
+/*wait until communication files are ready to read|write, set revents of items;
+ *zmq_poll is used for zeromq sockets, shm rings are checked between polls;
+ *REQREP reader is always ready: data is requested only by commf_read itself;
+ *@param timeout_ms -1 wait forever, 0 just check
+ *@return ready items count, -1 if error*/
+int commf_poll(struct commf_pollitem_t *items, int count, long timeout_ms);
+
+/*part of the shuffle buffer and communication file it goes to|comes from*/
+struct commf_part_t{
+	int fd;
+	size_t offset;
+	size_t size;
+};
+
+/*all-to-all shuffle: every part is handled by own i/o thread, so all peers are served
+ *at once and a slow peer does not hold the others. each part goes as zvm_netw_header_t
+ *with req_len=part size and the part data, so the receiver knows how much to take*/
+
+/*send every part of buf to its file
+ *@return sent bytes, -1 if error*/
+ssize_t commf_scatter(const struct commf_part_t *parts, int count, const char *buf);
+
+/*receive one part from every file into buf of given size, parts are put one after
+ *another in the order of arrival, offset and size of the parts are set
+ *@return received bytes, -1 if error*/
+ssize_t commf_gather(struct commf_part_t *parts, int count, char *buf, size_t size);
+
 
 #endif /* ZVM_NETW_H_ */
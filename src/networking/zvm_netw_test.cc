@@ -6,6 +6,8 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <zmq.h>
 
 #include "gtest/gtest.h"
@@ -107,6 +109,138 @@ TEST_F(ZvmNetwTests, TestZvmWrite1) {
 }
 
 
+TEST_F(ZvmNetwTests, TestZvmStream) {
+	/*load from DB sockets data by key=test, fd 5,6 are STREAM*/
+	EXPECT_EQ(EZVM_OK, init_zvm_networking(TEST_DB_PATH, "test", 1) );
+	const int fdw = 5;
+	const int fdr = 6;
+	const int testlen = 100000;
+	char *buf_w = alloc_fill_random(testlen);
+	char *buf_r = (char*)malloc(testlen);
+	memset(buf_r, '\0', testlen);
+
+	/*writer does not wait for request, initial credits are already granted*/
+	EXPECT_EQ( testlen, commf_write(fdw, buf_w, testlen) );
+	EXPECT_EQ( testlen, commf_write(fdw, buf_w, testlen) );
+	/*read by parts smaller than written message*/
+	EXPECT_EQ( testlen/2, commf_read(fdr, buf_r, testlen/2) );
+	EXPECT_EQ( testlen/2, commf_read(fdr, buf_r+testlen/2, testlen) );
+	EXPECT_EQ( 0, memcmp(buf_w, buf_r, testlen) );
+	EXPECT_EQ( testlen, commf_read(fdr, buf_r, testlen) );
+	EXPECT_EQ( 0, memcmp(buf_w, buf_r, testlen) );
+
+	/*more than credit window: writer spends credits granted back by reader*/
+	for (int i=0; i < 3*STREAM_CREDIT/testlen; i++){
+		ASSERT_EQ( testlen, commf_write(fdw, buf_w, testlen) );
+		ASSERT_EQ( testlen, commf_read(fdr, buf_r, testlen) );
+	}
+
+	free(buf_w);
+	free(buf_r);
+	EXPECT_EQ(EZVM_OK, term_zvm_networking() );
+}
+
+
+struct scatter_arg_t{
+	struct commf_part_t *parts;
+	int count;
+	const char *buf;
+	ssize_t sent;
+};
+
+void *scatter_thread(void *arg){
+	struct scatter_arg_t *scatter = (struct scatter_arg_t*)arg;
+	scatter->sent = commf_scatter(scatter->parts, scatter->count, scatter->buf);
+	return NULL;
+}
+
+TEST_F(ZvmNetwTests, TestZvmShuffle) {
+	/*REQREP (fd 3,4) and STREAM (fd 5,6) peers, each gets own part*/
+	EXPECT_EQ(EZVM_OK, init_zvm_networking(TEST_DB_PATH, "test", 1) );
+	const int testlen = 100000;
+	char *buf_w = alloc_fill_random(testlen);
+	char *buf_r = (char*)malloc(testlen);
+	struct commf_part_t out[2] = {{3, 0, 30000}, {5, 30000, 70000}};
+	struct commf_part_t in[2] = {{4, 0, 0}, {6, 0, 0}};
+	struct scatter_arg_t scatter = {out, 2, buf_w, 0};
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, scatter_thread, &scatter);
+	EXPECT_EQ( testlen, commf_gather(in, 2, buf_r, testlen) );
+	pthread_join(thread, NULL);
+	EXPECT_EQ( testlen, scatter.sent );
+
+	/*parts are placed in order of arrival*/
+	EXPECT_EQ( 30000, (int)in[0].size );
+	EXPECT_EQ( 70000, (int)in[1].size );
+	EXPECT_EQ( 0, memcmp(buf_w, buf_r + in[0].offset, in[0].size) );
+	EXPECT_EQ( 0, memcmp(buf_w + 30000, buf_r + in[1].offset, in[1].size) );
+
+	/*writer fd cannot gather, reader fd cannot scatter*/
+	EXPECT_EQ( -1, commf_gather(out, 1, buf_r, testlen) );
+	EXPECT_EQ( -1, commf_scatter(in, 1, buf_w) );
+
+	free(buf_w);
+	free(buf_r);
+	EXPECT_EQ(EZVM_OK, term_zvm_networking() );
+}
+
+
+struct bench_writer_t{
+	int fd;
+	size_t msg_size;
+	size_t total;
+	char *buf;
+};
+
+void *bench_writer(void *arg){
+	struct bench_writer_t *writer = (struct bench_writer_t*)arg;
+	for (size_t done=0; done < writer->total; done+=writer->msg_size)
+		if ( (ssize_t)writer->msg_size != commf_write(writer->fd, writer->buf, writer->msg_size) )
+			break;
+	return NULL;
+}
+
+/*transfer "total" bytes by messages of given size, return MB per second*/
+double bench_channel(int fdw, int fdr, size_t msg_size, size_t total){
+	struct bench_writer_t writer = {fdw, msg_size, total, alloc_fill_random(msg_size)};
+	char *buf = (char*)malloc(msg_size);
+	struct timeval start, end;
+	pthread_t thread;
+	size_t done = 0;
+
+	gettimeofday(&start, NULL);
+	pthread_create(&thread, NULL, bench_writer, &writer);
+	while ( done < total ){
+		ssize_t got = commf_read(fdr, buf, msg_size);
+		if ( got <= 0 ) break;
+		done += got;
+	}
+	pthread_join(thread, NULL);
+	gettimeofday(&end, NULL);
+	EXPECT_EQ( total, done );
+
+	free(writer.buf);
+	free(buf);
+	return (double)done / 0x100000 /
+			((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+}
+
+/*REQREP (fd 3,4) against STREAM (fd 5,6) on ipc:// with 4KB and 1MB messages*/
+TEST_F(ZvmNetwTests, BenchStreamVsReqRep) {
+	const size_t sizes[] = {0x1000, 0x100000};
+	const size_t total = 0x4000000;
+	EXPECT_EQ(EZVM_OK, init_zvm_networking(TEST_DB_PATH, "test", 1) );
+	for (int i=0; i < (int)(sizeof(sizes)/sizeof(*sizes)); i++){
+		double reqrep = bench_channel(3, 4, sizes[i], total);
+		double stream = bench_channel(5, 6, sizes[i], total);
+		printf("message %7d bytes: reqrep %8.1f MB/s, stream %8.1f MB/s\n",
+				(int)sizes[i], reqrep, stream);
+	}
+	EXPECT_EQ(EZVM_OK, term_zvm_networking() );
+}
+
+
 //TEST_F(ZvmNetwTests, TestZvmWrite2) {
 //	/*load from DB sockets data by key=test*/
 //	EXPECT_EQ(EZVM_OK, init_zvm_networking(TEST_DB_PATH, "test", 1) );
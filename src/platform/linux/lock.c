@@ -21,6 +21,10 @@ NaClSyncStatus NaClMutexLock(struct NaClMutex *mp) {
   return NACL_SYNC_OK;
 }
 
+NaClSyncStatus NaClMutexTryLock(struct NaClMutex *mp) {
+  return 0 == pthread_mutex_trylock(&mp->mu) ? NACL_SYNC_OK : NACL_SYNC_BUSY;
+}
+
 NaClSyncStatus NaClMutexUnlock(struct NaClMutex *mp) {
   pthread_mutex_unlock(&mp->mu);
   return NACL_SYNC_OK;
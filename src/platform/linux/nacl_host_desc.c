@@ -29,6 +29,7 @@
 #include "src/service_runtime/sel_ldr.h"
 #include "src/service_runtime/nacl_globals.h"
 #include "src/manifest/manifest_setup.h"
+#include "src/manifest/mem_release.h"
 
 /*
  * Map our ABI to the host OS's ABI.  On linux, this should be a big no-op.
@@ -167,6 +168,9 @@ uintptr_t NaClHostDescMap(struct NaClHostDesc *d,
             (uintptr_t) map_addr,
             (uintptr_t) start_addr);
   }
+  /* the mapped pages must not be released with the freed ones */
+  if(gnap != NULL) MemReleaseUse(gnap->mem_release, (uintptr_t) map_addr, len);
+
   NaClLog(4, "NaClHostDescMap: returning 0x%08"NACL_PRIxPTR"\n",
           (uintptr_t) start_addr);
 
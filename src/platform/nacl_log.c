@@ -342,6 +342,7 @@ void NaClLogDoLogV(int         detail_level,
   (void) (*s->vtbl->Flush)(s);
 
   if (LOG_FATAL == detail_level) {
+    (*gNaClLogAbortBehavior)();
     NaClAbort();
   }
 }
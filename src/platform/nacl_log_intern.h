@@ -32,6 +32,9 @@ EXTERN_C_BEGIN
  * do this for every death test), it should be feasible to have
  * multiple copies of the svn source tree, and to run at least the
  * small tests in those tree in parallel.
+ *
+ * d'b: zerovm batch mode sets it to end only the failed job (see
+ * sel_main.c). if the behavior returns the process is aborted
  */
 extern void (*gNaClLogAbortBehavior)(void);
 
@@ -85,6 +85,8 @@ void NaClMutexDtor(struct NaClMutex *mp);
 
 NaClSyncStatus NaClMutexLock(struct NaClMutex *mp) NACL_WUR;
 
+NaClSyncStatus NaClMutexTryLock(struct NaClMutex *mp) NACL_WUR;
+
 NaClSyncStatus NaClMutexUnlock(struct NaClMutex *mp) NACL_WUR;
 
 
@@ -36,10 +36,12 @@ void NaClInitSwitchToApp(struct NaClApp *nap) {
 
 /*
  * switch to the nacl module (untrusted content)
+ * note: syscall result must be already set in the calling thread context,
+ * nap->sysret is shared by all user threads
  */
 NORETURN void NaClSwitchToApp(struct NaClApp *nap, nacl_reg_t new_prog_ctr)
 {
+  UNREFERENCED_PARAMETER(nap);
   nacl_user->new_prog_ctr = new_prog_ctr;
-  nacl_user->sysret = nap->sysret;
   NaClSwitch(nacl_user);
 }
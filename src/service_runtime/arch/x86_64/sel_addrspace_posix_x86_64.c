@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <sys/mman.h>
 
 #include "include/nacl_platform.h"
 #include "src/platform/nacl_check.h"
@@ -133,3 +134,11 @@ NaClErrorCode NaClAllocateSpace(void **mem, size_t addrsp_size) {
 
   return LOAD_OK;
 }
+
+/* d'b: release the space allocated by NaClAllocateSpace() with its guards */
+void NaClFreeSpace(void *mem, size_t addrsp_size) {
+  CHECK(addrsp_size == FOURGIG);
+  if (0 != munmap(((char *) mem) - GUARDSIZE, 2 * GUARDSIZE + FOURGIG)) {
+    NaClLog(LOG_ERROR, "NaClFreeSpace: munmap failed, errno %d\n", errno);
+  }
+}
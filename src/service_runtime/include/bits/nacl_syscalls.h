@@ -18,9 +18,25 @@
 #define NACL_sys_mmap                   21 /* to remove */
 #define NACL_sys_munmap                 22 /* to remove */
 #define NACL_sys_exit                   30
+#define NACL_sys_sched_yield            32
 #define NACL_sys_mutex_create           70
+#define NACL_sys_mutex_lock             71
+#define NACL_sys_mutex_trylock          72
+#define NACL_sys_mutex_unlock           73
+#define NACL_sys_cond_create            74
+#define NACL_sys_cond_wait              75
+#define NACL_sys_cond_signal            76
+#define NACL_sys_cond_broadcast         77
+#define NACL_sys_cond_timed_wait_abs    79
+#define NACL_sys_thread_create          80
+#define NACL_sys_thread_exit            81
 #define NACL_sys_tls_init               82
+#define NACL_sys_thread_nice            83
 #define NACL_sys_tls_get                84
+#define NACL_sys_sem_create             100
+#define NACL_sys_sem_wait               101
+#define NACL_sys_sem_post               102
+#define NACL_sys_sem_get_value          103
 
 #define NACL_MAX_SYSCALLS               110
 
@@ -53,3 +53,18 @@ void NaClSignalContextFromHandler(struct NaClSignalContext *sigCtx,
   sigCtx->ds = 0;
   sigCtx->ss = 0;
 }
+
+/*
+ * d'b: when the signal handler returns the interrupted thread continues
+ * in "func" on "stack" as if "func" was called there. used to take the
+ * thread out of the user code without leaving the handler by longjmp
+ */
+void NaClSignalContextRedirect(void *rawCtx, uintptr_t stack,
+                               void (*func)(void)) {
+  ucontext_t *uctx = (ucontext_t *) rawCtx;
+  mcontext_t *mctx = &uctx->uc_mcontext;
+
+  mctx->gregs[REG_RSP] = (stack & ~(uintptr_t) 0xf) - sizeof(uintptr_t);
+  mctx->gregs[REG_RIP] = (uintptr_t) func;
+  mctx->gregs[REG_EFL] &= ~(greg_t) 0x400; /* direction flag */
+}
@@ -19,11 +19,17 @@ struct NaClAppThread;
 struct NaClMutex;
 struct NaClApp;
 
-extern int64_t syscallback; /* d'b */
-struct NaClThreadContext    *nacl_user; /* d'b */
-struct NaClThreadContext    *nacl_sys; /* d'b */
-struct NaClApp              *gnap; /* d'b */
-jmp_buf                     user_exit; /* d'b */
+/* d'b: per thread. each user thread has own registers and trusted stack */
+extern __thread struct NaClThreadContext *nacl_user;
+extern __thread struct NaClThreadContext *nacl_sys;
+
+/*
+ * d'b: per thread too. one process can host many sandboxes, each
+ * sandbox is run by own thread (see sel_main.c batch mode)
+ */
+extern __thread int64_t syscallback;
+extern __thread struct NaClApp *gnap;
+extern __thread jmp_buf user_exit;
 
 extern struct NaClMutex         nacl_thread_mu;
 /*
@@ -56,6 +56,21 @@ typedef enum NaClSignalResult (*NaClSignalHandler)(int sig_num, void *ctx);
  */
 int NaClSignalStackAllocate(void **result);
 
+/*
+ * Releases a signal stack allocated by NaClSignalStackAllocate().
+ */
+void NaClSignalStackFree(void *stack);
+
+/*
+ * Registers a signal stack for use by the current thread.
+ */
+void NaClSignalStackRegister(void *stack);
+
+/*
+ * Undoes the effect of NaClSignalStackRegister().
+ */
+void NaClSignalStackUnregister(void);
+
 /*
  * Register process-wide signal handlers.
  */
@@ -104,6 +119,14 @@ void NaClSignalContextFromHandler(struct NaClSignalContext *sigCtx,
  */
 int NaClSignalContextIsUntrusted(const struct NaClSignalContext *sigCtx);
 
+/*
+ * d'b: make the thread interrupted by the signal continue in "func" on
+ * "stack" (trusted) when the handler returns. "rawCtx" is the context
+ * given to the handler
+ */
+void NaClSignalContextRedirect(void *rawCtx, uintptr_t stack,
+                               void (*func)(void));
+
 /*
  * A basic handler which will do nothing, passing the
  * error to the OS.
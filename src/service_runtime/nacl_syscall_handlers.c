@@ -3,6 +3,7 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  */
+#include <sched.h>
 #include "include/nacl_platform.h"
 #include "include/nacl_macros.h"
 #include "src/platform/nacl_sync_checked.h"
@@ -14,10 +15,14 @@
 #include "src/service_runtime/include/bits/mman.h"
 #include "src/service_runtime/include/bits/nacl_syscalls.h"
 #include "src/service_runtime/include/sys/stat.h"
+#include "src/service_runtime/include/sys/time.h"
 #include "src/service_runtime/linux/nacl_syscall_inl.h"
 #include "src/manifest/trap.h"
 #include "include/nacl_assert.h"
 #include "src/manifest/manifest_setup.h"
+#include "src/service_runtime/nacl_user_thread.h"
+#include "src/service_runtime/nacl_user_sync.h"
+#include "src/manifest/mem_release.h"
 
 struct NaClSyscallTableEntry nacl_syscall[NACL_MAX_SYSCALLS] = {{0}};
 static const size_t kMaxUsableFileSize = (SIZE_T_MAX >> 1);
@@ -130,6 +135,7 @@ int32_t NaClSysSysbrk(struct NaClApp *nap, uintptr_t new_break)
     /* freeing memory */
     NaClLog(4, "new_break before break (0x%"NACL_PRIxPTR"); freeing\n",
             nap->break_addr);
+    MemReleaseFree(nap->mem_release, sys_new_break, nap->break_addr - new_break);
     nap->break_addr = new_break;
     break_addr = new_break;
   } else {
@@ -173,6 +179,7 @@ int32_t NaClSysSysbrk(struct NaClApp *nap, uintptr_t new_break)
             ent->page_num, ent->npages);
     if (usr_new_last_data_page < ent->page_num + ent->npages) {
       NaClLog(4, "new break within break segment, just bumping addr\n");
+      MemReleaseUse(nap->mem_release, sys_break, new_break - nap->break_addr);
       nap->break_addr = new_break;
       break_addr = new_break;
     } else {
@@ -226,6 +233,7 @@ int32_t NaClSysSysbrk(struct NaClApp *nap, uintptr_t new_break)
       NaClLog(4, "segment now: page_num 0x%08"NACL_PRIxPTR", "
               "npages 0x%"NACL_PRIxS"\n",
               ent->page_num, ent->npages);
+      MemReleaseUse(nap->mem_release, sys_break, new_break - nap->break_addr);
       nap->break_addr = new_break;
       break_addr = new_break;
     }
@@ -802,6 +810,7 @@ int32_t NaClSysMunmap(struct NaClApp *nap, void *start, size_t length) {
       nap->manifest->user_setup->max_mem)
   {
     /* skip real syscall. all allowed memory already allocated */
+    MemReleaseFree(nap->mem_release, sysaddr, length);
   }
   else
   {
@@ -832,9 +841,7 @@ cleanup:
 /* d'b: duplicate of trap() exit. remove it when trap() replace syscalls */
 int32_t NaClSysExit(struct NaClApp *nap, int status)
 {
-  NaClLog(1, "Exit syscall handler: %d\n", status);
-  nap->exit_status = status;
-  longjmp(user_exit, status);
+  UserJobExit(nap, status);
 
   /* NOTREACHED */
   return -NACL_ABI_EINVAL;
@@ -859,6 +866,7 @@ int32_t NaClSysTls_Init(struct NaClApp *nap, void *thread_ptr)
 
   CLEANUP(kNaClBadAddress == sys_tls, -NACL_ABI_EFAULT);
   nap->sys_tls = sys_tls;
+  nacl_user->tls_base = (void*)sys_tls; /* d'b: each user thread has own tls */
   retval = 0;
 
 cleanup:
@@ -871,7 +879,8 @@ int32_t NaClSysTls_Get(struct NaClApp *nap) {
   uint32_t user_tls;
 
   /* too frequently used, and syscall-number level logging suffices */
-  user_tls = (int32_t) NaClSysToUser(nap, nap->sys_tls);
+  if(nacl_user->tls_base == NULL) return 0;
+  user_tls = (int32_t) NaClSysToUser(nap, (uintptr_t) nacl_user->tls_base);
   return user_tls;
 }
 
@@ -942,12 +951,117 @@ static int32_t NaClSysTls_GetDecoder(struct NaClApp *nap)
 }
 
 /*
- * only needed by nexe prologue. if user need real functionality
- * zrt library can be used (in the future)
+ * d'b: user threads and synchronization. syscalls which can block
+ * release the trusted lock while waiting. arguments must be fetched
+ * before that: nap->syscall_args is shared by all threads
  */
+static int32_t NaClSysThread_CreateDecoder(struct NaClApp *nap)
+{
+  struct NaClSysThread_CreateArgs {
+    uint32_t prog_ctr;
+    uint32_t stack_ptr;
+    uint32_t thread_ptr;
+    uint32_t second_thread_ptr;
+  } p = *(struct NaClSysThread_CreateArgs *) nap->syscall_args;
+
+  return UserThreadCreate(nap, p.prog_ctr, p.stack_ptr, p.thread_ptr);
+}
+
+static int32_t NaClSysThread_ExitDecoder(struct NaClApp *nap)
+{
+  struct NaClSysThread_ExitArgs {
+    uint32_t stack_flag;
+  } p = *(struct NaClSysThread_ExitArgs *) nap->syscall_args;
+
+  UserThreadExit(nap, p.stack_flag);
+}
+
+static int32_t NaClSysThread_NiceDecoder(struct NaClApp *nap)
+{
+  UNREFERENCED_PARAMETER(nap);
+  return 0;
+}
+
+static int32_t NaClSysSched_YieldDecoder(struct NaClApp *nap)
+{
+  UNREFERENCED_PARAMETER(nap);
+  TrustedUnlock();
+  sched_yield();
+  TrustedLock();
+  return 0;
+}
+
+/* decoders of the calls with single integer argument (handle or value) */
+#define INT_DECODER(name, call, blocking) \
+static int32_t name(struct NaClApp *nap) \
+{ \
+  int32_t retval; \
+  int32_t arg = *(int32_t *) nap->syscall_args; \
+  if(blocking) TrustedUnlock(); \
+  retval = call(nap->user_sync, arg); \
+  if(blocking) TrustedLock(); \
+  return retval; \
+}
+
+INT_DECODER(NaClSysMutex_LockDecoder, UserMutexLock, 1)
+INT_DECODER(NaClSysMutex_TrylockDecoder, UserMutexTrylock, 0)
+INT_DECODER(NaClSysMutex_UnlockDecoder, UserMutexUnlock, 0)
+INT_DECODER(NaClSysCond_SignalDecoder, UserCondSignal, 0)
+INT_DECODER(NaClSysCond_BroadcastDecoder, UserCondBroadcast, 0)
+INT_DECODER(NaClSysSem_CreateDecoder, UserSemCreate, 0)
+INT_DECODER(NaClSysSem_WaitDecoder, UserSemWait, 1)
+INT_DECODER(NaClSysSem_PostDecoder, UserSemPost, 0)
+INT_DECODER(NaClSysSem_Get_ValueDecoder, UserSemGetValue, 0)
+#undef INT_DECODER
+
 static int32_t NaClSysMutex_CreateDecoder(struct NaClApp *nap)
 {
-  return 1;
+  UNREFERENCED_PARAMETER(nap);
+  return UserMutexCreate(nap->user_sync);
+}
+
+static int32_t NaClSysCond_CreateDecoder(struct NaClApp *nap)
+{
+  UNREFERENCED_PARAMETER(nap);
+  return UserCondCreate(nap->user_sync);
+}
+
+static int32_t NaClSysCond_WaitDecoder(struct NaClApp *nap)
+{
+  struct NaClSysCond_WaitArgs {
+    uint32_t cv;
+    uint32_t mutex;
+  } p = *(struct NaClSysCond_WaitArgs *) nap->syscall_args;
+  int32_t retval;
+
+  TrustedUnlock();
+  retval = UserCondWait(nap->user_sync, p.cv, p.mutex, NULL);
+  TrustedLock();
+  return retval;
+}
+
+static int32_t NaClSysCond_Timed_Wait_AbsDecoder(struct NaClApp *nap)
+{
+  struct NaClSysCond_Timed_Wait_AbsArgs {
+    uint32_t cv;
+    uint32_t mutex;
+    uint32_t ts;
+  } p = *(struct NaClSysCond_Timed_Wait_AbsArgs *) nap->syscall_args;
+  struct nacl_abi_timespec *user_ts;
+  struct timespec abstime;
+  int32_t retval;
+
+  user_ts = (struct nacl_abi_timespec *) NaClUserToSysAddrRange(nap,
+      p.ts, sizeof *user_ts);
+  if(kNaClBadAddress == (uintptr_t) user_ts) return -NACL_ABI_EFAULT;
+  abstime.tv_sec = user_ts->tv_sec;
+  abstime.tv_nsec = user_ts->tv_nsec;
+  if(abstime.tv_nsec < 0 || abstime.tv_nsec >= 1000000000) return -NACL_ABI_EINVAL;
+
+  TrustedUnlock();
+  retval = UserCondWait(nap->user_sync, p.cv, p.mutex, &abstime);
+  TrustedLock();
+  return retval;
 }
 
 /* d'b: trap(). see documentation for the details */
@@ -976,7 +1090,23 @@ void NaClSyscallTableInit() {
   NaClAddSyscall(NACL_sys_exit, &NaClSysExitDecoder); /* 30 */
   NaClAddSyscall(NACL_sys_tls_init, &NaClSysTls_InitDecoder); /* 82 */
   NaClAddSyscall(NACL_sys_tls_get, &NaClSysTls_GetDecoder); /* 84 */
+  NaClAddSyscall(NACL_sys_sched_yield, &NaClSysSched_YieldDecoder); /* 32 */
   NaClAddSyscall(NACL_sys_mutex_create, &NaClSysMutex_CreateDecoder); /* 70 */
+  NaClAddSyscall(NACL_sys_mutex_lock, &NaClSysMutex_LockDecoder); /* 71 */
+  NaClAddSyscall(NACL_sys_mutex_trylock, &NaClSysMutex_TrylockDecoder); /* 72 */
+  NaClAddSyscall(NACL_sys_mutex_unlock, &NaClSysMutex_UnlockDecoder); /* 73 */
+  NaClAddSyscall(NACL_sys_cond_create, &NaClSysCond_CreateDecoder); /* 74 */
+  NaClAddSyscall(NACL_sys_cond_wait, &NaClSysCond_WaitDecoder); /* 75 */
+  NaClAddSyscall(NACL_sys_cond_signal, &NaClSysCond_SignalDecoder); /* 76 */
+  NaClAddSyscall(NACL_sys_cond_broadcast, &NaClSysCond_BroadcastDecoder); /* 77 */
+  NaClAddSyscall(NACL_sys_cond_timed_wait_abs, &NaClSysCond_Timed_Wait_AbsDecoder); /* 79 */
+  NaClAddSyscall(NACL_sys_thread_create, &NaClSysThread_CreateDecoder); /* 80 */
+  NaClAddSyscall(NACL_sys_thread_exit, &NaClSysThread_ExitDecoder); /* 81 */
+  NaClAddSyscall(NACL_sys_thread_nice, &NaClSysThread_NiceDecoder); /* 83 */
+  NaClAddSyscall(NACL_sys_sem_create, &NaClSysSem_CreateDecoder); /* 100 */
+  NaClAddSyscall(NACL_sys_sem_wait, &NaClSysSem_WaitDecoder); /* 101 */
+  NaClAddSyscall(NACL_sys_sem_post, &NaClSysSem_PostDecoder); /* 102 */
+  NaClAddSyscall(NACL_sys_sem_get_value, &NaClSysSem_Get_ValueDecoder); /* 103 */
   /* 21. syscall is not used by current nexe prolog, but can be invoked by large mallocs */
   NaClAddSyscall(NACL_sys_mmap, &NaClSysMmapDecoder);
   NaClAddSyscall(NACL_sys_munmap, &NaClSysMunmapDecoder); /* same here */
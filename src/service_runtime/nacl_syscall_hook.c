@@ -18,6 +18,8 @@
 #include "src/service_runtime/nacl_globals.h" /* d'b */
 #include "src/manifest/trap.h" /* d'b: ResumeCpuClock(), PauseCpuClock() */
 #include "src/manifest/manifest_setup.h" /* d'b: ResumeCpuClock(), PauseCpuClock() */
+#include "src/service_runtime/nacl_user_thread.h" /* d'b: TrustedLock() */
+#include "src/service_runtime/nacl_syscall_profile.h" /* d'b */
 
 /*
  * d'b: make syscall invoked from the untrusted code
@@ -37,12 +39,15 @@ NORETURN void NaClSyscallCSegHook()
    * increase syscalls counter (correction for setup call will be
    * corrected later). small mallocs and other calls which are
    * not really "system" will be accounted anyway!
+   * the trusted side is serialized: one user thread at a time
    */
   nap = gnap; /* restore NaClApp object */
+  TrustedLock();
+  UserThreadStopCheck(nap); /* d'b: the job is ending */
   nap->user_side_flag = 1; /* set "user side call" mark */
   PauseCpuClock(nap);
   AccountingSyscallsInc(nap);
-  user = nacl_user; /* restore from global */
+  user = nacl_user; /* restore context of the calling thread */
   sp_user = NaClGetThreadCtxSp(user);
 
   sp_sys = NaClUserToSysStackAddr(nap, sp_user);
@@ -75,6 +80,13 @@ NORETURN void NaClSyscallCSegHook()
   /* debug print to log */
   NaClLog(4, "system call number %"NACL_PRIdS"\n", sysnum);
 
+  /* d'b: cpu limit is shared by all user threads */
+  if(CpuLimitExceeded(nap))
+  {
+    NaClLog(LOG_ERROR, "cpu limit exceeded\n");
+    UserJobExit(nap, ERR_CODE);
+  }
+
   if (sysnum >= NACL_MAX_SYSCALLS) {
     NaClLog(2, "INVALID system call %"NACL_PRIdS"\n", sysnum);
     nap->sysret = -NACL_ABI_EINVAL;
@@ -89,7 +101,16 @@ NORETURN void NaClSyscallCSegHook()
      * user stack.
      */
     nap->syscall_args = (uintptr_t *) sp_sys;
-    nap->sysret = (*(nap->syscall_table[sysnum].handler))(nap);
+    ++nap->syscall_counts[sysnum];
+    if(nap->syscall_profile == NULL)
+      nap->sysret = (*(nap->syscall_table[sysnum].handler))(nap);
+    else
+    {
+      /* d'b: syscall latency for the profile */
+      uint64_t start = SyscallProfileClock();
+      nap->sysret = (*(nap->syscall_table[sysnum].handler))(nap);
+      SyscallProfileAdd(nap->syscall_profile, sysnum, SyscallProfileClock() - start);
+    }
   }
 
   /*
@@ -97,10 +118,13 @@ NORETURN void NaClSyscallCSegHook()
    * user_ret is properly sandboxed.
    */
   user_ret = (nacl_reg_t) NaClSandboxCodeAddr(nap, (uintptr_t)user_ret);
+  user->sysret = nap->sysret;
 
   /* d'b: give control to the nexe. start cpu time counting */
+  UserThreadStopCheck(nap);
   ResumeCpuClock(nap);
   nap->user_side_flag = 0; /* remove "user side call" mark */
+  TrustedUnlock();
   NaClSwitchToApp(nap, user_ret);
 
   /* NOTREACHED */
@@ -0,0 +1,125 @@
+/*
+ * syscalls profile. the latency is measured with rdtsc around the syscall
+ * handler (under the trusted lock) and put to the log-linear histogram:
+ * 4 buckets per power of 2, so the bucket error is below 25%
+ *
+ *  Created on: May 13, 2012
+ *      Author: d'b
+ */
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "src/service_runtime/nacl_syscall_profile.h"
+
+#define SUB_BUCKETS (1 << PROFILE_SUB_BITS)
+
+static int64_t NowUs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+struct SyscallProfile *SyscallProfileCtor()
+{
+  struct SyscallProfile *profile = calloc(1, sizeof *profile);
+
+  if(profile == NULL) return NULL;
+  profile->start_tsc = SyscallProfileClock();
+  profile->start_us = NowUs();
+  return profile;
+}
+
+void SyscallProfileDtor(struct SyscallProfile *profile)
+{
+  free(profile);
+}
+
+int SyscallProfileBucket(uint64_t cycles)
+{
+  int power;
+
+  if(cycles < SUB_BUCKETS) return (int)cycles;
+  power = 63 - __builtin_clzll(cycles);
+  return ((power - PROFILE_SUB_BITS + 1) << PROFILE_SUB_BITS)
+      + (int)((cycles >> (power - PROFILE_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+uint64_t SyscallProfileBucketLow(int bucket)
+{
+  int power;
+
+  if(bucket < SUB_BUCKETS) return bucket;
+  power = (bucket >> PROFILE_SUB_BITS) + PROFILE_SUB_BITS - 1;
+  return 1ULL << power
+      | (uint64_t)(bucket & (SUB_BUCKETS - 1)) << (power - PROFILE_SUB_BITS);
+}
+
+void SyscallProfileAdd(struct SyscallProfile *profile, uint32_t sysnum, uint64_t cycles)
+{
+  if(sysnum >= NACL_MAX_SYSCALLS) return;
+  ++profile->count[sysnum];
+  profile->cycles[sysnum] += cycles;
+  if(profile->max[sysnum] < cycles) profile->max[sysnum] = cycles;
+  ++profile->histogram[sysnum][SyscallProfileBucket(cycles)];
+}
+
+uint64_t SyscallProfilePercentile(const struct SyscallProfile *profile,
+    uint32_t sysnum, int percentile)
+{
+  uint64_t need;
+  uint64_t got = 0;
+  int i;
+
+  if(sysnum >= NACL_MAX_SYSCALLS || profile->count[sysnum] == 0) return 0;
+  need = ((uint64_t)profile->count[sysnum] * percentile + 99) / 100;
+  if(need == 0) need = 1;
+
+  for(i = 0; i < PROFILE_BUCKETS - 1; ++i)
+  {
+    got += profile->histogram[sysnum][i];
+    if(got >= need) break;
+  }
+
+  /* upper bound of the bucket, but not more than the real maximum */
+  if(i == PROFILE_BUCKETS - 1) return profile->max[sysnum];
+  got = SyscallProfileBucketLow(i + 1) - 1;
+  return got < profile->max[sysnum] ? got : profile->max[sysnum];
+}
+
+int SyscallProfileWrite(const struct SyscallProfile *profile, FILE *f)
+{
+  int64_t us = NowUs() - profile->start_us;
+  uint64_t rate = us > 0 ? (SyscallProfileClock() - profile->start_tsc) / us : 0;
+  uint32_t n;
+  int i;
+
+  fprintf(f, "# syscalls latency in tsc cycles, %llu cycles per microsecond\n",
+      (unsigned long long)rate);
+  fprintf(f, "# %-6s %10s %14s %10s %10s %10s %10s %10s\n", "number",
+      "count", "cycles", "mean", "p50", "p90", "p99", "max");
+  for(n = 0; n < NACL_MAX_SYSCALLS; ++n)
+  {
+    if(profile->count[n] == 0) continue;
+    fprintf(f, "%-8u %10u %14llu %10llu %10llu %10llu %10llu %10llu\n", n,
+        profile->count[n], (unsigned long long)profile->cycles[n],
+        (unsigned long long)(profile->cycles[n] / profile->count[n]),
+        (unsigned long long)SyscallProfilePercentile(profile, n, 50),
+        (unsigned long long)SyscallProfilePercentile(profile, n, 90),
+        (unsigned long long)SyscallProfilePercentile(profile, n, 99),
+        (unsigned long long)profile->max[n]);
+  }
+
+  /* histograms: lowest latency of the bucket:calls */
+  for(n = 0; n < NACL_MAX_SYSCALLS; ++n)
+  {
+    if(profile->count[n] == 0) continue;
+    fprintf(f, "histogram %u:", n);
+    for(i = 0; i < PROFILE_BUCKETS; ++i)
+      if(profile->histogram[n][i] != 0)
+        fprintf(f, " %llu:%u",
+            (unsigned long long)SyscallProfileBucketLow(i), profile->histogram[n][i]);
+    fprintf(f, "\n");
+  }
+  return ferror(f) ? -1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * syscalls profile: calls count, time and log-linear histogram of the
+ * latency (in tsc cycles) per syscall number. enabled by "SyscallProfile"
+ * manifest key, the hook only checks nap->syscall_profile when disabled
+ *
+ *  Created on: May 13, 2012
+ *      Author: d'b
+ */
+
+#ifndef NACL_SYSCALL_PROFILE_H_
+#define NACL_SYSCALL_PROFILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "include/nacl_base.h"
+#include "include/nacl_compiler_annotations.h"
+#include "src/service_runtime/include/bits/nacl_syscalls.h"
+
+EXTERN_C_BEGIN
+
+/* each power of 2 is split to 2^PROFILE_SUB_BITS buckets */
+#define PROFILE_SUB_BITS 2
+#define PROFILE_BUCKETS (64 << PROFILE_SUB_BITS)
+
+struct SyscallProfile
+{
+  uint64_t start_tsc; /* to measure the tsc rate */
+  int64_t start_us;
+  uint32_t count[NACL_MAX_SYSCALLS];
+  uint64_t cycles[NACL_MAX_SYSCALLS];
+  uint64_t max[NACL_MAX_SYSCALLS];
+  uint32_t histogram[NACL_MAX_SYSCALLS][PROFILE_BUCKETS];
+};
+
+/* time stamp counter */
+static INLINE uint64_t SyscallProfileClock()
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+  return (uint64_t)hi << 32 | lo;
+}
+
+/* return zeroed profile or NULL if failed */
+struct SyscallProfile *SyscallProfileCtor();
+void SyscallProfileDtor(struct SyscallProfile *profile);
+
+/* account the syscall "sysnum" which took "cycles" */
+void SyscallProfileAdd(struct SyscallProfile *profile, uint32_t sysnum, uint64_t cycles);
+
+/* histogram bucket of the latency and the lowest latency of the bucket */
+int SyscallProfileBucket(uint64_t cycles);
+uint64_t SyscallProfileBucketLow(int bucket);
+
+/*
+ * latency (upper bound of the bucket) of the given percentile (0..100)
+ * of the syscall. return 0 if the syscall was not called
+ */
+uint64_t SyscallProfilePercentile(const struct SyscallProfile *profile,
+    uint32_t sysnum, int percentile);
+
+/*
+ * write the profile as text: per syscall count, cycles, percentiles and
+ * not empty buckets of the histogram. return 0 if success, otherwise -1
+ */
+int SyscallProfileWrite(const struct SyscallProfile *profile, FILE *f);
+
+EXTERN_C_END
+
+#endif /* NACL_SYSCALL_PROFILE_H_ */
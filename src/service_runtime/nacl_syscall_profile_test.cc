@@ -0,0 +1,47 @@
+/*
+ * nacl_syscall_profile_test.cc
+ * log-linear buckets and percentiles of the syscalls profile
+ *
+ *  Created on: May 13, 2012
+ *      Author: d'b
+ */
+
+#include "gtest/gtest.h"
+#include "src/service_runtime/nacl_syscall_profile.h"
+
+// every latency falls into the bucket which lowest latency is not greater
+TEST(SyscallProfile, buckets) {
+  EXPECT_EQ(0, SyscallProfileBucket(0));
+  EXPECT_EQ(3, SyscallProfileBucket(3));
+  EXPECT_GT(PROFILE_BUCKETS, SyscallProfileBucket(~0ULL));
+
+  for (uint64_t cycles = 1; cycles < (1ULL << 62); cycles = cycles * 3 + 1) {
+    int bucket = SyscallProfileBucket(cycles);
+    ASSERT_LT(bucket, PROFILE_BUCKETS);
+    EXPECT_LE(SyscallProfileBucketLow(bucket), cycles);
+    EXPECT_GT(SyscallProfileBucketLow(bucket + 1), cycles);
+  }
+}
+
+// percentiles are bounded by the bucket and by the maximum
+TEST(SyscallProfile, percentiles) {
+  SyscallProfile *profile = SyscallProfileCtor();
+  ASSERT_TRUE(profile != NULL);
+
+  EXPECT_EQ(0u, SyscallProfilePercentile(profile, 1, 50));
+  for (int i = 0; i < 99; ++i)
+    SyscallProfileAdd(profile, 1, 100);
+  SyscallProfileAdd(profile, 1, 100000);
+  SyscallProfileAdd(profile, NACL_MAX_SYSCALLS, 1);
+
+  EXPECT_EQ(100u, profile->count[1]);
+  EXPECT_EQ(99u * 100 + 100000, profile->cycles[1]);
+  EXPECT_EQ(100000u, profile->max[1]);
+
+  uint64_t p50 = SyscallProfilePercentile(profile, 1, 50);
+  EXPECT_GE(p50, 100u);
+  EXPECT_LT(p50, 125u);
+  EXPECT_EQ(p50, SyscallProfilePercentile(profile, 1, 99));
+  EXPECT_EQ(100000u, SyscallProfilePercentile(profile, 1, 100));
+  SyscallProfileDtor(profile);
+}
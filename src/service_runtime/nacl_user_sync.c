@@ -0,0 +1,254 @@
+/*
+ * synchronization objects for user threads. futex word of the object
+ * is the only state:
+ *   mutex: 0 - unlocked, 1 - locked, 2 - locked and has waiters
+ *   condition: sequence number changed by each signal/broadcast
+ *   semaphore: current value
+ * uncontended operations do not enter the kernel
+ *
+ *  Created on: May 8, 2012
+ *      Author: d'b
+ */
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "src/service_runtime/nacl_user_sync.h"
+#include "src/service_runtime/include/sys/errno.h"
+
+enum UserSyncType {SyncMutex = 1, SyncCond, SyncSem};
+
+struct UserSyncObject
+{
+  int32_t type;
+  int32_t value; /* futex word */
+};
+
+struct UserSyncTable
+{
+  int32_t cnt; /* allocated objects */
+  int32_t stop; /* waits are interrupted, the job ends */
+  struct UserSyncObject objects[USER_SYNC_MAX];
+};
+
+/* pages of the table are only touched when objects are created */
+struct UserSyncTable *UserSyncCtor()
+{
+  struct UserSyncTable *table = mmap(NULL, sizeof *table,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return table == MAP_FAILED ? NULL : table;
+}
+
+void UserSyncDtor(struct UserSyncTable *table)
+{
+  if(table != NULL) munmap(table, sizeof *table);
+}
+
+void UserSyncStop(struct UserSyncTable *table)
+{
+  if(table != NULL) *(volatile int32_t*)&table->stop = 1;
+}
+
+/* the waiter was interrupted by the stop signal of the job end */
+#define STOPPED(table) (*(volatile int32_t*)&(table)->stop)
+
+/* private futex call. return 0 or -1 and errno */
+static int Futex(int32_t *addr, int op, int32_t value, const struct timespec *ts)
+{
+  return syscall(SYS_futex, addr, op | FUTEX_PRIVATE_FLAG, value, ts,
+      NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+/* allocate new object. return handle or negative error */
+static int32_t SyncCreate(struct UserSyncTable *table,
+    enum UserSyncType type, int32_t value)
+{
+  int32_t handle;
+
+  if(table == NULL) return -NACL_ABI_ENOMEM;
+  handle = __sync_fetch_and_add(&table->cnt, 1);
+  if(handle >= USER_SYNC_MAX)
+  {
+    __sync_fetch_and_sub(&table->cnt, 1);
+    return -NACL_ABI_EAGAIN;
+  }
+
+  table->objects[handle].value = value;
+  __sync_synchronize();
+  table->objects[handle].type = type;
+  return handle;
+}
+
+/* return futex word of the object with given handle and type or NULL */
+static int32_t *SyncGet(struct UserSyncTable *table,
+    int32_t handle, enum UserSyncType type)
+{
+  if(table == NULL || handle < 0 || handle >= USER_SYNC_MAX) return NULL;
+  if(table->objects[handle].type != (int32_t)type) return NULL;
+  return &table->objects[handle].value;
+}
+
+/* wait until mutex is acquired. return 0 or -NACL_ABI_EINTR if stopped */
+static int32_t MutexLock(struct UserSyncTable *table, int32_t *m)
+{
+  int32_t c = __sync_val_compare_and_swap(m, 0, 1);
+
+  if(c == 0) return 0;
+  if(c != 2) c = __sync_lock_test_and_set(m, 2);
+  while(c != 0)
+  {
+    if(STOPPED(table)) return -NACL_ABI_EINTR;
+    Futex(m, FUTEX_WAIT, 2, NULL);
+    c = __sync_lock_test_and_set(m, 2);
+  }
+  return 0;
+}
+
+/* release mutex, wake one waiter if any */
+static int32_t MutexUnlock(int32_t *m)
+{
+  if(*(volatile int32_t*)m == 0) return -NACL_ABI_EPERM;
+  if(__sync_fetch_and_sub(m, 1) != 1)
+  {
+    *(volatile int32_t*)m = 0;
+    Futex(m, FUTEX_WAKE, 1, NULL);
+  }
+  return 0;
+}
+
+int32_t UserMutexCreate(struct UserSyncTable *table)
+{
+  return SyncCreate(table, SyncMutex, 0);
+}
+
+int32_t UserMutexLock(struct UserSyncTable *table, int32_t handle)
+{
+  int32_t *m = SyncGet(table, handle, SyncMutex);
+
+  if(m == NULL) return -NACL_ABI_EBADF;
+  return MutexLock(table, m);
+}
+
+int32_t UserMutexTrylock(struct UserSyncTable *table, int32_t handle)
+{
+  int32_t *m = SyncGet(table, handle, SyncMutex);
+
+  if(m == NULL) return -NACL_ABI_EBADF;
+  return __sync_bool_compare_and_swap(m, 0, 1) ? 0 : -NACL_ABI_EBUSY;
+}
+
+int32_t UserMutexUnlock(struct UserSyncTable *table, int32_t handle)
+{
+  int32_t *m = SyncGet(table, handle, SyncMutex);
+
+  if(m == NULL) return -NACL_ABI_EBADF;
+  return MutexUnlock(m);
+}
+
+int32_t UserCondCreate(struct UserSyncTable *table)
+{
+  return SyncCreate(table, SyncCond, 0);
+}
+
+/*
+ * unlock the mutex and wait for the signal. the mutex is taken back
+ * in "contended" state since other waiters can be woken with us
+ */
+int32_t UserCondWait(struct UserSyncTable *table,
+    int32_t cond, int32_t mutex, const struct timespec *abstime)
+{
+  int32_t *cv = SyncGet(table, cond, SyncCond);
+  int32_t *m = SyncGet(table, mutex, SyncMutex);
+  int32_t seq;
+  int32_t retcode = 0;
+
+  if(cv == NULL || m == NULL) return -NACL_ABI_EBADF;
+
+  seq = *(volatile int32_t*)cv;
+  if((retcode = MutexUnlock(m)) != 0) return retcode;
+
+  if(STOPPED(table)) return -NACL_ABI_EINTR;
+  if(abstime == NULL)
+    Futex(cv, FUTEX_WAIT, seq, NULL);
+  else if(Futex(cv, FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME, seq, abstime) != 0
+      && errno == ETIMEDOUT)
+    retcode = -NACL_ABI_ETIMEDOUT;
+
+  while(__sync_lock_test_and_set(m, 2) != 0)
+  {
+    if(STOPPED(table)) return -NACL_ABI_EINTR;
+    Futex(m, FUTEX_WAIT, 2, NULL);
+  }
+  return retcode;
+}
+
+int32_t UserCondSignal(struct UserSyncTable *table, int32_t cond)
+{
+  int32_t *cv = SyncGet(table, cond, SyncCond);
+
+  if(cv == NULL) return -NACL_ABI_EBADF;
+  __sync_fetch_and_add(cv, 1);
+  Futex(cv, FUTEX_WAKE, 1, NULL);
+  return 0;
+}
+
+int32_t UserCondBroadcast(struct UserSyncTable *table, int32_t cond)
+{
+  int32_t *cv = SyncGet(table, cond, SyncCond);
+
+  if(cv == NULL) return -NACL_ABI_EBADF;
+  __sync_fetch_and_add(cv, 1);
+  Futex(cv, FUTEX_WAKE, INT_MAX, NULL);
+  return 0;
+}
+
+int32_t UserSemCreate(struct UserSyncTable *table, int32_t value)
+{
+  if(value < 0) return -NACL_ABI_EINVAL;
+  return SyncCreate(table, SyncSem, value);
+}
+
+int32_t UserSemWait(struct UserSyncTable *table, int32_t handle)
+{
+  int32_t *s = SyncGet(table, handle, SyncSem);
+
+  if(s == NULL) return -NACL_ABI_EBADF;
+  for(;;)
+  {
+    int32_t value = *(volatile int32_t*)s;
+    if(value > 0)
+    {
+      if(__sync_bool_compare_and_swap(s, value, value - 1)) return 0;
+      continue;
+    }
+    if(STOPPED(table)) return -NACL_ABI_EINTR;
+    Futex(s, FUTEX_WAIT, 0, NULL);
+  }
+}
+
+int32_t UserSemPost(struct UserSyncTable *table, int32_t handle)
+{
+  int32_t *s = SyncGet(table, handle, SyncSem);
+  int32_t value;
+
+  if(s == NULL) return -NACL_ABI_EBADF;
+  do
+  {
+    value = *(volatile int32_t*)s;
+    if(value == INT32_MAX) return -NACL_ABI_EOVERFLOW;
+  } while(!__sync_bool_compare_and_swap(s, value, value + 1));
+
+  Futex(s, FUTEX_WAKE, 1, NULL);
+  return 0;
+}
+
+int32_t UserSemGetValue(struct UserSyncTable *table, int32_t handle)
+{
+  int32_t *s = SyncGet(table, handle, SyncSem);
+
+  if(s == NULL) return -NACL_ABI_EBADF;
+  return *(volatile int32_t*)s;
+}
@@ -0,0 +1,56 @@
+/*
+ * synchronization objects for user threads: mutexes, condition variables
+ * and semaphores (nacl syscalls 70..79, 100..103). objects are futex
+ * words kept in the trusted memory, user refers them by handles.
+ * each sandbox has own table, handles are not shared between sandboxes
+ *
+ * note: waiting functions block the calling thread. the trusted lock
+ * must be released before they are called
+ *
+ *  Created on: May 8, 2012
+ *      Author: d'b
+ */
+
+#ifndef NACL_USER_SYNC_H_
+#define NACL_USER_SYNC_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "include/nacl_base.h"
+
+EXTERN_C_BEGIN
+
+/* max amount of objects per job. objects are never destroyed */
+#define USER_SYNC_MAX 0x10000
+
+/* objects of one sandbox. return NULL if failed */
+struct UserSyncTable *UserSyncCtor();
+void UserSyncDtor(struct UserSyncTable *table);
+
+/*
+ * the job ends: waits of the table return -NACL_ABI_EINTR. blocked waiters
+ * notice it when interrupted by the user threads stop signal
+ */
+void UserSyncStop(struct UserSyncTable *table);
+
+/* all functions return handle/value or 0 if successful, otherwise -NACL_ABI_E* */
+int32_t UserMutexCreate(struct UserSyncTable *table);
+int32_t UserMutexLock(struct UserSyncTable *table, int32_t handle);
+int32_t UserMutexTrylock(struct UserSyncTable *table, int32_t handle);
+int32_t UserMutexUnlock(struct UserSyncTable *table, int32_t handle);
+
+/* "abstime" is CLOCK_REALTIME deadline, NULL - wait forever */
+int32_t UserCondCreate(struct UserSyncTable *table);
+int32_t UserCondWait(struct UserSyncTable *table,
+    int32_t cond, int32_t mutex, const struct timespec *abstime);
+int32_t UserCondSignal(struct UserSyncTable *table, int32_t cond);
+int32_t UserCondBroadcast(struct UserSyncTable *table, int32_t cond);
+
+int32_t UserSemCreate(struct UserSyncTable *table, int32_t value);
+int32_t UserSemWait(struct UserSyncTable *table, int32_t handle);
+int32_t UserSemPost(struct UserSyncTable *table, int32_t handle);
+int32_t UserSemGetValue(struct UserSyncTable *table, int32_t handle);
+
+EXTERN_C_END
+
+#endif /* NACL_USER_SYNC_H_ */
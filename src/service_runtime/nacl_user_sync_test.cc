@@ -0,0 +1,151 @@
+/*
+ * nacl_user_sync_test.cc
+ * mutexes, condition variables and semaphores of user threads
+ *
+ *  Created on: May 8, 2012
+ *      Author: d'b
+ */
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "gtest/gtest.h"
+#include "src/service_runtime/nacl_user_sync.h"
+#include "src/service_runtime/include/sys/errno.h"
+
+namespace {
+
+struct Shared {
+  UserSyncTable *table;
+  int32_t mutex;
+  int32_t cond;
+  int32_t sem;
+  int counter;
+  int ready;
+};
+
+// increments counter under mutex
+void *Increment(void *arg) {
+  Shared *shared = reinterpret_cast<Shared*>(arg);
+  for (int i = 0; i < 100000; ++i) {
+    UserMutexLock(shared->table, shared->mutex);
+    ++shared->counter;
+    UserMutexUnlock(shared->table, shared->mutex);
+  }
+  return NULL;
+}
+
+// sets "ready" and signals
+void *Signal(void *arg) {
+  Shared *shared = reinterpret_cast<Shared*>(arg);
+  UserMutexLock(shared->table, shared->mutex);
+  shared->ready = 1;
+  UserCondSignal(shared->table, shared->cond);
+  UserMutexUnlock(shared->table, shared->mutex);
+  return NULL;
+}
+
+// waits for the semaphore twice
+void *SemWait(void *arg) {
+  Shared *shared = reinterpret_cast<Shared*>(arg);
+  UserSemWait(shared->table, shared->sem);
+  UserSemWait(shared->table, shared->sem);
+  return NULL;
+}
+
+}  // namespace
+
+TEST(UserSync, mutex) {
+  UserSyncTable *table = UserSyncCtor();
+  Shared shared = {table, UserMutexCreate(table), 0, 0, 0, 0};
+  pthread_t threads[4];
+
+  ASSERT_LE(0, shared.mutex);
+  EXPECT_EQ(0, UserMutexTrylock(shared.table, shared.mutex));
+  EXPECT_EQ(-NACL_ABI_EBUSY, UserMutexTrylock(shared.table, shared.mutex));
+  EXPECT_EQ(0, UserMutexUnlock(shared.table, shared.mutex));
+  EXPECT_EQ(-NACL_ABI_EPERM, UserMutexUnlock(shared.table, shared.mutex));
+
+  for (int i = 0; i < 4; ++i)
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, Increment, &shared));
+  for (int i = 0; i < 4; ++i)
+    pthread_join(threads[i], NULL);
+  EXPECT_EQ(400000, shared.counter);
+  UserSyncDtor(table);
+}
+
+TEST(UserSync, cond) {
+  UserSyncTable *table = UserSyncCtor();
+  Shared shared = {table, UserMutexCreate(table), UserCondCreate(table),
+                   0, 0, 0};
+  pthread_t thread;
+  struct timeval now;
+  struct timespec deadline;
+
+  // timeout
+  gettimeofday(&now, NULL);
+  deadline.tv_sec = now.tv_sec;
+  deadline.tv_nsec = now.tv_usec * 1000 + 10000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= 1000000000;
+  }
+  UserMutexLock(shared.table, shared.mutex);
+  EXPECT_EQ(-NACL_ABI_ETIMEDOUT,
+      UserCondWait(shared.table, shared.cond, shared.mutex, &deadline));
+
+  // signal
+  ASSERT_EQ(0, pthread_create(&thread, NULL, Signal, &shared));
+  while (!shared.ready)
+    EXPECT_EQ(0, UserCondWait(shared.table, shared.cond, shared.mutex, NULL));
+  EXPECT_EQ(0, UserMutexUnlock(shared.table, shared.mutex));
+  pthread_join(thread, NULL);
+  UserSyncDtor(table);
+}
+
+TEST(UserSync, semaphore) {
+  UserSyncTable *table = UserSyncCtor();
+  Shared shared = {table, 0, 0, UserSemCreate(table, 1), 0, 0};
+  pthread_t thread;
+
+  ASSERT_LE(0, shared.sem);
+  ASSERT_EQ(0, pthread_create(&thread, NULL, SemWait, &shared));
+  EXPECT_EQ(0, UserSemPost(shared.table, shared.sem));
+  pthread_join(thread, NULL);
+  EXPECT_EQ(0, UserSemGetValue(shared.table, shared.sem));
+  EXPECT_EQ(-NACL_ABI_EINVAL, UserSemCreate(table, -1));
+  UserSyncDtor(table);
+}
+
+TEST(UserSync, handles) {
+  UserSyncTable *table = UserSyncCtor();
+  UserSyncTable *other = UserSyncCtor();
+  int32_t mutex = UserMutexCreate(table);
+  int32_t sem = UserSemCreate(table, 0);
+
+  // objects cannot be used as other types
+  EXPECT_EQ(-NACL_ABI_EBADF, UserSemPost(table, mutex));
+  EXPECT_EQ(-NACL_ABI_EBADF, UserMutexLock(table, sem));
+  EXPECT_EQ(-NACL_ABI_EBADF, UserCondSignal(table, -1));
+  EXPECT_EQ(-NACL_ABI_EBADF, UserMutexUnlock(table, USER_SYNC_MAX));
+
+  // objects of other sandbox are not visible
+  EXPECT_EQ(-NACL_ABI_EBADF, UserMutexLock(other, mutex));
+  EXPECT_EQ(-NACL_ABI_EBADF, UserSemPost(other, sem));
+  UserSyncDtor(other);
+  UserSyncDtor(table);
+}
+
+TEST(UserSync, stop) {
+  UserSyncTable *table = UserSyncCtor();
+  int32_t mutex = UserMutexCreate(table);
+  int32_t cond = UserCondCreate(table);
+  int32_t sem = UserSemCreate(table, 0);
+
+  // stopped waits return at once instead of blocking
+  UserSyncStop(table);
+  EXPECT_EQ(-NACL_ABI_EINTR, UserSemWait(table, sem));
+  EXPECT_EQ(0, UserMutexLock(table, mutex));
+  EXPECT_EQ(-NACL_ABI_EINTR, UserCondWait(table, cond, mutex, NULL));
+  UserSyncDtor(table);
+}
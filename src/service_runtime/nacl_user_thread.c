@@ -0,0 +1,406 @@
+/*
+ * user threads. each thread is a pthread with own NaClThreadContext pair:
+ * "user" holds registers of the untrusted side, "sys" holds the trusted
+ * stack used to handle syscalls of this thread (see nacl_syscall_64.S)
+ *
+ * job end sets the stop flag. threads notice it on the trusted side (the
+ * syscall hook, interrupted waits). a thread running the user code gets
+ * USER_THREAD_SIGNAL which returns it to the trusted side on the trusted
+ * stack. there the main thread leaves to the user exit point (see
+ * sel_main.c), other threads are parked until the process end
+ *
+ *  Created on: May 8, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <linux/futex.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "src/service_runtime/nacl_user_thread.h"
+#include "src/service_runtime/nacl_globals.h"
+#include "src/platform/nacl_sync_checked.h"
+#include "src/service_runtime/nacl_switch_to_app.h"
+#include "src/service_runtime/nacl_signal.h"
+#include "src/service_runtime/nacl_user_sync.h"
+#include "src/service_runtime/include/sys/errno.h"
+#include "src/manifest/manifest_setup.h"
+#include "src/manifest/trap.h"
+
+#define USER_THREAD_SIGNAL SIGRTMIN
+
+struct UserThread
+{
+  struct NaClThreadContext user; /* must be the 1st field (see nacl_user) */
+  struct NaClThreadContext sys;
+  struct NaClApp *nap;
+  int64_t syscallback; /* inherited from the creator */
+  pthread_t id;
+  int slot;
+  char signal_stack[USER_THREAD_SIGNAL_STACK];
+};
+
+/* user threads of the job (NaClApp::user_threads) */
+struct UserThreads
+{
+  pthread_mutex_t lock; /* guards "threads" */
+  struct UserThread *threads[USER_THREADS_LIMIT]; /* all except main */
+  pthread_t main_thread; /* main thread of the sandbox */
+  int32_t secondary; /* running threads except main. futex word */
+  int32_t parked; /* stopped threads. futex word */
+};
+
+static __thread int is_secondary = 0;
+
+void TrustedLock()
+{
+  NaClXMutexLock(&gnap->trusted_mu);
+}
+
+void TrustedUnlock()
+{
+  NaClXMutexUnlock(&gnap->trusted_mu);
+}
+
+/* the thread will not receive the stop signal anymore */
+static void RemoveThread(struct UserThread *thread)
+{
+  struct UserThreads *ut = thread->nap->user_threads;
+
+  pthread_mutex_lock(&ut->lock);
+  ut->threads[thread->slot] = NULL;
+  pthread_mutex_unlock(&ut->lock);
+}
+
+/* set the stop flag of the job. must be called under trusted lock */
+static void SetStop(struct NaClApp *nap)
+{
+  *(volatile int32_t*)&nap->threads_stop = 1;
+  UserSyncStop(nap->user_sync);
+}
+
+/* stopped thread waits for the process end. the user code is not run */
+static NORETURN void Park()
+{
+  struct UserThreads *ut = gnap->user_threads;
+
+  if(nacl_user != NULL) RemoveThread((struct UserThread*)nacl_user);
+  __sync_fetch_and_add(&ut->parked, 1);
+  syscall(SYS_futex, &ut->parked, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL);
+  for(;;) pause();
+}
+
+/*
+ * the job is stopped. main thread leaves to the user exit point, others
+ * are parked. the trusted lock must not be held
+ */
+static NORETURN void UserThreadStopped()
+{
+  if(!is_secondary) longjmp(user_exit, gnap->exit_status);
+  Park();
+}
+
+/*
+ * the thread interrupted in the user code continues in UserThreadStopped()
+ * on the trusted stack as if it was called there. trusted code is not
+ * touched: it notices the stop flag itself (see UserThreadStopCheck)
+ */
+static void UserThreadSignal(int sig, siginfo_t *info, void *ctx)
+{
+  ucontext_t *uc = ctx;
+  struct NaClApp *nap = gnap;
+  uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+
+  UNREFERENCED_PARAMETER(sig);
+  UNREFERENCED_PARAMETER(info);
+  if(nap == NULL || nacl_sys == NULL || !nap->threads_stop) return;
+  if(pc < nap->mem_start || pc >= nap->mem_start + ((uintptr_t)1 << nap->addr_bits))
+    return;
+
+  NaClSignalContextRedirect(ctx, nacl_sys->rsp, UserThreadStopped);
+}
+
+/*
+ * the cpu hard limit is reached by threads not doing syscalls. the job
+ * is ended as by the syscall hook check: the stop flag is set (plain
+ * stores, safe here), the main thread is sent to the user exit point
+ */
+static void UserCpuSignal(int sig, siginfo_t *info, void *ctx)
+{
+  struct NaClApp *nap = gnap;
+
+  if(nap == NULL || nap->user_threads == NULL) return;
+  if(!nap->threads_stop) nap->exit_status = ERR_CODE;
+  SetStop(nap);
+  if(is_secondary) pthread_kill(nap->user_threads->main_thread, USER_THREAD_SIGNAL);
+  UserThreadSignal(sig, info, ctx);
+}
+
+void UserThreadStopCheck(struct NaClApp *nap)
+{
+  if(!*(volatile int32_t*)&nap->threads_stop) return;
+  TrustedUnlock();
+  UserThreadStopped();
+}
+
+void UserThreadsInit(struct NaClApp *nap)
+{
+  struct SetupList *policy;
+  struct sigaction sa;
+
+  if(nap->user_threads == NULL)
+  {
+    nap->user_threads = calloc(1, sizeof *nap->user_threads);
+    COND_ABORT(nap->user_threads == NULL, "cannot allocate user threads table\n");
+    pthread_mutex_init(&nap->user_threads->lock, NULL);
+  }
+  nap->user_threads->main_thread = pthread_self();
+
+  memset(&sa, 0, sizeof sa);
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = UserThreadSignal;
+  sa.sa_flags = SA_ONSTACK | SA_SIGINFO;
+  COND_ABORT(sigaction(USER_THREAD_SIGNAL, &sa, NULL) != 0,
+      "cannot set user threads signal\n");
+
+  if(nap->manifest == NULL) return;
+  policy = nap->manifest->user_setup;
+  COND_ABORT(policy->max_threads < 0 || policy->max_threads > USER_THREADS_LIMIT,
+      "invalid threads limit\n");
+  policy->cnt_threads = 1;
+
+  /*
+   * the threads table and the cpu hard limit belong to the process.
+   * sandboxes sharing the process are single threaded
+   */
+  if(nap->multi_tenant)
+  {
+    if(policy->max_threads > 1)
+      NaClLog(LOG_WARNING, "user threads are disabled in multi-tenant mode\n");
+    policy->max_threads = 0;
+    return;
+  }
+
+  /*
+   * cpu limit is checked on syscalls. threads spinning without syscalls
+   * are stopped a bit later by SIGXCPU (max_cpu is in milliseconds). the
+   * single threaded nexe does not need it: the process limit also counts
+   * zerovm startup, the syscalls check and the timeout are enough
+   */
+  if(policy->max_cpu > 0 && policy->max_threads > 1)
+  {
+    struct rlimit rl;
+
+    sa.sa_sigaction = UserCpuSignal;
+    COND_ABORT(sigaction(SIGXCPU, &sa, NULL) != 0, "cannot set cpu limit signal\n");
+    rl.rlim_cur = policy->max_cpu / 1000 + 2;
+    rl.rlim_max = rl.rlim_cur + 1;
+    if(setrlimit(RLIMIT_CPU, &rl) != 0)
+      NaClLog(LOG_ERROR, "cannot set cpu hard limit\n");
+  }
+}
+
+void UserThreadsFini(struct NaClApp *nap)
+{
+  if(nap->user_threads == NULL) return;
+  pthread_mutex_destroy(&nap->user_threads->lock);
+  free(nap->user_threads);
+  nap->user_threads = NULL;
+}
+
+/* set trusted stack of the thread and jump to the user code */
+static NORETURN void ThreadSwitchToApp(struct UserThread *thread)
+{
+  thread->sys.rbp = NaClGetStackPtr();
+  thread->sys.rsp = NaClGetStackPtr();
+  NaClSwitchToApp(thread->nap, thread->user.prog_ctr);
+}
+
+static void *UserThreadStart(void *arg)
+{
+  struct UserThread *thread = arg;
+  stack_t ss;
+
+  /* signals must not use the user stack */
+  ss.ss_sp = thread->signal_stack;
+  ss.ss_size = sizeof thread->signal_stack;
+  ss.ss_flags = 0;
+  if(sigaltstack(&ss, NULL) != 0)
+    NaClLog(LOG_ERROR, "cannot set signal stack for user thread\n");
+
+  is_secondary = 1;
+  gnap = thread->nap;
+  syscallback = thread->syscallback;
+  nacl_user = &thread->user;
+  nacl_sys = &thread->sys;
+  ThreadSwitchToApp(thread);
+
+  /* not reached */
+  return NULL;
+}
+
+int32_t UserThreadCreate(struct NaClApp *nap,
+    uintptr_t prog_ctr, uintptr_t stack_ptr, uintptr_t tls)
+{
+  struct UserThreads *ut = nap->user_threads;
+  struct SetupList *policy;
+  struct UserThread *thread;
+  pthread_attr_t attr;
+  uintptr_t sys_stack;
+  uintptr_t sys_tls = 0;
+  int slot;
+  int code;
+
+  /* threads must be allowed by manifest */
+  if(nap->manifest == NULL) return -NACL_ABI_EAGAIN;
+  policy = nap->manifest->user_setup;
+  if(policy->cnt_threads >= policy->max_threads) return -NACL_ABI_EAGAIN;
+  if(nap->threads_stop) return -NACL_ABI_EAGAIN;
+
+  /* entry point must be a bundle in the user code */
+  if(prog_ctr & (nap->bundle_size - 1)) return -NACL_ABI_EFAULT;
+  if(!(prog_ctr >= NACL_TRAMPOLINE_END && prog_ctr < nap->static_text_end)
+      && !(prog_ctr >= nap->dynamic_text_start && prog_ctr < nap->dynamic_text_end))
+    return -NACL_ABI_EFAULT;
+
+  sys_stack = NaClUserToSysAddr(nap, stack_ptr);
+  if(sys_stack == kNaClBadAddress) return -NACL_ABI_EFAULT;
+  if(tls != 0)
+  {
+    sys_tls = NaClUserToSysAddrRange(nap, tls, 4);
+    if(sys_tls == kNaClBadAddress) return -NACL_ABI_EFAULT;
+  }
+
+  thread = malloc(sizeof *thread);
+  if(thread == NULL) return -NACL_ABI_ENOMEM;
+  NaClThreadContextCtor(&thread->user, nap, prog_ctr,
+      NaClSysToUserStackAddr(nap, sys_stack), 0);
+  thread->user.sysret = 0;
+  thread->user.tls_base = (void*)sys_tls;
+  thread->nap = nap;
+  thread->syscallback = syscallback;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, USER_THREAD_STACK);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  /* the thread cannot leave the slot until the lock is released */
+  pthread_mutex_lock(&ut->lock);
+  for(slot = 0; slot < USER_THREADS_LIMIT && ut->threads[slot] != NULL; ++slot);
+  code = slot < USER_THREADS_LIMIT
+      ? pthread_create(&thread->id, &attr, UserThreadStart, thread) : -1;
+  if(code == 0)
+  {
+    thread->slot = slot;
+    ut->threads[slot] = thread;
+  }
+  pthread_mutex_unlock(&ut->lock);
+  pthread_attr_destroy(&attr);
+
+  if(code != 0)
+  {
+    free(thread);
+    return -NACL_ABI_EAGAIN;
+  }
+
+  ++policy->cnt_threads;
+  __sync_fetch_and_add(&ut->secondary, 1);
+  ResumeCpuClock(nap); /* the new thread runs the user code */
+  return 0;
+}
+
+NORETURN void UserThreadExit(struct NaClApp *nap, uintptr_t stack_flag)
+{
+  struct UserThread *thread = (struct UserThread*)nacl_user;
+  struct UserThreads *ut = nap->user_threads;
+  int32_t *flag = NULL;
+  stack_t ss;
+
+  if(stack_flag != 0)
+  {
+    uintptr_t sys_flag = NaClUserToSysAddrRange(nap, stack_flag, 4);
+    if(sys_flag != kNaClBadAddress) flag = (int32_t*)sys_flag;
+  }
+  if(nap->manifest) --nap->manifest->user_setup->cnt_threads;
+
+  /* the main thread waits for the others and ends the job */
+  if(!is_secondary)
+  {
+    int32_t n;
+
+    if(flag != NULL) *flag = 0;
+    TrustedUnlock();
+    while((n = *(volatile int32_t*)&ut->secondary) > 0
+        && !*(volatile int32_t*)&nap->threads_stop)
+      syscall(SYS_futex, &ut->secondary, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, n, NULL);
+    TrustedLock();
+    UserJobExit(nap, 0);
+  }
+
+  RemoveThread(thread);
+  memset(&ss, 0, sizeof ss);
+  ss.ss_flags = SS_DISABLE;
+  sigaltstack(&ss, NULL);
+  nacl_user = NULL;
+  nacl_sys = NULL;
+  free(thread);
+
+  /* the user stack is not used anymore */
+  if(flag != NULL) *flag = 0;
+  TrustedUnlock();
+
+  if(__sync_sub_and_fetch(&ut->secondary, 1) == 0)
+    syscall(SYS_futex, &ut->secondary, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL);
+  pthread_exit(NULL);
+}
+
+NORETURN void UserJobExit(struct NaClApp *nap, int32_t code)
+{
+  NaClLog(1, "Exit syscall handler: %d\n", code);
+
+  /* the first exit gives the job code */
+  if(!nap->threads_stop) nap->exit_status = code;
+  SetStop(nap);
+  TrustedUnlock();
+  if(!is_secondary) longjmp(user_exit, nap->exit_status);
+
+  /* pass the exit to the main thread */
+  pthread_kill(nap->user_threads->main_thread, USER_THREAD_SIGNAL);
+  Park();
+}
+
+void UserThreadsStop()
+{
+  struct UserThreads *ut = gnap->user_threads;
+  struct timespec wait = {0, USER_THREADS_STOP_WAIT};
+  int32_t n;
+  int i, j;
+
+  if(ut == NULL) return;
+  TrustedLock();
+  SetStop(gnap);
+  TrustedUnlock();
+
+  /*
+   * the signal can come when the thread is about to enter the user code
+   * and did not see the flag. it is repeated until all threads are parked
+   */
+  for(i = 1; (n = *(volatile int32_t*)&ut->parked) < *(volatile int32_t*)&ut->secondary; ++i)
+  {
+    pthread_mutex_lock(&ut->lock);
+    for(j = 0; j < USER_THREADS_LIMIT; ++j)
+      if(ut->threads[j] != NULL) pthread_kill(ut->threads[j]->id, USER_THREAD_SIGNAL);
+    pthread_mutex_unlock(&ut->lock);
+
+    syscall(SYS_futex, &ut->parked, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, n, &wait);
+    if(i % (1000000000 / USER_THREADS_STOP_WAIT) == 0)
+      NaClLog(LOG_WARNING, "%d user threads are still running\n",
+          *(volatile int32_t*)&ut->secondary - *(volatile int32_t*)&ut->parked);
+  }
+}
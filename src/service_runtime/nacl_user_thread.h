@@ -0,0 +1,87 @@
+/*
+ * user threads. each thread has own registers, trusted stack and tls.
+ * the trusted side (syscalls, traps, accounting) is serialized by the
+ * trusted lock, user code of the threads runs in parallel
+ *
+ *  Created on: May 8, 2012
+ *      Author: d'b
+ */
+
+#ifndef NACL_USER_THREAD_H_
+#define NACL_USER_THREAD_H_
+
+#include "include/nacl_base.h"
+#include "src/service_runtime/sel_ldr.h"
+
+EXTERN_C_BEGIN
+
+/* trusted stack size of the user thread */
+#define USER_THREAD_STACK 0x200000
+
+/* signal stack size of the user thread */
+#define USER_THREAD_SIGNAL_STACK 0x10000
+
+/* sanity limit for "ThreadsMax" */
+#define USER_THREADS_LIMIT 1024
+
+/* the stop signal is repeated with this interval (nanoseconds) */
+#define USER_THREADS_STOP_WAIT 10000000
+
+/*
+ * serialize the trusted side. must be held while syscall is handled
+ * note: syscalls which can block (futex waits) must release it
+ */
+void TrustedLock();
+void TrustedUnlock();
+
+/*
+ * must be called from the main thread before the nexe start. allocates
+ * the threads table of the job, sets the main thread, the thread stop
+ * signal and the cpu hard limit
+ */
+void UserThreadsInit(struct NaClApp *nap);
+
+/* free the threads table of the finished job (see NaClAppDtor()) */
+void UserThreadsFini(struct NaClApp *nap);
+
+/*
+ * start new user thread from "prog_ctr" with "stack_ptr" and "tls"
+ * (user addresses). return 0 if successful, otherwise negative error
+ * note: syscallback of the caller is inherited by the new thread
+ * note: must be called under trusted lock
+ */
+int32_t UserThreadCreate(struct NaClApp *nap,
+    uintptr_t prog_ctr, uintptr_t stack_ptr, uintptr_t tls);
+
+/*
+ * finish the calling user thread. "stack_flag" (user address or 0) will
+ * be zeroed when the thread stack is not used anymore. if the main thread
+ * exits the job ends when all other threads are finished
+ * note: must be called under trusted lock
+ */
+NORETURN void UserThreadExit(struct NaClApp *nap, uintptr_t stack_flag);
+
+/*
+ * finish the whole job with the given code. can be called from any
+ * user thread. control will be passed to the main thread exit point
+ * note: must be called under trusted lock. the lock is released
+ */
+NORETURN void UserJobExit(struct NaClApp *nap, int32_t code);
+
+/*
+ * leave if the job is stopped: the main thread goes to the exit point,
+ * others are parked. must be called under trusted lock, the lock is
+ * released if the thread leaves
+ */
+void UserThreadStopCheck(struct NaClApp *nap);
+
+/*
+ * park all user threads except the caller. must be called by the main
+ * thread before the user memory and channels are released. returns when
+ * all threads are parked or finished
+ */
+void UserThreadsStop();
+
+EXTERN_C_END
+
+#endif /* NACL_USER_THREAD_H_ */
@@ -8,6 +8,7 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#include "src/platform/nacl_check.h"
 #include "src/platform/nacl_exit.h"
 #include "src/service_runtime/nacl_signal.h"
 #include "src/service_runtime/sel_ldr.h"
@@ -72,6 +73,49 @@ int NaClSignalStackAllocate(void **result) {
   return 1;
 }
 
+void NaClSignalStackFree(void *stack) {
+  CHECK(stack != NULL);
+  if (munmap(stack, SIGNAL_STACK_SIZE + STACK_GUARD_SIZE) != 0) {
+    NaClLog(LOG_FATAL, "Failed to munmap() signal stack:\n\t%s\n",
+      strerror(errno));
+  }
+}
+
+void NaClSignalStackRegister(void *stack) {
+  /*
+   * If we set up signal handlers, we must ensure that any thread that
+   * runs untrusted code has an alternate signal stack set up.  The
+   * default for a new thread is to use the stack pointer from the
+   * point at which the fault occurs, but it would not be safe to use
+   * untrusted code's %esp/%rsp value.
+   */
+  stack_t st;
+  st.ss_size = SIGNAL_STACK_SIZE;
+  st.ss_sp = ((uint8_t *) stack) + STACK_GUARD_SIZE;
+  st.ss_flags = 0;
+  if (sigaltstack(&st, NULL) != 0) {
+    NaClLog(LOG_FATAL, "Failed to register signal stack:\n\t%s\n",
+      strerror(errno));
+  }
+}
+
+void NaClSignalStackUnregister(void) {
+  /*
+   * Unregister the signal stack in case a fault occurs between the
+   * thread deallocating the signal stack and exiting.  Such a fault
+   * could be a security hole, because the kernel would use the
+   * unmapped (or reused) memory as the signal stack.
+   */
+  stack_t st;
+  st.ss_size = 0;
+  st.ss_sp = NULL;
+  st.ss_flags = SS_DISABLE;
+  if (sigaltstack(&st, NULL) != 0) {
+    NaClLog(LOG_FATAL, "Failed to unregister signal stack:\n\t%s\n",
+      strerror(errno));
+  }
+}
+
 static void FindAndRunHandler(int sig, siginfo_t *info, void *uc) {
   if (NaClSignalHandlerFind(sig, uc) == NACL_SIGNAL_SEARCH) {
     int a;
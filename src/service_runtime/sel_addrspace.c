@@ -82,6 +82,13 @@ NaClErrorCode NaClAllocAddrSpace(struct NaClApp *nap) {
   return LOAD_OK;
 }
 
+void NaClFreeAddrSpace(struct NaClApp *nap) {
+  if (0 == nap->mem_start) return;
+  NaClLog(2, "releasing memory at 0x%08"NACL_PRIxPTR"\n", nap->mem_start);
+  NaClFreeSpace((void *) nap->mem_start, (size_t) 1 << nap->addr_bits);
+  nap->mem_start = 0;
+}
+
 /*
  * Apply memory protection to memory regions.
  */
@@ -17,6 +17,12 @@ struct NaClApp; /* fwd */
 
 NaClErrorCode NaClAllocAddrSpace(struct NaClApp *nap) NACL_WUR;
 
+/*
+ * d'b: release the whole address space of the module (guards included).
+ * allows many modules to be loaded one after another by one process
+ */
+void NaClFreeAddrSpace(struct NaClApp *nap);
+
 /*
  * Apply memory protection to memory regions.
  */
@@ -41,5 +47,8 @@ NaClErrorCode NaClMemoryProtection(struct NaClApp *nap) NACL_WUR;
  */
 NaClErrorCode NaClAllocateSpace(void **mem, size_t addrsp_size) NACL_WUR;
 
+/* d'b: counterpart of NaClAllocateSpace() */
+void NaClFreeSpace(void *mem, size_t addrsp_size);
+
 NaClErrorCode NaClMprotectGuards(struct NaClApp *nap);
 #endif
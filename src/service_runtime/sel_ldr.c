@@ -11,11 +11,22 @@
  */
 #include "src/platform/nacl_check.h"
 #include "src/platform/nacl_sync_checked.h"
+#include "src/desc/nacl_desc_base.h"
+#include "src/desc/nacl_desc_imc_shm.h"
 #include "src/gio/gio_shm.h"
 #include "src/service_runtime/arch/x86/sel_ldr_x86.h"
 #include "src/service_runtime/nacl_globals.h"
 #include "src/service_runtime/nacl_syscall_handlers.h"
 #include "src/service_runtime/nacl_desc_effector_ldr.h"
+#include "src/service_runtime/nacl_signal.h"
+#include "src/service_runtime/nacl_user_sync.h"
+#include "src/service_runtime/nacl_user_thread.h"
+#include "src/service_runtime/nacl_syscall_profile.h"
+#include "src/manifest/mem_release.h"
+#include "src/manifest/lazy_map.h"
+#include "api/zvm.h"
+#include "src/service_runtime/sel_addrspace.h"
+#include "src/service_runtime/sel_memory.h"
 
 static int IsEnvironmentVariableSet(char const *env_name) {
   return NULL != getenv(env_name);
@@ -104,6 +115,7 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
   }
 
   nap->syscall_table = table;
+  memset(nap->syscall_counts, 0, sizeof nap->syscall_counts);
 
   nap->module_load_status = LOAD_STATUS_UNKNOWN;
   nap->module_may_start = 0;  /* only when secure_service != NULL */
@@ -111,6 +123,7 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
   nap->ignore_validator_result = 0;
   nap->skip_validator = 0;
   nap->validator_stub_out_mode = 0;
+  nap->validation_time = 0;
 
   if (!NaClMutexCtor(&nap->threads_mu)) {
     goto cleanup_cv;
@@ -122,6 +135,26 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
     goto cleanup_threads_cv;
   }
 
+  /* d'b: sandbox own state */
+  if (!NaClMutexCtor(&nap->trusted_mu)) {
+    goto cleanup_desc_mu;
+  }
+  nap->user_sync = UserSyncCtor();
+  if (NULL == nap->user_sync) {
+    goto cleanup_trusted_mu;
+  }
+  nap->user_threads = NULL;
+  nap->cpu_clock_users = 0;
+  nap->cpu_clock = 0;
+  nap->cpu_clock_last = 0;
+  nap->threads_stop = 0;
+  nap->readahead = NULL;
+  nap->journal = NULL;
+  nap->syscall_profile = NULL;
+  nap->mem_release = NULL;
+  nap->lazy_maps = NULL;
+  nap->signal_stack = NULL;
+
   nap->exit_status = -1;
 
   nap->enable_debug_stub = 0;
@@ -129,6 +162,10 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
 
   return 1;
 
+ cleanup_trusted_mu:
+  NaClMutexDtor(&nap->trusted_mu);
+ cleanup_desc_mu:
+  NaClMutexDtor(&nap->desc_mu);
  cleanup_threads_cv:
   NaClCondVarDtor(&nap->threads_cv);
  cleanup_threads_mu:
@@ -157,6 +194,85 @@ int NaClAppCtor(struct NaClApp *nap) {
   return NaClAppWithSyscallTableCtor(nap, nacl_syscall);
 }
 
+/*
+ * d'b: release resources of the finished module, the address space
+ * included. the manifest is not touched
+ */
+/*
+ * d'b: the failed job can leave holding its locks (see NaClJobAbort()).
+ * the job is single threaded, the holder can only be the caller
+ */
+static void NaClMutexRelease(struct NaClMutex *mp) {
+  (void) NaClMutexTryLock(mp);
+  NaClXMutexUnlock(mp);
+  NaClMutexDtor(mp);
+}
+
+void NaClAppDtor(struct NaClApp *nap) {
+  UserThreadsFini(nap);
+  UserSyncDtor(nap->user_sync);
+  nap->user_sync = NULL;
+  NaClMutexRelease(&nap->trusted_mu);
+  NaClMutexRelease(&nap->desc_mu);
+  NaClCondVarDtor(&nap->threads_cv);
+  NaClMutexRelease(&nap->threads_mu);
+  NaClCondVarDtor(&nap->cv);
+  NaClMutexRelease(&nap->mu);
+  NaClMutexRelease(&nap->dynamic_load_mutex);
+  (*nap->effp->vtbl->Dtor)(nap->effp);
+  free(nap->effp);
+  NaClVmmapDtor(&nap->mem_map);
+  DynArrayDtor(&nap->desc_tbl);
+  DynArrayDtor(&nap->threads);
+
+  free(nap->readahead);
+  nap->readahead = NULL;
+  SyscallProfileDtor(nap->syscall_profile);
+  nap->syscall_profile = NULL;
+  MemReleaseDtor(nap->mem_release);
+  nap->mem_release = NULL;
+  if (NULL != nap->lazy_maps) {
+    int i;
+    for (i = 0; i < CHANNELS_COUNT; ++i) LazyMapDtor(nap->lazy_maps[i]);
+    free(nap->lazy_maps);
+    nap->lazy_maps = NULL;
+  }
+  free(nap->dynamic_page_bitmap);
+  free(nap->dynamic_regions);
+  /* d'b: the stack was registered by this thread (see SwitchToApp()) */
+  if (NULL != nap->signal_stack) {
+    NaClSignalStackUnregister();
+    NaClSignalStackFree(nap->signal_stack);
+  }
+  nap->signal_stack = NULL;
+#if (NACL_ARCH(NACL_BUILD_ARCH) == NACL_x86 \
+     && NACL_BUILD_SUBARCH == 64)
+  if (0 != nap->dispatch_thunk) {
+    NaCl_page_free((void *) nap->dispatch_thunk, NACL_MAP_PAGESIZE);
+    nap->dispatch_thunk = 0;
+  }
+#endif
+  NaClFreeAddrSpace(nap);
+
+  /* d'b: nothing maps the dynamic text anymore, the next job can reuse it */
+  NaCl_page_free((void *) nap->dynamic_mapcache_ret,
+                 nap->dynamic_mapcache_size);
+  nap->dynamic_mapcache_size = 0;
+  nap->dynamic_mapcache_ret = 0;
+  if (NULL != nap->text_shm) {
+    NaClDescImcShmRecycle((struct NaClDescImcShm *) nap->text_shm);
+    NaClDescUnref(nap->text_shm);
+  }
+  nap->text_shm = NULL;
+}
+
+void NaClJobAbort(int code) {
+  if (NULL != gnap && NULL != gnap->job_abort) {
+    siglongjmp(*gnap->job_abort, code);
+  }
+  exit(code);
+}
+
 /*
  * unaligned little-endian load.  precondition: nbytes should never be
  * more than 8.
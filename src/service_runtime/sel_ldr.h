@@ -28,9 +28,12 @@
 #ifndef NATIVE_CLIENT_SRC_TRUSTED_SERVICE_RUNTIME_SEL_LDR_H_
 #define NATIVE_CLIENT_SRC_TRUSTED_SERVICE_RUNTIME_SEL_LDR_H_ 1
 
+#include <setjmp.h>
+#include <sys/resource.h>
 #include "include/elf.h"
 #include "src/platform/nacl_log.h"
 #include "src/service_runtime/dyn_array.h"
+#include "src/service_runtime/include/bits/nacl_syscalls.h"
 #include "src/service_runtime/nacl_error_code.h"
 
 #include "src/service_runtime/sel_mem.h"
@@ -59,6 +62,13 @@ struct NaClManifestProxy;
 struct NaClSecureService;
 struct NaClSecureReverseService;
 struct NaClThreadInterface;  /* see sel_ldr_thread_interface.h */
+struct UserSyncTable;  /* see nacl_user_sync.h */
+struct UserThreads;  /* see nacl_user_thread.c */
+struct ChannelReadahead;  /* see src/manifest/readahead.c */
+struct TrapJournal;  /* see src/manifest/trap_journal.c */
+struct SyscallProfile;  /* see nacl_syscall_profile.c */
+struct MemRelease;  /* see src/manifest/mem_release.c */
+struct LazyMap;  /* see src/manifest/lazy_map.c */
 
 struct NaClDebugCallbacks {
   void (*thread_create_hook)(struct NaClAppThread *natp);
@@ -152,6 +162,7 @@ struct NaClApp {
    * at least NACL_MAX_SYSCALLS.
    */
   struct NaClSyscallTableEntry *syscall_table;
+  uint32_t                  syscall_counts[NACL_MAX_SYSCALLS]; /* d'b: for the report */
 
   NaClErrorCode             module_load_status;
   int                       module_may_start;
@@ -220,6 +231,7 @@ struct NaClApp {
   int                       ignore_validator_result;
   int                       skip_validator;
   int                       validator_stub_out_mode;
+  int64_t                   validation_time; /* d'b: microseconds, for benchmarks */
 
 #if NACL_ARCH(NACL_BUILD_ARCH) == NACL_x86 && NACL_BUILD_SUBARCH == 32
   uint16_t                  code_seg_sel;
@@ -264,6 +276,23 @@ struct NaClApp {
   uintptr_t                 *syscall_args;
   uint32_t                  sysret; /* syscall return code */
   uintptr_t                 sys_tls;  /* only need for nexe prolog */
+
+  /* d'b: sandbox state which cannot be shared with other sandboxes of the process */
+  int                       multi_tenant; /* the process hosts other sandboxes too */
+  sigjmp_buf                *job_abort; /* failed job leaves here, NULL - the process ends */
+  struct rusage             job_usage; /* resources at the job start, zero - whole process */
+  struct NaClMutex          trusted_mu; /* serializes trusted side of user threads */
+  int32_t                   cpu_clock_users; /* user threads running the user code */
+  int64_t                   cpu_clock; /* cpu time of the user code in clock() ticks */
+  int64_t                   cpu_clock_last; /* clock() when the counting resumed */
+  int32_t                   threads_stop; /* the job ends, user threads must stop */
+  struct UserSyncTable      *user_sync; /* mutexes, conditions, semaphores of user threads */
+  struct UserThreads        *user_threads; /* threads of the job except main */
+  struct ChannelReadahead   *readahead; /* page cache state of channels (see readahead.c) */
+  struct TrapJournal        *journal; /* trap record/replay, NULL - disabled */
+  struct SyscallProfile     *syscall_profile; /* NULL - syscalls are not profiled */
+  struct MemRelease         *mem_release; /* freed user memory, NULL - not whole chunk */
+  struct LazyMap            **lazy_maps; /* by channel type, NULL - no lazy channels */
   /* d'b end */
 };
 
@@ -284,6 +313,18 @@ int NaClAppWithSyscallTableCtor(struct NaClApp               *nap,
 
 int   NaClAppCtor(struct NaClApp  *nap) NACL_WUR;
 
+/*
+ * d'b: counterpart of NaClAppCtor(). releases the module address space
+ */
+void  NaClAppDtor(struct NaClApp  *nap);
+
+/*
+ * d'b: end the failed job with "code". the batch job (see sel_main.c)
+ * leaves to its abort point and the process goes on, otherwise the
+ * process exits. the job state is released by NaClAppDtor()
+ */
+NORETURN void NaClJobAbort(int code);
+
 /*
  * Loads a NaCl ELF file into memory in preparation for running it.
  *
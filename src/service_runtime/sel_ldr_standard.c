@@ -40,7 +40,10 @@ NORETURN void SwitchToApp(struct NaClApp  *nap, uintptr_t stack_ptr)
   /* construct "nacl_user" global */
   NaClThreadContextCtor(nacl_user, nap, nap->initial_entry_pt,
                         NaClSysToUserStackAddr(nap, stack_ptr), 0);
-  assert(NaClSignalStackAllocate(&nap->signal_stack));
+  /* d'b: signals of the main thread must not use the user stack */
+  if(nap->signal_stack == NULL && !NaClSignalStackAllocate(&nap->signal_stack))
+    NaClLog(LOG_FATAL, "cannot allocate signal stack\n");
+  NaClSignalStackRegister(nap->signal_stack);
   nacl_user->sysret = nap->break_addr;
   nacl_user->prog_ctr = NaClUserToSys(nap, nap->initial_entry_pt);
   nacl_user->new_prog_ctr = NaClUserToSys(nap, nap->initial_entry_pt);
@@ -380,7 +383,7 @@ NaClErrorCode NaClAppLoadFile(struct Gio       *gp,
   subret = NaClValidateImage(nap);
   NaClPerfCounterMark(&time_load_file,
                       NACL_PERF_IMPORTANT_PREFIX "ValidateImg");
-  NaClPerfCounterIntervalLast(&time_load_file);
+  nap->validation_time = NaClPerfCounterIntervalLast(&time_load_file);
   if (LOAD_OK != subret) {
     ret = subret;
     goto done;
@@ -10,12 +10,18 @@
  * todo: imc related stuff marked for removal
  */
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include <setjmp.h> /* d'b: need for trap() exit */
+#include <sys/resource.h>
+#include <sys/time.h>
 
 #include "include/portability_io.h"
 #include "src/gio/gio.h"
 #include "src/platform/nacl_exit.h"
+#include "src/platform/nacl_log_intern.h"
 #include "src/fault_injection/fault_injection.h"
+#include "src/imc/nacl_imc_c.h"
 #include "src/perf_counter/nacl_perf_counter.h"
 #include "src/service_runtime/nacl_all_modules.h"
 #include "src/service_runtime/nacl_globals.h"
@@ -25,6 +31,10 @@
 #include "src/manifest/manifest_setup.h" /* d'b */
 #include "src/manifest/trap.h" /* d'b */
 #include "src/manifest/mount_channel.h" /* d'b */
+#include "src/manifest/trap_journal.h" /* d'b */
+#include "src/manifest/manifest_binary.h" /* d'b */
+#include "src/service_runtime/nacl_syscall_profile.h" /* d'b */
+#include "src/service_runtime/nacl_user_thread.h" /* d'b */
 #include "src/service_runtime/sel_qualify.h"
 
 /*YaroslavLitvinov*/
@@ -53,6 +63,22 @@ struct redir {
   } u;
 };
 
+/* d'b: batch mode. list of manifests and amount of sandboxes run in parallel */
+#define BATCH_WORKERS_MAX 256
+#define MEMORY_POOL_MAX 64 /* nacl::kMemoryObjectPoolMax */
+static char *batch_name = NULL;
+static int batch_workers = 1;
+
+/* d'b: file for the startup/teardown timings (json), NULL - disabled */
+static char *perf_name = NULL;
+
+/* d'b: trap journal to record or to replay, NULL - disabled */
+static char *journal_name = NULL;
+static enum JournalMode journal_mode = JournalRecord;
+
+/* d'b: platform qualification time (microseconds). 0 in batch mode */
+static int64_t qualify_time = 0;
+
 static void VmentryPrinter(void *state, struct NaClVmmapEntry *vmep)
 {
   UNREFERENCED_PARAMETER(state);
@@ -88,7 +114,8 @@ static void PrintUsage() {
   /* NOTE: this is broken up into multiple statements to work around
            the constant string size limit */
   fprintf(stderr,
-          "Usage: sel_ldr [-M manifest_file] [-h d:D] [-r d:D]\n"
+          "Usage: sel_ldr [-M manifest_file | -B manifests_list [-j n]]\n"
+          "               [-h d:D] [-r d:D]\n"
           "               [-w d:D] [-i d:D] [-v d] [-cFgIsQZD]\n\n"
           " -h\n"
           " -r\n"
@@ -107,11 +134,79 @@ static void PrintUsage() {
           " -s safely stub out non-validating instructions\n"
           " -Q disable platform qualification (dangerous!)\n"
 		      " -M <file> load settings from manifest\n"
+          " -B <file> run jobs from the list of manifests (\"-\" - stdin)\n"
+          " -j <n> amount of jobs run in parallel in batch mode\n"
+          " -p <file> write job timings to the file (json)\n"
+          " -t <file> record channel i/o traps to the journal\n"
+          " -T <file> replay the journal instead of channel i/o\n"
           " -Z use fixed feature x86 CPU mode\n"
           " -D enable the UNSTABLE dfa validator\n"
           );  /* easier to add new flags/lines */
 }
 
+/*
+ * d'b: parse manifest, initialize user/system policies and nexe command line
+ * return 0 if success, non-zero error code if failed
+ */
+static int LoadManifest(struct NaClApp *nap, const char *name)
+{
+  int32_t size;
+  int nexe_argc = 1;
+  char **nexe_argv;
+  char *cmd_line;
+  char *saveptr;
+
+  if(!parse_manifest(name, nap))
+  {
+    fprintf(stderr, "Invalid manifest file \"%s\".\n", name);
+    return ERR_CODE;
+  }
+
+  /* initialize user policy, zerovm settings */
+  SetupUserPolicy(nap);
+  SetupSystemPolicy(nap);
+
+  /* construct nexe command line from manifest (add nexe name as argv[0]) */
+  COND_ABORT(!(nexe_argv = malloc(128 * sizeof(char*))),
+      "cannot allocate memory for nexe command line\n");
+  nexe_argv[0] = "_";
+  if(nap->manifest->binary != NULL)
+    nexe_argc += BinaryCommandLine(nap->manifest->binary, nexe_argv + 1);
+  else
+  {
+    cmd_line = get_value_by_key(nap, "CommandLine");
+    nexe_argv[nexe_argc] = cmd_line ? strtok_r(cmd_line, " \t", &saveptr) : NULL;
+    while(nexe_argv[nexe_argc])
+      nexe_argv[++nexe_argc] = strtok_r(NULL, " \t", &saveptr);
+  }
+  nap->manifest->system_setup->cmd_line = nexe_argv;
+  nap->manifest->system_setup->cmd_line_size = nexe_argc;
+
+  /* check for limits given in manifest */
+  if(nap->manifest->system_setup->version == NULL
+      || strcmp(nap->manifest->system_setup->version, MANIFEST_VERSION))
+  {
+    fprintf(stderr, "%s: wrong manifest version\n", name);
+    return ERR_CODE;
+  }
+  if(NULL == nap->manifest->system_setup->nexe)
+  {
+    fprintf(stderr, "%s: nexe is not specified\n", name);
+    return ERR_CODE;
+  }
+  if((size = GetFileSize(nap->manifest->system_setup->nexe)) < 0)
+  {
+    fprintf(stderr, "%s not found\n", nap->manifest->system_setup->nexe);
+    return ERR_CODE;
+  }
+  if(nap->manifest->system_setup->nexe_max && nap->manifest->system_setup->nexe_max < size)
+  {
+    fprintf(stderr, "%s: nexe file is greater then alowed\n", name);
+    return ERR_CODE;
+  }
+  return OK_CODE;
+}
+
 /*
  * parse given command line and initialize NaClApp object
  * return 0 if success, non-zero error code if failed
@@ -122,8 +217,6 @@ int ParseCommandLine(int argc, char **argv, struct NaClApp *nap)
   struct redir *entry;
   char *rest;
   int i;
-  int nexe_argc = 1;
-  char **nexe_argv;
   char *manifest_name = NULL;
   int debug_mode_ignore_validator = 0;
   int enable_debug_stub = 0;
@@ -139,13 +232,32 @@ int ParseCommandLine(int argc, char **argv, struct NaClApp *nap)
   nap->manifest = 0;
 
   /* note: in a future zerovm command line will be reduced */
-  while((opt = getopt(argc, argv, "+cFgh:i:Il:QDZr:sSv:w:X:M:")) != -1)
+  while((opt = getopt(argc, argv, "+cFgh:i:Il:QDZr:sSv:w:X:M:B:j:p:t:T:")) != -1)
   {
     switch(opt)
     {
       case 'M':
         manifest_name = optarg;
         break;
+      case 'B':
+        batch_name = optarg;
+        break;
+      case 'j':
+        batch_workers = atoi(optarg);
+        if(batch_workers < 1 || batch_workers > BATCH_WORKERS_MAX)
+        {
+          fprintf(stderr, "invalid amount of batch workers\n");
+          return ERR_CODE;
+        }
+        break;
+      case 'p':
+        perf_name = optarg;
+        break;
+      case 't':
+      case 'T':
+        journal_name = optarg;
+        journal_mode = opt == 't' ? JournalRecord : JournalReplay;
+        break;
       case 'c':
         ++debug_mode_ignore_validator;
         break;
@@ -238,43 +350,21 @@ int ParseCommandLine(int argc, char **argv, struct NaClApp *nap)
   }
 
   /* process manifest file specified in cmdline */
-  if (manifest_name != NULL)
+  if(manifest_name != NULL && batch_name != NULL)
   {
-    int32_t size;
-    if(!parse_manifest(manifest_name, nap))
-    {
-      fprintf(stderr, "Invalid manifest file \"%s\".\n", manifest_name);
-      return ERR_CODE;
-    }
-
-    /* initialize user policy, zerovm settings */
-    SetupUserPolicy(nap);
-    SetupSystemPolicy(nap);
-
-    /* construct nexe command line from manifest (add nexe name as argv[0]) */
-    COND_ABORT(!(nexe_argv = malloc(128 * sizeof(char*))),
-        "cannot allocate memory for nexe command line\n");
-    nexe_argv[0] = "_";
-    nexe_argv[nexe_argc] = strtok(get_value_by_key(nap, "CommandLine"), " \t");
-    while(nexe_argv[nexe_argc])
-      nexe_argv[++nexe_argc] = strtok(NULL, " \t");
-    nap->manifest->system_setup->cmd_line = nexe_argv;
-    nap->manifest->system_setup->cmd_line_size = nexe_argc;
-
-    /* check for limits given in manifest */
-    COND_ABORT(nap->manifest->system_setup->version == NULL,
-        "manifest version is not provided\n");
-    COND_ABORT(strcmp(nap->manifest->system_setup->version, MANIFEST_VERSION),
-        "wrong manifest version\n");
-    if((size = GetFileSize(nap->manifest->system_setup->nexe)) < 0)
-    {
-      fprintf(stderr, "%s not found\n", nap->manifest->system_setup->nexe);
-      return ERR_CODE;
-    }
-    if(nap->manifest->system_setup->nexe_max)
-      COND_ABORT(nap->manifest->system_setup->nexe_max < size, "nexe file is greater then alowed\n");
+    fprintf(stderr, "manifest and batch cannot be used together\n");
+    return ERR_CODE;
+  }
+  if(journal_name != NULL && batch_name != NULL)
+  {
+    fprintf(stderr, "trap journal cannot be used in batch mode\n");
+    return ERR_CODE;
+  }
+  if(manifest_name != NULL)
+  {
+    if(LoadManifest(nap, manifest_name)) return ERR_CODE;
   }
-  else /* manifest file is not provided */
+  else if(batch_name == NULL) /* nor manifest nor batch provided */
   {
     PrintUsage();
     return ERR_CODE;
@@ -284,100 +374,156 @@ int ParseCommandLine(int argc, char **argv, struct NaClApp *nap)
   nap->skip_validator = (debug_mode_ignore_validator > 1);
   nap->validator_stub_out_mode = stub_out_mode;
   nap->enable_debug_stub = enable_debug_stub;
+  nap->multi_tenant = 0;
+  nap->job_abort = NULL;
+  return OK_CODE;
+}
 
-  /* check if nexe is given */
-  if(NULL == nap->manifest->system_setup->nexe)
+/* d'b: return index of the named mark or the last one if not found */
+static uint32_t PerfMark(struct NaClPerfCounter *pc, const char *name)
+{
+  uint32_t i;
+  for(i = 0; i < pc->samples; ++i)
+    if(strcmp(pc->sample_names[i], name) == 0) return i;
+  return pc->samples - 1;
+}
+
+/* d'b: time between two named marks, 0 if any of them is absent */
+static int64_t PerfSpan(struct NaClPerfCounter *pc, const char *from, const char *to)
+{
+  uint32_t i, a = 0, b = 0;
+
+  for(i = 0; i < pc->samples; ++i)
   {
-    PrintUsage();
-    return ERR_CODE;
+    if(strcmp(pc->sample_names[i], from) == 0) a = i;
+    if(strcmp(pc->sample_names[i], to) == 0) b = i;
   }
-  return OK_CODE;
+  return b > a ? NaClPerfCounterInterval(pc, a, b) : 0;
 }
 
-int main(int argc, char **argv)
+/* d'b: write the syscalls profile to the file given in manifest */
+static void WriteSyscallProfile(struct NaClApp *nap)
 {
-  struct NaClApp                state, *nap = &state;
-  NaClErrorCode                 errcode = LOAD_INTERNAL;
-  struct GioFile                gout;
-  struct GioFile                *log_gio;
+  char *name = nap->manifest->system_setup->syscall_profile;
+  FILE *f;
+
+  if(nap->syscall_profile == NULL) return;
+  if((f = fopen(name, "w")) == NULL)
+  {
+    NaClLog(LOG_ERROR, "cannot open syscalls profile %s\n", name);
+    return;
+  }
+  if(SyscallProfileWrite(nap->syscall_profile, f) != 0 || fclose(f) != 0)
+    NaClLog(LOG_ERROR, "cannot write syscalls profile %s\n", name);
+}
+
+/*
+ * d'b: tell the orchestrator the job is over (the report is synced) before
+ * the process exit. the exit unmaps the sandbox and the guard regions,
+ * for the large dirty memory it takes long. the zerovm return code is
+ * written to the pipe given in manifest, then the pipe is closed
+ */
+static void SignalDone(struct NaClApp *nap, int ret_code)
+{
+  char line[16];
+  int fd;
+  int len;
+
+  if(nap->manifest == NULL || nap->multi_tenant) return;
+  if((fd = nap->manifest->system_setup->done_fd) <= 0) return;
+
+  len = snprintf(line, sizeof line, "%d\n", ret_code);
+  if(write(fd, line, len) != len)
+    NaClLog(LOG_ERROR, "cannot signal the job end to descriptor %d\n", fd);
+  close(fd);
+  nap->manifest->system_setup->done_fd = 0;
+}
+
+/* d'b: set phase timings of the report from the job marks */
+static void ReportTimes(struct NaClApp *nap, struct NaClPerfCounter *pc)
+{
+  int64_t *times = nap->manifest->report->times;
+
+  times[PhaseQualify] = nap->multi_tenant ? 0 : qualify_time;
+  times[PhaseSnapshot] = PerfSpan(pc, "__start__", "SnapshotNaclFile");
+  times[PhaseLoad] = PerfSpan(pc, "SnapshotNaclFile", "AppLoadEnd") - nap->validation_time;
+  times[PhaseValidate] = nap->validation_time;
+  times[PhaseMount] = PerfSpan(pc, "AppLoadEnd", "ChannelsMounted");
+  times[PhaseRun] = PerfSpan(pc, "CreateMainThread", "WaitForMainThread");
+  times[PhaseTeardown] = PerfSpan(pc, "WaitForMainThread", "ChannelsUnmounted");
+}
+
+/*
+ * d'b: write the job timings to "perf_name" in json. startup is the time
+ * to the first user instruction, run - the user code (with traps),
+ * teardown - channels unmount and the report. all times in microseconds
+ */
+static void PerfReport(struct NaClApp *nap, struct NaClPerfCounter *pc)
+{
+  uint32_t start = PerfMark(pc, "CreateMainThread");
+  uint32_t stop = PerfMark(pc, "WaitForMainThread");
+  uint32_t i;
+  FILE *f;
+
+  if((f = fopen(perf_name, "w")) == NULL)
+  {
+    NaClLog(LOG_ERROR, "cannot open perf report %s\n", perf_name);
+    return;
+  }
+
+  fprintf(f, "{\n  \"nexe\": \"%s\",\n", nap->manifest->system_setup->nexe);
+  fprintf(f, "  \"user_ret_code\": %d,\n", nap->exit_status);
+  fprintf(f, "  \"text_bytes\": %"NACL_PRIuPTR",\n",
+      nap->static_text_end - NACL_TRAMPOLINE_END);
+  fprintf(f, "  \"validation_us\": %"NACL_PRId64",\n", nap->validation_time);
+  fprintf(f, "  \"startup_us\": %"NACL_PRId64",\n",
+      NaClPerfCounterInterval(pc, 0, start));
+  fprintf(f, "  \"run_us\": %"NACL_PRId64",\n",
+      NaClPerfCounterInterval(pc, start, stop));
+  fprintf(f, "  \"teardown_us\": %"NACL_PRId64",\n",
+      NaClPerfCounterInterval(pc, stop, pc->samples - 1));
+  fprintf(f, "  \"report_us\": %"NACL_PRId64",\n",
+      PerfSpan(pc, "WaitForMainThread", "ReportDone"));
+  fprintf(f, "  \"total_us\": %"NACL_PRId64",\n",
+      NaClPerfCounterInterval(pc, 0, pc->samples - 1));
+
+  /* all marks of the job with the time from the previous one */
+  fprintf(f, "  \"marks\": [");
+  for(i = 1; i < pc->samples; ++i)
+    fprintf(f, "%s\n    {\"name\": \"%s\", \"us\": %"NACL_PRId64"}",
+        i > 1 ? "," : "", pc->sample_names[i],
+        NaClPerfCounterInterval(pc, i - 1, i));
+  fprintf(f, "\n  ]\n}\n");
+  fclose(f);
+}
+
+/*
+ * d'b: load the nexe given in the manifest of "nap", mount channels, run
+ * the nexe, unmount channels and make the report. NaClApp object must
+ * be constructed and have the manifest loaded. return zerovm return code
+ * note: the job is run by the calling thread, one job per thread
+ */
+static int RunJob(struct NaClApp *nap, struct Gio *gout)
+{
+  NaClErrorCode                 errcode;
   struct GioMemoryFileSnapshot  blob_file;
   struct GioMemoryFileSnapshot  main_file;
   struct NaClPerfCounter        time_all_main;
   int                           ret_code = 1;
   char                          manifest[MAX_MANIFEST_LEN];
 
-  /* @IGNORE_LINES_FOR_CODE_HYGIENE[1] */
-  /*
-   * Set malloc not to use mmap even for large allocations.  This is currently
-   * necessary when we must use a specific area of RAM for the sandbox.
-   *
-   * During startup, before the sandbox is set up, the sel_ldr allocates a chunk
-   * of memory to store the untrusted code.  Normally such an allocation would
-   * go into the sel_ldr's heap area, but the allocation is typically large --
-   * at least hundreds of KiB.  The default malloc configuration on Linux (at
-   * least) switches to mmap for such allocations, and mmap will select
-   * essentially any unoccupied section of the address space.  The result: the
-   * nexe is allocated in the region we use for the sandbox, we protect the
-   * address space, and then the memcpy into the sandbox (of course) fails.
-   *
-   * This is at best a temporary fix.  The proper fix is to reserve the
-   * sandbox region early enough that this isn't a problem.  Possible methods
-   * are discussed in this bug:
-   *   http://code.google.com/p/nativeclient/issues/detail?id=232
-   */
-
   /* whole chunk" user memory management initialization */
   nap->user_side_flag = 0; /* we are in the trusted code */
 
-  NaClAllModulesInit();
-  NaClPerfCounterCtor(&time_all_main, "SelMain");
-  fflush((FILE *) NULL);
-  COND_ABORT(!GioFileRefCtor(&gout, stdout), "Could not create general standard output channel\n");
-  COND_ABORT(ParseCommandLine(argc, argv, nap), "command line parse error\n");
+  /* the report counts resources of this job only (see SetupReportSettings) */
+  if(nap->multi_tenant)
+    getrusage(RUSAGE_THREAD, &nap->job_usage);
+  else
+    memset(&nap->job_usage, 0, sizeof nap->job_usage);
 
-	/*
-	 * change stdout/stderr to log file now, so that subsequent error
-	 * messages will go there.  unfortunately, error messages that
-	 * result from getopt processing -- usually out-of-memory, which
-	 * shouldn't happen -- won't show up.
-	 */
-	if (NULL != nap->manifest && NULL != nap->manifest->system_setup->log)
-	  NaClLogSetFile(nap->manifest->system_setup->log);
-
-  /*
-   * NB: the following cast is okay since we only ever permit GioFile
-   * objects to be used -- NaClLogModuleInit and NaClLogSetFile both
-   * can only assign the log output to a file.  If neither were
-   * called, logging goes to stderr.
-   */
-  log_gio = (struct GioFile*) NaClLogGetGio();
-
-  COND_ABORT(!NaClAppCtor(nap), "Error while constructing app state\n");
+  NaClPerfCounterCtor(&time_all_main, "SelMain");
 	errcode = LOAD_OK;
 
-	/* We use the signal handler to verify a signal took place. */
-	NaClSignalHandlerInit();
-	if (!nap->skip_qualification)
-	{
-		NaClErrorCode pq_error = NACL_FI_VAL("pq", NaClErrorCode, NaClRunSelQualificationTests());
-		if (LOAD_OK != pq_error)
-		{
-			errcode = pq_error;
-			nap->module_load_status = pq_error;
-			fprintf(stderr, "Error while loading \"%s\": %s\n",
-					NULL != nap->manifest->system_setup->nexe ?
-					nap->manifest->system_setup->nexe : "(no file, to-be-supplied-via-RPC)",
-					NaClErrorString(errcode));
-		}
-	}
-
-  /* Remove the signal handler if we are not using it. */
-	if (!nap->handle_signals)
-	{
-		NaClSignalHandlerFini();
-		NaClSignalAssertNoHandlers(); /* Sanity check. */
-	}
-
   /* Open (not load) both files nexe and blob. only need for "fuzzy load". can be removed */
 #define PERF_CNT(str)\
 	NaClPerfCounterMark(&time_all_main, str);\
@@ -389,7 +535,7 @@ int main(int argc, char **argv)
     {
       perror("sel_main");
       fprintf(stderr, "Cannot open \"%s\".\n", nap->manifest->system_setup->blob);
-      exit(1);
+      return ret_code;
     }
     PERF_CNT("SnapshotBlob");
   }
@@ -398,25 +544,22 @@ int main(int argc, char **argv)
   {
     perror("sel_main");
     fprintf(stderr, "Cannot open \"%s\".\n", nap->manifest->system_setup->nexe);
-    exit(1);
+    return ret_code;
   }
   PERF_CNT("SnapshotNaclFile");
 
-  if (LOAD_OK == errcode)
+  NaClLog(2, "Loading nacl file %s (non-RPC)\n", nap->manifest->system_setup->nexe);
+  errcode = NaClAppLoadFile((struct Gio *) &main_file, nap);
+  if (LOAD_OK != errcode)
   {
-    NaClLog(2, "Loading nacl file %s (non-RPC)\n", nap->manifest->system_setup->nexe);
-    errcode = NaClAppLoadFile((struct Gio *) &main_file, nap);
-    if (LOAD_OK != errcode)
-    {
-      fprintf(stderr, "Error while loading \"%s\": %s\n", nap->manifest->system_setup->nexe,
-              NaClErrorString(errcode));
-      fprintf(stderr, ("Using the wrong type of nexe (nacl-x86-32"
-              " on an x86-64 or vice versa)\nor a corrupt nexe file may be"
-              " responsible for this error.\n"));
-    }
-    PERF_CNT("AppLoadEnd");
-    nap->module_load_status = errcode;
+    fprintf(stderr, "Error while loading \"%s\": %s\n", nap->manifest->system_setup->nexe,
+            NaClErrorString(errcode));
+    fprintf(stderr, ("Using the wrong type of nexe (nacl-x86-32"
+            " on an x86-64 or vice versa)\nor a corrupt nexe file may be"
+            " responsible for this error.\n"));
   }
+  PERF_CNT("AppLoadEnd");
+  nap->module_load_status = errcode;
 
   if(-1 == (*((struct Gio *) &main_file)->vtbl->Close)((struct Gio *) &main_file))
   {
@@ -426,26 +569,12 @@ int main(int argc, char **argv)
   (*((struct Gio *) &main_file)->vtbl->Dtor)((struct Gio *) &main_file);
   if(nap->fuzzing_quit_after_load) exit(0);
 
-   /*YaroslavLitvinov*/
-#ifdef NETWORKING
-  if ( nap->manifest && nap->manifest->system_setup->cmd_line && nap->manifest->system_setup->cmd_line_size >= 3 ){
-	  /*get node generic name*/
-	  char *netw_nodename = nap->manifest->system_setup->cmd_line[2];
-	  /*get node id*/
-	  int nodeid = atoi(nap->manifest->system_setup->cmd_line[1]);
-	  if ( netw_nodename ){
-		  int err = init_zvm_networking(ZVM_DB_NAME, netw_nodename, nodeid);
-		  if ( EZVM_OK != err ){
-			  NaClLog(LOG_INFO, "init_zvm_networking err=%d, nodename=%s\n", err, netw_nodename);
-			  NaClAbort();
-		  }
-	  }
-  }else{
-	  NaClLog(LOG_ERROR, "NETWORKING defined but command line parameters not valid\n");
-	  NaClAbort();
+  /* d'b: open the trap journal. replayed job does not need i/o channels */
+  if(journal_name != NULL && !nap->multi_tenant)
+  {
+    nap->journal = JournalCtor(journal_name, journal_mode);
+    COND_ABORT(nap->journal == NULL, "cannot open trap journal\n");
   }
-#endif
-
 
   /* construct each mentioned in manifest channel and mount it */
   if(nap->manifest)
@@ -453,10 +582,28 @@ int main(int argc, char **argv)
     enum ChannelType ch;
     for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
     {
+      struct PreOpenedFileDesc *channel = &nap->manifest->user_setup->channels[ch];
       if(ConstructChannel(nap, ch)) continue;
+
+      /* the nexe reads mapped memory without traps, the journal cannot keep it */
+      COND_ABORT(nap->journal != NULL
+          && (channel->mounted == MAPPED || channel->mounted == LAZY),
+          "trap journal cannot be used with mapped channels\n");
+      if(journal_mode == JournalReplay && nap->journal != NULL)
+      {
+        channel->handle = -1;
+        continue;
+      }
       MountChannel(nap, ch);
     }
+
+#ifdef NETWORKING
+    /* d'b: integrity mode of the network channels is kept by the sockets */
+    commf_integrity(nap->manifest->user_setup->channels[NetworkInputChannel].integrity,
+        nap->manifest->user_setup->channels[NetworkOutputChannel].integrity);
+#endif
   }
+  PERF_CNT("ChannelsMounted");
 
   /* load blob library */
   if(NULL != nap->manifest->system_setup->blob)
@@ -480,8 +627,8 @@ int main(int argc, char **argv)
     (*((struct Gio *) &blob_file)->vtbl->Dtor)((struct Gio *) &blob_file);
     if(nap->verbosity)
     {
-      gprintf((struct Gio *) &gout, "printing post-IRT NaClApp details\n");
-      NaClAppPrintDetails(nap, (struct Gio *) &gout);
+      gprintf(gout, "printing post-IRT NaClApp details\n");
+      NaClAppPrintDetails(nap, gout);
     }
   }
 
@@ -500,6 +647,16 @@ int main(int argc, char **argv)
   /* Make sure all the file buffers are flushed before entering the nexe */
   fflush((FILE *) NULL);
 
+  /* d'b: main thread, threads limit and the stop signal */
+  UserThreadsInit(nap);
+
+  /* d'b: syscalls profile if requested in manifest */
+  if(nap->manifest->system_setup->syscall_profile != NULL)
+  {
+    nap->syscall_profile = SyscallProfileCtor();
+    COND_ABORT(nap->syscall_profile == NULL, "cannot allocate syscalls profile\n");
+  }
+
   /* set user code trap() exit location */
   if((ret_code = setjmp(user_exit)) == 0)
   {
@@ -511,7 +668,13 @@ int main(int argc, char **argv)
       goto done;
     }
   }
+  /* d'b: other user threads must not touch channels and memory anymore */
+  UserThreadsStop();
   PauseCpuClock(nap);
+  if(JournalDtor(nap->journal) != 0)
+    NaClLog(LOG_ERROR, "cannot write trap journal %s\n", journal_name);
+  nap->journal = NULL;
+  WriteSyscallProfile(nap);
   PERF_CNT("WaitForMainThread");
   PERF_CNT("SelMainEnd");
 
@@ -520,7 +683,13 @@ int main(int argc, char **argv)
   {
     FILE *f = NULL;
     char *name = nap->manifest->system_setup->report;
-    struct PreOpenedFileDesc *log_ch = &nap->manifest->user_setup->channels[LogChannel];
+    enum ChannelType ch;
+
+    /* unmount channels, output channels will be trimmed to written data size */
+    for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+      if(UnmountChannel(nap, ch))
+        NaClLog(LOG_ERROR, "cannot unmount channel %d\n", ch);
+    PERF_CNT("ChannelsUnmounted");
 
     /* make report if specified in manifest */
     if(nap->manifest->system_setup->report != NULL)
@@ -532,28 +701,325 @@ int main(int argc, char **argv)
       }
       /* generate report, "manifest" reused for report, fix it ### */
       SetupReportSettings(nap);
+      ReportTimes(nap, &time_all_main);
       nap->manifest->report->ret_code = 0;
       nap->manifest->report->user_ret_code = nap->exit_status;
       AnswerManifestPut(nap, manifest);
 
-      /* write it and free resources */
+      /* write it and free resources. the orchestrator waiting for the
+       * job end signal (DoneFd) reads the report right away */
       fwrite(manifest, 1, strlen(manifest), f);
+      if(nap->manifest->system_setup->done_fd > 0
+          && (fflush(f) != 0 || fsync(fileno(f)) != 0))
+        NaClLog(LOG_ERROR, "cannot sync report %s\n", name);
       fclose(f);
     }
+  }
+  PERF_CNT("ReportDone");
+#undef PERF_CNT
+
+  /* timings of the batch jobs would overwrite each other */
+  if(perf_name != NULL && !nap->multi_tenant) PerfReport(nap, &time_all_main);
+  return ret_code;
+
+ done:
+  if(nap->verbosity)
+  {
+    gprintf(gout, "exiting -- printing NaClApp details\n");
+    NaClAppPrintDetails(nap, gout);
+    printf("Dumping vmmap.\n");
+    PrintVmmap(nap);
+  }
+  return ret_code;
+}
+
+/* d'b: batch mode state shared by the workers */
+struct Batch
+{
+  FILE *list; /* manifest names, one per line */
+  pthread_mutex_t lock; /* guards "list" and the counters */
+  struct NaClApp *pattern; /* command line settings for all jobs */
+  struct Gio *gout;
+  int jobs;
+  int failed;
+};
+
+/*
+ * run the job "name" with own sandbox. any failure of the job (COND_ABORT,
+ * LOG_FATAL, fault of the user code) ends only the job: it leaves to the
+ * abort point, channels are closed and the sandbox is released as usual.
+ * return 0 if the job succeeded
+ */
+static int RunBatchJob(struct Batch *batch, const char *name)
+{
+  struct NaClApp job;
+  sigjmp_buf abort_point;
+  volatile int constructed = 0;
+  volatile int failed = 1;
+
+  job = *batch->pattern;
+  job.manifest = NULL;
+  job.multi_tenant = 1;
+  job.job_abort = &abort_point;
+  gnap = &job;
 
-    // make it function: UnmountChannel(nap, channel) to avoid truncate()
-    /* trim user_log */
-    if (log_ch->buffer)
+  if(sigsetjmp(abort_point, 1) == 0)
+  {
+    if(LoadManifest(&job, name) == OK_CODE)
     {
-      char *p = (char*) NaClUserToSys(nap, (uint32_t)log_ch->buffer);
-      log_ch->fsize = strlen(p);
-      munmap(p, log_ch->bsize);
-      if(log_ch->fsize) truncate((char*)log_ch->name, log_ch->fsize);
-      else remove((char*)log_ch->name);
+      COND_ABORT(!NaClAppCtor(&job), "Error while constructing app state\n");
+      constructed = 1;
+      RunJob(&job, batch->gout);
+      failed = job.module_load_status != LOAD_OK;
     }
+  }
+  else if(constructed)
+  {
+    enum ChannelType ch;
+
+    /* failure of the cleanup ends the process */
+    job.job_abort = NULL;
+    for(ch = InputChannel; ch < CHANNELS_COUNT; ++ch)
+      UnmountChannel(&job, ch);
+  }
+
+  if(constructed) NaClAppDtor(&job);
+  gnap = NULL;
+  syscallback = 0;
+  free_manifest(&job);
+  return failed;
+}
+
+/* take manifests from the list and run them until the list is over */
+static void *BatchWorker(void *arg)
+{
+  struct Batch *batch = arg;
+  char line[PATH_MAX];
+
+  for(;;)
+  {
+    char *name;
+    int failed;
+
+    pthread_mutex_lock(&batch->lock);
+    name = fgets(line, sizeof line, batch->list);
+    pthread_mutex_unlock(&batch->lock);
+    if(name == NULL) break;
+
+    /* skip empty lines and comments */
+    name = cut_spaces(line);
+    if(name == NULL || *name == '#') continue;
+
+    /* each job has own sandbox. the address space is released after the job */
+    failed = RunBatchJob(batch, name);
+    if(failed) NaClLog(LOG_ERROR, "job %s failed\n", name);
+
+    pthread_mutex_lock(&batch->lock);
+    ++batch->jobs;
+    batch->failed += failed;
+    pthread_mutex_unlock(&batch->lock);
+  }
+  return NULL;
+}
+
+/*
+ * the user code of the batch job faulted. the thread continues here on
+ * the trusted stack (see JobFault())
+ */
+static NORETURN void JobFaulted(void)
+{
+  NaClLog(LOG_ERROR, "the job user code faulted\n");
+  NaClJobAbort(ERR_CODE);
+}
+
+/* fault of the batch job user code ends only the job */
+static enum NaClSignalResult JobFault(int signal, void *ctx)
+{
+  struct NaClSignalContext context;
+  struct NaClApp *nap = gnap;
+  uintptr_t limit;
+
+  UNREFERENCED_PARAMETER(signal);
+  if(nap == NULL || nap->job_abort == NULL || nacl_sys == NULL)
+    return NACL_SIGNAL_SEARCH;
+
+  /* faults of the trusted code are not the job ones */
+  NaClSignalContextFromHandler(&context, ctx);
+  limit = nap->mem_start + ((uintptr_t)1 << nap->addr_bits);
+  if(context.prog_ctr < nap->mem_start || context.prog_ctr >= limit)
+    return NACL_SIGNAL_SEARCH;
+
+  NaClSignalContextRedirect(ctx, nacl_sys->rsp, JobFaulted);
+  return NACL_SIGNAL_RETURN;
+}
+
+/* LOG_FATAL of the batch job ends only the job */
+static void JobFatal(void)
+{
+  if(gnap != NULL && gnap->job_abort != NULL) NaClJobAbort(ERR_CODE);
+}
+
+/*
+ * d'b: run all jobs from the batch list using "batch_workers" threads.
+ * show jobs rate and memory usage. return 0 if all jobs succeeded
+ */
+static int RunBatch(struct NaClApp *pattern, struct Gio *gout)
+{
+  struct Batch batch;
+  pthread_t workers[BATCH_WORKERS_MAX];
+  struct timeval start, end;
+  struct rusage usage;
+  double elapsed;
+  int i;
+
+  batch.list = strcmp(batch_name, "-") ? fopen(batch_name, "r") : stdin;
+  if(batch.list == NULL)
+  {
+    fprintf(stderr, "cannot open batch list %s\n", batch_name);
+    return ERR_CODE;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+  batch.pattern = pattern;
+  batch.gout = gout;
+  batch.jobs = 0;
+  batch.failed = 0;
+
+  /*
+   * dynamic text objects of the finished jobs are reused by the next ones.
+   * the pool is pre-sized for all workers by the first job dynamic text
+   */
+  COND_ABORT(!NaClInitMemoryObjectPool(batch_workers < MEMORY_POOL_MAX
+      ? batch_workers : MEMORY_POOL_MAX, 0, 1), "cannot enable memory objects pool\n");
+
+  /* failed jobs must not end the process */
+  COND_ABORT(NaClSignalHandlerAdd(JobFault) == 0, "cannot set jobs fault handler\n");
+  gNaClLogAbortBehavior = JobFatal;
+
+  gettimeofday(&start, NULL);
+  for(i = 0; i < batch_workers; ++i)
+    COND_ABORT(pthread_create(&workers[i], NULL, BatchWorker, &batch) != 0,
+        "cannot create batch worker\n");
+  for(i = 0; i < batch_workers; ++i)
+    pthread_join(workers[i], NULL);
+  gettimeofday(&end, NULL);
+
+  /* statistics */
+  elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(stderr, "batch: %d jobs, %d failed, %.3f sec, %.1f jobs/sec, "
+      "max rss %ld kb, %ld kb per running job\n", batch.jobs, batch.failed,
+      elapsed, elapsed > 0 ? batch.jobs / elapsed : 0.0,
+      usage.ru_maxrss, usage.ru_maxrss / batch_workers);
+
+  if(batch.list != stdin) fclose(batch.list);
+  pthread_mutex_destroy(&batch.lock);
+  gNaClLogAbortBehavior = NaClAbort;
+  NaClFiniMemoryObjectPool();
+  return batch.failed ? ERR_CODE : OK_CODE;
+}
+
+int main(int argc, char **argv)
+{
+  struct NaClApp                state, *nap = &state;
+  struct GioFile                gout;
+  int                           ret_code = 1;
+
+  /* @IGNORE_LINES_FOR_CODE_HYGIENE[1] */
+  /*
+   * Set malloc not to use mmap even for large allocations.  This is currently
+   * necessary when we must use a specific area of RAM for the sandbox.
+   *
+   * During startup, before the sandbox is set up, the sel_ldr allocates a chunk
+   * of memory to store the untrusted code.  Normally such an allocation would
+   * go into the sel_ldr's heap area, but the allocation is typically large --
+   * at least hundreds of KiB.  The default malloc configuration on Linux (at
+   * least) switches to mmap for such allocations, and mmap will select
+   * essentially any unoccupied section of the address space.  The result: the
+   * nexe is allocated in the region we use for the sandbox, we protect the
+   * address space, and then the memcpy into the sandbox (of course) fails.
+   *
+   * This is at best a temporary fix.  The proper fix is to reserve the
+   * sandbox region early enough that this isn't a problem.  Possible methods
+   * are discussed in this bug:
+   *   http://code.google.com/p/nativeclient/issues/detail?id=232
+   */
+
+  NaClAllModulesInit();
+  fflush((FILE *) NULL);
+  COND_ABORT(!GioFileRefCtor(&gout, stdout), "Could not create general standard output channel\n");
+  COND_ABORT(ParseCommandLine(argc, argv, nap), "command line parse error\n");
+
+	/*
+	 * change stdout/stderr to log file now, so that subsequent error
+	 * messages will go there.  unfortunately, error messages that
+	 * result from getopt processing -- usually out-of-memory, which
+	 * shouldn't happen -- won't show up.
+	 * note: in batch mode jobs use the process log
+	 */
+	if (NULL != nap->manifest && NULL != nap->manifest->system_setup->log)
+	  NaClLogSetFile(nap->manifest->system_setup->log);
+
+	/* We use the signal handler to verify a signal took place. */
+	NaClSignalHandlerInit();
+	if (!nap->skip_qualification)
+	{
+		struct NaClPerfCounter time_qualify;
+		NaClErrorCode pq_error;
 
+		NaClPerfCounterCtor(&time_qualify, "Qualify");
+		pq_error = NACL_FI_VAL("pq", NaClErrorCode, NaClRunSelQualificationTests());
+		NaClPerfCounterMark(&time_qualify, "QualifyEnd");
+		qualify_time = NaClPerfCounterIntervalLast(&time_qualify);
+		if (LOAD_OK != pq_error)
+		{
+			fprintf(stderr, "Error while loading \"%s\": %s\n",
+					NULL != nap->manifest ? nap->manifest->system_setup->nexe : batch_name,
+					NaClErrorString(pq_error));
+			goto done;
+		}
+	}
+
+  /*
+   * Remove the signal handler if we are not using it.
+   * d'b: batch mode needs it to end the faulted jobs
+   */
+	if (!nap->handle_signals && batch_name == NULL)
+	{
+		NaClSignalHandlerFini();
+		NaClSignalAssertNoHandlers(); /* Sanity check. */
+	}
+
+  /* d'b: many jobs in one process */
+  if(batch_name != NULL)
+  {
+    ret_code = RunBatch(nap, (struct Gio *) &gout);
+    goto done;
   }
 
+   /*YaroslavLitvinov*/
+#ifdef NETWORKING
+  if ( nap->manifest && nap->manifest->system_setup->cmd_line && nap->manifest->system_setup->cmd_line_size >= 3 ){
+	  /*get node generic name*/
+	  char *netw_nodename = nap->manifest->system_setup->cmd_line[2];
+	  /*get node id*/
+	  int nodeid = atoi(nap->manifest->system_setup->cmd_line[1]);
+	  if ( netw_nodename ){
+		  int err = init_zvm_networking(ZVM_DB_NAME, netw_nodename, nodeid);
+		  if ( EZVM_OK != err ){
+			  NaClLog(LOG_INFO, "init_zvm_networking err=%d, nodename=%s\n", err, netw_nodename);
+			  NaClAbort();
+		  }
+	  }
+  }else{
+	  NaClLog(LOG_ERROR, "NETWORKING defined but command line parameters not valid\n");
+	  NaClAbort();
+  }
+#endif
+
+  COND_ABORT(!NaClAppCtor(nap), "Error while constructing app state\n");
+  ret_code = RunJob(nap, (struct Gio *) &gout);
+  if(LOAD_OK != nap->module_load_status) goto done;
+
   /*YaroslavLitvinov*/
 #ifdef NETWORKING
   {
@@ -565,17 +1031,11 @@ int main(int argc, char **argv)
   }
 #endif
 
+  SignalDone(nap, ret_code);
   NaClExit(ret_code);
 
  done:
-  if(nap->verbosity)
-  {
-    gprintf((struct Gio *) &gout, "exiting -- printing NaClApp details\n");
-    NaClAppPrintDetails(nap, (struct Gio *) &gout);
-    printf("Dumping vmmap.\n");
-    PrintVmmap(nap);
-  }
-
+  SignalDone(nap, ret_code);
   if(nap->verbosity) printf("Done.\n");
   if (nap->handle_signals) NaClSignalHandlerFini();
   NaClAllModulesFini();
@@ -18,6 +18,11 @@
 #include <sys/mman.h>
 #endif
 
+#if NACL_LINUX
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -114,7 +119,7 @@ static int IsTrustedWrite(uint8_t *dst,
 void* g_squashybuffer = NULL;
 char g_firstbyte = 0;
 
-static Bool SerializeAllProcessors() {
+static Bool SerializeWithMprotect() {
   /*
    * We rely on the OS mprotect() call to issue interprocessor interrupts,
    * which will cause other processors to execute an IRET, which is
@@ -175,13 +180,145 @@ static Bool SerializeAllProcessors() {
   return TRUE;
 }
 
+#if NACL_LINUX
+/* membarrier(2) is newer than the system headers we build with */
+# ifndef __NR_membarrier
+#  define __NR_membarrier 324
+# endif
+# define MEMBARRIER_QUERY 0
+# define MEMBARRIER_PRIVATE_EXPEDITED_SYNC_CORE (1 << 5)
+# define MEMBARRIER_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE (1 << 6)
+#endif
+
+/*
+ * serialization method: -1 - not detected yet, 0 - mprotect() hack,
+ * 1 - membarrier(). global so it can be forced by tests and benchmarks
+ */
+int g_membarrier = -1;
+
+/*
+ * membarrier(PRIVATE_EXPEDITED_SYNC_CORE) makes every running thread of
+ * the process execute a core serializing instruction before it returns.
+ * unlike the mprotect() hack it does not flush tlbs and only interrupts
+ * cpus which run our threads. the process must be registered once
+ */
+static int DetectMembarrier() {
+#if NACL_LINUX
+  long cmds = syscall(__NR_membarrier, MEMBARRIER_QUERY, 0);
+  if (cmds < 0 || !(cmds & MEMBARRIER_PRIVATE_EXPEDITED_SYNC_CORE)) return 0;
+  if (syscall(__NR_membarrier,
+              MEMBARRIER_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0) != 0) {
+    return 0;
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+static Bool SerializeAllProcessors() {
+  if (g_membarrier < 0) {
+    g_membarrier = DetectMembarrier();
+    NaClLog(1, "SerializeAllProcessors: using %s\n",
+            g_membarrier ? "membarrier" : "mprotect");
+  }
+
+#if NACL_LINUX
+  if (g_membarrier) {
+    if (0 == syscall(__NR_membarrier,
+                     MEMBARRIER_PRIVATE_EXPEDITED_SYNC_CORE, 0)) {
+      return TRUE;
+    }
+    NaClLog(LOG_WARNING,
+            "SerializeAllProcessors: membarrier failed, using mprotect\n");
+    g_membarrier = 0;
+  }
+#endif
+  return SerializeWithMprotect();
+}
+
+/*
+ * instructions which cannot be replaced by one atomic store. the first
+ * byte of each is set to HLT, then all of them are copied between two
+ * serializations, then the first bytes are restored. so the whole
+ * replacement costs two serializations instead of two per instruction
+ */
+struct PendingCopy {
+  uint8_t *firstbyte_p;
+  uint8_t *dst;
+  uint8_t *src;
+  uint8_t sz;
+  uint8_t firstbyte;
+};
+
+struct CopyBatch {
+  struct PendingCopy *items;
+  size_t cnt;
+  size_t max;
+};
+
+static Bool CopyBatchAdd(struct CopyBatch *batch, uint8_t *firstbyte_p,
+                         uint8_t *dst, uint8_t *src, uint8_t sz) {
+  struct PendingCopy *item;
+
+  if (batch->cnt == batch->max) {
+    size_t max = batch->max ? 2 * batch->max : 64;
+    struct PendingCopy *items = realloc(batch->items, max * sizeof *items);
+    if (NULL == items) return FALSE;
+    batch->items = items;
+    batch->max = max;
+  }
+  item = &batch->items[batch->cnt++];
+  item->firstbyte_p = firstbyte_p;
+  item->dst = dst;
+  item->src = src;
+  item->sz = sz;
+  item->firstbyte = firstbyte_p[0];
+  return TRUE;
+}
+
+/* finish the pending instructions. return FALSE if serialization failed */
+static Bool CopyBatchFlush(struct CopyBatch *batch) {
+  size_t i;
+
+  if (batch->cnt == 0) return TRUE;
+
+  /* the first bytes are HLT already */
+  if (!SerializeAllProcessors()) return FALSE;
+
+  /* copy the rest of instructions */
+  for (i = 0; i < batch->cnt; ++i) {
+    struct PendingCopy *item = &batch->items[i];
+    uint8_t *dst = item->dst;
+    uint8_t *src = item->src;
+    uint8_t sz = item->sz;
+
+    if (dst == item->firstbyte_p) {
+      /* but not the first byte! */
+      item->firstbyte = *src;
+      dst++, src++, sz--;
+    }
+    memcpy(dst, src, sz);
+  }
+
+  if (!SerializeAllProcessors()) return FALSE;
+
+  /* flip first bytes back */
+  for (i = 0; i < batch->cnt; ++i)
+    batch->items[i].firstbyte_p[0] = batch->items[i].firstbyte;
+  batch->cnt = 0;
+  return TRUE;
+}
+
 /*
  * Copy a single instruction, avoiding the possibility of other threads
- * executing a partially changed instruction.
+ * executing a partially changed instruction. if "batch" is given the
+ * slow path is deferred to CopyBatchFlush()
  */
 static Bool CopyInstructionInternal(uint8_t *dst,
                                     uint8_t *src,
-                                    uint8_t sz) {
+                                    uint8_t sz,
+                                    struct CopyBatch *batch) {
   intptr_t offset = 0;
   uint8_t *firstbyte_p = dst;
 
@@ -213,6 +350,10 @@ static Bool CopyInstructionInternal(uint8_t *dst,
     memcpy(tmp, dst-offset, sizeof tmp);
     memcpy(tmp+offset, src, sz);
     onestore_memmove8(dst-offset, tmp);
+  } else if (NULL != batch) {
+    /* the slow path, the rest of instruction is copied later */
+    if (!CopyBatchAdd(batch, firstbyte_p, dst, src, sz)) return FALSE;
+    firstbyte_p[0] = kNaClFullStop;
   } else {
     /* the slow path, first flip first byte to halt*/
     uint8_t firstbyte = firstbyte_p[0];
@@ -250,7 +391,8 @@ static Bool CopyInstruction(NCDecoderStatePair* tthis,
 
   return CopyInstructionInternal(mem_old->mpc,
                                  mem_new->mpc,
-                                 mem_old->read_length);
+                                 mem_old->read_length,
+                                 NULL);
 }
 
 int NCCopyCode(uint8_t *dst, uint8_t *src, NaClPcAddress vbase,
@@ -297,6 +439,7 @@ int NaClCopyCodeIter(uint8_t *dst, uint8_t *src,
   NaClSegment segment_old, segment_new;
   NaClInstIter *iter_old, *iter_new;
   NaClInstState *istate_old, *istate_new;
+  struct CopyBatch batch = {NULL, 0, 0};
   int still_good = 1;
 
   NaClSegmentInitialize(dst, vbase, size, &segment_old);
@@ -337,13 +480,14 @@ int NaClCopyCodeIter(uint8_t *dst, uint8_t *src,
       still_good = 0;
       break;
     }
-    /* Replacing all modified instructions at once could yield a speedup here
-     * as every time we modify instructions we must serialize all processors
-     * twice.  Re-evaluate if code modification performance is an issue.
+    /* Instructions which need serialization are collected in the batch and
+     * replaced all at once, so all processors are serialized twice per
+     * replacement rather than twice per modified instruction.
      */
     if (!CopyInstructionInternal(iter_old->memory.mpc,
                                  iter_new->memory.mpc,
-                                 iter_old->memory.read_length)) {
+                                 iter_old->memory.read_length,
+                                 &batch)) {
       NaClLog(LOG_ERROR,
               "Segment replacement: copy failed: unable to copy instruction\n");
       still_good = 0;
@@ -353,6 +497,14 @@ int NaClCopyCodeIter(uint8_t *dst, uint8_t *src,
     NaClInstIterAdvance(iter_new);
   }
 
+  /* the pending instructions must be finished even if the copy failed */
+  if (!CopyBatchFlush(&batch)) {
+    NaClLog(LOG_ERROR,
+            "Segment replacement: copy failed: unable to serialize\n");
+    still_good = 0;
+  }
+  free(batch.items);
+
   NaClInstIterDestroy(iter_old);
   NaClInstIterDestroy(iter_new);
   return still_good;
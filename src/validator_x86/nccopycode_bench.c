@@ -0,0 +1,145 @@
+/*
+ * code replacement latency (dyncode modify). the code is a set of bundles
+ * of "mov $imm32, %eax" with changing immediates, some of them cross the
+ * instruction fetch boundary and need serialization of all processors.
+ * compares per instruction replacement (as it was) with the batched one,
+ * for both serialization methods (mprotect hack and membarrier)
+ *
+ * usage: nccopycode_bench [bundles] [rounds]
+ *
+ *  Created on: May 9, 2012
+ *      Author: d'b
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "src/service_runtime/nacl_config.h"
+
+#define DEFAULT_BUNDLES 256
+#define DEFAULT_ROUNDS 100
+#define MOV_SIZE 5 /* b8 imm32 */
+#define MOVS_PER_BUNDLE (NACL_INSTR_BLOCK_SIZE / MOV_SIZE)
+#define VBASE 0x20000
+
+/* from nccopycode.c */
+extern int g_membarrier;
+int NaClCopyCodeIter(uint8_t *dst, uint8_t *src, uintptr_t vbase, size_t size);
+
+static double Now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* fill the code with movs using "seed" for immediates, nops to bundle end */
+static void MakeCode(uint8_t *code, int bundles, uint32_t seed)
+{
+  int i, j;
+
+  memset(code, 0x90, bundles * NACL_INSTR_BLOCK_SIZE);
+  for(i = 0; i < bundles; ++i)
+    for(j = 0; j < MOVS_PER_BUNDLE; ++j)
+    {
+      uint8_t *mov = code + i * NACL_INSTR_BLOCK_SIZE + j * MOV_SIZE;
+      uint32_t imm = seed * 2654435761U + i * MOVS_PER_BUNDLE + j;
+      mov[0] = 0xb8;
+      memcpy(mov + 1, &imm, sizeof imm);
+    }
+}
+
+/* replace code with the new one "rounds" times. return usec per replacement */
+static double Replace(uint8_t *code, uint8_t *news[2], int bundles,
+    int rounds, int batched)
+{
+  size_t size = bundles * NACL_INSTR_BLOCK_SIZE;
+  double start = Now();
+  int i;
+
+  for(i = 0; i < rounds; ++i)
+  {
+    uint8_t *src = news[i & 1];
+    size_t offset;
+
+    if(batched)
+    {
+      if(!NaClCopyCodeIter(code, src, VBASE, size)) return -1;
+      continue;
+    }
+
+    /* one instruction at a time */
+    for(offset = 0; offset < size; offset += NACL_INSTR_BLOCK_SIZE)
+    {
+      int j;
+      for(j = 0; j < MOVS_PER_BUNDLE; ++j)
+        if(!NaClCopyCodeIter(code + offset + j * MOV_SIZE,
+            src + offset + j * MOV_SIZE, VBASE + offset + j * MOV_SIZE, MOV_SIZE))
+          return -1;
+    }
+  }
+
+  /* the code must be the last replacement */
+  if(memcmp(code, news[(rounds - 1) & 1], size) != 0) return -1;
+  return (Now() - start) * 1e6 / rounds;
+}
+
+int main(int argc, char **argv)
+{
+  int bundles = argc > 1 ? atoi(argv[1]) : DEFAULT_BUNDLES;
+  int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+  size_t size = bundles * NACL_INSTR_BLOCK_SIZE;
+  uint8_t *code = malloc(size);
+  uint8_t *news[2] = {malloc(size), malloc(size)};
+  int mode;
+
+  if(bundles < 1 || rounds < 1 || code == NULL || news[0] == NULL || news[1] == NULL)
+  {
+    fprintf(stderr, "usage: nccopycode_bench [bundles] [rounds]\n");
+    return 1;
+  }
+  MakeCode(code, bundles, 0);
+  MakeCode(news[0], bundles, 1);
+  MakeCode(news[1], bundles, 2);
+
+  printf("%d bundles, %d instructions, %d rounds\n",
+      bundles, bundles * MOVS_PER_BUNDLE, rounds);
+  for(mode = 0; mode < 2; ++mode)
+  {
+    int batched;
+
+    g_membarrier = -1;
+    if(mode == 0) g_membarrier = 0;
+    else
+    {
+      /* detect it. the bundle must change to be serialized */
+      uint8_t *src = memcmp(code, news[0], NACL_INSTR_BLOCK_SIZE) ? news[0] : news[1];
+      NaClCopyCodeIter(code, src, VBASE, NACL_INSTR_BLOCK_SIZE);
+      if(g_membarrier != 1)
+      {
+        printf("%-12s not supported\n", "membarrier");
+        continue;
+      }
+    }
+
+    for(batched = 0; batched < 2; ++batched)
+    {
+      double usec = Replace(code, news, bundles, rounds, batched);
+      if(usec < 0)
+      {
+        fprintf(stderr, "replacement failed\n");
+        return 1;
+      }
+      printf("%-12s %-16s %12.1f usec per replacement\n",
+          mode ? "membarrier" : "mprotect",
+          batched ? "batched" : "per instruction", usec);
+    }
+  }
+
+  free(code);
+  free(news[0]);
+  free(news[1]);
+  return 0;
+}
@@ -102,4 +102,5 @@ INSERT INTO channels VALUES('test1', 'ipc:///tmp/testa', 'r',  3);
 INSERT INTO channels VALUES('test1', 'ipc:///tmp/testb', 'w',  4);
 INSERT INTO channels VALUES('test2', 'ipc:///tmp/testb', 'r',  3);
 INSERT INTO channels VALUES('test2', 'ipc:///tmp/testa', 'w',  4);
+ALTER TABLE channels ADD COLUMN sock text DEFAULT 'REQREP';
 COMMIT;